@@ -0,0 +1,136 @@
+#include "histogram_tile_generated.h"
+#include "histogram_tile.pb.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <chrono>
+
+#include <arrow/io/file.h>
+#include <parquet/api/reader.h>
+
+#include "mmapped_file.hpp"
+#include "checked_histogram.hpp"
+#include "histogram_reader.hpp"
+#include "fb_histogram_reader.hpp"
+#include "pbf_histogram_reader.hpp"
+#include "parquet_histogram_reader.hpp"
+#include "packed_histogram_reader.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+namespace otpbf = OpenTraffic::pbf;
+
+struct query {
+  std::set<uint32_t> segment_ids;
+  uint32_t day_hour;
+};
+
+// runs passes over the queries until at least min_seconds have gone by, and
+// returns the time per query. checksum is the sum of the answers of one pass,
+// which should be the same for every format.
+template <typename Reader>
+double time_queries(const Reader &reader, const std::vector<query> &queries, double min_seconds, double &checksum) {
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+
+  size_t num_queries = 0;
+  steady_clock::time_point t0 = steady_clock::now();
+  duration<double> elapsed(0);
+  while (elapsed.count() < min_seconds) {
+    checksum = 0;
+    for (const auto &q : queries) {
+      checksum += query_mean_speed(reader, q.segment_ids, q.day_hour);
+    }
+    num_queries += queries.size();
+    elapsed = duration_cast<duration<double>>(steady_clock::now() - t0);
+  }
+  return elapsed.count() / double(num_queries);
+}
+
+void print_result(const std::string &name, double setup_s, double per_query_s, double checksum) {
+  std::cout << name << ": " << per_query_s << "s per query, plus " << setup_s
+            << "s to setup (checksum " << checksum << ")\n";
+}
+
+int main() {
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+
+  // the same queries for every format, each of 50 segments at a weekday
+  // daytime hour.
+  std::mt19937_64 eng(12345);
+  std::uniform_int_distribution<uint32_t> dist_segment_id(0, 9999);
+  std::uniform_int_distribution<uint32_t> dist_day(1, 5);
+  std::uniform_int_distribution<uint32_t> dist_hour(7, 19);
+  std::vector<query> queries(20);
+  for (auto &q : queries) {
+    while (q.segment_ids.size() < 50) {
+      q.segment_ids.insert(dist_segment_id(eng));
+    }
+    q.day_hour = dist_day(eng) * 24 + dist_hour(eng);
+  }
+  const double min_seconds = 1.0;
+  double checksum = 0;
+
+  try {
+    steady_clock::time_point t0 = steady_clock::now();
+    mmapped_file f("sample.tile");
+    checked_histogram tile(f.buffer, f.size, tile_open_mode::verify_full);
+    require_default_speed_buckets(tile_speed_buckets(tile.histogram()));
+    steady_clock::time_point t1 = steady_clock::now();
+    const double per_query = time_queries(fb_histogram_reader(tile), queries, min_seconds, checksum);
+    print_result("FlatBuffers", duration_cast<duration<double>>(t1 - t0).count(), per_query, checksum);
+  } catch (const std::exception &e) {
+    std::cout << "FlatBuffers: skipped, " << e.what() << "\n";
+  }
+
+  try {
+    steady_clock::time_point t0 = steady_clock::now();
+    mmapped_file f("sample.tile.packed");
+    checked_histogram tile(f.buffer, f.size, tile_open_mode::verify_full);
+    require_default_speed_buckets(tile_speed_buckets(tile.histogram()));
+    if (tile.histogram()->log_count_bits() != 0) {
+      throw std::runtime_error("Tile has log coded counts");
+    }
+    steady_clock::time_point t1 = steady_clock::now();
+    const double per_query = time_queries(packed_histogram_reader(tile), queries, min_seconds, checksum);
+    print_result("FlatBuffers, packed entries", duration_cast<duration<double>>(t1 - t0).count(), per_query, checksum);
+  } catch (const std::exception &e) {
+    std::cout << "FlatBuffers, packed entries: skipped, " << e.what() << "\n";
+  }
+
+  try {
+    steady_clock::time_point t0 = steady_clock::now();
+    otpbf::Histogram histogram;
+    std::fstream in("sample.tile.pbf");
+    if (!histogram.ParseFromIstream(&in)) {
+      throw std::runtime_error("Unable to open input");
+    }
+    require_default_speed_buckets(tile_speed_buckets(histogram));
+    steady_clock::time_point t1 = steady_clock::now();
+    const double per_query = time_queries(pbf_histogram_reader(histogram), queries, min_seconds, checksum);
+    print_result("Protocol Buffers", duration_cast<duration<double>>(t1 - t0).count(), per_query, checksum);
+  } catch (const std::exception &e) {
+    std::cout << "Protocol Buffers: skipped, " << e.what() << "\n";
+  }
+
+  try {
+    steady_clock::time_point t0 = steady_clock::now();
+    using FileClass = ::arrow::io::ReadableFile;
+    std::shared_ptr<FileClass> input;
+    PARQUET_THROW_NOT_OK(FileClass::Open("sample.tile.parquet", &input));
+    parquet::ReaderProperties props;
+    std::shared_ptr<parquet::ParquetFileReader> file_reader =
+      parquet::ParquetFileReader::Open(input, props);
+    require_default_speed_buckets(parquet_speed_buckets(file_reader));
+    steady_clock::time_point t1 = steady_clock::now();
+    const double per_query = time_queries(parquet_histogram_reader(file_reader), queries, min_seconds, checksum);
+    print_result("Parquet", duration_cast<duration<double>>(t1 - t0).count(), per_query, checksum);
+  } catch (const std::exception &e) {
+    std::cout << "Parquet: skipped, " << e.what() << "\n";
+  }
+
+  return 0;
+}
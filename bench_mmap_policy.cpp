@@ -0,0 +1,224 @@
+#include "histogram_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cstring>
+
+#include "mmapped_file.hpp"
+#include "plain_entries.hpp"
+#include "speed_buckets.hpp"
+#include "numa_replicas.hpp"
+#include "perf_counters.hpp"
+#include "page_cache.hpp"
+#include "segment_prefetch.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+double query_file(
+  const ot::Histogram *histogram,
+  const std::set<uint32_t> &query_ids,
+  uint32_t day_hour) {
+
+  uint32_t hist[MAX_N_SPEEDS];
+  memset(hist, 0, sizeof hist);
+
+  auto segs = histogram->segments();
+  assert(segs != nullptr);
+  for (auto segment_id : query_ids) {
+    auto entries = (*segs)[segment_id]->entries();
+    if (entries == nullptr) {
+      require_plain_entries((*segs)[segment_id]);
+      continue;
+    }
+    auto itr = std::lower_bound(
+      entries->begin(), entries->end(),
+      day_hour,
+      [](const ot::Entry *lhs, uint32_t rhs) {
+        return uint32_t(lhs->day_hour()) < rhs;
+      });
+    while ((itr != entries->end()) && ((*itr)->day_hour() == day_hour)) {
+      int bucket = (*itr)->speed_bucket();
+      if (bucket < MAX_N_SPEEDS) {
+        hist[bucket] += (*itr)->count();
+      }
+      ++itr;
+    }
+  }
+
+  uint64_t sum = 0, num = 0;
+  for (int i = 0; i < MAX_N_SPEEDS; ++i) {
+    sum += (i * 5) * hist[i];
+    num += hist[i];
+  }
+  return (num > 0) ? double(sum) / double(num) : 0.0;
+}
+
+struct query_stats {
+  double first_query_s;
+  double per_query_s;
+  double dtlb_misses_per_query;
+};
+
+// runs the queries against the tile, each at a random day_hour, so that the
+// working set is spread over the whole tile rather than sitting in the TLB.
+// with prefetch, the first query starts by prefetching its segments' pages,
+// which is counted in its time.
+query_stats run_queries(
+  const void *buffer,
+  size_t size,
+  const std::vector<std::set<uint32_t> > &queries,
+  int num_iterations,
+  bool prefetch) {
+
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+
+  auto histogram = ot::GetHistogram(buffer);
+  query_stats stats;
+
+  steady_clock::time_point t0 = steady_clock::now();
+  if (prefetch) {
+    prefetch_segments(buffer, size, histogram, queries[0]);
+  }
+  double val = query_file(histogram, queries[0], 0);
+  steady_clock::time_point t1 = steady_clock::now();
+  stats.first_query_s = duration_cast<duration<double>>(t1 - t0).count();
+
+  perf_counter dtlb(PERF_TYPE_HW_CACHE, dtlb_load_miss_config());
+  dtlb.start();
+  t0 = steady_clock::now();
+  for (int n = 0; n < num_iterations; ++n) {
+    for (size_t q = 0; q < queries.size(); ++q) {
+      val += query_file(histogram, queries[q], (n * 31 + q) % (7 * 24));
+    }
+  }
+  t1 = steady_clock::now();
+  const uint64_t misses = dtlb.stop();
+
+  const double num_queries = double(num_iterations) * double(queries.size());
+  stats.per_query_s = duration_cast<duration<double>>(t1 - t0).count() / num_queries;
+  stats.dtlb_misses_per_query = dtlb.ok() ? double(misses) / num_queries : -1.0;
+  if (val < 0) {
+    std::cout << "impossible\n";
+  }
+  return stats;
+}
+
+void print_stats(const std::string &name, double setup_s, const query_stats &stats) {
+  std::cout << name << ": setup " << setup_s << "s, first query " << stats.first_query_s
+            << "s, " << stats.per_query_s << "s per query, ";
+  if (stats.dtlb_misses_per_query >= 0) {
+    std::cout << stats.dtlb_misses_per_query << " dTLB load misses per query\n";
+  } else {
+    std::cout << "dTLB load misses not available\n";
+  }
+}
+
+int main(int argc, char *argv[]) {
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+
+  const std::string path = "sample.tile";
+  bool cold = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--cold") == 0) {
+      cold = true;
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--cold]\n"
+                << "  --cold  drop the tile from the page cache before each mapping.\n";
+      return 1;
+    }
+  }
+
+  uint32_t num_segments = 0;
+  {
+    mmapped_file f(path);
+    auto verifier = fb::Verifier((const uint8_t *)f.buffer, f.size);
+    if (!ot::VerifyHistogramBuffer(verifier)) {
+      throw std::runtime_error("Buffer verification failed.");
+    }
+    num_segments = ot::GetHistogram(f.buffer)->segments()->size();
+  }
+
+  std::mt19937_64 eng(12345);
+  std::uniform_int_distribution<uint32_t> dist_segment_id(0, num_segments - 1);
+  std::vector<std::set<uint32_t> > queries(1000);
+  for (auto &query : queries) {
+    for (int i = 0; i < 50; ++i) {
+      query.insert(dist_segment_id(eng));
+    }
+  }
+  const int num_iterations = 20;
+
+  struct named_policy {
+    std::string name;
+    mmap_policy policy;
+    bool prefetch;
+  };
+  std::vector<named_policy> policies;
+  mmap_policy p;
+  policies.push_back({"file", p, false});
+  policies.push_back({"file, segment prefetch", p, true});
+  p.populate = true;
+  policies.push_back({"file, MAP_POPULATE", p, false});
+  p = mmap_policy();
+  p.advice = mmap_advice::random;
+  policies.push_back({"file, MADV_RANDOM", p, false});
+  p.advice = mmap_advice::willneed;
+  policies.push_back({"file, MADV_WILLNEED", p, false});
+  p = mmap_policy();
+  p.huge_pages = true;
+  policies.push_back({"file, MADV_HUGEPAGE", p, false});
+  p = mmap_policy();
+  p.backing = mmap_backing::anonymous;
+  policies.push_back({"anonymous copy", p, false});
+  p.backing = mmap_backing::transparent_huge_pages;
+  policies.push_back({"transparent huge page copy", p, false});
+  p.backing = mmap_backing::hugetlb;
+  policies.push_back({"hugetlbfs copy", p, false});
+
+  for (const auto &np : policies) {
+    if (cold) {
+      drop_page_cache(path);
+    }
+    try {
+      steady_clock::time_point t0 = steady_clock::now();
+      mmapped_file f(path, np.policy);
+      steady_clock::time_point t1 = steady_clock::now();
+      print_stats(np.name, duration_cast<duration<double>>(t1 - t0).count(),
+                  run_queries(f.buffer, f.size, queries, num_iterations, np.prefetch));
+    } catch (const std::exception &e) {
+      std::cout << np.name << ": skipped, " << e.what() << "\n";
+    }
+  }
+
+  // per-node replicas: compare each node reading its local copy with reading
+  // the copy on the next node along.
+  p = mmap_policy();
+  p.backing = mmap_backing::transparent_huge_pages;
+  numa_replicas replicas(path, p);
+  if (replicas.num_nodes() < 2) {
+    std::cout << "Only one NUMA node, skipping replica comparison.\n";
+    return 0;
+  }
+  for (int node = 0; node < replicas.num_nodes(); ++node) {
+    const int remote = (node + 1) % replicas.num_nodes();
+    if (replicas.replica(node) == nullptr || replicas.replica(remote) == nullptr) {
+      continue;
+    }
+    std::thread worker([&]() {
+        numa_replicas::pin_to_node(node);
+        print_stats("node " + std::to_string(node) + ", local replica", 0.0,
+                    run_queries(replicas.local()->buffer, replicas.local()->size, queries, num_iterations, false));
+        print_stats("node " + std::to_string(node) + ", remote replica on node " + std::to_string(remote), 0.0,
+                    run_queries(replicas.replica(remote)->buffer, replicas.replica(remote)->size, queries, num_iterations, false));
+      });
+    worker.join();
+  }
+
+  return 0;
+}
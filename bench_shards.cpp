@@ -0,0 +1,113 @@
+#include "histogram_tile_generated.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <csignal>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "mmapped_file.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+// measures how query throughput scales with the number of shards. for 1, 2,
+// 4 and so on shards it splits sample.tile with convert_fb_to_shards, starts
+// a query_server on each shard and a query_coordinator in front of them,
+// then drives the coordinator with query_client. a query_server on the whole
+// tile, without a coordinator, is run first as the baseline. everything is
+// run from the current directory, so build the tools first.
+
+pid_t spawn(const std::vector<std::string> &args) {
+  std::vector<char *> argv;
+  for (const auto &arg : args) {
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+  const pid_t pid = fork();
+  if (pid == -1) {
+    throw std::runtime_error("Unable to fork.");
+  }
+  if (pid == 0) {
+    execv(argv[0], argv.data());
+    std::cerr << "Unable to run " << args[0] << "\n";
+    _exit(127);
+  }
+  return pid;
+}
+
+void wait_for(pid_t pid, const std::string &name) {
+  int status = 0;
+  if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    throw std::runtime_error(name + " failed.");
+  }
+}
+
+void run(const std::vector<std::string> &args) {
+  wait_for(spawn(args), args[0]);
+}
+
+// asks the servers to stop, and waits for them to print their stats.
+void stop(const std::vector<pid_t> &pids) {
+  for (auto pid : pids) {
+    kill(pid, SIGINT);
+  }
+  for (auto pid : pids) {
+    wait_for(pid, "Server");
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 3) {
+    std::cerr << "Usage: " << argv[0] << " [max shards, default 4] [seconds per run, default 5]\n";
+    return 1;
+  }
+  const uint32_t max_shards = (argc > 1) ? uint32_t(atoi(argv[1])) : 4;
+  const std::string seconds = (argc > 2) ? argv[2] : "5";
+
+  uint32_t num_segments = 0;
+  {
+    mmapped_file f("sample.tile");
+    auto verifier = fb::Verifier((const uint8_t *)f.buffer, f.size);
+    if (!ot::VerifyHistogramBuffer(verifier)) {
+      throw std::runtime_error("Buffer verification failed.");
+    }
+    auto histogram = ot::GetHistogram(f.buffer);
+    if (histogram->segments() == nullptr) {
+      throw std::runtime_error("Tile has no segments.");
+    }
+    num_segments = histogram->segments()->size();
+  }
+  const std::string segments = std::to_string(num_segments);
+  const std::string client_socket = "bench_shards.sock";
+
+  std::cout << "== whole tile, no coordinator" << std::endl;
+  {
+    const pid_t server = spawn({"./query_server", client_socket, "sample.tile"});
+    run({"./query_client", client_socket, "4", "16", seconds, "0.1", segments});
+    stop({server});
+  }
+
+  for (uint32_t num_shards = 1; num_shards <= max_shards; num_shards *= 2) {
+    std::cout << "== " << num_shards << " shards" << std::endl;
+    run({"./convert_fb_to_shards", std::to_string(num_shards)});
+
+    std::vector<pid_t> servers;
+    std::vector<std::string> coordinator_args = {"./query_coordinator", client_socket, segments};
+    for (uint32_t shard = 0; shard < num_shards; ++shard) {
+      const std::string socket = "bench_shards." + std::to_string(shard) + ".sock";
+      servers.push_back(spawn({"./query_server", socket, "sample.tile.shard." + std::to_string(shard)}));
+      coordinator_args.push_back(socket);
+    }
+    // the coordinator waits for the shards to come up, and the client for
+    // the coordinator.
+    const pid_t coordinator = spawn(coordinator_args);
+    run({"./query_client", client_socket, "4", "16", seconds, "0.1", segments});
+    stop({coordinator});
+    stop(servers);
+  }
+
+  return 0;
+}
@@ -0,0 +1,259 @@
+#ifndef BLOCKED_TILE_HPP
+#define BLOCKED_TILE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <lz4.h>
+#include <lz4hc.h>
+#include <zstd.h>
+
+#include "mmapped_file.hpp"
+
+// a container which splits a tile's segments into fixed-size blocks of
+// consecutive segment IDs, each of which is compressed independently. the
+// header and block index at the start of the file are not compressed, so a
+// reader only has to decompress the blocks holding the segments it needs.
+//
+// the container doesn't care what's in a block; for histogram tiles each one
+// is a complete FlatBuffers Histogram whose segments vector starts at the
+// block's first segment ID.
+//
+// layout, all little-endian:
+//   blocked_tile_header
+//   blocked_tile_index_entry[num_blocks]
+//   compressed block data
+
+enum class block_codec : uint32_t {
+  zstd = 1,
+  lz4 = 2
+};
+
+struct blocked_tile_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t codec;
+  uint32_t num_segments;
+  uint32_t segments_per_block;
+  uint32_t num_blocks;
+  uint32_t reserved;
+};
+
+struct blocked_tile_index_entry {
+  // offset of the compressed block from the start of the file.
+  uint64_t offset;
+  uint32_t compressed_size;
+  uint32_t uncompressed_size;
+};
+
+static_assert(sizeof(blocked_tile_header) == 32, "unexpected header padding");
+static_assert(sizeof(blocked_tile_index_entry) == 16, "unexpected index entry padding");
+
+constexpr char blocked_tile_magic[8] = {'O', 'T', 'B', 'L', 'O', 'C', 'K', 'S'};
+constexpr uint32_t blocked_tile_version = 1;
+
+inline std::vector<uint8_t> compress_block(
+  block_codec codec, int level, const uint8_t *data, size_t size) {
+
+  std::vector<uint8_t> out;
+  if (codec == block_codec::zstd) {
+    out.resize(ZSTD_compressBound(size));
+    size_t n = ZSTD_compress(out.data(), out.size(), data, size, level);
+    if (ZSTD_isError(n)) {
+      throw std::runtime_error(std::string("zstd compression failed: ") + ZSTD_getErrorName(n));
+    }
+    out.resize(n);
+  } else {
+    out.resize(LZ4_compressBound(int(size)));
+    int n = LZ4_compress_HC((const char *)data, (char *)out.data(), int(size), int(out.size()), level);
+    if (n <= 0) {
+      throw std::runtime_error("lz4 compression failed.");
+    }
+    out.resize(n);
+  }
+  return out;
+}
+
+inline void decompress_block(
+  block_codec codec, const uint8_t *src, size_t src_size, uint8_t *dst, size_t dst_size) {
+
+  if (codec == block_codec::zstd) {
+    size_t n = ZSTD_decompress(dst, dst_size, src, src_size);
+    if (ZSTD_isError(n) || n != dst_size) {
+      throw std::runtime_error("zstd decompression failed.");
+    }
+  } else {
+    int n = LZ4_decompress_safe((const char *)src, (char *)dst, int(src_size), int(dst_size));
+    if (n < 0 || size_t(n) != dst_size) {
+      throw std::runtime_error("lz4 decompression failed.");
+    }
+  }
+}
+
+// compresses the blocks, which must already be split by segment ID, and
+// writes the container to path. returns the size of the file.
+inline size_t write_blocked_tile(
+  const std::string &path,
+  block_codec codec, int level,
+  uint32_t num_segments, uint32_t segments_per_block,
+  const std::vector<std::vector<uint8_t> > &blocks) {
+
+  blocked_tile_header header;
+  memset(&header, 0, sizeof header);
+  memcpy(header.magic, blocked_tile_magic, sizeof header.magic);
+  header.version = blocked_tile_version;
+  header.codec = uint32_t(codec);
+  header.num_segments = num_segments;
+  header.segments_per_block = segments_per_block;
+  header.num_blocks = uint32_t(blocks.size());
+
+  std::vector<blocked_tile_index_entry> index(blocks.size());
+  std::vector<std::vector<uint8_t> > compressed(blocks.size());
+  uint64_t offset = sizeof header + blocks.size() * sizeof(blocked_tile_index_entry);
+  for (size_t b = 0; b < blocks.size(); ++b) {
+    compressed[b] = compress_block(codec, level, blocks[b].data(), blocks[b].size());
+    index[b].offset = offset;
+    index[b].compressed_size = uint32_t(compressed[b].size());
+    index[b].uncompressed_size = uint32_t(blocks[b].size());
+    offset += compressed[b].size();
+  }
+
+  std::ofstream out(path, std::ios::binary);
+  out.write((const char *)&header, sizeof header);
+  out.write((const char *)index.data(), index.size() * sizeof(blocked_tile_index_entry));
+  for (const auto &c : compressed) {
+    out.write((const char *)c.data(), c.size());
+  }
+  if (!out) {
+    throw std::runtime_error("Unable to write blocked tile.");
+  }
+  return size_t(offset);
+}
+
+// reads a blocked tile, keeping recently used decompressed blocks in an LRU
+// cache limited to cache_budget bytes. the most recently used block is always
+// kept, even if it's larger than the budget.
+//
+// the pointer returned by block() is valid until the next call to block().
+class blocked_tile_reader {
+public:
+  blocked_tile_reader(const std::string &path, size_t cache_budget)
+    : file_(path), budget_(cache_budget), cached_bytes_(0),
+      hits_(0), misses_(0), evictions_(0), decompressed_bytes_(0) {
+
+    if (file_.size < sizeof(blocked_tile_header)) {
+      throw std::runtime_error("Blocked tile is too small.");
+    }
+    memcpy(&header_, file_.buffer, sizeof header_);
+    if (memcmp(header_.magic, blocked_tile_magic, sizeof header_.magic) != 0 ||
+        header_.version != blocked_tile_version) {
+      throw std::runtime_error("Not a blocked tile, or unsupported version.");
+    }
+    if (header_.codec != uint32_t(block_codec::zstd) && header_.codec != uint32_t(block_codec::lz4)) {
+      throw std::runtime_error("Unknown blocked tile codec.");
+    }
+    const size_t index_end = sizeof header_ + size_t(header_.num_blocks) * sizeof(blocked_tile_index_entry);
+    if (header_.segments_per_block == 0 || index_end > file_.size) {
+      throw std::runtime_error("Blocked tile index is truncated.");
+    }
+    index_ = (const blocked_tile_index_entry *)((const uint8_t *)file_.buffer + sizeof header_);
+    for (uint32_t b = 0; b < header_.num_blocks; ++b) {
+      if (index_[b].offset + index_[b].compressed_size > file_.size) {
+        throw std::runtime_error("Blocked tile block is truncated.");
+      }
+    }
+  }
+
+  uint32_t num_segments() const { return header_.num_segments; }
+  uint32_t num_blocks() const { return header_.num_blocks; }
+  uint32_t segments_per_block() const { return header_.segments_per_block; }
+  uint32_t block_for_segment(uint32_t segment_id) const { return segment_id / header_.segments_per_block; }
+  uint32_t first_segment(uint32_t block) const { return block * header_.segments_per_block; }
+
+  // the decompressed data for block, and its size. the second argument is set
+  // to true if the block had to be decompressed (i.e: it's new to the cache),
+  // so that the caller can verify it.
+  const uint8_t *block(uint32_t b, size_t &size, bool &is_new) {
+    auto itr = cache_.find(b);
+    if (itr != cache_.end()) {
+      ++hits_;
+      lru_.splice(lru_.begin(), lru_, itr->second.lru_pos);
+      size = itr->second.data.size();
+      is_new = false;
+      return itr->second.data.data();
+    }
+
+    ++misses_;
+    if (b >= header_.num_blocks) {
+      throw std::runtime_error("Block index out of range.");
+    }
+    const auto &entry = index_[b];
+    cached_block cb;
+    cb.data.resize(entry.uncompressed_size);
+    decompress_block(
+      block_codec(header_.codec),
+      (const uint8_t *)file_.buffer + entry.offset, entry.compressed_size,
+      cb.data.data(), cb.data.size());
+    decompressed_bytes_ += entry.uncompressed_size;
+
+    lru_.push_front(b);
+    cb.lru_pos = lru_.begin();
+    cached_bytes_ += cb.data.size();
+    auto &inserted = cache_[b];
+    inserted = std::move(cb);
+    evict();
+
+    size = inserted.data.size();
+    is_new = true;
+    return inserted.data.data();
+  }
+
+  size_t cached_bytes() const { return cached_bytes_; }
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+  uint64_t evictions() const { return evictions_; }
+  uint64_t decompressed_bytes() const { return decompressed_bytes_; }
+
+  void clear_cache() {
+    cache_.clear();
+    lru_.clear();
+    cached_bytes_ = 0;
+  }
+
+private:
+  struct cached_block {
+    std::vector<uint8_t> data;
+    std::list<uint32_t>::iterator lru_pos;
+  };
+
+  // drop least recently used blocks until we're within budget, but never the
+  // one which was just used.
+  void evict() {
+    while (cached_bytes_ > budget_ && lru_.size() > 1) {
+      const uint32_t victim = lru_.back();
+      lru_.pop_back();
+      auto itr = cache_.find(victim);
+      cached_bytes_ -= itr->second.data.size();
+      cache_.erase(itr);
+      ++evictions_;
+    }
+  }
+
+  mmapped_file file_;
+  blocked_tile_header header_;
+  const blocked_tile_index_entry *index_;
+
+  size_t budget_, cached_bytes_;
+  std::list<uint32_t> lru_;
+  std::unordered_map<uint32_t, cached_block> cache_;
+
+  uint64_t hits_, misses_, evictions_, decompressed_bytes_;
+};
+
+#endif /* BLOCKED_TILE_HPP */
@@ -0,0 +1,166 @@
+#ifndef BUCKET_RUNS_HPP
+#define BUCKET_RUNS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include "query_trace.hpp"
+
+// a run-length encoding of a segment's entries. entries come in clusters of
+// adjacent speed buckets for each (day_hour, next_segment_idx), so rather
+// than repeat the key in each entry, each cluster is stored as one header and
+// a run of counts for consecutive buckets starting at first_bucket.
+//
+// the layout matches the BucketRun struct in histogram_tile.fbs.
+struct bucket_run {
+  uint8_t day_hour;
+  uint8_t next_segment_idx;
+  uint8_t first_bucket;
+  uint8_t length;
+  // index of the run's first count in the segment's run_counts.
+  uint16_t counts_offset;
+};
+
+static_assert(sizeof(bucket_run) == 6, "unexpected bucket_run padding");
+
+struct bucket_run_segment {
+  std::vector<bucket_run> runs;
+  std::vector<uint32_t> counts;
+};
+
+// gaps of up to this many empty buckets are filled with zero counts rather
+// than starting a new run, as a header costs more than a couple of counts.
+constexpr uint32_t BUCKET_RUN_MAX_GAP = 1;
+constexpr uint32_t BUCKET_RUN_MAX_LENGTH = 255;
+// counts_offset is 16 bits, so every run has to start within the first 65536
+// counts of its segment. the last run can go past that, by up to
+// BUCKET_RUN_MAX_LENGTH counts.
+constexpr uint32_t BUCKET_RUN_MAX_OFFSET = 65535;
+
+// encodes entries, which must be sorted by day_hour then next_segment_idx and
+// have day_hour(), next_segment_idx(), speed_bucket(), vehicle_type() and
+// count() accessors. entries with the same key are summed, so the histogram
+// for any day_hour is unchanged. returns false if a run would start past
+// BUCKET_RUN_MAX_OFFSET, or for entries for vehicle types other than the
+// default.
+template <typename Entries>
+bool build_bucket_runs(const Entries &entries, bucket_run_segment &out) {
+  out = bucket_run_segment();
+
+  auto itr = entries.begin();
+  while (itr != entries.end()) {
+    const uint32_t day_hour = itr->day_hour();
+    const uint32_t next_segment_idx = itr->next_segment_idx();
+    if (day_hour > 255 || next_segment_idx > 255 || itr->vehicle_type() != 0) {
+      return false;
+    }
+
+    // buckets are usually already in order, but the generator's clamping
+    // can repeat one at either end.
+    std::map<uint32_t, uint32_t> buckets;
+    while (itr != entries.end() && itr->day_hour() == day_hour &&
+           itr->next_segment_idx() == next_segment_idx) {
+      if (itr->vehicle_type() != 0) {
+        return false;
+      }
+      buckets[itr->speed_bucket()] += itr->count();
+      ++itr;
+    }
+
+    bucket_run run = {};
+    uint32_t last_bucket = 0;
+    for (const auto &bucket : buckets) {
+      const bool extends = (run.length > 0) &&
+        (bucket.first - last_bucket <= BUCKET_RUN_MAX_GAP + 1) &&
+        (bucket.first - run.first_bucket < BUCKET_RUN_MAX_LENGTH);
+      if (extends) {
+        for (uint32_t b = last_bucket + 1; b < bucket.first; ++b) {
+          out.counts.push_back(0);
+        }
+      } else {
+        if (run.length > 0) {
+          out.runs.push_back(run);
+        }
+        if (bucket.first > 255 || out.counts.size() > BUCKET_RUN_MAX_OFFSET) {
+          return false;
+        }
+        run.day_hour = uint8_t(day_hour);
+        run.next_segment_idx = uint8_t(next_segment_idx);
+        run.first_bucket = uint8_t(bucket.first);
+        run.counts_offset = uint16_t(out.counts.size());
+      }
+      out.counts.push_back(bucket.second);
+      run.length = uint8_t(out.counts.size() - run.counts_offset);
+      last_bucket = bucket.first;
+    }
+    if (run.length > 0) {
+      out.runs.push_back(run);
+    }
+  }
+
+  return true;
+}
+
+// calls f(speed_bucket, count) for each count of each run with day_hour in
+// [begin, end). as add_bucket_runs, this checks runs stay inside the counts.
+template <typename F>
+void for_each_bucket_run_count(
+  const bucket_run *runs, size_t num_runs,
+  const uint32_t *counts, size_t num_counts,
+  uint32_t begin, uint32_t end, F &&f) {
+
+  QUERY_TRACE_PHASE(entry_search);
+  const bucket_run *run = std::lower_bound(
+    runs, runs + num_runs, begin,
+    [](const bucket_run &lhs, uint32_t rhs) {
+      QUERY_TRACE_TOUCH(&lhs, sizeof lhs);
+      return uint32_t(lhs.day_hour) < rhs;
+    });
+
+  QUERY_TRACE_PHASE(scan);
+  for (; run != runs + num_runs && run->day_hour < end; ++run) {
+    if (size_t(run->counts_offset) + run->length > num_counts) {
+      throw std::runtime_error("Bucket run is outside the run counts.");
+    }
+    const uint32_t *c = counts + run->counts_offset;
+    QUERY_TRACE_ENTRIES(run->length);
+    QUERY_TRACE_TOUCH(run, sizeof *run);
+    QUERY_TRACE_TOUCH(c, run->length * sizeof *c);
+    for (uint32_t i = 0; i < run->length; ++i) {
+      f(uint32_t(run->first_bucket) + i, c[i]);
+    }
+  }
+}
+
+// adds all runs with day_hour in [begin, end) into hist, which has max_buckets
+// buckets. each run is clipped to the histogram once, so the inner loop is a
+// straight add of consecutive counts. the FlatBuffers Verifier can't check
+// that runs stay inside the counts, so that's checked here.
+inline void add_bucket_runs(
+  const bucket_run *runs, size_t num_runs,
+  const uint32_t *counts, size_t num_counts,
+  uint32_t begin, uint32_t end, uint32_t *hist, uint32_t max_buckets) {
+
+  const bucket_run *run = std::lower_bound(
+    runs, runs + num_runs, begin,
+    [](const bucket_run &lhs, uint32_t rhs) {
+      return uint32_t(lhs.day_hour) < rhs;
+    });
+
+  for (; run != runs + num_runs && run->day_hour < end; ++run) {
+    if (size_t(run->counts_offset) + run->length > num_counts) {
+      throw std::runtime_error("Bucket run is outside the run counts.");
+    }
+    const uint32_t first = run->first_bucket;
+    const uint32_t last = std::min<uint32_t>(first + run->length, max_buckets);
+    const uint32_t *c = counts + run->counts_offset;
+    for (uint32_t b = first; b < last; ++b) {
+      hist[b] += c[b - first];
+    }
+  }
+}
+
+#endif /* BUCKET_RUNS_HPP */
@@ -0,0 +1,123 @@
+#ifndef CHECKED_HISTOGRAM_HPP
+#define CHECKED_HISTOGRAM_HPP
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+#include "histogram_tile_generated.h"
+#include "tile_footer.hpp"
+
+// a FlatBuffers Histogram tile, opened with the amount of checking given by
+// tile_open_mode. tiles without a footer, or whose footer doesn't have the
+// verified flag, always get the full Verifier whatever mode is asked for.
+//
+// in lazy mode, only the root table and the segments vector are checked on
+// open, and each segment is verified the first time segment() returns it.
+// queries must go through segment() rather than histogram()->segments().
+// segment() may be called from several threads at once: the flags are
+// atomic, and two threads verifying the same segment is only wasted work.
+class checked_histogram {
+public:
+  checked_histogram(const void *buffer, size_t size, tile_open_mode mode)
+    : buffer_((const uint8_t *)buffer), payload_size_(size), mode_(tile_open_mode::verify_full),
+      histogram_(nullptr), num_segments_(0) {
+
+    tile_footer footer;
+    const bool has_footer = read_tile_footer(buffer, size, footer);
+    if (has_footer) {
+      payload_size_ = footer.payload_size;
+      if ((footer.flags & tile_footer_verified) != 0) {
+        mode_ = mode;
+      }
+    }
+
+    if (mode_ == tile_open_mode::checksum &&
+        crc32c(buffer_, payload_size_) != footer.checksum) {
+      throw std::runtime_error("Tile checksum mismatch.");
+    }
+
+    if (mode_ == tile_open_mode::verify_full) {
+      auto verifier = flatbuffers::Verifier(buffer_, payload_size_);
+      if (!OpenTraffic::VerifyHistogramBuffer(verifier)) {
+        throw std::runtime_error("Buffer verification failed.");
+      }
+    } else if (mode_ == tile_open_mode::lazy) {
+      if (!verify_root()) {
+        throw std::runtime_error("Root table verification failed.");
+      }
+    }
+
+    histogram_ = OpenTraffic::GetHistogram(buffer_);
+    if (histogram_->segments() != nullptr) {
+      num_segments_ = histogram_->segments()->size();
+    }
+    if (mode_ == tile_open_mode::lazy) {
+      verified_.reset(new std::atomic<uint8_t>[num_segments_]);
+      for (uint32_t i = 0; i < num_segments_; ++i) {
+        verified_[i].store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // the mode actually used, which may be stricter than the one requested.
+  tile_open_mode mode() const { return mode_; }
+
+  const OpenTraffic::Histogram *histogram() const { return histogram_; }
+
+  uint32_t num_segments() const { return num_segments_; }
+
+  const OpenTraffic::Segment *segment(uint32_t segment_id) {
+    if (segment_id >= num_segments_) {
+      throw std::runtime_error("Segment ID out of range.");
+    }
+    const OpenTraffic::Segment *segment = (*histogram_->segments())[segment_id];
+    if (mode_ == tile_open_mode::lazy && !verified_[segment_id].load(std::memory_order_acquire)) {
+      auto verifier = flatbuffers::Verifier(buffer_, payload_size_);
+      if (!segment->Verify(verifier)) {
+        throw std::runtime_error("Segment verification failed.");
+      }
+      verified_[segment_id].store(1, std::memory_order_release);
+    }
+    return segment;
+  }
+
+private:
+  // verifies the root table and the bounds of the segments vector, but none of
+  // the segments it points to.
+  bool verify_root() const {
+    namespace fb = flatbuffers;
+    if (payload_size_ < sizeof(fb::uoffset_t)) {
+      return false;
+    }
+    const fb::uoffset_t root = fb::ReadScalar<fb::uoffset_t>(buffer_);
+    if ((root % sizeof(fb::uoffset_t)) != 0 || root >= payload_size_) {
+      return false;
+    }
+
+    auto verifier = fb::Verifier(buffer_, payload_size_);
+    auto table = reinterpret_cast<const fb::Table *>(buffer_ + root);
+    auto histogram = OpenTraffic::GetHistogram(buffer_);
+    return table->VerifyTableStart(verifier) &&
+      table->VerifyField<uint8_t>(verifier, OpenTraffic::Histogram::VT_VEHICLE_TYPE) &&
+      table->VerifyField<uint8_t>(verifier, OpenTraffic::Histogram::VT_LOG_COUNT_BITS) &&
+      table->VerifyOffset(verifier, OpenTraffic::Histogram::VT_VEHICLE_TYPES) &&
+      verifier.VerifyVector(histogram->vehicle_types()) &&
+      table->VerifyOffset(verifier, OpenTraffic::Histogram::VT_SEGMENTS) &&
+      verifier.VerifyVector(histogram->segments()) &&
+      table->VerifyOffset(verifier, OpenTraffic::Histogram::VT_SPEED_BUCKETS) &&
+      verifier.VerifyTable(histogram->speed_buckets()) &&
+      table->VerifyOffset(verifier, OpenTraffic::Histogram::VT_SKETCHES) &&
+      verifier.VerifyVector(histogram->sketches()) &&
+      verifier.EndTable();
+  }
+
+  const uint8_t *buffer_;
+  size_t payload_size_;
+  tile_open_mode mode_;
+  const OpenTraffic::Histogram *histogram_;
+  uint32_t num_segments_;
+  std::unique_ptr<std::atomic<uint8_t>[]> verified_;
+};
+
+#endif /* CHECKED_HISTOGRAM_HPP */
@@ -0,0 +1,109 @@
+#include "histogram_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+#include "mmapped_file.hpp"
+#include "blocked_tile.hpp"
+#include "copy_segment.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+void usage(const char *prog) {
+  std::cerr << "Usage: " << prog << " [--codec zstd|lz4] [--level N] [--segments-per-block N]\n"
+            << "  --codec               block compression, default zstd.\n"
+            << "  --level               compression level, default 19 for zstd, 12 for lz4.\n"
+            << "  --segments-per-block  number of consecutive segments in each block,\n"
+            << "                        default 64.\n";
+}
+
+int main(int argc, char *argv[]) {
+  block_codec codec = block_codec::zstd;
+  int level = -1;
+  uint32_t segments_per_block = 64;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--codec") == 0 && i + 1 < argc) {
+      ++i;
+      if (strcmp(argv[i], "zstd") == 0) {
+        codec = block_codec::zstd;
+      } else if (strcmp(argv[i], "lz4") == 0) {
+        codec = block_codec::lz4;
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--level") == 0 && i + 1 < argc) {
+      level = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--segments-per-block") == 0 && i + 1 < argc) {
+      segments_per_block = uint32_t(atoi(argv[++i]));
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (segments_per_block == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (level < 0) {
+    level = (codec == block_codec::zstd) ? 19 : 12;
+  }
+
+  mmapped_file f("sample.tile");
+
+  auto verifier = fb::Verifier((const uint8_t *)f.buffer, f.size);
+  bool ok = ot::VerifyHistogramBuffer(verifier);
+  if (!ok) {
+    throw std::runtime_error("Buffer verification failed.");
+  }
+
+  auto histogram = ot::GetHistogram(f.buffer);
+  if (histogram->segments() == nullptr) {
+    throw std::runtime_error("Tile has no segments.");
+  }
+  const auto &segments = *(histogram->segments());
+  const uint32_t num_segments = segments.size();
+
+  // each block is a complete Histogram holding a run of consecutive segments.
+  std::vector<std::vector<uint8_t> > blocks;
+  for (uint32_t first = 0; first < num_segments; first += segments_per_block) {
+    const uint32_t last = std::min(num_segments, first + segments_per_block);
+
+    fb::FlatBufferBuilder builder(1024);
+    std::vector<fb::Offset<ot::Segment>> segments_vector;
+    for (uint32_t segment_id = first; segment_id < last; ++segment_id) {
+      segments_vector.push_back(copy_segment(builder, segments[segment_id]));
+    }
+    auto block_segments = builder.CreateVector(segments_vector);
+    fb::Offset<fb::Vector<int8_t>> vehicle_types;
+    if (histogram->vehicle_types() != nullptr) {
+      vehicle_types = builder.CreateVector(
+        histogram->vehicle_types()->data(), histogram->vehicle_types()->size());
+    }
+
+    auto speed_buckets = copy_speed_buckets(builder, histogram);
+    auto sketches = copy_sketches(builder, histogram, first, last);
+
+    ot::HistogramBuilder hbuilder(builder);
+    hbuilder.add_vehicle_type(histogram->vehicle_type());
+    hbuilder.add_segments(block_segments);
+    if (!vehicle_types.IsNull()) { hbuilder.add_vehicle_types(vehicle_types); }
+    if (!speed_buckets.IsNull()) { hbuilder.add_speed_buckets(speed_buckets); }
+    hbuilder.add_log_count_bits(histogram->log_count_bits());
+    if (!sketches.IsNull()) { hbuilder.add_sketches(sketches); }
+    builder.Finish(hbuilder.Finish());
+
+    blocks.emplace_back(builder.GetBufferPointer(), builder.GetBufferPointer() + builder.GetSize());
+  }
+
+  size_t size = write_blocked_tile(
+    "sample.tile.blocked", codec, level, num_segments, segments_per_block, blocks);
+
+  std::cout << "Wrote " << blocks.size() << " blocks of " << segments_per_block
+            << " segments, " << size << " bytes from " << f.size << " bytes ("
+            << (100.0 * double(size) / double(f.size)) << "%).\n";
+
+  return 0;
+}
@@ -0,0 +1,166 @@
+#include "histogram_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <set>
+
+#include "mmapped_file.hpp"
+#include "copy_segment.hpp"
+#include "shared_vectors.hpp"
+#include "page_cache.hpp"
+#include "tile_footer.hpp"
+#include "zipf_workload.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+// the pages of a tile which queries for each of the sets of segment_ids read:
+// the segments' slots, tables, vtables and whichever entry vectors they have,
+// as segment_prefetch.hpp reads them in.
+uint64_t workload_footprint(const void *buffer, size_t size, const std::vector<std::set<uint32_t> > &queries) {
+  const uint8_t *base = static_cast<const uint8_t *>(buffer);
+  auto range_of = [base](const void *p, size_t n) {
+    return byte_range{uint64_t(static_cast<const uint8_t *>(p) - base), n};
+  };
+  auto vector_range = [&](const void *data, size_t bytes) {
+    return range_of(static_cast<const uint8_t *>(data) - sizeof(fb::uoffset_t), sizeof(fb::uoffset_t) + bytes);
+  };
+
+  auto segs = ot::GetHistogram(buffer)->segments();
+  std::vector<byte_range> ranges;
+  for (const auto &segment_ids : queries) {
+    for (auto segment_id : segment_ids) {
+      if (segs == nullptr || segment_id >= segs->size()) {
+        continue;
+      }
+      const uint8_t *table = reinterpret_cast<const uint8_t *>((*segs)[segment_id]);
+      const uint8_t *vtable = table - fb::ReadScalar<fb::soffset_t>(table);
+      ranges.push_back(range_of(segs->Data() + segment_id * sizeof(fb::uoffset_t), sizeof(fb::uoffset_t)));
+      ranges.push_back(range_of(table, 64));
+      ranges.push_back(range_of(vtable, 32));
+      auto segment = (*segs)[segment_id];
+      if (segment->next_segment_ids() != nullptr) {
+        ranges.push_back(vector_range(segment->next_segment_ids()->Data(), segment->next_segment_ids()->size() * sizeof(uint32_t)));
+      }
+      if (segment->entries() != nullptr) {
+        ranges.push_back(vector_range(segment->entries()->Data(), segment->entries()->size() * sizeof(ot::Entry)));
+      }
+      if (segment->bucket_runs() != nullptr && segment->run_counts() != nullptr) {
+        ranges.push_back(vector_range(segment->bucket_runs()->Data(), segment->bucket_runs()->size() * sizeof(ot::BucketRun)));
+        ranges.push_back(vector_range(segment->run_counts()->Data(), segment->run_counts()->size() * sizeof(uint32_t)));
+      }
+    }
+  }
+  uint64_t bytes = 0;
+  for (const auto &range : coalesce_pages(ranges, size)) {
+    bytes += range.size;
+  }
+  return bytes;
+}
+
+// rewrites a tile with each distinct vector stored once and shared by every
+// segment which has it, and a single table for all the segments with nothing
+// in them, as make_sample_tile writes. queries read the shared vectors as
+// they would their own, so the readers don't change.
+int main(int argc, char *argv[]) {
+  if (argc > 3) {
+    std::cerr << "Usage: " << argv[0] << " [input, default sample.tile] [output, default INPUT.dedup]\n";
+    return 1;
+  }
+  const std::string input_path = (argc > 1) ? argv[1] : "sample.tile";
+  const std::string output_path = (argc > 2) ? argv[2] : input_path + ".dedup";
+  mmapped_file f(input_path);
+
+  size_t input_size = f.size;
+  tile_footer input_footer;
+  if (read_tile_footer(f.buffer, f.size, input_footer)) {
+    input_size = input_footer.payload_size;
+  }
+  auto verifier = fb::Verifier((const uint8_t *)f.buffer, input_size);
+  bool ok = ot::VerifyHistogramBuffer(verifier);
+  if (!ok) {
+    throw std::runtime_error("Buffer verification failed.");
+  }
+
+  auto histogram = ot::GetHistogram(f.buffer);
+  if (histogram->segments() == nullptr) {
+    throw std::runtime_error("Tile has no segments.");
+  }
+
+  fb::FlatBufferBuilder builder(1024);
+  shared_vectors shared;
+  std::vector<fb::Offset<ot::Segment>> segments_vector;
+  fb::Offset<ot::Segment> empty_segment;
+  size_t num_empty = 0;
+  for (auto segment : *(histogram->segments())) {
+    const bool empty = segment->next_segment_ids() == nullptr && segment->entries() == nullptr &&
+      segment->day_hour_index() == nullptr && segment->prefix_counts() == nullptr &&
+      segment->cdf_counts() == nullptr && segment->packed_day_hours() == nullptr &&
+      segment->bucket_runs() == nullptr;
+    if (empty) {
+      if (empty_segment.IsNull()) {
+        ot::SegmentBuilder sbuilder(builder);
+        empty_segment = sbuilder.Finish();
+      }
+      segments_vector.push_back(empty_segment);
+      ++num_empty;
+    } else {
+      segments_vector.push_back(copy_segment(builder, segment, &shared));
+    }
+  }
+  auto segments = builder.CreateVector(segments_vector);
+  fb::Offset<fb::Vector<int8_t>> vehicle_types;
+  if (histogram->vehicle_types() != nullptr) {
+    vehicle_types = builder.CreateVector(
+      histogram->vehicle_types()->data(), histogram->vehicle_types()->size());
+  }
+
+  auto speed_buckets = copy_speed_buckets(builder, histogram);
+  auto sketches = copy_sketches(builder, histogram, 0, histogram->segments()->size());
+
+  ot::HistogramBuilder hbuilder(builder);
+  hbuilder.add_vehicle_type(histogram->vehicle_type());
+  hbuilder.add_segments(segments);
+  if (!vehicle_types.IsNull()) { hbuilder.add_vehicle_types(vehicle_types); }
+  if (!speed_buckets.IsNull()) { hbuilder.add_speed_buckets(speed_buckets); }
+  hbuilder.add_log_count_bits(histogram->log_count_bits());
+  if (!sketches.IsNull()) { hbuilder.add_sketches(sketches); }
+  builder.Finish(hbuilder.Finish());
+
+  uint8_t *buf = builder.GetBufferPointer();
+  size_t size = builder.GetSize();
+
+  auto out_verifier = fb::Verifier(buf, size);
+  const bool verified = ot::VerifyHistogramBuffer(out_verifier);
+  if (!verified) {
+    std::cerr << "Warning: deduplicated tile failed verification.\n";
+  }
+  const tile_footer footer = make_tile_footer(buf, size, verified);
+
+  std::ofstream out(output_path);
+  out.write((const char *)buf, (std::streamsize)size);
+  out.write((const char *)&footer, sizeof footer);
+
+  // the pages a skewed workload keeps in the page cache, for each tile.
+  const uint32_t num_segments = histogram->segments()->size();
+  std::vector<std::set<uint32_t> > queries(1000);
+  zipf_workload workload(num_segments, 1.1, 12345);
+  for (auto &q : queries) {
+    while (q.size() < 50 && q.size() < num_segments) {
+      q.insert(workload());
+    }
+  }
+  const uint64_t before = workload_footprint(f.buffer, input_size, queries);
+  const uint64_t after = workload_footprint(buf, size, queries);
+
+  const shared_vectors::stats &totals = shared.totals();
+  std::cout << "Shared " << totals.shared << " of " << totals.vectors << " vectors, saving "
+            << totals.bytes_saved << " bytes, and " << num_empty << " empty segments share one table.\n";
+  std::cout << "Tile is " << size << " bytes from " << input_size << " ("
+            << (100.0 * (1.0 - double(size) / double(input_size))) << "% smaller), "
+            << (size + page_size() - 1) / page_size() << " pages from "
+            << (input_size + page_size() - 1) / page_size() << ".\n";
+  std::cout << queries.size() << " Zipf distributed queries touch " << after << " bytes of pages, from "
+            << before << " (" << (100.0 * (1.0 - double(after) / double(before))) << "% less).\n";
+
+  return 0;
+}
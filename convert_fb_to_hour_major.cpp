@@ -0,0 +1,131 @@
+#include "histogram_tile_generated.h"
+#include "histogram_hour_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+#include "mmapped_file.hpp"
+#include "plain_entries.hpp"
+#include "copy_segment.hpp"
+
+#include "prefix_sums.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+// the data for one day_hour while it's being built up, in the same shape as
+// the DayHourBlock table.
+struct hour_block {
+  std::vector<uint32_t> segment_ids;
+  std::vector<uint32_t> offsets;
+  std::vector<uint8_t> speed_buckets;
+  std::vector<uint32_t> counts;
+};
+
+// transpose the segment-major histogram into one block per day_hour, merging
+// the entries for different next segments into a single run of buckets.
+std::vector<hour_block> transpose(const ot::Histogram *histogram) {
+  std::vector<hour_block> blocks(NUM_DAY_HOURS);
+  if (histogram->segments() == nullptr) {
+    return blocks;
+  }
+  const auto &segments = *(histogram->segments());
+
+  const uint32_t num_segments = segments.size();
+  for (uint32_t segment_id = 0; segment_id < num_segments; ++segment_id) {
+    auto entries = segments[segment_id]->entries();
+    if (entries == nullptr) {
+      require_plain_entries(segments[segment_id]);
+      continue;
+    }
+
+    auto itr = entries->begin();
+    while (itr != entries->end()) {
+      const uint32_t day_hour = (*itr)->day_hour();
+      if (day_hour >= NUM_DAY_HOURS) {
+        throw std::runtime_error("Entry day_hour out of range.");
+      }
+
+      uint32_t bucket_counts[256];
+      memset(bucket_counts, 0, sizeof bucket_counts);
+      while ((itr != entries->end()) && ((*itr)->day_hour() == day_hour)) {
+        bucket_counts[(*itr)->speed_bucket()] += (*itr)->count();
+        ++itr;
+      }
+
+      auto &block = blocks[day_hour];
+      block.segment_ids.push_back(segment_id);
+      block.offsets.push_back(block.counts.size());
+      for (uint32_t bucket = 0; bucket < 256; ++bucket) {
+        if (bucket_counts[bucket] > 0) {
+          block.speed_buckets.push_back(uint8_t(bucket));
+          block.counts.push_back(bucket_counts[bucket]);
+        }
+      }
+    }
+  }
+
+  for (auto &block : blocks) {
+    block.offsets.push_back(block.counts.size());
+  }
+
+  return blocks;
+}
+
+int main(int argc, char *argv[]) {
+  mmapped_file f("sample.tile");
+
+  auto verifier = fb::Verifier((const uint8_t *)f.buffer, f.size);
+  bool ok = ot::VerifyHistogramBuffer(verifier);
+  if (!ok) {
+    throw std::runtime_error("Buffer verification failed.");
+  }
+
+  auto histogram = ot::GetHistogram(f.buffer);
+  auto blocks = transpose(histogram);
+
+  fb::FlatBufferBuilder builder(1024);
+  std::vector<fb::Offset<ot::DayHourBlock>> blocks_vector;
+  size_t num_runs = 0, num_buckets = 0;
+  for (const auto &block : blocks) {
+    auto segment_ids = builder.CreateVector(block.segment_ids);
+    auto offsets = builder.CreateVector(block.offsets);
+    auto speed_buckets = builder.CreateVector(block.speed_buckets);
+    auto counts = builder.CreateVector(block.counts);
+
+    ot::DayHourBlockBuilder bbuilder(builder);
+    bbuilder.add_segment_ids(segment_ids);
+    bbuilder.add_offsets(offsets);
+    bbuilder.add_speed_buckets(speed_buckets);
+    bbuilder.add_counts(counts);
+    blocks_vector.push_back(bbuilder.Finish());
+
+    num_runs += block.segment_ids.size();
+    num_buckets += block.counts.size();
+  }
+  auto day_hours = builder.CreateVector(blocks_vector);
+  auto speed_buckets = copy_speed_buckets(builder, histogram);
+
+  const uint32_t num_segments =
+    (histogram->segments() == nullptr) ? 0 : histogram->segments()->size();
+
+  // snapshots are of all traffic, so a tile with several vehicle types is
+  // summed over all of them and labelled with the first.
+  ot::HourMajorHistogramBuilder hbuilder(builder);
+  hbuilder.add_vehicle_type(histogram->vehicle_type());
+  hbuilder.add_num_segments(num_segments);
+  hbuilder.add_day_hours(day_hours);
+  if (!speed_buckets.IsNull()) { hbuilder.add_speed_buckets(speed_buckets); }
+  ot::FinishHourMajorHistogramBuffer(builder, hbuilder.Finish());
+
+  uint8_t *buf = builder.GetBufferPointer();
+  int size = builder.GetSize();
+
+  std::ofstream out("sample.tile.hour");
+  out.write((const char *)buf, (std::streamsize)size);
+
+  std::cout << "Wrote " << num_runs << " segment runs with " << num_buckets
+            << " buckets, " << size << " bytes.\n";
+
+  return 0;
+}
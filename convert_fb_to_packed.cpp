@@ -0,0 +1,180 @@
+#include "histogram_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "mmapped_file.hpp"
+#include "plain_entries.hpp"
+#include "packed_entries.hpp"
+#include "log_counts.hpp"
+#include "copy_segment.hpp"
+#include "tile_footer.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+// how far log coded counts are from the exact ones, entry by entry.
+struct log_count_errors {
+  uint64_t entries = 0, exact = 0, saturated = 0;
+  uint64_t total_count = 0, total_decoded = 0;
+  double sum_relative = 0.0, max_relative = 0.0;
+
+  void add(uint32_t count, uint32_t decoded, uint32_t max_count) {
+    ++entries;
+    exact += (decoded == count);
+    saturated += (count > max_count);
+    total_count += count;
+    total_decoded += decoded;
+    const double relative = (count == 0) ? 0.0 : std::fabs(double(decoded) - double(count)) / double(count);
+    sum_relative += relative;
+    max_relative = std::max(max_relative, relative);
+  }
+
+  void print() const {
+    if (entries == 0) {
+      return;
+    }
+    std::cout << "Log counts: " << exact << " of " << entries << " entries exact, " << saturated
+              << " saturated, mean error " << (100.0 * sum_relative / double(entries)) << "%, max "
+              << (100.0 * max_relative) << "%, total count "
+              << (100.0 * (double(total_decoded) - double(total_count)) / double(total_count)) << "% off.\n";
+  }
+};
+
+// rewrites sample.tile with each segment's entries in the packed encoding,
+// keeping plain entries for any segment that doesn't fit it. with
+// --log-counts, the counts are stored as log-scale codes of that many bits
+// instead, see log_counts.hpp.
+int main(int argc, char *argv[]) {
+  uint32_t log_bits = 0;
+  if (argc == 3 && strcmp(argv[1], "--log-counts") == 0) {
+    log_bits = uint32_t(atoi(argv[2]));
+  }
+  if ((argc != 1 && argc != 3) || (argc == 3 && log_bits != 8 && log_bits != 4)) {
+    std::cerr << "Usage: " << argv[0] << " [--log-counts 8|4]\n";
+    return 1;
+  }
+  mmapped_file f("sample.tile");
+
+  auto verifier = fb::Verifier((const uint8_t *)f.buffer, f.size);
+  bool ok = ot::VerifyHistogramBuffer(verifier);
+  if (!ok) {
+    throw std::runtime_error("Buffer verification failed.");
+  }
+
+  auto histogram = ot::GetHistogram(f.buffer);
+  if (histogram->segments() == nullptr) {
+    throw std::runtime_error("Tile has no segments.");
+  }
+
+  fb::FlatBufferBuilder builder(1024);
+  std::vector<fb::Offset<ot::Segment>> segments_vector;
+  size_t num_packed = 0, num_unpacked = 0, num_escapes = 0;
+  size_t entries_size = 0, packed_size = 0;
+  log_count_errors errors;
+
+  for (auto segment : *(histogram->segments())) {
+    fb::Offset<fb::Vector<uint32_t>> next_segment_ids;
+    if (segment->next_segment_ids() != nullptr) {
+      next_segment_ids = builder.CreateVector(
+        segment->next_segment_ids()->data(), segment->next_segment_ids()->size());
+    }
+
+    fb::Offset<fb::Vector<const ot::Entry *>> entries;
+    fb::Offset<fb::Vector<uint8_t>> packed_day_hours, packed_keys, packed_counts;
+    fb::Offset<fb::Vector<const ot::CountEscape *>> count_escapes;
+    fb::Offset<fb::Vector<uint8_t>> log_counts;
+    packed_segment packed;
+    if (segment->entries() == nullptr) {
+      // nothing to pack.
+      require_plain_entries(segment);
+    } else if (pack_entries(*(segment->entries()), packed)) {
+      packed_day_hours = builder.CreateVector(packed.day_hours);
+      packed_keys = builder.CreateVector(packed.keys);
+      if (log_bits != 0) {
+        const std::vector<uint8_t> codes = (log_bits == 8) ?
+          encode_log_counts<8>(packed) : encode_log_counts<4>(packed);
+        log_counts = builder.CreateVector(codes);
+        uint32_t i = 0;
+        for (auto e : *(segment->entries())) {
+          errors.add(e->count(), log_count_at(log_bits, codes.data(), i++), max_log_count(log_bits));
+        }
+        packed_size += 2 * packed.keys.size() + codes.size();
+      } else {
+        packed_counts = builder.CreateVector(packed.counts);
+        if (!packed.escapes.empty()) {
+          static_assert(sizeof(packed_escape) == sizeof(ot::CountEscape), "escape layouts differ");
+          count_escapes = builder.CreateVectorOfStructs(
+            reinterpret_cast<const ot::CountEscape *>(packed.escapes.data()), packed.escapes.size());
+        }
+        num_escapes += packed.escapes.size();
+        packed_size += 3 * packed.keys.size() + packed.escapes.size() * sizeof(ot::CountEscape);
+      }
+      ++num_packed;
+      entries_size += segment->entries()->size() * sizeof(ot::Entry);
+    } else {
+      entries = builder.CreateVectorOfStructs(
+        reinterpret_cast<const ot::Entry *>(segment->entries()->Data()),
+        segment->entries()->size());
+      ++num_unpacked;
+    }
+
+    ot::SegmentBuilder sbuilder(builder);
+    sbuilder.add_segment_id(segment->segment_id());
+    if (!next_segment_ids.IsNull()) { sbuilder.add_next_segment_ids(next_segment_ids); }
+    if (!entries.IsNull()) { sbuilder.add_entries(entries); }
+    if (!packed_day_hours.IsNull()) {
+      sbuilder.add_packed_day_hours(packed_day_hours);
+      sbuilder.add_packed_keys(packed_keys);
+      sbuilder.add_packed_counts(packed_counts);
+    }
+    if (!count_escapes.IsNull()) { sbuilder.add_count_escapes(count_escapes); }
+    if (!log_counts.IsNull()) { sbuilder.add_log_counts(log_counts); }
+    segments_vector.push_back(sbuilder.Finish());
+  }
+  auto segments = builder.CreateVector(segments_vector);
+  fb::Offset<fb::Vector<int8_t>> vehicle_types;
+  if (histogram->vehicle_types() != nullptr) {
+    vehicle_types = builder.CreateVector(
+      histogram->vehicle_types()->data(), histogram->vehicle_types()->size());
+  }
+
+  auto speed_buckets = copy_speed_buckets(builder, histogram);
+  auto sketches = copy_sketches(builder, histogram, 0, histogram->segments()->size());
+
+  ot::HistogramBuilder hbuilder(builder);
+  hbuilder.add_vehicle_type(histogram->vehicle_type());
+  hbuilder.add_segments(segments);
+  if (!vehicle_types.IsNull()) { hbuilder.add_vehicle_types(vehicle_types); }
+  if (!speed_buckets.IsNull()) { hbuilder.add_speed_buckets(speed_buckets); }
+  if (!sketches.IsNull()) { hbuilder.add_sketches(sketches); }
+  if (log_bits != 0) { hbuilder.add_log_count_bits(uint8_t(log_bits)); }
+  builder.Finish(hbuilder.Finish());
+
+  uint8_t *buf = builder.GetBufferPointer();
+  size_t size = builder.GetSize();
+
+  auto out_verifier = fb::Verifier(buf, size);
+  const bool verified = ot::VerifyHistogramBuffer(out_verifier);
+  if (!verified) {
+    std::cerr << "Warning: packed tile failed verification.\n";
+  }
+  const tile_footer footer = make_tile_footer(buf, size, verified);
+
+  const std::string output_path = (log_bits != 0) ?
+    "sample.tile.log" + std::to_string(log_bits) : "sample.tile.packed";
+  std::ofstream out(output_path);
+  out.write((const char *)buf, (std::streamsize)size);
+  out.write((const char *)&footer, sizeof footer);
+
+  std::cout << "Packed " << num_packed << " segments, left " << num_unpacked
+            << " unpacked, with " << num_escapes << " escaped counts.\n";
+  std::cout << "Packed entries use " << packed_size << " bytes rather than "
+            << entries_size << " (" << (double(entries_size) / double(packed_size))
+            << "x smaller), tile is " << size << " bytes from " << f.size << ".\n";
+  errors.print();
+
+  return 0;
+}
@@ -4,57 +4,30 @@
 #include <random>
 #include <chrono>
 
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <sys/mman.h>
-#include <fcntl.h>
-#include <unistd.h>
+#include "mmapped_file.hpp"
+#include "plain_entries.hpp"
+#include "fb_histogram_reader.hpp"
 
 #include <arrow/io/file.h>
+#include <arrow/util/key_value_metadata.h>
 #include <parquet/api/reader.h>
 #include <parquet/api/writer.h>
 
+#include "parquet_histogram_reader.hpp"
+
 namespace ot = OpenTraffic;
 namespace fb = flatbuffers;
 
 constexpr size_t NUM_ROWS_PER_ROW_GROUP = 500;
 
-struct mmapped_file {
-  mmapped_file(const std::string &path) {
-    int fd = open(path.c_str(), O_RDONLY);
-    if (fd == -1) {
-      throw std::runtime_error("Unable to open input file.");
-    }
-    struct stat st;
-    int status = fstat(fd, &st);
-    if (status != 0) {
-      throw std::runtime_error("Unable to stat input file.");
-    }
-    size = st.st_size;
-    buffer = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
-    if (buffer == MAP_FAILED) {
-      throw std::runtime_error("Unable to mmap input file.");
-    }
-    close(fd);
-  }
-
-  ~mmapped_file() {
-    munmap(buffer, size);
-  }
-
-  size_t size;
-  void *buffer;
-};
-
-#define MAX_N_SPEEDS (120 / 5)
-
 // std::array<uint32_t, 6>
 // vtype, segment_id, day_hour, next_segment_id, speed_bucket, count
 typedef std::array<uint32_t, 6> row_type;
 
 std::vector<row_type> export_file(
   const ot::Histogram *histogram) {
-  const uint32_t vtype = histogram->vehicle_type();
+  const uint32_t tile_vtype = histogram->vehicle_type();
+  const bool multi_type = histogram->vehicle_types() != nullptr;
   if (histogram->segments() == nullptr) {
     return std::vector<row_type>();
   }
@@ -67,6 +40,7 @@ std::vector<row_type> export_file(
     auto entries = segment->entries();
     if (entries == nullptr) {
       //std::cout << "No entries for segment_id " << segment_id << "\n";
+      require_plain_entries(segment);
       continue;
     }
     auto next_segment_ids = segment->next_segment_ids();
@@ -78,6 +52,7 @@ std::vector<row_type> export_file(
       uint32_t next_segment_id = (*next_segment_ids)[entry->next_segment_idx()];
       uint32_t bucket = entry->speed_bucket();
       uint32_t count = entry->count();
+      uint32_t vtype = multi_type ? uint32_t(entry->vehicle_type()) : tile_vtype;
 
       row_type row = {vtype, segment_id, day_hour, next_segment_id, bucket, count};
       results.emplace_back(std::move(row));
@@ -165,8 +140,13 @@ int main(int argc, char *argv[]) {
   builder.encoding("next_segment_id", parquet::Encoding::RLE);
   std::shared_ptr<parquet::WriterProperties> props = builder.build();
 
+  // the rows' speed_bucket values only mean anything with the scheme.
+  auto key_value_metadata = std::make_shared<::arrow::KeyValueMetadata>(
+    std::vector<std::string>{parquet_speed_buckets_key},
+    std::vector<std::string>{format_speed_buckets(tile_speed_buckets(histogram))});
+
   std::shared_ptr<parquet::ParquetFileWriter> file_writer =
-    parquet::ParquetFileWriter::Open(output, schema, props);
+    parquet::ParquetFileWriter::Open(output, schema, props, key_value_metadata);
 
   auto sch = file_writer->schema();
   for (int i = 0; i < sch->num_columns(); ++i) {
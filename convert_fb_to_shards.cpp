@@ -0,0 +1,101 @@
+#include "histogram_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#include "mmapped_file.hpp"
+#include "copy_segment.hpp"
+#include "segment_shards.hpp"
+#include "tile_footer.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+// splits sample.tile into sample.tile.shard.0 to N-1, each owning one range
+// of segment IDs as given by segment_shards.hpp. every shard still has a
+// Segment table for every ID, so that IDs index the segments vector as
+// usual, but those outside its range are empty. a query_server on each
+// shard then answers exactly its own part of any query, and the parts sum
+// to the answer from the whole tile.
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    std::cerr << "Usage: " << argv[0] << " NUM_SHARDS\n";
+    return 1;
+  }
+  const uint32_t num_shards = uint32_t(atoi(argv[1]));
+
+  mmapped_file f("sample.tile");
+
+  auto verifier = fb::Verifier((const uint8_t *)f.buffer, f.size);
+  bool ok = ot::VerifyHistogramBuffer(verifier);
+  if (!ok) {
+    throw std::runtime_error("Buffer verification failed.");
+  }
+
+  auto histogram = ot::GetHistogram(f.buffer);
+  if (histogram->segments() == nullptr) {
+    throw std::runtime_error("Tile has no segments.");
+  }
+  const uint32_t num_segments = histogram->segments()->size();
+  if (num_shards == 0 || num_shards > num_segments) {
+    std::cerr << "Need between 1 and " << num_segments << " shards.\n";
+    return 1;
+  }
+
+  for (uint32_t shard = 0; shard < num_shards; ++shard) {
+    const uint32_t first = shard_first_segment(shard, num_segments, num_shards);
+    const uint32_t last = shard_first_segment(shard + 1, num_segments, num_shards);
+
+    fb::FlatBufferBuilder builder(1024);
+    std::vector<fb::Offset<ot::Segment>> segments_vector;
+    segments_vector.reserve(num_segments);
+    for (uint32_t i = 0; i < num_segments; ++i) {
+      auto segment = histogram->segments()->Get(i);
+      if (i >= first && i < last) {
+        segments_vector.push_back(copy_segment(builder, segment));
+      } else {
+        ot::SegmentBuilder sbuilder(builder);
+        sbuilder.add_segment_id(segment->segment_id());
+        segments_vector.push_back(sbuilder.Finish());
+      }
+    }
+    auto segments = builder.CreateVector(segments_vector);
+    fb::Offset<fb::Vector<int8_t>> vehicle_types;
+    if (histogram->vehicle_types() != nullptr) {
+      vehicle_types = builder.CreateVector(
+        histogram->vehicle_types()->data(), histogram->vehicle_types()->size());
+    }
+    auto speed_buckets = copy_speed_buckets(builder, histogram);
+
+    // sketches are left out: they're laid out for every segment, and the
+    // coordinator only asks shards for exact answers.
+    ot::HistogramBuilder hbuilder(builder);
+    hbuilder.add_vehicle_type(histogram->vehicle_type());
+    hbuilder.add_segments(segments);
+    if (!vehicle_types.IsNull()) { hbuilder.add_vehicle_types(vehicle_types); }
+    if (!speed_buckets.IsNull()) { hbuilder.add_speed_buckets(speed_buckets); }
+    hbuilder.add_log_count_bits(histogram->log_count_bits());
+    builder.Finish(hbuilder.Finish());
+
+    uint8_t *buf = builder.GetBufferPointer();
+    size_t size = builder.GetSize();
+
+    auto out_verifier = fb::Verifier(buf, size);
+    const bool verified = ot::VerifyHistogramBuffer(out_verifier);
+    if (!verified) {
+      std::cerr << "Warning: shard " << shard << " failed verification.\n";
+    }
+    const tile_footer footer = make_tile_footer(buf, size, verified);
+
+    const std::string filename = "sample.tile.shard." + std::to_string(shard);
+    std::ofstream out(filename);
+    out.write((const char *)buf, (std::streamsize)size);
+    out.write((const char *)&footer, sizeof footer);
+
+    std::cout << filename << ": segments " << first << " to " << (last - 1)
+              << ", " << size << " bytes\n";
+  }
+
+  return 0;
+}
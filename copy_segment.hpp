@@ -0,0 +1,100 @@
+#ifndef COPY_SEGMENT_HPP
+#define COPY_SEGMENT_HPP
+
+#include "histogram_tile_generated.h"
+#include "speed_sketch.hpp"
+#include "shared_vectors.hpp"
+
+namespace detail {
+
+template <typename T>
+flatbuffers::Offset<flatbuffers::Vector<T>> copy_vector(
+  flatbuffers::FlatBufferBuilder &builder, const flatbuffers::Vector<T> *v, shared_vectors *shared) {
+  if (v == nullptr) {
+    return flatbuffers::Offset<flatbuffers::Vector<T>>();
+  }
+  return shared ? shared->create(builder, v->data(), v->size()) : builder.CreateVector(v->data(), v->size());
+}
+
+template <typename T>
+flatbuffers::Offset<flatbuffers::Vector<const T *>> copy_struct_vector(
+  flatbuffers::FlatBufferBuilder &builder, const flatbuffers::Vector<const T *> *v, shared_vectors *shared) {
+  if (v == nullptr) {
+    return flatbuffers::Offset<flatbuffers::Vector<const T *>>();
+  }
+  const T *data = reinterpret_cast<const T *>(v->Data());
+  return shared ? shared->create_structs(builder, data, v->size()) : builder.CreateVectorOfStructs(data, v->size());
+}
+
+} // namespace detail
+
+// deep copies a Segment table, including any optional sections, from one
+// FlatBuffer into a builder for another. with shared, vectors which are the
+// same as one already copied point to it rather than being copied again.
+inline flatbuffers::Offset<OpenTraffic::Segment> copy_segment(
+  flatbuffers::FlatBufferBuilder &builder,
+  const OpenTraffic::Segment *segment,
+  shared_vectors *shared = nullptr) {
+
+  // vectors have to be created before the table is started.
+  auto next_segment_ids = detail::copy_vector(builder, segment->next_segment_ids(), shared);
+  auto entries = detail::copy_struct_vector(builder, segment->entries(), shared);
+  auto day_hour_index = detail::copy_vector(builder, segment->day_hour_index(), shared);
+  auto prefix_counts = detail::copy_vector(builder, segment->prefix_counts(), shared);
+  auto cdf_counts = detail::copy_vector(builder, segment->cdf_counts(), shared);
+  auto packed_day_hours = detail::copy_vector(builder, segment->packed_day_hours(), shared);
+  auto packed_keys = detail::copy_vector(builder, segment->packed_keys(), shared);
+  auto packed_counts = detail::copy_vector(builder, segment->packed_counts(), shared);
+  auto count_escapes = detail::copy_struct_vector(builder, segment->count_escapes(), shared);
+  auto bucket_runs = detail::copy_struct_vector(builder, segment->bucket_runs(), shared);
+  auto run_counts = detail::copy_vector(builder, segment->run_counts(), shared);
+  auto log_counts = detail::copy_vector(builder, segment->log_counts(), shared);
+
+  OpenTraffic::SegmentBuilder sbuilder(builder);
+  sbuilder.add_segment_id(segment->segment_id());
+  if (!next_segment_ids.IsNull()) { sbuilder.add_next_segment_ids(next_segment_ids); }
+  if (!entries.IsNull()) { sbuilder.add_entries(entries); }
+  if (!day_hour_index.IsNull()) { sbuilder.add_day_hour_index(day_hour_index); }
+  if (!prefix_counts.IsNull()) { sbuilder.add_prefix_counts(prefix_counts); }
+  if (!cdf_counts.IsNull()) { sbuilder.add_cdf_counts(cdf_counts); }
+  if (!packed_day_hours.IsNull()) { sbuilder.add_packed_day_hours(packed_day_hours); }
+  if (!packed_keys.IsNull()) { sbuilder.add_packed_keys(packed_keys); }
+  if (!packed_counts.IsNull()) { sbuilder.add_packed_counts(packed_counts); }
+  if (!count_escapes.IsNull()) { sbuilder.add_count_escapes(count_escapes); }
+  if (!bucket_runs.IsNull()) { sbuilder.add_bucket_runs(bucket_runs); }
+  if (!run_counts.IsNull()) { sbuilder.add_run_counts(run_counts); }
+  if (!log_counts.IsNull()) { sbuilder.add_log_counts(log_counts); }
+  return sbuilder.Finish();
+}
+
+// copies a Histogram's speed bucket scheme, if it has one. returns a null
+// offset otherwise.
+inline flatbuffers::Offset<OpenTraffic::SpeedBuckets> copy_speed_buckets(
+  flatbuffers::FlatBufferBuilder &builder,
+  const OpenTraffic::Histogram *histogram) {
+
+  auto buckets = histogram->speed_buckets();
+  if (buckets == nullptr) {
+    return flatbuffers::Offset<OpenTraffic::SpeedBuckets>();
+  }
+  return OpenTraffic::CreateSpeedBuckets(
+    builder, buckets->width(), buckets->count(), buckets->units());
+}
+
+// copies the sketches of segments [first, last) of a Histogram, if it has
+// them. returns a null offset otherwise.
+inline flatbuffers::Offset<flatbuffers::Vector<const OpenTraffic::SpeedSketch *>> copy_sketches(
+  flatbuffers::FlatBufferBuilder &builder,
+  const OpenTraffic::Histogram *histogram,
+  uint32_t first, uint32_t last) {
+
+  auto sketches = histogram->sketches();
+  if (sketches == nullptr || sketches->size() < last * SKETCH_NUM_PARTS) {
+    return flatbuffers::Offset<flatbuffers::Vector<const OpenTraffic::SpeedSketch *>>();
+  }
+  return builder.CreateVectorOfStructs(
+    reinterpret_cast<const OpenTraffic::SpeedSketch *>(sketches->Data()) + first * SKETCH_NUM_PARTS,
+    (last - first) * SKETCH_NUM_PARTS);
+}
+
+#endif /* COPY_SEGMENT_HPP */
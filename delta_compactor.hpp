@@ -0,0 +1,141 @@
+#ifndef DELTA_COMPACTOR_HPP
+#define DELTA_COMPACTOR_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "histogram_tile_generated.h"
+#include "tile_handle.hpp"
+#include "delta_tile.hpp"
+#include "tile_footer.hpp"
+
+// folds a tile_handle's deltas into a new tile, on a thread of its own, once
+// there are more than max_deltas of them or they add up to more than
+// max_delta_bytes. queries carry on against the tile and its deltas while
+// it's compacting, and deltas added meanwhile stay overlaid on the new tile.
+//
+// each new tile is written to output_prefix.N. the one before is removed once
+// the next is published, which doesn't disturb readers still on it since the
+// mapping outlives the name.
+class delta_compactor {
+public:
+  delta_compactor(tile_handle &handle, const std::string &output_prefix,
+                  size_t max_deltas, size_t max_delta_bytes)
+    : handle_(handle), output_prefix_(output_prefix), max_deltas_(max_deltas),
+      max_delta_bytes_(max_delta_bytes), stop_(false), pending_(false), num_compactions_(0) {
+    thread_ = std::thread(&delta_compactor::run, this);
+  }
+
+  ~delta_compactor() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+  }
+
+  delta_compactor(const delta_compactor &) = delete;
+  delta_compactor &operator=(const delta_compactor &) = delete;
+
+  // tells the compactor to look at the deltas again, e.g: after add_delta().
+  void notify() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_ = true;
+    }
+    changed_.notify_all();
+  }
+
+  uint64_t num_compactions() const { return num_compactions_.load(); }
+
+private:
+  void run() {
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this]() { return stop_ || pending_; });
+        if (stop_) {
+          return;
+        }
+        pending_ = false;
+      }
+      try {
+        compact_if_due();
+      } catch (const std::exception &e) {
+        // the deltas are still overlaid, so queries are right, just slower.
+        std::cerr << "Delta compaction failed: " << e.what() << "\n";
+      }
+    }
+  }
+
+  void compact_if_due() {
+    std::shared_ptr<mapped_tile> base;
+    delta_list deltas;
+    handle_.layers(base, deltas);
+    size_t delta_bytes = 0;
+    for (const auto &delta : deltas) {
+      delta_bytes += delta->size();
+    }
+    if (deltas.size() <= max_deltas_ && delta_bytes <= max_delta_bytes_) {
+      return;
+    }
+
+    namespace fb = flatbuffers;
+    fb::FlatBufferBuilder builder(1024 * 1024);
+    compact_deltas(base->tile.histogram(), deltas, builder);
+    uint8_t *buf = builder.GetBufferPointer();
+    size_t size = builder.GetSize();
+    auto verifier = fb::Verifier(buf, size);
+    if (!OpenTraffic::VerifyHistogramBuffer(verifier)) {
+      throw std::runtime_error("Compacted tile failed verification.");
+    }
+    const tile_footer footer = make_tile_footer(buf, size, true);
+
+    const std::string path = output_prefix_ + "." + std::to_string(num_compactions_.load());
+    {
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      out.write((const char *)buf, (std::streamsize)size);
+      out.write((const char *)&footer, sizeof footer);
+      if (!out) {
+        throw std::runtime_error("Unable to write " + path + ".");
+      }
+    }
+
+    try {
+      handle_.swap_compacted(path, base, deltas.size());
+    } catch (...) {
+      std::remove(path.c_str());
+      throw;
+    }
+    if (!last_path_.empty()) {
+      std::remove(last_path_.c_str());
+    }
+    last_path_ = path;
+    ++num_compactions_;
+  }
+
+  tile_handle &handle_;
+  const std::string output_prefix_;
+  const size_t max_deltas_;
+  const size_t max_delta_bytes_;
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  bool stop_;
+  bool pending_;
+
+  std::atomic<uint64_t> num_compactions_;
+  std::string last_path_;
+  std::thread thread_;
+};
+
+#endif /* DELTA_COMPACTOR_HPP */
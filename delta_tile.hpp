@@ -0,0 +1,374 @@
+#ifndef DELTA_TILE_HPP
+#define DELTA_TILE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "histogram_tile_generated.h"
+#include "histogram_delta_generated.h"
+#include "mmapped_file.hpp"
+#include "checked_histogram.hpp"
+#include "fb_histogram_reader.hpp"
+#include "tile_merge.hpp"
+#include "tile_footer.hpp"
+#include "vehicle_types.hpp"
+#include "speed_buckets.hpp"
+#include "query_trace.hpp"
+
+// small tiles of new observations, e.g: a day's, which are overlaid on a
+// Histogram tile at query time rather than rebuilding it for each. a delta
+// holds only the counts to add, keyed by next segment ID rather than index,
+// so it can add turns and segments the tile doesn't have yet. once there are
+// enough of them they're compacted into a new tile, see delta_compactor.hpp.
+
+namespace detail {
+
+inline uint64_t delta_key(const OpenTraffic::DeltaEntry &e) {
+  return (uint64_t(e.segment_id()) << 32) | (uint64_t(e.day_hour()) << 24);
+}
+
+// compares everything but the count, in the order entries are sorted in.
+inline bool delta_entry_less(const OpenTraffic::DeltaEntry &a, const OpenTraffic::DeltaEntry &b) {
+  if (a.segment_id() != b.segment_id()) { return a.segment_id() < b.segment_id(); }
+  if (a.day_hour() != b.day_hour()) { return a.day_hour() < b.day_hour(); }
+  if (a.next_segment_id() != b.next_segment_id()) { return a.next_segment_id() < b.next_segment_id(); }
+  if (a.vehicle_type() != b.vehicle_type()) { return uint8_t(a.vehicle_type()) < uint8_t(b.vehicle_type()); }
+  return a.speed_bucket() < b.speed_bucket();
+}
+
+} // namespace detail
+
+// a mapped and verified delta tile.
+class delta_tile {
+public:
+  explicit delta_tile(const std::string &path, const mmap_policy &policy = mmap_policy())
+    : file_(path, policy), delta_(nullptr), entries_(nullptr), num_entries_(0), num_segments_(0) {
+
+    size_t size = file_.size;
+    tile_footer footer;
+    if (read_tile_footer(file_.buffer, file_.size, footer)) {
+      size = footer.payload_size;
+    }
+    auto verifier = flatbuffers::Verifier((const uint8_t *)file_.buffer, size);
+    if (!OpenTraffic::VerifyHistogramDeltaBuffer(verifier)) {
+      throw std::runtime_error("Delta verification failed.");
+    }
+    delta_ = OpenTraffic::GetHistogramDelta(file_.buffer);
+
+    if (delta_->entries() != nullptr) {
+      entries_ = reinterpret_cast<const OpenTraffic::DeltaEntry *>(delta_->entries()->Data());
+      num_entries_ = delta_->entries()->size();
+    }
+    // lookups are binary searches, so the order has to be right.
+    for (size_t i = 1; i < num_entries_; ++i) {
+      if (!detail::delta_entry_less(entries_[i - 1], entries_[i])) {
+        throw std::runtime_error("Delta entries are out of order.");
+      }
+    }
+    if (num_entries_ > 0) {
+      num_segments_ = entries_[num_entries_ - 1].segment_id() + 1;
+    }
+
+    scheme_ = default_speed_buckets;
+    if (delta_->speed_buckets() != nullptr) {
+      scheme_.width = delta_->speed_buckets()->width();
+      scheme_.count = delta_->speed_buckets()->count();
+      scheme_.units = speed_units(delta_->speed_buckets()->units());
+      check_speed_buckets(scheme_);
+    }
+  }
+
+  delta_tile(const delta_tile &) = delete;
+  delta_tile &operator=(const delta_tile &) = delete;
+
+  const OpenTraffic::HistogramDelta *delta() const { return delta_; }
+
+  // bytes on disk.
+  size_t size() const { return file_.size; }
+
+  size_t num_entries() const { return num_entries_; }
+  const OpenTraffic::DeltaEntry *begin() const { return entries_; }
+  const OpenTraffic::DeltaEntry *end() const { return entries_ + num_entries_; }
+
+  // one past the highest segment ID with an entry.
+  uint32_t num_segments() const { return num_segments_; }
+
+  const speed_bucket_scheme &scheme() const { return scheme_; }
+
+  // the entries for segment_id at day_hour, as [begin, end).
+  void find(uint32_t segment_id, uint32_t day_hour,
+            const OpenTraffic::DeltaEntry *&begin, const OpenTraffic::DeltaEntry *&end) const {
+    if (day_hour > 255) {
+      begin = end = entries_;
+      return;
+    }
+    const uint64_t key = (uint64_t(segment_id) << 32) | (uint64_t(day_hour) << 24);
+    find_range(key, key + (uint64_t(1) << 24), begin, end);
+  }
+
+  // all the entries for segment_id, as [begin, end).
+  void find_segment(uint32_t segment_id,
+                    const OpenTraffic::DeltaEntry *&begin, const OpenTraffic::DeltaEntry *&end) const {
+    const uint64_t key = uint64_t(segment_id) << 32;
+    find_range(key, key + (uint64_t(1) << 32), begin, end);
+  }
+
+private:
+  void find_range(uint64_t from, uint64_t to,
+                  const OpenTraffic::DeltaEntry *&begin, const OpenTraffic::DeltaEntry *&end) const {
+    auto less = [](const OpenTraffic::DeltaEntry &e, uint64_t key) {
+      QUERY_TRACE_TOUCH(&e, sizeof e);
+      return detail::delta_key(e) < key;
+    };
+    begin = std::lower_bound(entries_, entries_ + num_entries_, from, less);
+    end = std::lower_bound(begin, entries_ + num_entries_, to, less);
+  }
+
+  mmapped_file file_;
+  const OpenTraffic::HistogramDelta *delta_;
+  const OpenTraffic::DeltaEntry *entries_;
+  size_t num_entries_;
+  uint32_t num_segments_;
+  speed_bucket_scheme scheme_;
+};
+
+typedef std::vector<std::shared_ptr<const delta_tile> > delta_list;
+
+// throws unless delta can be overlaid on histogram: the speed buckets have to
+// be the same, and it can't add vehicle types the tile doesn't have, since a
+// tile of one type doesn't record the type of each entry.
+inline void check_delta_applies(const OpenTraffic::Histogram *histogram, const delta_tile &delta) {
+  if (delta.scheme() != tile_speed_buckets(histogram)) {
+    throw std::runtime_error("Delta has a different speed bucket scheme to the tile.");
+  }
+  vehicle_type_mask types = 0;
+  if (histogram->vehicle_types() != nullptr) {
+    for (auto type : *(histogram->vehicle_types())) {
+      types |= vehicle_type_bit(OpenTraffic::VehicleType(type));
+    }
+  } else {
+    types = vehicle_type_bit(histogram->vehicle_type());
+  }
+  for (auto e = delta.begin(); e != delta.end(); ++e) {
+    if (!vehicle_type_matches(types, uint8_t(e->vehicle_type()))) {
+      throw std::runtime_error("Delta has vehicle types the tile doesn't.");
+    }
+    if (e->speed_bucket() >= delta.scheme().count) {
+      throw std::runtime_error("Delta entry's speed bucket is out of range.");
+    }
+  }
+}
+
+// histogram_reader.hpp reader for a FlatBuffers tile with deltas overlaid:
+// each segment's entries in the tile, then its entries in each delta. the
+// deltas must have passed check_delta_applies().
+//
+// a route step along a turn only the deltas know about gets an index with
+// delta_turn set and the next segment's ID in the rest, so that it's found
+// even though the tile has no index for it.
+class delta_histogram_reader {
+public:
+  static constexpr uint32_t delta_turn = uint32_t(1) << 30;
+
+  delta_histogram_reader(checked_histogram &tile, const delta_list &deltas,
+                         vehicle_type_mask types = all_vehicle_types)
+    : base_(tile, types), tile_(&tile), deltas_(&deltas), types_(types),
+      base_segments_(base_.num_segments()), num_segments_(base_segments_) {
+    for (const auto &delta : deltas) {
+      num_segments_ = std::max(num_segments_, delta->num_segments());
+    }
+  }
+
+  uint32_t num_segments() const { return num_segments_; }
+
+  template <typename F>
+  void for_each_entry(uint32_t segment_id, uint32_t day_hour, F &&f) const {
+    if (segment_id < base_segments_) {
+      base_.for_each_entry(segment_id, day_hour, f);
+    }
+    for (const auto &delta : *deltas_) {
+      const OpenTraffic::DeltaEntry *begin, *end;
+      QUERY_TRACE_PHASE(entry_search);
+      delta->find(segment_id, day_hour, begin, end);
+      QUERY_TRACE_PHASE(scan);
+      QUERY_TRACE_ENTRIES(end - begin);
+      for (auto e = begin; e != end; ++e) {
+        QUERY_TRACE_TOUCH(e, sizeof *e);
+        if (vehicle_type_matches(types_, uint8_t(e->vehicle_type()))) {
+          f(uint32_t(e->speed_bucket()), uint32_t(e->count()));
+        }
+      }
+    }
+  }
+
+  // the tile's index of to among segment_id's next segments, or delta_turn
+  // and to for a turn the tile doesn't have.
+  int next_segment_index(uint32_t segment_id, uint32_t to) const {
+    if (segment_id < base_segments_) {
+      const int idx = base_.next_segment_index(segment_id, to);
+      if (idx >= 0) {
+        return idx;
+      }
+    }
+    return (to < delta_turn) ? int(delta_turn | to) : -1;
+  }
+
+  template <typename F>
+  void for_each_entry_to(uint32_t segment_id, uint32_t day_hour, uint32_t next_idx, F &&f) const {
+    uint32_t to = next_idx & (delta_turn - 1);
+    if ((next_idx & delta_turn) == 0) {
+      base_.for_each_entry_to(segment_id, day_hour, next_idx, f);
+      to = tile_->segment(segment_id)->next_segment_ids()->Get(next_idx);
+    }
+    for (const auto &delta : *deltas_) {
+      const OpenTraffic::DeltaEntry *begin, *end;
+      QUERY_TRACE_PHASE(entry_search);
+      delta->find(segment_id, day_hour, begin, end);
+      QUERY_TRACE_PHASE(scan);
+      QUERY_TRACE_ENTRIES(end - begin);
+      for (auto e = begin; e != end; ++e) {
+        QUERY_TRACE_TOUCH(e, sizeof *e);
+        if (e->next_segment_id() == to && vehicle_type_matches(types_, uint8_t(e->vehicle_type()))) {
+          f(uint32_t(e->speed_bucket()), uint32_t(e->count()));
+        }
+      }
+    }
+  }
+
+private:
+  fb_histogram_reader base_;
+  checked_histogram *tile_;
+  const delta_list *deltas_;
+  vehicle_type_mask types_;
+  uint32_t base_segments_;
+  uint32_t num_segments_;
+};
+
+// sorts entries into the order a delta needs, summing any with the same key,
+// and finishes builder with a delta of them.
+inline void build_delta_tile(
+  std::vector<OpenTraffic::DeltaEntry> &entries, const speed_bucket_scheme &scheme,
+  flatbuffers::FlatBufferBuilder &builder) {
+
+  namespace ot = OpenTraffic;
+  std::sort(entries.begin(), entries.end(), detail::delta_entry_less);
+  size_t kept = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (kept > 0 && !detail::delta_entry_less(entries[kept - 1], entries[i])) {
+      const uint64_t count = uint64_t(entries[kept - 1].count()) + entries[i].count();
+      if (count > UINT32_MAX) {
+        throw std::runtime_error("Delta count is too big for an entry.");
+      }
+      const ot::DeltaEntry &prev = entries[kept - 1];
+      entries[kept - 1] = ot::DeltaEntry(prev.segment_id(), prev.next_segment_id(), prev.day_hour(),
+                                         prev.speed_bucket(), prev.vehicle_type(), uint32_t(count));
+    } else {
+      entries[kept++] = entries[i];
+    }
+  }
+  entries.resize(kept);
+
+  auto vector = builder.CreateVectorOfStructs(entries);
+  auto speed_buckets = ot::CreateSpeedBuckets(
+    builder, uint8_t(scheme.width), uint16_t(scheme.count), ot::SpeedUnits(scheme.units));
+  ot::HistogramDeltaBuilder dbuilder(builder);
+  dbuilder.add_speed_buckets(speed_buckets);
+  dbuilder.add_entries(vector);
+  builder.Finish(dbuilder.Finish());
+}
+
+// folds deltas into a copy of histogram, finishing builder with it. turns
+// which are new to a segment are added after its existing next segments, so
+// the existing indexes stay the same. like merge_tiles(), the result has
+// plain entries and none of the optional sections.
+inline tile_merge_stats compact_deltas(
+  const OpenTraffic::Histogram *histogram, const delta_list &deltas,
+  flatbuffers::FlatBufferBuilder &builder) {
+
+  namespace ot = OpenTraffic;
+  namespace fb = flatbuffers;
+  for (const auto &delta : deltas) {
+    check_delta_applies(histogram, *delta);
+  }
+
+  uint32_t num_segments = (histogram->segments() != nullptr) ? histogram->segments()->size() : 0;
+  for (const auto &delta : deltas) {
+    num_segments = std::max(num_segments, delta->num_segments());
+  }
+
+  std::vector<int8_t> types;
+  const bool multi_type = histogram->vehicle_types() != nullptr;
+  if (multi_type) {
+    types.assign(histogram->vehicle_types()->begin(), histogram->vehicle_types()->end());
+    std::sort(types.begin(), types.end());
+    types.erase(std::unique(types.begin(), types.end()), types.end());
+  } else {
+    types.push_back(int8_t(histogram->vehicle_type()));
+  }
+
+  tile_merge_stats stats = {num_segments, 0, 0};
+  std::vector<fb::Offset<ot::Segment> > segments_vector;
+  segments_vector.reserve(num_segments);
+  merged_segment out;
+  for (uint32_t segment_id = 0; segment_id < num_segments; ++segment_id) {
+    out.next_segment_ids.clear();
+    out.entries.clear();
+    if (histogram->segments() != nullptr && segment_id < histogram->segments()->size()) {
+      auto segment = histogram->segments()->Get(segment_id);
+      if (segment->next_segment_ids() != nullptr) {
+        if (segment->next_segment_ids()->size() > 256) {
+          throw std::runtime_error("Segment has more than 256 next segments.");
+        }
+        out.next_segment_ids.assign(segment->next_segment_ids()->begin(), segment->next_segment_ids()->end());
+      }
+      detail::read_segment_entries(histogram, segment, out.entries);
+    }
+    const size_t num_base = out.entries.size();
+
+    for (const auto &delta : deltas) {
+      const ot::DeltaEntry *begin, *end;
+      delta->find_segment(segment_id, begin, end);
+      for (auto e = begin; e != end; ++e) {
+        const uint8_t idx = detail::next_segment_index(out.next_segment_ids, e->next_segment_id());
+        out.entries.emplace_back(e->day_hour(), idx, e->speed_bucket(), e->vehicle_type(), e->count());
+      }
+    }
+    stats.entries_in += out.entries.size();
+
+    // the tile's entries are already in order, so only segments the deltas
+    // touched need sorting.
+    if (out.entries.size() > num_base) {
+      std::stable_sort(out.entries.begin(), out.entries.end(), [](const ot::Entry &a, const ot::Entry &b) {
+          return detail::merge_key(a) < detail::merge_key(b);
+        });
+      size_t kept = 0;
+      for (size_t i = 0; i < out.entries.size(); ++i) {
+        const ot::Entry &e = out.entries[i];
+        if (kept > 0 && detail::merge_key(out.entries[kept - 1]) == detail::merge_key(e)) {
+          const ot::Entry &prev = out.entries[kept - 1];
+          const uint64_t count = uint64_t(prev.count()) + e.count();
+          if (count > UINT32_MAX) {
+            throw std::runtime_error("Merged count is too big for an entry.");
+          }
+          out.entries[kept - 1] = ot::Entry(prev.day_hour(), prev.next_segment_idx(), prev.speed_bucket(),
+                                            prev.vehicle_type(), uint32_t(count));
+        } else {
+          out.entries[kept++] = e;
+        }
+      }
+      out.entries.resize(kept);
+    }
+
+    segments_vector.push_back(detail::write_merged_segment(builder, segment_id, out));
+    stats.entries_out += out.entries.size();
+  }
+
+  detail::finish_merged_tile(builder, segments_vector, types, multi_type, tile_speed_buckets(histogram));
+  return stats;
+}
+
+#endif /* DELTA_TILE_HPP */
@@ -0,0 +1,34 @@
+#ifndef ERROR_STATS_HPP
+#define ERROR_STATS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// absolute errors of approximate answers, such as from sketches or log coded
+// counts, against the exact ones.
+struct error_stats {
+  std::vector<double> errors;
+
+  void add(double exact, double approx) {
+    errors.push_back(std::fabs(approx - exact));
+  }
+
+  // prints the mean, p95 and max error, or nothing if there are none.
+  void print(const char *name, const char *units) {
+    if (errors.empty()) {
+      return;
+    }
+    std::sort(errors.begin(), errors.end());
+    double sum = 0;
+    for (auto e : errors) {
+      sum += e;
+    }
+    std::cout << name << " error: mean " << (sum / double(errors.size())) << " "
+              << units << ", p95 " << errors[errors.size() * 95 / 100] << " "
+              << units << ", max " << errors.back() << " " << units << "\n";
+  }
+};
+
+#endif /* ERROR_STATS_HPP */
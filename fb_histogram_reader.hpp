@@ -0,0 +1,171 @@
+#ifndef FB_HISTOGRAM_READER_HPP
+#define FB_HISTOGRAM_READER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#include "histogram_tile_generated.h"
+#include "checked_histogram.hpp"
+#include "bucket_runs.hpp"
+#include "vehicle_types.hpp"
+#include "speed_buckets.hpp"
+#include "query_trace.hpp"
+
+// histogram_reader.hpp reader for FlatBuffers tiles, reading either plain
+// entries or bucket runs, and only the entries for the given vehicle types.
+class fb_histogram_reader {
+public:
+  explicit fb_histogram_reader(checked_histogram &tile, vehicle_type_mask types = all_vehicle_types)
+    : tile_(&tile), mask_(entry_mask(tile.histogram(), types)) {}
+
+  uint32_t num_segments() const {
+    // no segment has anything of interest if none of the types are in it.
+    return (mask_ == 0) ? 0 : tile_->num_segments();
+  }
+
+  template <typename F>
+  void for_each_entry(uint32_t segment_id, uint32_t day_hour, F &&f) const {
+    auto segment = tile_->segment(segment_id);
+    QUERY_TRACE_TOUCH(segment, sizeof(flatbuffers::soffset_t));
+
+    // runs are only written for segments where everything is Auto.
+    auto runs = segment->bucket_runs();
+    auto run_counts = segment->run_counts();
+    if (runs != nullptr && run_counts != nullptr) {
+      if (vehicle_type_matches(mask_, OpenTraffic::VehicleType_Auto)) {
+        for_each_bucket_run_count(
+          reinterpret_cast<const bucket_run *>(runs->Data()), runs->size(),
+          run_counts->data(), run_counts->size(),
+          day_hour, day_hour + 1, f);
+      }
+      return;
+    }
+
+    auto entries = segment->entries();
+    if (entries == nullptr) {
+      return;
+    }
+    QUERY_TRACE_PHASE(entry_search);
+    auto itr = std::lower_bound(
+      entries->begin(), entries->end(),
+      day_hour,
+      [](const OpenTraffic::Entry *lhs, uint32_t rhs) {
+        QUERY_TRACE_TOUCH(lhs, sizeof *lhs);
+        return uint32_t(lhs->day_hour()) < rhs;
+      });
+    QUERY_TRACE_PHASE(scan);
+    while ((itr != entries->end()) && ((*itr)->day_hour() == day_hour)) {
+      QUERY_TRACE_ENTRIES(1);
+      QUERY_TRACE_TOUCH(*itr, sizeof(OpenTraffic::Entry));
+      if (vehicle_type_matches(mask_, uint8_t((*itr)->vehicle_type()))) {
+        f(uint32_t((*itr)->speed_bucket()), uint32_t((*itr)->count()));
+      }
+      ++itr;
+    }
+  }
+
+  // the index of to among segment_id's next segments, or -1 if it isn't one.
+  int next_segment_index(uint32_t segment_id, uint32_t to) const {
+    auto next_segment_ids = tile_->segment(segment_id)->next_segment_ids();
+    if (next_segment_ids == nullptr) {
+      return -1;
+    }
+    for (uint32_t i = 0; i < next_segment_ids->size(); ++i) {
+      if (next_segment_ids->Get(i) == to) {
+        return int(i);
+      }
+    }
+    return -1;
+  }
+
+  // as for_each_entry, but only for entries which went on to segment_id's
+  // next_idx'th next segment.
+  template <typename F>
+  void for_each_entry_to(uint32_t segment_id, uint32_t day_hour, uint32_t next_idx, F &&f) const {
+    auto segment = tile_->segment(segment_id);
+    QUERY_TRACE_TOUCH(segment, sizeof(flatbuffers::soffset_t));
+
+    auto runs = segment->bucket_runs();
+    auto run_counts = segment->run_counts();
+    if (runs != nullptr && run_counts != nullptr) {
+      if (!vehicle_type_matches(mask_, OpenTraffic::VehicleType_Auto)) {
+        return;
+      }
+      const bucket_run *begin = reinterpret_cast<const bucket_run *>(runs->Data());
+      const bucket_run *end = begin + runs->size();
+      QUERY_TRACE_PHASE(entry_search);
+      const bucket_run *run = std::lower_bound(
+        begin, end, day_hour,
+        [](const bucket_run &lhs, uint32_t rhs) {
+          QUERY_TRACE_TOUCH(&lhs, sizeof lhs);
+          return uint32_t(lhs.day_hour) < rhs;
+        });
+      QUERY_TRACE_PHASE(scan);
+      for (; run != end && run->day_hour == day_hour; ++run) {
+        QUERY_TRACE_TOUCH(run, sizeof *run);
+        if (run->next_segment_idx != next_idx) {
+          continue;
+        }
+        if (size_t(run->counts_offset) + run->length > run_counts->size()) {
+          throw std::runtime_error("Bucket run is outside the run counts.");
+        }
+        const uint32_t *c = run_counts->data() + run->counts_offset;
+        QUERY_TRACE_ENTRIES(run->length);
+        QUERY_TRACE_TOUCH(c, run->length * sizeof *c);
+        for (uint32_t i = 0; i < run->length; ++i) {
+          f(uint32_t(run->first_bucket) + i, c[i]);
+        }
+      }
+      return;
+    }
+
+    auto entries = segment->entries();
+    if (entries == nullptr) {
+      return;
+    }
+    QUERY_TRACE_PHASE(entry_search);
+    auto itr = std::lower_bound(
+      entries->begin(), entries->end(),
+      day_hour,
+      [](const OpenTraffic::Entry *lhs, uint32_t rhs) {
+        QUERY_TRACE_TOUCH(lhs, sizeof *lhs);
+        return uint32_t(lhs->day_hour()) < rhs;
+      });
+    QUERY_TRACE_PHASE(scan);
+    while ((itr != entries->end()) && ((*itr)->day_hour() == day_hour)) {
+      QUERY_TRACE_ENTRIES(1);
+      QUERY_TRACE_TOUCH(*itr, sizeof(OpenTraffic::Entry));
+      if ((*itr)->next_segment_idx() == next_idx &&
+          vehicle_type_matches(mask_, uint8_t((*itr)->vehicle_type()))) {
+        f(uint32_t((*itr)->speed_bucket()), uint32_t((*itr)->count()));
+      }
+      ++itr;
+    }
+  }
+
+private:
+  // checked_histogram verifies segments on first use, so isn't const.
+  checked_histogram *tile_;
+  vehicle_type_mask mask_;
+};
+
+// the scheme a SpeedBuckets table records, or the default when there's none.
+inline speed_bucket_scheme speed_buckets_scheme(const OpenTraffic::SpeedBuckets *buckets) {
+  if (buckets == nullptr) {
+    return default_speed_buckets;
+  }
+  speed_bucket_scheme scheme = {
+    uint32_t(buckets->width()), uint32_t(buckets->count()),
+    speed_units(buckets->units())};
+  check_speed_buckets(scheme);
+  return scheme;
+}
+
+// the tile's speed bucket scheme, or the default for tiles which don't record
+// one.
+inline speed_bucket_scheme tile_speed_buckets(const OpenTraffic::Histogram *histogram) {
+  return speed_buckets_scheme(histogram->speed_buckets());
+}
+
+#endif /* FB_HISTOGRAM_READER_HPP */
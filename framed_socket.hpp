@@ -0,0 +1,171 @@
+#ifndef FRAMED_SOCKET_HPP
+#define FRAMED_SOCKET_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// UNIX domain socket plumbing shared by query_server, query_coordinator and
+// query_client, for connections carrying query_protocol.hpp frames.
+
+// a non-blocking connection driven by an epoll loop, which owns it.
+struct framed_connection {
+  int fd;
+  // bytes read which don't make a whole frame yet.
+  std::vector<uint8_t> in;
+  // frames not yet written, from out_offset.
+  std::vector<uint8_t> out;
+  size_t out_offset;
+  // whether the loop is watching for the socket becoming readable, which it
+  // can stop doing while the connection's output is backed up.
+  bool want_read;
+  // whether the loop is watching for the socket becoming writable.
+  bool want_write;
+  // requests read which haven't been answered yet, for loops which bound
+  // how much they'll buffer for a connection.
+  size_t in_flight;
+};
+
+// the bytes a connection will have waiting to be written once its requests
+// in flight are answered with frames of response_size.
+inline size_t pending_output(const framed_connection &c, size_t response_size) {
+  return (c.out.size() - c.out_offset) + c.in_flight * response_size;
+}
+
+// has epoll watch the connection for what's wanted, if that's changed.
+inline void watch_connection(int epoll_fd, uint64_t id, framed_connection &c, bool want_read, bool want_write) {
+  if (want_read == c.want_read && want_write == c.want_write) {
+    return;
+  }
+  epoll_event ev;
+  ev.events = uint32_t(EPOLLRDHUP) | (want_read ? uint32_t(EPOLLIN) : 0u) |
+    (want_write ? uint32_t(EPOLLOUT) : 0u);
+  ev.data.u64 = id;
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c.fd, &ev);
+  c.want_read = want_read;
+  c.want_write = want_write;
+}
+
+inline sockaddr_un unix_address(const std::string &path) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof addr.sun_path) {
+    throw std::runtime_error("Socket path is too long.");
+  }
+  strcpy(addr.sun_path, path.c_str());
+  return addr;
+}
+
+// a non-blocking socket listening at path, replacing anything already there.
+inline int listen_unix(const std::string &path) {
+  const sockaddr_un addr = unix_address(path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    throw std::runtime_error("Unable to create socket.");
+  }
+  unlink(path.c_str());
+  if (bind(fd, (const sockaddr *)&addr, sizeof addr) == -1 || listen(fd, 128) == -1) {
+    close(fd);
+    throw std::runtime_error("Unable to listen on socket.");
+  }
+  return fd;
+}
+
+// connects to path, retrying for up to wait_seconds while nothing is
+// listening there yet, so that a process can be started alongside the
+// servers it talks to.
+inline int connect_unix(const std::string &path, bool nonblocking, double wait_seconds = 0.0) {
+  const sockaddr_un addr = unix_address(path);
+  const auto give_up = std::chrono::steady_clock::now() +
+    std::chrono::microseconds(int64_t(wait_seconds * 1e6));
+  while (true) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+      throw std::runtime_error("Unable to create socket.");
+    }
+    if (connect(fd, (const sockaddr *)&addr, sizeof addr) == 0) {
+      // connecting blocks, which for a local socket is immediate, then the
+      // socket is switched over.
+      if (nonblocking) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      }
+      return fd;
+    }
+    close(fd);
+    if ((errno != ENOENT && errno != ECONNREFUSED) || std::chrono::steady_clock::now() >= give_up) {
+      throw std::runtime_error("Unable to connect to " + path + ".");
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+// writes all of data to a blocking socket.
+inline void write_all(int fd, const std::vector<uint8_t> &data) {
+  size_t offset = 0;
+  while (offset < data.size()) {
+    ssize_t n = send(fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      throw std::runtime_error("Unable to write to socket.");
+    }
+    offset += n;
+  }
+}
+
+// reads everything available on a non-blocking connection into in. returns
+// false if the other end has gone away.
+inline bool read_available(framed_connection &c) {
+  uint8_t buffer[64 * 1024];
+  while (true) {
+    ssize_t n = read(c.fd, buffer, sizeof buffer);
+    if (n > 0) {
+      c.in.insert(c.in.end(), buffer, buffer + n);
+      continue;
+    }
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    return n != 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+}
+
+// writes as much of the connection's output as it can, and has epoll watch
+// for the socket becoming writable if there's any left. returns false if
+// the connection failed.
+inline bool flush_connection(int epoll_fd, uint64_t id, framed_connection &c) {
+  while (c.out_offset < c.out.size()) {
+    ssize_t n = send(c.fd, c.out.data() + c.out_offset, c.out.size() - c.out_offset, MSG_NOSIGNAL);
+    if (n > 0) {
+      c.out_offset += n;
+    } else if (n == -1 && errno == EINTR) {
+      continue;
+    } else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else {
+      return false;
+    }
+  }
+  if (c.out_offset == c.out.size()) {
+    c.out.clear();
+    c.out_offset = 0;
+  }
+
+  watch_connection(epoll_fd, id, c, c.want_read, !c.out.empty());
+  return true;
+}
+
+#endif /* FRAMED_SOCKET_HPP */
@@ -0,0 +1,223 @@
+#ifndef HISTOGRAM_READER_HPP
+#define HISTOGRAM_READER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include "prefix_sums.hpp"
+#include "quantiles.hpp"
+#include "speed_buckets.hpp"
+#include "query_trace.hpp"
+
+// the query core shared by every tile format. it's templated on a reader for
+// the format, rather than calling through an interface, so each format gets
+// its own copy of the hot loop with the reader's accessors inlined into it,
+// and timings between formats compare the formats, not the glue.
+//
+// a reader is any type with:
+//
+//   // number of segments, queries for IDs beyond which are skipped.
+//   uint32_t num_segments() const;
+//
+//   // calls f(speed_bucket, count) for each entry of segment_id at day_hour.
+//   template <typename F>
+//   void for_each_entry(uint32_t segment_id, uint32_t day_hour, F &&f) const;
+//
+// a format which is better read a whole query at a time than segment by
+// segment, such as a columnar one, can instead overload visit_entries() for
+// its reader, and then needn't have either of the above.
+//
+// readers mark the phases of a query with the query_trace.hpp hooks: each
+// segment starts in segment_lookup, and the reader marks entry_search and
+// scan as it gets to them.
+
+// calls f(speed_bucket, count) for each entry of each of segment_ids at
+// day_hour.
+template <typename Reader, typename F>
+void visit_entries(const Reader &reader, const std::set<uint32_t> &segment_ids, uint32_t day_hour, F &&f) {
+  const uint32_t num_segments = reader.num_segments();
+  for (auto segment_id : segment_ids) {
+    if (segment_id >= num_segments) {
+      continue;
+    }
+    QUERY_TRACE_PHASE(segment_lookup);
+    reader.for_each_entry(segment_id, day_hour, f);
+  }
+}
+
+// adds the counts for segment_ids at day_hour into hist.
+template <typename Reader>
+void accumulate_hist(const Reader &reader, const std::set<uint32_t> &segment_ids, uint32_t day_hour, uint32_t *hist) {
+  visit_entries(reader, segment_ids, day_hour, [hist](uint32_t bucket, uint32_t count) {
+      if (bucket < MAX_N_SPEEDS) {
+        hist[bucket] += count;
+      }
+    });
+}
+
+// mean speed of hist, or 0 if it's empty, counting bucket i as the lower
+// edge of its range, i * 5mph. quantile_from_cdf interpolates across the
+// bucket instead, so see there before comparing the two. it prints nothing,
+// as the benchmarks call it from several threads at once; callers report
+// empties.
+inline double mean_speed(const uint32_t *hist) {
+  uint64_t sum = 0, num = 0;
+  for (int i = 0; i < MAX_N_SPEEDS; ++i) {
+    sum += (i * 5) * hist[i];
+    num += hist[i];
+  }
+
+  if (num > 0) {
+    return double(sum) / double(num);
+  } else {
+    return 0.0;
+  }
+}
+
+// mean speed over segment_ids at day_hour.
+template <typename Reader>
+double query_mean_speed(const Reader &reader, const std::set<uint32_t> &segment_ids, uint32_t day_hour) {
+  uint32_t hist[MAX_N_SPEEDS];
+  memset(hist, 0, sizeof hist);
+  accumulate_hist(reader, segment_ids, day_hour, hist);
+  QUERY_TRACE_PHASE(finalise);
+  return mean_speed(hist);
+}
+
+// calls f(speed_bucket, count) for the entries along a route at day_hour: for
+// each segment, only the entries which went on to the next segment of the
+// route, and all of the last segment's entries. a step which isn't a turn the
+// tile knows about has none. this needs a reader which also has:
+//
+//   // the index of to among segment_id's next segments, or -1.
+//   int next_segment_index(uint32_t segment_id, uint32_t to) const;
+//
+//   // as for_each_entry, for entries going on to the next_idx'th next segment.
+//   template <typename F>
+//   void for_each_entry_to(uint32_t segment_id, uint32_t day_hour, uint32_t next_idx, F &&f) const;
+template <typename Reader, typename F>
+void visit_route(const Reader &reader, const std::vector<uint32_t> &route, uint32_t day_hour, F &&f) {
+  const uint32_t num_segments = reader.num_segments();
+  for (size_t i = 0; i < route.size(); ++i) {
+    if (route[i] >= num_segments) {
+      continue;
+    }
+    QUERY_TRACE_PHASE(segment_lookup);
+    if (i + 1 == route.size()) {
+      reader.for_each_entry(route[i], day_hour, f);
+      continue;
+    }
+    const int next_idx = reader.next_segment_index(route[i], route[i + 1]);
+    if (next_idx >= 0) {
+      reader.for_each_entry_to(route[i], day_hour, uint32_t(next_idx), f);
+    }
+  }
+}
+
+// adds the counts along a route at day_hour, as visit_route finds them, into
+// hist.
+template <typename Reader>
+void accumulate_route(const Reader &reader, const std::vector<uint32_t> &route, uint32_t day_hour, uint32_t *hist) {
+  visit_route(reader, route, day_hour, [hist](uint32_t bucket, uint32_t count) {
+      if (bucket < MAX_N_SPEEDS) {
+        hist[bucket] += count;
+      }
+    });
+}
+
+// speed quantiles over segment_ids at day_hour, aggregated on the fly.
+template <typename Reader>
+std::vector<double> query_quantiles(
+  const Reader &reader, const std::set<uint32_t> &segment_ids, uint32_t day_hour,
+  const std::vector<double> &qs) {
+
+  uint32_t hist[MAX_N_SPEEDS];
+  memset(hist, 0, sizeof hist);
+  accumulate_hist(reader, segment_ids, day_hour, hist);
+  QUERY_TRACE_PHASE(finalise);
+  return quantiles_from_hist(hist, qs);
+}
+
+// kernels for tiles with any speed bucket scheme. the common schemes each get
+// a kernel with the bucket width and count as compile-time constants, so that
+// the histogram is a fixed size on the stack and the loops over it unroll as
+// well as the MAX_N_SPEEDS ones above. anything else gets the generic kernel,
+// which sizes the histogram at run time. the kernel is picked once, when the
+// tile is opened, so queries don't pay for the choice.
+template <typename Reader>
+using mean_speed_kernel = double (*)(
+  const speed_bucket_scheme &, const Reader &, const std::set<uint32_t> &, uint32_t);
+
+template <uint32_t Width, uint32_t Count>
+double mean_speed_fixed(const uint32_t *hist) {
+  uint64_t sum = 0, num = 0;
+  for (uint32_t i = 0; i < Count; ++i) {
+    sum += uint64_t(i * Width) * hist[i];
+    num += hist[i];
+  }
+  return (num > 0) ? double(sum) / double(num) : 0.0;
+}
+
+// mean speed, in the scheme's units, for a scheme of Count buckets of Width.
+template <uint32_t Width, uint32_t Count, typename Reader>
+double fixed_mean_speed(
+  const speed_bucket_scheme &, const Reader &reader,
+  const std::set<uint32_t> &segment_ids, uint32_t day_hour) {
+
+  static_assert(Count <= 256, "speed buckets are bytes");
+  uint32_t hist[Count];
+  memset(hist, 0, sizeof hist);
+  visit_entries(reader, segment_ids, day_hour, [&hist](uint32_t bucket, uint32_t count) {
+      if (bucket < Count) {
+        hist[bucket] += count;
+      }
+    });
+  QUERY_TRACE_PHASE(finalise);
+  return mean_speed_fixed<Width, Count>(hist);
+}
+
+template <typename Reader>
+double generic_mean_speed(
+  const speed_bucket_scheme &scheme, const Reader &reader,
+  const std::set<uint32_t> &segment_ids, uint32_t day_hour) {
+
+  std::vector<uint32_t> hist(scheme.count, 0);
+  visit_entries(reader, segment_ids, day_hour, [&hist](uint32_t bucket, uint32_t count) {
+      if (bucket < hist.size()) {
+        hist[bucket] += count;
+      }
+    });
+
+  QUERY_TRACE_PHASE(finalise);
+  uint64_t sum = 0, num = 0;
+  for (uint32_t i = 0; i < scheme.count; ++i) {
+    sum += uint64_t(i * scheme.width) * hist[i];
+    num += hist[i];
+  }
+  return (num > 0) ? double(sum) / double(num) : 0.0;
+}
+
+// the kernel for a scheme. units don't matter to the arithmetic, so schemes
+// with the same width and count in different units share a kernel.
+template <typename Reader>
+mean_speed_kernel<Reader> select_mean_speed_kernel(const speed_bucket_scheme &scheme) {
+  check_speed_buckets(scheme);
+  if (scheme.width == 5 && scheme.count == 24) {
+    // 5 mph to 120 mph, the default.
+    return &fixed_mean_speed<5, 24, Reader>;
+  } else if (scheme.width == 1 && scheme.count == 160) {
+    // 1 km/h to 160 km/h.
+    return &fixed_mean_speed<1, 160, Reader>;
+  } else if (scheme.width == 5 && scheme.count == 40) {
+    // 5 km/h to 200 km/h.
+    return &fixed_mean_speed<5, 40, Reader>;
+  } else if (scheme.width == 1 && scheme.count == 100) {
+    // 1 mph to 100 mph.
+    return &fixed_mean_speed<1, 100, Reader>;
+  }
+  return &generic_mean_speed<Reader>;
+}
+
+#endif /* HISTOGRAM_READER_HPP */
@@ -0,0 +1,89 @@
+#ifndef HOT_SEGMENT_CUBES_HPP
+#define HOT_SEGMENT_CUBES_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "prefix_sums.hpp"
+
+// dense [168][MAX_N_SPEEDS] bucket count cubes for the hottest segments of a
+// tile, built in-process at load time. a query for a cached segment reads one
+// row of its cube instead of searching and scanning its entries.
+//
+// hotness comes from a workload trace of segment IDs, and the number of cubes
+// is limited by a size budget in bytes. each cube is a little under 16KiB.
+class hot_segment_cubes {
+public:
+  static constexpr size_t cube_size = NUM_DAY_HOURS * MAX_N_SPEEDS;
+  static constexpr size_t cube_bytes = cube_size * sizeof(uint32_t);
+
+  // picks the most frequently accessed segments in trace which fit into
+  // budget_bytes. the cubes start out empty, and should be populated with
+  // add() for each of hot_segments().
+  hot_segment_cubes(uint32_t num_segments, const std::vector<uint32_t> &trace, size_t budget_bytes)
+    : slots_(num_segments, -1), hits_(0), misses_(0) {
+
+    std::vector<std::pair<uint64_t, uint32_t> > frequency(num_segments);
+    for (uint32_t i = 0; i < num_segments; ++i) {
+      frequency[i] = std::make_pair(0, i);
+    }
+    for (auto segment_id : trace) {
+      if (segment_id < num_segments) {
+        frequency[segment_id].first += 1;
+      }
+    }
+    // most frequent first, ties broken by segment ID so it's deterministic.
+    std::sort(frequency.begin(), frequency.end(),
+              [](const std::pair<uint64_t, uint32_t> &a, const std::pair<uint64_t, uint32_t> &b) {
+                return (a.first > b.first) || (a.first == b.first && a.second < b.second);
+              });
+
+    const size_t max_cubes = std::min(size_t(num_segments), budget_bytes / cube_bytes);
+    for (size_t i = 0; i < max_cubes && frequency[i].first > 0; ++i) {
+      slots_[frequency[i].second] = int32_t(hot_segments_.size());
+      hot_segments_.push_back(frequency[i].second);
+    }
+    cubes_.assign(hot_segments_.size() * cube_size, 0);
+  }
+
+  const std::vector<uint32_t> &hot_segments() const {
+    return hot_segments_;
+  }
+
+  // add an entry's count to the cube for segment_id, if it's cached.
+  void add(uint32_t segment_id, uint32_t day_hour, uint32_t bucket, uint32_t count) {
+    const int32_t slot = slots_[segment_id];
+    if (slot >= 0 && day_hour < NUM_DAY_HOURS && bucket < MAX_N_SPEEDS) {
+      cubes_[slot * cube_size + day_hour * MAX_N_SPEEDS + bucket] += count;
+    }
+  }
+
+  // the MAX_N_SPEEDS bucket counts for segment_id at day_hour, or nullptr if
+  // the segment isn't cached.
+  const uint32_t *lookup(uint32_t segment_id, uint32_t day_hour) {
+    const int32_t slot = (segment_id < slots_.size()) ? slots_[segment_id] : -1;
+    if (slot < 0) {
+      ++misses_;
+      return nullptr;
+    }
+    ++hits_;
+    return &cubes_[slot * cube_size + day_hour * MAX_N_SPEEDS];
+  }
+
+  size_t num_cubes() const { return hot_segments_.size(); }
+  size_t size_bytes() const { return cubes_.size() * sizeof(uint32_t); }
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+  void reset_counters() { hits_ = 0; misses_ = 0; }
+
+private:
+  // index of the cube for each segment ID, or -1 when it's not cached.
+  std::vector<int32_t> slots_;
+  std::vector<uint32_t> hot_segments_;
+  std::vector<uint32_t> cubes_;
+  uint64_t hits_, misses_;
+};
+
+#endif /* HOT_SEGMENT_CUBES_HPP */
@@ -0,0 +1,100 @@
+#include "histogram_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+
+#include "observations.hpp"
+#include "observation_ingest.hpp"
+#include "speed_buckets.hpp"
+#include "tile_footer.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+void usage(const char *prog) {
+  std::cerr << "Usage: " << prog << " [--threads N] [--segments N] [--min-count N]\n"
+            << "       [--speed-buckets WIDTH,COUNT,UNITS] OUTPUT INPUT...\n"
+            << "  --threads        default all cores.\n"
+            << "  --segments       segments in the network, default 10000.\n"
+            << "  --min-count      fewest observations an entry can have, default 2,\n"
+            << "                   so that no entry is a single trip.\n"
+            << "  --speed-buckets  as for make_sample_tile, default 5,24,mph.\n";
+}
+
+// aggregates batches of raw observations, as written by
+// make_sample_observations, into a tile. see observation_ingest.hpp.
+int main(int argc, char *argv[]) {
+  ingest_options options;
+  options.num_segments = 10000;
+  options.scheme = default_speed_buckets;
+  options.min_count = 2;
+  options.num_threads = std::thread::hardware_concurrency();
+  options.chunk_size = 1 << 20;
+
+  int i = 1;
+  for (; i < argc && strncmp(argv[i], "--", 2) == 0; ++i) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      options.num_threads = unsigned(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--segments") == 0 && i + 1 < argc) {
+      options.num_segments = uint32_t(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--min-count") == 0 && i + 1 < argc) {
+      options.min_count = uint32_t(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--speed-buckets") == 0 && i + 1 < argc) {
+      if (!parse_speed_buckets(argv[++i], options.scheme)) {
+        usage(argv[0]);
+        return 1;
+      }
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (argc - i < 2 || options.num_threads == 0 || options.num_segments == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  const std::string output_path = argv[i++];
+
+  std::vector<std::unique_ptr<observation_file> > files;
+  std::vector<const observation_file *> batches;
+  for (; i < argc; ++i) {
+    mmap_policy policy;
+    policy.advice = mmap_advice::sequential;
+    files.emplace_back(new observation_file(argv[i], policy));
+    batches.push_back(files.back().get());
+  }
+
+  fb::FlatBufferBuilder builder(1024 * 1024);
+  const ingest_stats stats = ingest_observations(batches, options, builder);
+
+  uint8_t *buf = builder.GetBufferPointer();
+  size_t size = builder.GetSize();
+
+  auto verifier = fb::Verifier(buf, size);
+  const bool verified = ot::VerifyHistogramBuffer(verifier);
+  if (!verified) {
+    std::cerr << "Warning: tile failed verification.\n";
+  }
+  const tile_footer footer = make_tile_footer(buf, size, verified);
+
+  std::ofstream out(output_path);
+  out.write((const char *)buf, (std::streamsize)size);
+  out.write((const char *)&footer, sizeof footer);
+
+  const double total_seconds = stats.aggregate_seconds + stats.merge_seconds + stats.write_seconds;
+  std::cout << "Ingested " << stats.observations << " observations from " << batches.size()
+            << " batches, " << stats.rejected << " rejected, into " << stats.keys << " keys.\n";
+  std::cout << stats.suppressed_keys << " keys of " << stats.suppressed_observations
+            << " observations were under the threshold of " << options.min_count
+            << ", leaving " << stats.entries_out << " entries in a tile of " << size << " bytes.\n";
+  std::cout << "aggregate " << stats.aggregate_seconds << "s, merge " << stats.merge_seconds
+            << "s, write " << stats.write_seconds << "s on " << options.num_threads << " threads: "
+            << (double(stats.observations) / total_seconds) << " observations/s, "
+            << (double(stats.observations) / total_seconds / options.num_threads)
+            << " observations/s per core (aggregate alone "
+            << (double(stats.observations) / stats.aggregate_seconds / options.num_threads) << ").\n";
+  return 0;
+}
@@ -0,0 +1,31 @@
+// automatically generated by the FlatBuffers compiler, do not modify
+
+package OpenTraffic;
+
+import java.nio.*;
+import java.lang.*;
+import java.util.*;
+import com.google.flatbuffers.*;
+
+@SuppressWarnings("unused")
+public final class BucketRun extends Struct {
+  public void __init(int _i, ByteBuffer _bb) { bb_pos = _i; bb = _bb; }
+  public BucketRun __assign(int _i, ByteBuffer _bb) { __init(_i, _bb); return this; }
+
+  public int dayHour() { return bb.get(bb_pos + 0) & 0xFF; }
+  public int nextSegmentIdx() { return bb.get(bb_pos + 1) & 0xFF; }
+  public int firstBucket() { return bb.get(bb_pos + 2) & 0xFF; }
+  public int length() { return bb.get(bb_pos + 3) & 0xFF; }
+  public int countsOffset() { return bb.getShort(bb_pos + 4) & 0xFFFF; }
+
+  public static int createBucketRun(FlatBufferBuilder builder, int dayHour, int nextSegmentIdx, int firstBucket, int length, int countsOffset) {
+    builder.prep(2, 6);
+    builder.putShort((short)countsOffset);
+    builder.putByte((byte)length);
+    builder.putByte((byte)firstBucket);
+    builder.putByte((byte)nextSegmentIdx);
+    builder.putByte((byte)dayHour);
+    return builder.offset();
+  }
+}
+
@@ -0,0 +1,25 @@
+// automatically generated by the FlatBuffers compiler, do not modify
+
+package OpenTraffic;
+
+import java.nio.*;
+import java.lang.*;
+import java.util.*;
+import com.google.flatbuffers.*;
+
+@SuppressWarnings("unused")
+public final class CountEscape extends Struct {
+  public void __init(int _i, ByteBuffer _bb) { bb_pos = _i; bb = _bb; }
+  public CountEscape __assign(int _i, ByteBuffer _bb) { __init(_i, _bb); return this; }
+
+  public long entry() { return (long)bb.getInt(bb_pos + 0) & 0xFFFFFFFFL; }
+  public long count() { return (long)bb.getInt(bb_pos + 4) & 0xFFFFFFFFL; }
+
+  public static int createCountEscape(FlatBufferBuilder builder, long entry, long count) {
+    builder.prep(4, 8);
+    builder.putInt((int)count);
+    builder.putInt((int)entry);
+    return builder.offset();
+  }
+}
+
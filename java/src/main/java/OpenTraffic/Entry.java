@@ -15,12 +15,13 @@ public final class Entry extends Struct {
   public int dayHour() { return bb.get(bb_pos + 0) & 0xFF; }
   public int nextSegmentIdx() { return bb.get(bb_pos + 1) & 0xFF; }
   public int speedBucket() { return bb.get(bb_pos + 2) & 0xFF; }
+  public byte vehicleType() { return bb.get(bb_pos + 3); }
   public long count() { return (long)bb.getInt(bb_pos + 4) & 0xFFFFFFFFL; }
 
-  public static int createEntry(FlatBufferBuilder builder, int dayHour, int nextSegmentIdx, int speedBucket, long count) {
+  public static int createEntry(FlatBufferBuilder builder, int dayHour, int nextSegmentIdx, int speedBucket, byte vehicleType, long count) {
     builder.prep(4, 8);
     builder.putInt((int)count);
-    builder.pad(1);
+    builder.putByte(vehicleType);
     builder.putByte((byte)speedBucket);
     builder.putByte((byte)nextSegmentIdx);
     builder.putByte((byte)dayHour);
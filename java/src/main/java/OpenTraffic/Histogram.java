@@ -18,21 +18,45 @@ public final class Histogram extends Table {
   public Segment segments(int j) { return segments(new Segment(), j); }
   public Segment segments(Segment obj, int j) { int o = __offset(6); return o != 0 ? obj.__assign(__indirect(__vector(o) + j * 4), bb) : null; }
   public int segmentsLength() { int o = __offset(6); return o != 0 ? __vector_len(o) : 0; }
+  public byte vehicleTypes(int j) { int o = __offset(8); return o != 0 ? bb.get(__vector(o) + j * 1) : 0; }
+  public int vehicleTypesLength() { int o = __offset(8); return o != 0 ? __vector_len(o) : 0; }
+  public ByteBuffer vehicleTypesAsByteBuffer() { return __vector_as_bytebuffer(8, 1); }
+  public SpeedBuckets speedBuckets() { return speedBuckets(new SpeedBuckets()); }
+  public SpeedBuckets speedBuckets(SpeedBuckets obj) { int o = __offset(10); return o != 0 ? obj.__assign(__indirect(o + bb_pos), bb) : null; }
+  public SpeedSketch sketches(int j) { return sketches(new SpeedSketch(), j); }
+  public SpeedSketch sketches(SpeedSketch obj, int j) { int o = __offset(12); return o != 0 ? obj.__assign(__vector(o) + j * 5, bb) : null; }
+  public int sketchesLength() { int o = __offset(12); return o != 0 ? __vector_len(o) : 0; }
+  public int logCountBits() { int o = __offset(14); return o != 0 ? bb.get(o + bb_pos) & 0xFF : 0; }
 
   public static int createHistogram(FlatBufferBuilder builder,
       byte vehicle_type,
-      int segmentsOffset) {
-    builder.startObject(2);
+      int segmentsOffset,
+      int vehicle_typesOffset,
+      int speed_bucketsOffset,
+      int sketchesOffset,
+      int log_count_bits) {
+    builder.startObject(6);
+    Histogram.addSketches(builder, sketchesOffset);
+    Histogram.addSpeedBuckets(builder, speed_bucketsOffset);
+    Histogram.addVehicleTypes(builder, vehicle_typesOffset);
     Histogram.addSegments(builder, segmentsOffset);
+    Histogram.addLogCountBits(builder, log_count_bits);
     Histogram.addVehicleType(builder, vehicle_type);
     return Histogram.endHistogram(builder);
   }
 
-  public static void startHistogram(FlatBufferBuilder builder) { builder.startObject(2); }
+  public static void startHistogram(FlatBufferBuilder builder) { builder.startObject(6); }
   public static void addVehicleType(FlatBufferBuilder builder, byte vehicleType) { builder.addByte(0, vehicleType, 0); }
   public static void addSegments(FlatBufferBuilder builder, int segmentsOffset) { builder.addOffset(1, segmentsOffset, 0); }
   public static int createSegmentsVector(FlatBufferBuilder builder, int[] data) { builder.startVector(4, data.length, 4); for (int i = data.length - 1; i >= 0; i--) builder.addOffset(data[i]); return builder.endVector(); }
   public static void startSegmentsVector(FlatBufferBuilder builder, int numElems) { builder.startVector(4, numElems, 4); }
+  public static void addVehicleTypes(FlatBufferBuilder builder, int vehicleTypesOffset) { builder.addOffset(2, vehicleTypesOffset, 0); }
+  public static int createVehicleTypesVector(FlatBufferBuilder builder, byte[] data) { builder.startVector(1, data.length, 1); for (int i = data.length - 1; i >= 0; i--) builder.addByte(data[i]); return builder.endVector(); }
+  public static void startVehicleTypesVector(FlatBufferBuilder builder, int numElems) { builder.startVector(1, numElems, 1); }
+  public static void addSpeedBuckets(FlatBufferBuilder builder, int speedBucketsOffset) { builder.addOffset(3, speedBucketsOffset, 0); }
+  public static void addSketches(FlatBufferBuilder builder, int sketchesOffset) { builder.addOffset(4, sketchesOffset, 0); }
+  public static void startSketchesVector(FlatBufferBuilder builder, int numElems) { builder.startVector(5, numElems, 1); }
+  public static void addLogCountBits(FlatBufferBuilder builder, int logCountBits) { builder.addByte(5, (byte)logCountBits, (byte)0); }
   public static int endHistogram(FlatBufferBuilder builder) {
     int o = builder.endObject();
     return o;
@@ -21,25 +21,103 @@ public final class Segment extends Table {
   public Entry entries(int j) { return entries(new Entry(), j); }
   public Entry entries(Entry obj, int j) { int o = __offset(8); return o != 0 ? obj.__assign(__vector(o) + j * 8, bb) : null; }
   public int entriesLength() { int o = __offset(8); return o != 0 ? __vector_len(o) : 0; }
+  public int dayHourIndex(int j) { int o = __offset(10); return o != 0 ? bb.get(__vector(o) + j * 1) & 0xFF : 0; }
+  public int dayHourIndexLength() { int o = __offset(10); return o != 0 ? __vector_len(o) : 0; }
+  public ByteBuffer dayHourIndexAsByteBuffer() { return __vector_as_bytebuffer(10, 1); }
+  public long prefixCounts(int j) { int o = __offset(12); return o != 0 ? (long)bb.getInt(__vector(o) + j * 4) & 0xFFFFFFFFL : 0; }
+  public int prefixCountsLength() { int o = __offset(12); return o != 0 ? __vector_len(o) : 0; }
+  public ByteBuffer prefixCountsAsByteBuffer() { return __vector_as_bytebuffer(12, 4); }
+  public long cdfCounts(int j) { int o = __offset(14); return o != 0 ? (long)bb.getInt(__vector(o) + j * 4) & 0xFFFFFFFFL : 0; }
+  public int cdfCountsLength() { int o = __offset(14); return o != 0 ? __vector_len(o) : 0; }
+  public ByteBuffer cdfCountsAsByteBuffer() { return __vector_as_bytebuffer(14, 4); }
+  public int packedDayHours(int j) { int o = __offset(16); return o != 0 ? bb.get(__vector(o) + j * 1) & 0xFF : 0; }
+  public int packedDayHoursLength() { int o = __offset(16); return o != 0 ? __vector_len(o) : 0; }
+  public ByteBuffer packedDayHoursAsByteBuffer() { return __vector_as_bytebuffer(16, 1); }
+  public int packedKeys(int j) { int o = __offset(18); return o != 0 ? bb.get(__vector(o) + j * 1) & 0xFF : 0; }
+  public int packedKeysLength() { int o = __offset(18); return o != 0 ? __vector_len(o) : 0; }
+  public ByteBuffer packedKeysAsByteBuffer() { return __vector_as_bytebuffer(18, 1); }
+  public int packedCounts(int j) { int o = __offset(20); return o != 0 ? bb.get(__vector(o) + j * 1) & 0xFF : 0; }
+  public int packedCountsLength() { int o = __offset(20); return o != 0 ? __vector_len(o) : 0; }
+  public ByteBuffer packedCountsAsByteBuffer() { return __vector_as_bytebuffer(20, 1); }
+  public CountEscape countEscapes(int j) { return countEscapes(new CountEscape(), j); }
+  public CountEscape countEscapes(CountEscape obj, int j) { int o = __offset(22); return o != 0 ? obj.__assign(__vector(o) + j * 8, bb) : null; }
+  public int countEscapesLength() { int o = __offset(22); return o != 0 ? __vector_len(o) : 0; }
+  public BucketRun bucketRuns(int j) { return bucketRuns(new BucketRun(), j); }
+  public BucketRun bucketRuns(BucketRun obj, int j) { int o = __offset(24); return o != 0 ? obj.__assign(__vector(o) + j * 6, bb) : null; }
+  public int bucketRunsLength() { int o = __offset(24); return o != 0 ? __vector_len(o) : 0; }
+  public long runCounts(int j) { int o = __offset(26); return o != 0 ? (long)bb.getInt(__vector(o) + j * 4) & 0xFFFFFFFFL : 0; }
+  public int runCountsLength() { int o = __offset(26); return o != 0 ? __vector_len(o) : 0; }
+  public ByteBuffer runCountsAsByteBuffer() { return __vector_as_bytebuffer(26, 4); }
+  public int logCounts(int j) { int o = __offset(28); return o != 0 ? bb.get(__vector(o) + j * 1) & 0xFF : 0; }
+  public int logCountsLength() { int o = __offset(28); return o != 0 ? __vector_len(o) : 0; }
+  public ByteBuffer logCountsAsByteBuffer() { return __vector_as_bytebuffer(28, 1); }
 
   public static int createSegment(FlatBufferBuilder builder,
       long segment_id,
       int next_segment_idsOffset,
-      int entriesOffset) {
-    builder.startObject(3);
+      int entriesOffset,
+      int day_hour_indexOffset,
+      int prefix_countsOffset,
+      int cdf_countsOffset,
+      int packed_day_hoursOffset,
+      int packed_keysOffset,
+      int packed_countsOffset,
+      int count_escapesOffset,
+      int bucket_runsOffset,
+      int run_countsOffset,
+      int log_countsOffset) {
+    builder.startObject(13);
+    Segment.addLogCounts(builder, log_countsOffset);
+    Segment.addRunCounts(builder, run_countsOffset);
+    Segment.addBucketRuns(builder, bucket_runsOffset);
+    Segment.addCountEscapes(builder, count_escapesOffset);
+    Segment.addPackedCounts(builder, packed_countsOffset);
+    Segment.addPackedKeys(builder, packed_keysOffset);
+    Segment.addPackedDayHours(builder, packed_day_hoursOffset);
+    Segment.addCdfCounts(builder, cdf_countsOffset);
+    Segment.addPrefixCounts(builder, prefix_countsOffset);
+    Segment.addDayHourIndex(builder, day_hour_indexOffset);
     Segment.addEntries(builder, entriesOffset);
     Segment.addNextSegmentIds(builder, next_segment_idsOffset);
     Segment.addSegmentId(builder, segment_id);
     return Segment.endSegment(builder);
   }
 
-  public static void startSegment(FlatBufferBuilder builder) { builder.startObject(3); }
+  public static void startSegment(FlatBufferBuilder builder) { builder.startObject(13); }
   public static void addSegmentId(FlatBufferBuilder builder, long segmentId) { builder.addInt(0, (int)segmentId, (int)0L); }
   public static void addNextSegmentIds(FlatBufferBuilder builder, int nextSegmentIdsOffset) { builder.addOffset(1, nextSegmentIdsOffset, 0); }
   public static int createNextSegmentIdsVector(FlatBufferBuilder builder, int[] data) { builder.startVector(4, data.length, 4); for (int i = data.length - 1; i >= 0; i--) builder.addInt(data[i]); return builder.endVector(); }
   public static void startNextSegmentIdsVector(FlatBufferBuilder builder, int numElems) { builder.startVector(4, numElems, 4); }
   public static void addEntries(FlatBufferBuilder builder, int entriesOffset) { builder.addOffset(2, entriesOffset, 0); }
   public static void startEntriesVector(FlatBufferBuilder builder, int numElems) { builder.startVector(8, numElems, 4); }
+  public static void addDayHourIndex(FlatBufferBuilder builder, int dayHourIndexOffset) { builder.addOffset(3, dayHourIndexOffset, 0); }
+  public static int createDayHourIndexVector(FlatBufferBuilder builder, byte[] data) { builder.startVector(1, data.length, 1); for (int i = data.length - 1; i >= 0; i--) builder.addByte(data[i]); return builder.endVector(); }
+  public static void startDayHourIndexVector(FlatBufferBuilder builder, int numElems) { builder.startVector(1, numElems, 1); }
+  public static void addPrefixCounts(FlatBufferBuilder builder, int prefixCountsOffset) { builder.addOffset(4, prefixCountsOffset, 0); }
+  public static int createPrefixCountsVector(FlatBufferBuilder builder, int[] data) { builder.startVector(4, data.length, 4); for (int i = data.length - 1; i >= 0; i--) builder.addInt(data[i]); return builder.endVector(); }
+  public static void startPrefixCountsVector(FlatBufferBuilder builder, int numElems) { builder.startVector(4, numElems, 4); }
+  public static void addCdfCounts(FlatBufferBuilder builder, int cdfCountsOffset) { builder.addOffset(5, cdfCountsOffset, 0); }
+  public static int createCdfCountsVector(FlatBufferBuilder builder, int[] data) { builder.startVector(4, data.length, 4); for (int i = data.length - 1; i >= 0; i--) builder.addInt(data[i]); return builder.endVector(); }
+  public static void startCdfCountsVector(FlatBufferBuilder builder, int numElems) { builder.startVector(4, numElems, 4); }
+  public static void addPackedDayHours(FlatBufferBuilder builder, int packedDayHoursOffset) { builder.addOffset(6, packedDayHoursOffset, 0); }
+  public static int createPackedDayHoursVector(FlatBufferBuilder builder, byte[] data) { builder.startVector(1, data.length, 1); for (int i = data.length - 1; i >= 0; i--) builder.addByte(data[i]); return builder.endVector(); }
+  public static void startPackedDayHoursVector(FlatBufferBuilder builder, int numElems) { builder.startVector(1, numElems, 1); }
+  public static void addPackedKeys(FlatBufferBuilder builder, int packedKeysOffset) { builder.addOffset(7, packedKeysOffset, 0); }
+  public static int createPackedKeysVector(FlatBufferBuilder builder, byte[] data) { builder.startVector(1, data.length, 1); for (int i = data.length - 1; i >= 0; i--) builder.addByte(data[i]); return builder.endVector(); }
+  public static void startPackedKeysVector(FlatBufferBuilder builder, int numElems) { builder.startVector(1, numElems, 1); }
+  public static void addPackedCounts(FlatBufferBuilder builder, int packedCountsOffset) { builder.addOffset(8, packedCountsOffset, 0); }
+  public static int createPackedCountsVector(FlatBufferBuilder builder, byte[] data) { builder.startVector(1, data.length, 1); for (int i = data.length - 1; i >= 0; i--) builder.addByte(data[i]); return builder.endVector(); }
+  public static void startPackedCountsVector(FlatBufferBuilder builder, int numElems) { builder.startVector(1, numElems, 1); }
+  public static void addCountEscapes(FlatBufferBuilder builder, int countEscapesOffset) { builder.addOffset(9, countEscapesOffset, 0); }
+  public static void startCountEscapesVector(FlatBufferBuilder builder, int numElems) { builder.startVector(8, numElems, 4); }
+  public static void addBucketRuns(FlatBufferBuilder builder, int bucketRunsOffset) { builder.addOffset(10, bucketRunsOffset, 0); }
+  public static void startBucketRunsVector(FlatBufferBuilder builder, int numElems) { builder.startVector(6, numElems, 2); }
+  public static void addRunCounts(FlatBufferBuilder builder, int runCountsOffset) { builder.addOffset(11, runCountsOffset, 0); }
+  public static int createRunCountsVector(FlatBufferBuilder builder, int[] data) { builder.startVector(4, data.length, 4); for (int i = data.length - 1; i >= 0; i--) builder.addInt(data[i]); return builder.endVector(); }
+  public static void startRunCountsVector(FlatBufferBuilder builder, int numElems) { builder.startVector(4, numElems, 4); }
+  public static void addLogCounts(FlatBufferBuilder builder, int logCountsOffset) { builder.addOffset(12, logCountsOffset, 0); }
+  public static int createLogCountsVector(FlatBufferBuilder builder, byte[] data) { builder.startVector(1, data.length, 1); for (int i = data.length - 1; i >= 0; i--) builder.addByte(data[i]); return builder.endVector(); }
+  public static void startLogCountsVector(FlatBufferBuilder builder, int numElems) { builder.startVector(1, numElems, 1); }
   public static int endSegment(FlatBufferBuilder builder) {
     int o = builder.endObject();
     return o;
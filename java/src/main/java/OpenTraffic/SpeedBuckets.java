@@ -0,0 +1,41 @@
+// automatically generated by the FlatBuffers compiler, do not modify
+
+package OpenTraffic;
+
+import java.nio.*;
+import java.lang.*;
+import java.util.*;
+import com.google.flatbuffers.*;
+
+@SuppressWarnings("unused")
+public final class SpeedBuckets extends Table {
+  public static SpeedBuckets getRootAsSpeedBuckets(ByteBuffer _bb) { return getRootAsSpeedBuckets(_bb, new SpeedBuckets()); }
+  public static SpeedBuckets getRootAsSpeedBuckets(ByteBuffer _bb, SpeedBuckets obj) { _bb.order(ByteOrder.LITTLE_ENDIAN); return (obj.__assign(_bb.getInt(_bb.position()) + _bb.position(), _bb)); }
+  public void __init(int _i, ByteBuffer _bb) { bb_pos = _i; bb = _bb; }
+  public SpeedBuckets __assign(int _i, ByteBuffer _bb) { __init(_i, _bb); return this; }
+
+  public int width() { int o = __offset(4); return o != 0 ? bb.get(o + bb_pos) & 0xFF : 5; }
+  public int count() { int o = __offset(6); return o != 0 ? bb.getShort(o + bb_pos) & 0xFFFF : 24; }
+  public byte units() { int o = __offset(8); return o != 0 ? bb.get(o + bb_pos) : 0; }
+
+  public static int createSpeedBuckets(FlatBufferBuilder builder,
+      int width,
+      int count,
+      byte units) {
+    builder.startObject(3);
+    SpeedBuckets.addCount(builder, count);
+    SpeedBuckets.addUnits(builder, units);
+    SpeedBuckets.addWidth(builder, width);
+    return SpeedBuckets.endSpeedBuckets(builder);
+  }
+
+  public static void startSpeedBuckets(FlatBufferBuilder builder) { builder.startObject(3); }
+  public static void addWidth(FlatBufferBuilder builder, int width) { builder.addByte(0, (byte)width, (byte)5); }
+  public static void addCount(FlatBufferBuilder builder, int count) { builder.addShort(1, (short)count, (short)24); }
+  public static void addUnits(FlatBufferBuilder builder, byte units) { builder.addByte(2, units, 0); }
+  public static int endSpeedBuckets(FlatBufferBuilder builder) {
+    int o = builder.endObject();
+    return o;
+  }
+}
+
@@ -0,0 +1,31 @@
+// automatically generated by the FlatBuffers compiler, do not modify
+
+package OpenTraffic;
+
+import java.nio.*;
+import java.lang.*;
+import java.util.*;
+import com.google.flatbuffers.*;
+
+@SuppressWarnings("unused")
+public final class SpeedSketch extends Struct {
+  public void __init(int _i, ByteBuffer _bb) { bb_pos = _i; bb = _bb; }
+  public SpeedSketch __assign(int _i, ByteBuffer _bb) { __init(_i, _bb); return this; }
+
+  public int count() { return bb.get(bb_pos + 0) & 0xFF; }
+  public int mean() { return bb.get(bb_pos + 1) & 0xFF; }
+  public int p15() { return bb.get(bb_pos + 2) & 0xFF; }
+  public int p50() { return bb.get(bb_pos + 3) & 0xFF; }
+  public int p85() { return bb.get(bb_pos + 4) & 0xFF; }
+
+  public static int createSpeedSketch(FlatBufferBuilder builder, int count, int mean, int p15, int p50, int p85) {
+    builder.prep(1, 5);
+    builder.putByte((byte)p85);
+    builder.putByte((byte)p50);
+    builder.putByte((byte)p15);
+    builder.putByte((byte)mean);
+    builder.putByte((byte)count);
+    return builder.offset();
+  }
+}
+
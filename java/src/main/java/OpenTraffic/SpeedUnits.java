@@ -0,0 +1,14 @@
+// automatically generated by the FlatBuffers compiler, do not modify
+
+package OpenTraffic;
+
+public final class SpeedUnits {
+  private SpeedUnits() { }
+  public static final byte MilesPerHour = 0;
+  public static final byte KilometresPerHour = 1;
+
+  public static final String[] names = { "MilesPerHour", "KilometresPerHour", };
+
+  public static String name(int e) { return names[e]; }
+}
+
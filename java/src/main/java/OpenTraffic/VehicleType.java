@@ -5,8 +5,10 @@ package OpenTraffic;
 public final class VehicleType {
   private VehicleType() { }
   public static final byte Auto = 0;
+  public static final byte Truck = 1;
+  public static final byte Bus = 2;
 
-  public static final String[] names = { "Auto", };
+  public static final String[] names = { "Auto", "Truck", "Bus", };
 
   public static String name(int e) { return names[e]; }
 }
@@ -0,0 +1,153 @@
+#ifndef LOG_COUNTS_HPP
+#define LOG_COUNTS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "packed_entries.hpp"
+
+// counts quantised to 8 or 4 bit log-scale codes, for tiles which can give up
+// a few percent of each count to be smaller. they replace the count bytes and
+// escapes of the packed encoding (see packed_entries.hpp), so an entry is
+// 2.5 or 2 bytes rather than 3 plus escapes.
+//
+// a code is a tiny float: the low mantissa bits have an implied leading 1
+// above them, and the high bits are the exponent. counts with no more bits
+// than the mantissa plus that 1 are exact, and larger ones round to the
+// nearest of 2^mantissa bits steps per doubling:
+//
+//   8 bit codes, 4 mantissa bits: exact to 31, within 3% up to 507904.
+//   4 bit codes, 1 mantissa bit:  exact to 3, within 20% up to 192.
+//
+// counts past the largest code saturate at it. 4 bit codes are two to a
+// byte, with the even numbered entry in the low half.
+
+template <uint32_t Bits> struct log_count_code;
+template <> struct log_count_code<8> { static constexpr uint32_t mantissa_bits = 4; };
+template <> struct log_count_code<4> { static constexpr uint32_t mantissa_bits = 1; };
+
+// the count a code stands for.
+template <uint32_t Bits>
+constexpr uint32_t decode_log_count(uint32_t code) {
+  return ((code & ((1u << Bits) - 1)) >> log_count_code<Bits>::mantissa_bits) == 0 ?
+    (code & ((1u << Bits) - 1)) :
+    ((1u << log_count_code<Bits>::mantissa_bits) |
+     (code & ((1u << log_count_code<Bits>::mantissa_bits) - 1)))
+      << (((code & ((1u << Bits) - 1)) >> log_count_code<Bits>::mantissa_bits) - 1);
+}
+
+static_assert(decode_log_count<8>(31) == 31, "8 bit codes should be exact to 31");
+static_assert(decode_log_count<8>(255) == 507904, "largest 8 bit code");
+static_assert(decode_log_count<4>(15) == 192, "largest 4 bit code");
+
+// the decoded count for every byte value, built at compile time so that the
+// query loop is a load rather than shifts and a branch. the 4 bit table
+// ignores the high half of the byte.
+#define LOG_COUNTS_4(c) decode_log_count<Bits>(c), decode_log_count<Bits>(c + 1), \
+    decode_log_count<Bits>(c + 2), decode_log_count<Bits>(c + 3)
+#define LOG_COUNTS_16(c) LOG_COUNTS_4(c), LOG_COUNTS_4(c + 4), LOG_COUNTS_4(c + 8), LOG_COUNTS_4(c + 12)
+#define LOG_COUNTS_64(c) LOG_COUNTS_16(c), LOG_COUNTS_16(c + 16), LOG_COUNTS_16(c + 32), LOG_COUNTS_16(c + 48)
+
+template <uint32_t Bits>
+struct log_count_table {
+  static constexpr uint32_t values[256] = {
+    LOG_COUNTS_64(0), LOG_COUNTS_64(64), LOG_COUNTS_64(128), LOG_COUNTS_64(192)
+  };
+};
+
+template <uint32_t Bits>
+constexpr uint32_t log_count_table<Bits>::values[256];
+
+#undef LOG_COUNTS_64
+#undef LOG_COUNTS_16
+#undef LOG_COUNTS_4
+
+static_assert(log_count_table<8>::values[200] == decode_log_count<8>(200), "table differs from decode");
+
+// the nearest code to count.
+template <uint32_t Bits>
+inline uint8_t encode_log_count(uint32_t count) {
+  const uint32_t m = log_count_code<Bits>::mantissa_bits;
+  if (count < (2u << m)) {
+    return uint8_t(count);
+  }
+  uint32_t e = 2;
+  while ((count >> (e - 1)) >= (2u << m)) {
+    ++e;
+  }
+  // round to nearest, and ties to an even mantissa, so that they don't all
+  // go the same way and bias sums of counts.
+  uint64_t mantissa = count >> (e - 1);
+  const uint32_t rest = count & ((1u << (e - 1)) - 1), half = 1u << (e - 2);
+  if (rest > half || (rest == half && (mantissa & 1))) {
+    ++mantissa;
+  }
+  if (mantissa == (2u << m)) {
+    // rounded up into the next doubling.
+    mantissa >>= 1;
+    ++e;
+  }
+  const uint64_t code = (uint64_t(e) << m) | (mantissa - (1u << m));
+  return uint8_t(std::min<uint64_t>(code, (1u << Bits) - 1));
+}
+
+// bytes of codes for num_entries entries.
+inline size_t log_counts_size(uint32_t bits, size_t num_entries) {
+  return (bits == 4) ? (num_entries + 1) / 2 : num_entries;
+}
+
+// the code of entry i.
+template <uint32_t Bits>
+inline uint32_t log_count_code_at(const uint8_t *codes, size_t i) {
+  return (Bits == 4) ? (codes[i >> 1] >> ((i & 1) << 2)) & 0xf : codes[i];
+}
+
+// log codes for the counts of a packed segment, including its escaped ones.
+template <uint32_t Bits>
+std::vector<uint8_t> encode_log_counts(const packed_segment &packed) {
+  std::vector<uint8_t> codes(log_counts_size(Bits, packed.counts.size()), 0);
+  auto escape = packed.escapes.begin();
+  for (size_t i = 0; i < packed.counts.size(); ++i) {
+    uint32_t count = packed.counts[i];
+    if (count == PACKED_COUNT_ESCAPE) {
+      count = escape->count;
+      ++escape;
+    }
+    const uint8_t code = encode_log_count<Bits>(count);
+    if (Bits == 4) {
+      codes[i >> 1] |= uint8_t(code << ((i & 1) << 2));
+    } else {
+      codes[i] = code;
+    }
+  }
+  return codes;
+}
+
+// calls f(speed_bucket, count) for packed entries [first, last), with their
+// counts decoded from log codes.
+template <uint32_t Bits, typename F>
+inline void for_each_log_count(
+  const uint8_t *keys, const uint8_t *codes, size_t first, size_t last, F &&f) {
+  const uint32_t *values = log_count_table<Bits>::values;
+  for (size_t i = first; i < last; ++i) {
+    f(keys[i] & PACKED_BUCKET_MASK, values[log_count_code_at<Bits>(codes, i)]);
+  }
+}
+
+// the count of entry i, for code bits only known at run time.
+inline uint32_t log_count_at(uint32_t bits, const uint8_t *codes, size_t i) {
+  switch (bits) {
+  case 8: return log_count_table<8>::values[log_count_code_at<8>(codes, i)];
+  case 4: return log_count_table<4>::values[log_count_code_at<4>(codes, i)];
+  default: throw std::runtime_error("Log counts must be 8 or 4 bits.");
+  }
+}
+
+// the largest count codes of bits can hold.
+inline uint32_t max_log_count(uint32_t bits) {
+  return (bits == 4) ? decode_log_count<4>(15) : decode_log_count<8>(255);
+}
+
+#endif /* LOG_COUNTS_HPP */
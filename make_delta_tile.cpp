@@ -0,0 +1,57 @@
+#include "histogram_tile_generated.h"
+#include "histogram_delta_generated.h"
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+
+#include "mmapped_file.hpp"
+#include "checked_histogram.hpp"
+#include "delta_tile.hpp"
+#include "sample_delta.hpp"
+#include "tile_footer.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+// writes a delta of fake new observations for sample.tile, as a day's worth
+// of new data would be. see delta_tile.hpp.
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 5) {
+    std::cerr << "Usage: " << argv[0] << " OUTPUT [day of the week, default 0] [fraction of segments, default 0.05]\n"
+              << "       [seed, default 12345]\n";
+    return 1;
+  }
+  const std::string output_path = argv[1];
+  const uint32_t day = (argc > 2) ? uint32_t(atoi(argv[2])) : 0;
+  const double fraction = (argc > 3) ? atof(argv[3]) : 0.05;
+  const uint64_t seed = (argc > 4) ? uint64_t(atoll(argv[4])) : 12345;
+  if (day > 6) {
+    std::cerr << "Day must be between 0 and 6.\n";
+    return 1;
+  }
+
+  mmapped_file file("sample.tile");
+  checked_histogram tile(file.buffer, file.size, tile_open_mode::verify_full);
+
+  std::vector<ot::DeltaEntry> entries = sample_delta_entries(tile.histogram(), day, fraction, seed);
+  fb::FlatBufferBuilder builder(1024);
+  build_delta_tile(entries, tile_speed_buckets(tile.histogram()), builder);
+
+  uint8_t *buf = builder.GetBufferPointer();
+  size_t size = builder.GetSize();
+
+  auto verifier = fb::Verifier(buf, size);
+  const bool verified = ot::VerifyHistogramDeltaBuffer(verifier);
+  if (!verified) {
+    std::cerr << "Warning: delta failed verification.\n";
+  }
+  const tile_footer footer = make_tile_footer(buf, size, verified);
+
+  std::ofstream out(output_path);
+  out.write((const char *)buf, (std::streamsize)size);
+  out.write((const char *)&footer, sizeof footer);
+
+  std::cout << "Wrote " << entries.size() << " delta entries for day " << day << ", "
+            << size << " bytes.\n";
+  return 0;
+}
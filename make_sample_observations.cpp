@@ -0,0 +1,65 @@
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <cstdlib>
+
+#include "observations.hpp"
+#include "zipf_workload.hpp"
+
+// writes a batch of fake raw observations for ingest_observations, over the
+// same 10000 segments as make_sample_tile: popular segments get most of the
+// traffic, each goes on to one of a few next segments, and speeds vary around
+// a mean for the segment. there's no empirical evidence for any of it.
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 4) {
+    std::cerr << "Usage: " << argv[0] << " OUTPUT [millions of observations, default 10] [seed, default 12345]\n";
+    return 1;
+  }
+  const std::string output_path = argv[1];
+  const uint64_t count = uint64_t(((argc > 2) ? atof(argv[2]) : 10.0) * 1e6);
+  const uint64_t seed = (argc > 3) ? uint64_t(atoll(argv[3])) : 12345;
+  const uint32_t num_segments = 10000;
+
+  zipf_workload workload(num_segments, 0.8, seed);
+  std::uniform_int_distribution<uint32_t> dist_next(1, 4);
+  std::uniform_int_distribution<uint32_t> dist_mean_speed(2000, 11000);
+  std::normal_distribution<double> dist_speed(0.0, 1200.0);
+  // a week from Sunday 2017-01-01 00:00 UTC, busiest around midday.
+  const uint32_t week_start = 1483228800;
+  std::uniform_int_distribution<uint32_t> dist_day(0, 6);
+  std::normal_distribution<double> dist_second_of_day(12.5 * 3600, 4 * 3600);
+  std::uniform_real_distribution<double> dist_unit(0.0, 1.0);
+
+  std::vector<uint32_t> mean_speed(num_segments);
+  for (auto &s : mean_speed) {
+    s = dist_mean_speed(workload.eng);
+  }
+
+  std::ofstream out(output_path);
+  const observation_file_header header = make_observation_file_header(count);
+  out.write((const char *)&header, sizeof header);
+  std::vector<observation> batch;
+  for (uint64_t written = 0; written < count; written += batch.size()) {
+    batch.clear();
+    while (batch.size() < 1000000 && written + batch.size() < count) {
+      observation o;
+      o.segment_id = workload();
+      o.next_segment_id = o.segment_id + dist_next(workload.eng);
+      double second = dist_second_of_day(workload.eng);
+      second = (second < 0) ? 0 : ((second >= 86400) ? 86399 : second);
+      o.timestamp = week_start + dist_day(workload.eng) * 86400 + uint32_t(second);
+      const double speed = mean_speed[o.segment_id] + dist_speed(workload.eng);
+      o.speed = uint16_t((speed < 0) ? 0 : ((speed > 65535) ? 65535 : speed));
+      const double u = dist_unit(workload.eng);
+      o.vehicle_type = (u < 0.9) ? 0 : ((u < 0.97) ? 1 : 2);
+      o.reserved = 0;
+      batch.push_back(o);
+    }
+    out.write((const char *)batch.data(), std::streamsize(batch.size() * sizeof(observation)));
+  }
+
+  std::cout << "Wrote " << count << " observations, " << (sizeof header + count * sizeof(observation))
+            << " bytes.\n";
+  return 0;
+}
@@ -3,13 +3,85 @@
 #include <fstream>
 #include <random>
 #include <iostream>
+#include <cstring>
+#include <cmath>
 #include "constants.hpp"
+#include "prefix_sums.hpp"
+#include "quantiles.hpp"
+#include "bucket_runs.hpp"
+#include "vehicle_types.hpp"
+#include "speed_buckets.hpp"
+#include "speed_sketch.hpp"
+#include "tile_footer.hpp"
 
 namespace ot = OpenTraffic;
 namespace fb = flatbuffers;
 namespace otpbf = OpenTraffic::pbf;
 
+void usage(const char *prog) {
+  std::cerr << "Usage: " << prog << " [--prefix-sums] [--cdf] [--bucket-runs] [--sketches] [--vehicle-types LIST]\n"
+            << "       [--speed-buckets WIDTH,COUNT,UNITS]\n"
+            << "  --prefix-sums  add per-segment cumulative counts along day_hour for\n"
+            << "                 fast time-range queries.\n"
+            << "  --cdf          add per-segment, per-day_hour cumulative counts across\n"
+            << "                 speed buckets for fast quantile queries.\n"
+            << "  --bucket-runs  store each segment's entries as runs of counts for\n"
+            << "                 adjacent speed buckets instead of one Entry each.\n"
+            << "  --sketches     add a few bytes per segment for each 4 hour part of\n"
+            << "                 the week, for approximate queries.\n"
+            << "  --vehicle-types  comma separated types to generate data for, from\n"
+            << "                 auto, truck and bus. default auto. more than one\n"
+            << "                 stores them all in one tile, sharing the segments.\n"
+            << "  --speed-buckets  COUNT buckets of WIDTH mph or kph each, e.g:\n"
+            << "                 1,160,kph. default 5,24,mph. prefix sums and cdfs\n"
+            << "                 need the default.\n";
+}
+
 int main(int argc, char *argv[]) {
+  bool with_prefix_sums = false;
+  bool with_cdf = false;
+  bool with_bucket_runs = false;
+  bool with_sketches = false;
+  std::vector<ot::VehicleType> vehicle_types = {ot::VehicleType_Auto};
+  speed_bucket_scheme scheme = default_speed_buckets;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--prefix-sums") == 0) {
+      with_prefix_sums = true;
+    } else if (strcmp(argv[i], "--cdf") == 0) {
+      with_cdf = true;
+    } else if (strcmp(argv[i], "--bucket-runs") == 0) {
+      with_bucket_runs = true;
+    } else if (strcmp(argv[i], "--sketches") == 0) {
+      with_sketches = true;
+    } else if (strcmp(argv[i], "--vehicle-types") == 0 && i + 1 < argc) {
+      if (!parse_vehicle_types(argv[++i], vehicle_types)) {
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--speed-buckets") == 0 && i + 1 < argc) {
+      if (!parse_speed_buckets(argv[++i], scheme)) {
+        usage(argv[0]);
+        return 1;
+      }
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if ((with_prefix_sums || with_cdf) && scheme != default_speed_buckets) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // the speed distributions are in 5mph buckets. this maps one of those to the
+  // bucket holding its middle in the tile's scheme, which is the same bucket
+  // for the default scheme.
+  const double units_per_mph = (scheme.units == speed_units::kph) ? 1.609344 : 1.0;
+  auto to_scheme_bucket = [&](int sb) {
+    return int(std::floor((sb * 5 + 2.5) * units_per_mph / scheme.width));
+  };
+  const int max_speed_bucket = int(scheme.count) - 1;
+
   fb::FlatBufferBuilder builder(1024);
 
   std::mt19937_64 eng(12345);
@@ -17,12 +89,19 @@ int main(int argc, char *argv[]) {
   std::discrete_distribution<int> dist_avg_speed_bucket(avg_speed_buckets.begin(), avg_speed_buckets.end());
   std::uniform_int_distribution<int> dist_next_segments(1, 4);
   std::discrete_distribution<int> dist_count(counts.begin(), counts.end());
+  std::uniform_real_distribution<double> dist_unit(0.0, 1.0);
+  const bool multi_type = vehicle_types.size() > 1;
 
   std::vector<fb::Offset<ot::Segment>> segments_vector;
   ot::SegmentBuilder sbuilder(builder);
   auto null_segment = sbuilder.Finish();
 
   otpbf::Histogram pbf_histogram;
+  size_t prefix_sums_size = 0;
+  size_t cdf_size = 0;
+  size_t entries_size = 0;
+  size_t bucket_runs_size = 0;
+  std::vector<speed_sketch> sketches_vector;
 
   for (uint32_t segment_id = 0; segment_id < 10000; ++segment_id) {
     std::vector<ot::Entry> entries_vector;
@@ -31,6 +110,9 @@ int main(int argc, char *argv[]) {
     // be constant across days for real data.
     int num_hours = dist_num_hours(eng);
     if (num_hours == 0) {
+      if (with_sketches) {
+        sketches_vector.resize(sketches_vector.size() + SKETCH_NUM_PARTS, speed_sketch{0, 0, 0, 0, 0});
+      }
       segments_vector.push_back(null_segment);
       auto pbf_segment = pbf_histogram.add_segments();
       pbf_segment->set_segment_id(segment_id);
@@ -52,15 +134,29 @@ int main(int argc, char *argv[]) {
       const int end_hour = start_hour + num_hours;
       for (int hour = start_hour; hour < end_hour; ++hour) {
         for (int n = 0; n < num_next_segments; ++n) {
-          const int sb = dist_avg_speed_bucket(eng);
-          for (int i = -1; i < 2; ++i) {
-            int speed_bucket = sb + i;
-            if (speed_bucket < 0) { speed_bucket = 0; }
-            if (speed_bucket > 24) { speed_bucket = 24; }
-            int count = dist_count(eng) + 1;
-
-            entries_vector.emplace_back(
-              day * 24 + hour, n, speed_bucket, count);
+          for (auto vehicle_type : vehicle_types) {
+            // trucks and buses are rarer and a little slower than autos. again,
+            // no empirical evidence for these.
+            int slowdown = 0;
+            if (vehicle_type == ot::VehicleType_Truck) {
+              if (dist_unit(eng) > 0.5) { continue; }
+              slowdown = 2;
+            } else if (vehicle_type == ot::VehicleType_Bus) {
+              if (dist_unit(eng) > 0.2) { continue; }
+              slowdown = 3;
+            }
+
+            const int sb = to_scheme_bucket(dist_avg_speed_bucket(eng) - slowdown);
+            for (int i = -1; i < 2; ++i) {
+              int speed_bucket = sb + i;
+              if (speed_bucket < 0) { speed_bucket = 0; }
+              if (speed_bucket > max_speed_bucket) { speed_bucket = max_speed_bucket; }
+              int count = dist_count(eng) + 1;
+
+              entries_vector.emplace_back(
+                day * 24 + hour, n, speed_bucket,
+                multi_type ? vehicle_type : ot::VehicleType_Auto, count);
+            }
           }
         }
       }
@@ -77,9 +173,49 @@ int main(int argc, char *argv[]) {
       e->set_next_segment_idx(entry.next_segment_idx());
       e->set_speed_bucket(entry.speed_bucket());
       e->set_count(entry.count());
+      if (multi_type) {
+        e->set_vehicle_type(otpbf::VehicleType(entry.vehicle_type()));
+      }
     }
 
-    auto entries = builder.CreateVectorOfStructs(entries_vector);
+    if (with_sketches) {
+      auto sketches = build_speed_sketches(entries_vector, scheme);
+      sketches_vector.insert(sketches_vector.end(), sketches.begin(), sketches.end());
+    }
+
+    // the day_hour index is shared between the prefix sums and the cdfs.
+    prefix_sums prefix;
+    std::vector<uint32_t> cdf_vector;
+    if (with_prefix_sums || with_cdf) {
+      prefix = build_prefix_sums(entries_vector);
+    }
+    if (with_cdf) {
+      cdf_vector = build_cdf_counts(prefix);
+      for (auto i : prefix.day_hour_index) {
+        pbf_segment->add_day_hour_index(i);
+      }
+      for (auto c : cdf_vector) {
+        pbf_segment->add_cdf_counts(c);
+      }
+    }
+
+    // falls back to plain entries if the segment can't be run-length encoded.
+    bucket_run_segment runs;
+    const bool use_bucket_runs = with_bucket_runs && build_bucket_runs(entries_vector, runs);
+    fb::Offset<fb::Vector<const ot::Entry *>> entries;
+    fb::Offset<fb::Vector<const ot::BucketRun *>> bucket_runs;
+    fb::Offset<fb::Vector<uint32_t>> run_counts;
+    if (use_bucket_runs) {
+      static_assert(sizeof(bucket_run) == sizeof(ot::BucketRun), "bucket run layouts differ");
+      bucket_runs = builder.CreateVectorOfStructs(
+        reinterpret_cast<const ot::BucketRun *>(runs.runs.data()), runs.runs.size());
+      run_counts = builder.CreateVector(runs.counts);
+      bucket_runs_size += runs.runs.size() * sizeof(ot::BucketRun) +
+        runs.counts.size() * sizeof(uint32_t);
+      entries_size += entries_vector.size() * sizeof(ot::Entry);
+    } else {
+      entries = builder.CreateVectorOfStructs(entries_vector);
+    }
 
     std::vector<uint32_t> next_segment_ids_vector;
     for (int n = 0; n < num_next_segments; ++n) {
@@ -87,26 +223,125 @@ int main(int argc, char *argv[]) {
     }
     auto next_segment_ids = builder.CreateVector(next_segment_ids_vector);
 
+    fb::Offset<fb::Vector<uint8_t>> day_hour_index;
+    fb::Offset<fb::Vector<uint32_t>> prefix_counts;
+    fb::Offset<fb::Vector<uint32_t>> cdf_counts;
+    if (with_prefix_sums || with_cdf) {
+      day_hour_index = builder.CreateVector(prefix.day_hour_index);
+    }
+    if (with_prefix_sums) {
+      prefix_counts = builder.CreateVector(prefix.counts);
+      prefix_sums_size += prefix.day_hour_index.size() * sizeof(uint8_t) +
+        prefix.counts.size() * sizeof(uint32_t);
+    }
+    if (with_cdf) {
+      cdf_counts = builder.CreateVector(cdf_vector);
+      cdf_size += cdf_vector.size() * sizeof(uint32_t);
+      if (!with_prefix_sums) {
+        cdf_size += prefix.day_hour_index.size() * sizeof(uint8_t);
+      }
+    }
+
     ot::SegmentBuilder sbuilder(builder);
     sbuilder.add_segment_id(segment_id);
     sbuilder.add_next_segment_ids(next_segment_ids);
-    sbuilder.add_entries(entries);
+    if (use_bucket_runs) {
+      sbuilder.add_bucket_runs(bucket_runs);
+      sbuilder.add_run_counts(run_counts);
+    } else {
+      sbuilder.add_entries(entries);
+    }
+    if (with_prefix_sums || with_cdf) {
+      sbuilder.add_day_hour_index(day_hour_index);
+    }
+    if (with_prefix_sums) {
+      sbuilder.add_prefix_counts(prefix_counts);
+    }
+    if (with_cdf) {
+      sbuilder.add_cdf_counts(cdf_counts);
+    }
     auto segment = sbuilder.Finish();
     segments_vector.push_back(segment);
   }
   auto segments = builder.CreateVector(segments_vector);
+  fb::Offset<fb::Vector<int8_t>> vehicle_types_vector;
+  if (multi_type) {
+    std::vector<int8_t> types(vehicle_types.begin(), vehicle_types.end());
+    vehicle_types_vector = builder.CreateVector(types);
+    for (auto vehicle_type : vehicle_types) {
+      pbf_histogram.add_vehicle_types(otpbf::VehicleType(vehicle_type));
+    }
+  }
+
+  fb::Offset<fb::Vector<const ot::SpeedSketch *>> sketches;
+  if (with_sketches) {
+    static_assert(sizeof(speed_sketch) == sizeof(ot::SpeedSketch), "sketch layouts differ");
+    sketches = builder.CreateVectorOfStructs(
+      reinterpret_cast<const ot::SpeedSketch *>(sketches_vector.data()), sketches_vector.size());
+  }
+  auto speed_buckets = ot::CreateSpeedBuckets(
+    builder, uint8_t(scheme.width), uint16_t(scheme.count), ot::SpeedUnits(scheme.units));
+  auto pbf_speed_buckets = pbf_histogram.mutable_speed_buckets();
+  pbf_speed_buckets->set_width(scheme.width);
+  pbf_speed_buckets->set_count(scheme.count);
+  pbf_speed_buckets->set_units(otpbf::SpeedUnits(scheme.units));
 
   ot::HistogramBuilder hbuilder(builder);
-  hbuilder.add_vehicle_type(ot::VehicleType_Auto);
+  hbuilder.add_vehicle_type(vehicle_types.front());
+  if (vehicle_types.front() != ot::VehicleType_Auto) {
+    pbf_histogram.set_vehicle_type(otpbf::VehicleType(vehicle_types.front()));
+  }
   hbuilder.add_segments(segments);
+  if (multi_type) {
+    hbuilder.add_vehicle_types(vehicle_types_vector);
+  }
+  hbuilder.add_speed_buckets(speed_buckets);
+  if (with_sketches) {
+    hbuilder.add_sketches(sketches);
+  }
   auto histogram = hbuilder.Finish();
 
   builder.Finish(histogram);
   uint8_t *buf = builder.GetBufferPointer();
   int size = builder.GetSize();
 
+  // the footer records that the tile passed verification here, so that
+  // readers can skip it.
+  auto verifier = fb::Verifier(buf, size);
+  const bool verified = ot::VerifyHistogramBuffer(verifier);
+  if (!verified) {
+    std::cerr << "Warning: generated tile failed verification.\n";
+  }
+  const tile_footer footer = make_tile_footer(buf, size, verified);
+
   std::ofstream out("sample.tile");
   out.write((const char *)buf, (std::streamsize)size);
+  out.write((const char *)&footer, sizeof footer);
+
+  // overheads are relative to the tile without any of the optional sections.
+  const size_t sketches_size = sketches_vector.size() * sizeof(speed_sketch);
+  const double base_size = double(size - prefix_sums_size - cdf_size - sketches_size);
+  if (with_prefix_sums) {
+    std::cout << "Prefix sums use " << prefix_sums_size << " bytes of the "
+              << size << " byte tile (" << (100.0 * prefix_sums_size / base_size)
+              << "% overhead).\n";
+  }
+  if (with_cdf) {
+    std::cout << "CDFs use " << cdf_size << " bytes of the "
+              << size << " byte tile (" << (100.0 * cdf_size / base_size)
+              << "% overhead).\n";
+  }
+
+  if (with_sketches) {
+    std::cout << "Sketches use " << sketches_size << " bytes of the "
+              << size << " byte tile (" << (100.0 * sketches_size / base_size)
+              << "% overhead).\n";
+  }
+
+  if (with_bucket_runs) {
+    std::cout << "Bucket runs use " << bucket_runs_size << " bytes for entries which take "
+              << entries_size << " bytes as Entry structs.\n";
+  }
 
   std::ofstream pbf_out("sample.tile.pbf");
   pbf_histogram.SerializeToOstream(&pbf_out);
@@ -0,0 +1,77 @@
+#include "histogram_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+
+#include "mmapped_file.hpp"
+#include "tile_merge.hpp"
+#include "tile_footer.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+// merges tiles for consecutive windows of time, e.g: weeks, into one for the
+// whole, e.g: a month, by summing their counts. see tile_merge.hpp.
+int main(int argc, char *argv[]) {
+  unsigned int num_threads = std::thread::hardware_concurrency();
+  int first_arg = 1;
+  if (argc > 2 && strcmp(argv[1], "--threads") == 0) {
+    num_threads = unsigned(atoi(argv[2]));
+    first_arg = 3;
+  }
+  if (argc - first_arg < 2 || num_threads == 0) {
+    std::cerr << "Usage: " << argv[0] << " [--threads N, default all cores] OUTPUT INPUT...\n";
+    return 1;
+  }
+  const std::string output_path = argv[first_arg];
+
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+  steady_clock::time_point t0 = steady_clock::now();
+
+  std::vector<std::unique_ptr<mmapped_file> > files;
+  std::vector<const ot::Histogram *> inputs;
+  size_t input_size = 0;
+  for (int i = first_arg + 1; i < argc; ++i) {
+    files.emplace_back(new mmapped_file(argv[i]));
+    const mmapped_file &f = *files.back();
+    auto verifier = fb::Verifier((const uint8_t *)f.buffer, f.size);
+    if (!ot::VerifyHistogramBuffer(verifier)) {
+      throw std::runtime_error(std::string("Buffer verification failed for ") + argv[i] + ".");
+    }
+    inputs.push_back(ot::GetHistogram(f.buffer));
+    input_size += f.size;
+  }
+
+  fb::FlatBufferBuilder builder(1024 * 1024);
+  const tile_merge_stats stats = merge_tiles(inputs, builder, num_threads);
+  steady_clock::time_point t1 = steady_clock::now();
+
+  uint8_t *buf = builder.GetBufferPointer();
+  size_t size = builder.GetSize();
+
+  // nothing is written unless the merged tile verifies, so a bad merge
+  // can't replace a good tile.
+  auto out_verifier = fb::Verifier(buf, size);
+  if (!ot::VerifyHistogramBuffer(out_verifier)) {
+    std::cerr << "Merged tile failed verification, not writing " << output_path << ".\n";
+    return 1;
+  }
+  const tile_footer footer = make_tile_footer(buf, size, true);
+
+  std::ofstream out(output_path);
+  out.write((const char *)buf, (std::streamsize)size);
+  out.write((const char *)&footer, sizeof footer);
+
+  std::cout << "Merged " << inputs.size() << " tiles of " << stats.num_segments << " segments, "
+            << stats.entries_in << " entries into " << stats.entries_out << ", in "
+            << duration_cast<duration<double>>(t1 - t0).count() << "s on " << num_threads
+            << " threads.\n";
+  std::cout << "Merged tile is " << size << " bytes from " << input_size << ".\n";
+
+  return 0;
+}
@@ -0,0 +1,187 @@
+#ifndef MMAPPED_FILE_HPP
+#define MMAPPED_FILE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// how the pages of a mapped tile are backed.
+enum class mmap_backing {
+  // a private, read-only mapping of the file, paged by the kernel.
+  file,
+  // a copy of the file in anonymous memory, which is placed on the NUMA node
+  // of the thread which constructs it (first touch).
+  anonymous,
+  // as anonymous, but aligned to 2MiB and advised MADV_HUGEPAGE so that it
+  // can be backed by transparent huge pages.
+  transparent_huge_pages,
+  // as anonymous, but allocated from the hugetlbfs pool with MAP_HUGETLB,
+  // which has to have been reserved, e.g: via /proc/sys/vm/nr_hugepages.
+  hugetlb
+};
+
+// madvise access pattern hint for the mapping.
+enum class mmap_advice {
+  normal,
+  random,
+  sequential,
+  willneed
+};
+
+struct mmap_policy {
+  mmap_policy() : backing(mmap_backing::file), populate(false), huge_pages(false), advice(mmap_advice::normal) {}
+
+  mmap_backing backing;
+
+  // MAP_POPULATE: fault in the whole file when it's mapped, rather than on
+  // first access.
+  bool populate;
+
+  // MADV_HUGEPAGE on a file mapping. this only has an effect on kernels and
+  // filesystems which support huge pages for the page cache.
+  bool huge_pages;
+
+  mmap_advice advice;
+};
+
+struct mmapped_file {
+  mmapped_file(const std::string &path, const mmap_policy &policy = mmap_policy())
+    : size(0), buffer(nullptr), mapped_size(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      throw std::runtime_error("Unable to open input file.");
+    }
+    struct stat st;
+    int status = fstat(fd, &st);
+    if (status != 0) {
+      close(fd);
+      throw std::runtime_error("Unable to stat input file.");
+    }
+    size = st.st_size;
+
+    try {
+      if (policy.backing == mmap_backing::file) {
+        map_file(fd, policy);
+      } else {
+        copy_file(fd, policy);
+      }
+    } catch (...) {
+      close(fd);
+      throw;
+    }
+    close(fd);
+
+    int advice = MADV_NORMAL;
+    switch (policy.advice) {
+    case mmap_advice::normal:     advice = MADV_NORMAL; break;
+    case mmap_advice::random:     advice = MADV_RANDOM; break;
+    case mmap_advice::sequential: advice = MADV_SEQUENTIAL; break;
+    case mmap_advice::willneed:   advice = MADV_WILLNEED; break;
+    }
+    if (advice != MADV_NORMAL) {
+      madvise(buffer, mapped_size, advice);
+    }
+  }
+
+  ~mmapped_file() {
+    munmap(buffer, mapped_size);
+  }
+
+  mmapped_file(const mmapped_file &) = delete;
+  mmapped_file &operator=(const mmapped_file &) = delete;
+
+  size_t size;
+  void *buffer;
+
+private:
+  static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+  void map_file(int fd, const mmap_policy &policy) {
+    const int flags = MAP_PRIVATE | (policy.populate ? MAP_POPULATE : 0);
+    mapped_size = size;
+    buffer = mmap(NULL, mapped_size, PROT_READ, flags, fd, 0);
+    if (buffer == MAP_FAILED) {
+      throw std::runtime_error("Unable to mmap input file.");
+    }
+#ifdef MADV_HUGEPAGE
+    if (policy.huge_pages) {
+      madvise(buffer, mapped_size, MADV_HUGEPAGE);
+    }
+#endif
+  }
+
+  // reads the file into anonymous memory. the copy is always fully
+  // populated, since reading it in touches every page.
+  void copy_file(int fd, const mmap_policy &policy) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    mapped_size = size;
+    if (policy.backing != mmap_backing::anonymous) {
+      mapped_size = (size + huge_page_size - 1) & ~(huge_page_size - 1);
+    }
+    if (policy.backing == mmap_backing::hugetlb) {
+#ifdef MAP_HUGETLB
+      flags |= MAP_HUGETLB;
+#else
+      throw std::runtime_error("MAP_HUGETLB is not supported on this platform.");
+#endif
+    }
+
+    void *region = (policy.backing == mmap_backing::transparent_huge_pages)
+      ? map_aligned(mapped_size, huge_page_size)
+      : mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (region == MAP_FAILED) {
+      throw std::runtime_error("Unable to allocate memory for input file.");
+    }
+
+#ifdef MADV_HUGEPAGE
+    if (policy.backing == mmap_backing::transparent_huge_pages) {
+      madvise(region, mapped_size, MADV_HUGEPAGE);
+    }
+#endif
+
+    size_t offset = 0;
+    while (offset < size) {
+      ssize_t n = pread(fd, (char *)region + offset, size - offset, offset);
+      if (n <= 0) {
+        munmap(region, mapped_size);
+        throw std::runtime_error("Unable to read input file.");
+      }
+      offset += n;
+    }
+
+    mprotect(region, mapped_size, PROT_READ);
+    buffer = region;
+  }
+
+  // anonymous memory of length bytes, a multiple of the page size, starting
+  // at a multiple of alignment. mmap only promises page alignment, so this
+  // maps alignment bytes more than needed and unmaps what's either side.
+  static void *map_aligned(size_t length, size_t alignment) {
+    const size_t padded = length + alignment;
+    void *region = mmap(NULL, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+      return MAP_FAILED;
+    }
+    char *start = (char *)region;
+    char *aligned = (char *)((uintptr_t(start) + alignment - 1) & ~uintptr_t(alignment - 1));
+    if (aligned != start) {
+      munmap(start, aligned - start);
+    }
+    const size_t tail = (start + padded) - (aligned + length);
+    if (tail > 0) {
+      munmap(aligned + length, tail);
+    }
+    return aligned;
+  }
+
+  size_t mapped_size;
+};
+
+#endif /* MMAPPED_FILE_HPP */
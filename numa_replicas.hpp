@@ -0,0 +1,75 @@
+#ifndef NUMA_REPLICAS_HPP
+#define NUMA_REPLICAS_HPP
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <numa.h>
+#include <sched.h>
+
+#include "mmapped_file.hpp"
+
+// one in-memory copy of a tile per NUMA node, each placed on its own node.
+// query threads should be pinned to a node with pin_to_node() and then use
+// local(), so that they never read from a remote node's memory.
+//
+// on machines without NUMA support, there's a single replica.
+class numa_replicas {
+public:
+  numa_replicas(const std::string &path, mmap_policy policy) {
+    if (policy.backing == mmap_backing::file) {
+      // a file mapping shares the page cache, which can't be replicated.
+      policy.backing = mmap_backing::anonymous;
+    }
+
+    const int num_nodes = (numa_available() < 0) ? 1 : numa_max_node() + 1;
+    replicas_.resize(num_nodes);
+    for (int node = 0; node < num_nodes; ++node) {
+      if (num_nodes > 1 && !numa_bitmask_isbitset(numa_all_nodes_ptr, node)) {
+        continue;
+      }
+      // the copy is made by a thread running on the node, and the pages are
+      // placed by first touch.
+      std::thread loader([&]() {
+          if (num_nodes > 1) {
+            numa_run_on_node(node);
+            numa_set_localalloc();
+          }
+          replicas_[node].reset(new mmapped_file(path, policy));
+        });
+      loader.join();
+    }
+  }
+
+  int num_nodes() const { return int(replicas_.size()); }
+
+  // the replica on node, or nullptr if the node has no memory.
+  const mmapped_file *replica(int node) const {
+    return replicas_[node].get();
+  }
+
+  // the replica local to the calling thread's current CPU.
+  const mmapped_file *local() const {
+    int node = 0;
+    if (replicas_.size() > 1) {
+      node = numa_node_of_cpu(sched_getcpu());
+    }
+    if (node < 0 || size_t(node) >= replicas_.size() || !replicas_[node]) {
+      node = 0;
+    }
+    return replicas_[node].get();
+  }
+
+  // restrict the calling thread to the CPUs of node.
+  static void pin_to_node(int node) {
+    if (numa_available() >= 0) {
+      numa_run_on_node(node);
+    }
+  }
+
+private:
+  std::vector<std::unique_ptr<mmapped_file> > replicas_;
+};
+
+#endif /* NUMA_REPLICAS_HPP */
@@ -0,0 +1,322 @@
+#ifndef OBSERVATION_INGEST_HPP
+#define OBSERVATION_INGEST_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "histogram_tile_generated.h"
+#include "observations.hpp"
+#include "tile_merge.hpp"
+#include "run_on_threads.hpp"
+#include "speed_buckets.hpp"
+
+// aggregates raw observations into a tile. it's done in three phases:
+//
+//   aggregate: threads take chunks of the batches in turn, bucket each
+//     observation into its day_hour and speed bucket and count it in a hash
+//     map of their own. each thread has a map per partition, where partitions
+//     are contiguous ranges of segment IDs, one per thread.
+//   merge: each thread takes a partition and merges every thread's map for
+//     it, drops entries with fewer than min_count observations, which would
+//     identify a single trip, then sorts what's left into its segments.
+//   write: the segments are written to the builder in order.
+//
+// no thread ever writes to another's map, so there's no locking but for
+// handing out chunks. next_segment_ids are sorted by ID, so each segment's
+// entries come out of the sort in the order the tile needs.
+
+struct ingest_options {
+  // segments in the network. observations of others are rejected.
+  uint32_t num_segments;
+  speed_bucket_scheme scheme;
+  // the anonymisation threshold.
+  uint32_t min_count;
+  unsigned int num_threads;
+  // observations per chunk handed out in the aggregate phase.
+  uint64_t chunk_size;
+};
+
+struct ingest_stats {
+  uint64_t observations;
+  // observations for segments outside the network, or of unknown vehicle
+  // types.
+  uint64_t rejected;
+  // distinct (segment, day_hour, next segment, vehicle type, speed bucket)
+  // keys, and those of them below the threshold.
+  uint64_t keys;
+  uint64_t suppressed_keys;
+  uint64_t suppressed_observations;
+  uint64_t entries_out;
+  double aggregate_seconds;
+  double merge_seconds;
+  double write_seconds;
+};
+
+namespace detail {
+
+// a count for a key of segment_id << 32 | next_segment_id and
+// day_hour << 16 | vehicle_type << 8 | speed_bucket.
+struct observation_count {
+  uint64_t segments;
+  uint32_t bins;
+  uint32_t count;
+};
+
+inline bool observation_count_less(const observation_count &a, const observation_count &b) {
+  const uint32_t a_segment = uint32_t(a.segments >> 32), b_segment = uint32_t(b.segments >> 32);
+  if (a_segment != b_segment) { return a_segment < b_segment; }
+  if ((a.bins >> 16) != (b.bins >> 16)) { return (a.bins >> 16) < (b.bins >> 16); }
+  if (uint32_t(a.segments) != uint32_t(b.segments)) { return uint32_t(a.segments) < uint32_t(b.segments); }
+  return (a.bins & 0xffff) < (b.bins & 0xffff);
+}
+
+// an open addressing hash map of counts, with linear probing. this is the
+// aggregate phase's inner loop, and a node based map would spend most of it
+// allocating. a zero count marks an empty slot.
+class observation_counts {
+public:
+  observation_counts() : slots_(1024), size_(0) {}
+
+  void add(uint64_t segments, uint32_t bins, uint32_t count) {
+    if ((size_ + 1) * 2 > slots_.size()) {
+      grow();
+    }
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = hash(segments, bins) & mask; ; i = (i + 1) & mask) {
+      observation_count &slot = slots_[i];
+      if (slot.count == 0) {
+        slot.segments = segments;
+        slot.bins = bins;
+        slot.count = count;
+        ++size_;
+        return;
+      }
+      if (slot.segments == segments && slot.bins == bins) {
+        const uint64_t sum = uint64_t(slot.count) + count;
+        if (sum > UINT32_MAX) {
+          throw std::runtime_error("Observation count is too big for an entry.");
+        }
+        slot.count = uint32_t(sum);
+        return;
+      }
+    }
+  }
+
+  size_t size() const { return size_; }
+
+  template <typename F>
+  void for_each(F &&f) const {
+    for (const auto &slot : slots_) {
+      if (slot.count != 0) {
+        f(slot);
+      }
+    }
+  }
+
+  // frees the memory, rather than just emptying the map.
+  void release() {
+    std::vector<observation_count>(1024).swap(slots_);
+    size_ = 0;
+  }
+
+private:
+  static size_t hash(uint64_t segments, uint32_t bins) {
+    uint64_t h = (segments ^ (uint64_t(bins) << 7)) * 0x9e3779b97f4a7c15ull;
+    return size_t(h ^ (h >> 32));
+  }
+
+  void grow() {
+    std::vector<observation_count> old(slots_.size() * 2);
+    old.swap(slots_);
+    size_ = 0;
+    for (const auto &slot : old) {
+      if (slot.count != 0) {
+        add(slot.segments, slot.bins, slot.count);
+      }
+    }
+  }
+
+  std::vector<observation_count> slots_;
+  size_t size_;
+};
+
+// the partition which segment_id falls in.
+inline uint32_t ingest_partition(uint32_t segment_id, uint32_t num_segments, uint32_t num_partitions) {
+  return uint32_t(uint64_t(segment_id) * num_partitions / num_segments);
+}
+
+inline uint32_t ingest_partition_start(uint32_t partition, uint32_t num_segments, uint32_t num_partitions) {
+  // the first ID whose partition is this one.
+  return uint32_t((uint64_t(partition) * num_segments + num_partitions - 1) / num_partitions);
+}
+
+} // namespace detail
+
+// aggregates every observation in batches into builder, finishing it. the
+// tile has plain entries and none of the optional sections, which the
+// converters can add.
+inline ingest_stats ingest_observations(
+  const std::vector<const observation_file *> &batches, const ingest_options &options,
+  flatbuffers::FlatBufferBuilder &builder) {
+
+  namespace ot = OpenTraffic;
+  namespace fb = flatbuffers;
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+  if (options.num_segments == 0 || options.num_threads == 0 || options.chunk_size == 0) {
+    throw std::runtime_error("Nothing to ingest into.");
+  }
+  check_speed_buckets(options.scheme);
+  const unsigned int num_threads = options.num_threads;
+  const uint32_t num_partitions = std::min(uint32_t(num_threads), options.num_segments);
+
+  struct chunk {
+    const observation *begin;
+    const observation *end;
+  };
+  std::vector<chunk> chunks;
+  ingest_stats stats = {};
+  for (auto batch : batches) {
+    for (uint64_t i = 0; i < batch->size(); i += options.chunk_size) {
+      const uint64_t n = std::min(options.chunk_size, batch->size() - i);
+      chunks.push_back(chunk{batch->data() + i, batch->data() + i + n});
+    }
+    stats.observations += batch->size();
+  }
+
+  // aggregate.
+  steady_clock::time_point t0 = steady_clock::now();
+  std::vector<std::vector<detail::observation_counts> > maps(
+    num_threads, std::vector<detail::observation_counts>(num_partitions));
+  std::vector<uint64_t> rejected(num_threads, 0);
+  std::atomic<size_t> next_chunk(0);
+  detail::run_on_threads(num_threads, [&](unsigned int t) {
+      std::vector<detail::observation_counts> &partitions = maps[t];
+      uint64_t bad = 0;
+      for (size_t c = next_chunk++; c < chunks.size(); c = next_chunk++) {
+        for (const observation *o = chunks[c].begin; o != chunks[c].end; ++o) {
+          if (o->segment_id >= options.num_segments || o->vehicle_type > ot::VehicleType_MAX) {
+            ++bad;
+            continue;
+          }
+          const uint32_t bins = (observation_day_hour(o->timestamp) << 16) |
+            (uint32_t(o->vehicle_type) << 8) | observation_speed_bucket(o->speed, options.scheme);
+          partitions[detail::ingest_partition(o->segment_id, options.num_segments, num_partitions)].add(
+            (uint64_t(o->segment_id) << 32) | o->next_segment_id, bins, 1);
+        }
+      }
+      rejected[t] = bad;
+    });
+  for (auto r : rejected) {
+    stats.rejected += r;
+  }
+
+  // merge, one partition per thread.
+  steady_clock::time_point t1 = steady_clock::now();
+  struct partition_result {
+    std::vector<merged_segment> segments;
+    uint64_t keys, suppressed_keys, suppressed_observations;
+    uint32_t types;
+  };
+  std::vector<partition_result> results(num_partitions);
+  detail::run_on_threads(num_partitions, [&](unsigned int p) {
+      partition_result &result = results[p];
+      detail::observation_counts merged;
+      for (unsigned int t = 0; t < num_threads; ++t) {
+        maps[t][p].for_each([&merged](const detail::observation_count &c) {
+            merged.add(c.segments, c.bins, c.count);
+          });
+        maps[t][p].release();
+      }
+
+      std::vector<detail::observation_count> counts;
+      counts.reserve(merged.size());
+      result.keys = merged.size();
+      result.suppressed_keys = result.suppressed_observations = 0;
+      merged.for_each([&](const detail::observation_count &c) {
+          if (c.count < options.min_count) {
+            ++result.suppressed_keys;
+            result.suppressed_observations += c.count;
+          } else {
+            counts.push_back(c);
+          }
+        });
+      merged.release();
+      std::sort(counts.begin(), counts.end(), detail::observation_count_less);
+
+      const uint32_t first = detail::ingest_partition_start(p, options.num_segments, num_partitions);
+      const uint32_t last = detail::ingest_partition_start(p + 1, options.num_segments, num_partitions);
+      result.segments.resize(last - first);
+      result.types = 0;
+      for (size_t i = 0; i < counts.size(); ) {
+        const uint32_t segment_id = uint32_t(counts[i].segments >> 32);
+        size_t j = i;
+        while (j < counts.size() && uint32_t(counts[j].segments >> 32) == segment_id) {
+          ++j;
+        }
+        merged_segment &segment = result.segments[segment_id - first];
+        for (size_t k = i; k < j; ++k) {
+          segment.next_segment_ids.push_back(uint32_t(counts[k].segments));
+        }
+        std::sort(segment.next_segment_ids.begin(), segment.next_segment_ids.end());
+        segment.next_segment_ids.erase(
+          std::unique(segment.next_segment_ids.begin(), segment.next_segment_ids.end()),
+          segment.next_segment_ids.end());
+        if (segment.next_segment_ids.size() > 256) {
+          throw std::runtime_error("Segment has more than 256 next segments.");
+        }
+        for (size_t k = i; k < j; ++k) {
+          const uint32_t idx = uint32_t(std::lower_bound(
+            segment.next_segment_ids.begin(), segment.next_segment_ids.end(),
+            uint32_t(counts[k].segments)) - segment.next_segment_ids.begin());
+          const uint32_t bins = counts[k].bins;
+          segment.entries.emplace_back(bins >> 16, idx, bins & 0xff, ot::VehicleType((bins >> 8) & 0xff),
+                                       counts[k].count);
+          result.types |= uint32_t(1) << ((bins >> 8) & 0xff);
+        }
+        i = j;
+      }
+    });
+
+  // write.
+  steady_clock::time_point t2 = steady_clock::now();
+  uint32_t types_seen = 0;
+  std::vector<fb::Offset<ot::Segment> > segments_vector;
+  segments_vector.reserve(options.num_segments);
+  uint32_t segment_id = 0;
+  for (auto &result : results) {
+    stats.keys += result.keys;
+    stats.suppressed_keys += result.suppressed_keys;
+    stats.suppressed_observations += result.suppressed_observations;
+    types_seen |= result.types;
+    for (const auto &segment : result.segments) {
+      segments_vector.push_back(detail::write_merged_segment(builder, segment_id++, segment));
+      stats.entries_out += segment.entries.size();
+    }
+    std::vector<merged_segment>().swap(result.segments);
+  }
+  std::vector<int8_t> types;
+  for (uint32_t type = 0; type < 32; ++type) {
+    if ((types_seen >> type) & 1) {
+      types.push_back(int8_t(type));
+    }
+  }
+  if (types.empty()) {
+    types.push_back(ot::VehicleType_Auto);
+  }
+  detail::finish_merged_tile(builder, segments_vector, types, types.size() > 1, options.scheme);
+  steady_clock::time_point t3 = steady_clock::now();
+
+  stats.aggregate_seconds = duration_cast<duration<double>>(t1 - t0).count();
+  stats.merge_seconds = duration_cast<duration<double>>(t2 - t1).count();
+  stats.write_seconds = duration_cast<duration<double>>(t3 - t2).count();
+  return stats;
+}
+
+#endif /* OBSERVATION_INGEST_HPP */
@@ -0,0 +1,101 @@
+#ifndef OBSERVATIONS_HPP
+#define OBSERVATIONS_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "mmapped_file.hpp"
+#include "speed_buckets.hpp"
+
+// raw probe observations, as they come in before being aggregated into a
+// tile: a vehicle went along segment_id and on to next_segment_id at speed,
+// at timestamp. a batch file is an observation_file_header followed by its
+// count of observations, all little-endian, so it can be mapped and read in
+// place.
+struct observation {
+  uint32_t segment_id;
+  uint32_t next_segment_id;
+  // seconds since the UNIX epoch, UTC.
+  uint32_t timestamp;
+  // hundredths of a km/h.
+  uint16_t speed;
+  // an OpenTraffic::VehicleType.
+  uint8_t vehicle_type;
+  uint8_t reserved;
+};
+
+static_assert(sizeof(observation) == 16, "observations are written as they are in memory");
+
+const char observation_file_magic[4] = {'O', 'T', 'O', 'B'};
+constexpr uint32_t observation_file_version = 1;
+
+struct observation_file_header {
+  char magic[4];
+  uint32_t version;
+  uint64_t count;
+};
+
+static_assert(sizeof(observation_file_header) == 16, "headers are written as they are in memory");
+
+inline observation_file_header make_observation_file_header(uint64_t count) {
+  observation_file_header header;
+  memcpy(header.magic, observation_file_magic, sizeof header.magic);
+  header.version = observation_file_version;
+  header.count = count;
+  return header;
+}
+
+// a mapped batch file, checked against its header.
+class observation_file {
+public:
+  explicit observation_file(const std::string &path, const mmap_policy &policy = mmap_policy())
+    : file_(path, policy) {
+    observation_file_header header;
+    if (file_.size < sizeof header) {
+      throw std::runtime_error("Observation file is too short for its header.");
+    }
+    memcpy(&header, file_.buffer, sizeof header);
+    if (memcmp(header.magic, observation_file_magic, sizeof header.magic) != 0 ||
+        header.version != observation_file_version) {
+      throw std::runtime_error("Not an observation file.");
+    }
+    if (file_.size - sizeof header != header.count * sizeof(observation)) {
+      throw std::runtime_error("Observation file's size doesn't match its header.");
+    }
+    count_ = header.count;
+  }
+
+  const observation *data() const {
+    return reinterpret_cast<const observation *>((const uint8_t *)file_.buffer + sizeof(observation_file_header));
+  }
+
+  uint64_t size() const { return count_; }
+
+private:
+  mmapped_file file_;
+  uint64_t count_;
+};
+
+// day (0=Sunday,...,6=Saturday) * 24 + hour of day, in UTC. the epoch was a
+// Thursday.
+inline uint32_t observation_day_hour(uint32_t timestamp) {
+  const uint32_t hours = timestamp / 3600;
+  const uint32_t day = (hours / 24 + 4) % 7;
+  return day * 24 + hours % 24;
+}
+
+// the bucket of scheme which speed, in hundredths of a km/h, falls in. speeds
+// past the last bucket go in it.
+inline uint32_t observation_speed_bucket(uint16_t speed, const speed_bucket_scheme &scheme) {
+  double units = double(speed) / 100.0;
+  if (scheme.units == speed_units::mph) {
+    units /= 1.609344;
+  }
+  const uint32_t bucket = uint32_t(std::floor(units / scheme.width));
+  return (bucket < scheme.count) ? bucket : scheme.count - 1;
+}
+
+#endif /* OBSERVATIONS_HPP */
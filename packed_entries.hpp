@@ -0,0 +1,200 @@
+#ifndef PACKED_ENTRIES_HPP
+#define PACKED_ENTRIES_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "prefix_sums.hpp"
+
+// a compact encoding of a segment's entries as three parallel byte streams,
+// one byte per entry in each, plus a side list for large counts:
+//
+//   day_hours: the day_hour, < 168.
+//   keys:      speed_bucket in the low 5 bits, next_segment_idx in the high 3.
+//   counts:    the count if it's less than 255, otherwise 255 as an escape
+//              with the real count in the escapes list.
+//
+// which is 3 bytes per entry rather than 8. segments with a speed_bucket of
+// 32 or more, more than 8 next segments, or entries for more than the default
+// vehicle type can't be packed and keep their plain entries.
+
+constexpr uint32_t PACKED_BUCKET_BITS = 5;
+constexpr uint32_t PACKED_BUCKET_MASK = (1u << PACKED_BUCKET_BITS) - 1;
+constexpr uint32_t PACKED_MAX_NEXT_SEGMENTS = 1u << (8 - PACKED_BUCKET_BITS);
+constexpr uint8_t PACKED_COUNT_ESCAPE = 255;
+
+// the real count for entry number "entry", whose count byte is the escape.
+struct packed_escape {
+  uint32_t entry;
+  uint32_t count;
+};
+
+struct packed_segment {
+  std::vector<uint8_t> day_hours;
+  std::vector<uint8_t> keys;
+  std::vector<uint8_t> counts;
+  std::vector<packed_escape> escapes;
+};
+
+namespace detail {
+template <typename T> const T &entry_ref(const T &e) { return e; }
+template <typename T> const T &entry_ref(const T *e) { return *e; }
+} // namespace detail
+
+// packs entries, which can be either values or pointers with day_hour(),
+// next_segment_idx(), speed_bucket(), vehicle_type() and count() accessors. returns false,
+// leaving out in an unspecified state, if any entry doesn't fit.
+template <typename Entries>
+bool pack_entries(const Entries &entries, packed_segment &out) {
+  out = packed_segment();
+  uint32_t entry_num = 0;
+  for (const auto &e : entries) {
+    const auto &entry = detail::entry_ref(e);
+    const uint32_t speed_bucket = entry.speed_bucket();
+    const uint32_t next_segment_idx = entry.next_segment_idx();
+    const uint32_t count = entry.count();
+    if (entry.day_hour() >= NUM_DAY_HOURS ||
+        speed_bucket > PACKED_BUCKET_MASK ||
+        next_segment_idx >= PACKED_MAX_NEXT_SEGMENTS ||
+        entry.vehicle_type() != 0) {
+      return false;
+    }
+
+    out.day_hours.push_back(uint8_t(entry.day_hour()));
+    out.keys.push_back(uint8_t(speed_bucket | (next_segment_idx << PACKED_BUCKET_BITS)));
+    if (count < PACKED_COUNT_ESCAPE) {
+      out.counts.push_back(uint8_t(count));
+    } else {
+      out.counts.push_back(PACKED_COUNT_ESCAPE);
+      packed_escape escape = {entry_num, count};
+      out.escapes.push_back(escape);
+    }
+    ++entry_num;
+  }
+  return true;
+}
+
+// the range [first, last) of entries at day_hour. the day_hours are sorted, so
+// the start is a binary search; the end is found by comparing 16 bytes at a
+// time, since runs are usually short.
+inline void find_packed_day_hour(
+  const uint8_t *day_hours, size_t num_entries, uint32_t day_hour,
+  size_t &first, size_t &last) {
+
+  first = std::lower_bound(day_hours, day_hours + num_entries, uint8_t(day_hour)) - day_hours;
+  last = first;
+  if (first == num_entries || day_hours[first] != day_hour) {
+    return;
+  }
+
+#if defined(__SSE2__)
+  const __m128i needle = _mm_set1_epi8(char(day_hour));
+  while (last + 16 <= num_entries) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(day_hours + last));
+    unsigned int equal = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+    if (equal != 0xffff) {
+      last += __builtin_ctz(~equal);
+      return;
+    }
+    last += 16;
+  }
+#endif
+  while (last < num_entries && day_hours[last] == day_hour) {
+    ++last;
+  }
+}
+
+// adds entries [first, last) into a 32-bucket histogram, one entry at a time.
+// throws if an escaped count has no escape.
+inline void accumulate_packed_scalar(
+  const uint8_t *keys, const uint8_t *counts,
+  const packed_escape *escapes, size_t num_escapes,
+  size_t first, size_t last,
+  uint32_t *hist32) {
+
+  const packed_escape *escape = std::lower_bound(
+    escapes, escapes + num_escapes, first,
+    [](const packed_escape &lhs, size_t rhs) { return lhs.entry < rhs; });
+
+  // tiles opened without full verification can have fewer escapes than
+  // escaped counts, so each one is checked before it's used.
+  for (size_t i = first; i < last; ++i) {
+    uint32_t count = counts[i];
+    if (count == PACKED_COUNT_ESCAPE) {
+      if (escape == escapes + num_escapes || escape->entry != i) {
+        throw std::runtime_error("Packed count escape is missing.");
+      }
+      count = escape->count;
+      ++escape;
+    }
+    hist32[keys[i] & PACKED_BUCKET_MASK] += count;
+  }
+}
+
+// as accumulate_packed_scalar, but unpacks 16 entries at a time with SSE2.
+// the 255 escapes are added along with everything else and then corrected
+// afterwards, so the main loop has no branches. the correction matches each
+// escaped count to its escape, and checks it, as the scalar loop does.
+inline void accumulate_packed(
+  const uint8_t *keys, const uint8_t *counts,
+  const packed_escape *escapes, size_t num_escapes,
+  size_t first, size_t last,
+  uint32_t *hist32) {
+
+#if defined(__SSE2__)
+  const __m128i bucket_mask = _mm_set1_epi8(char(PACKED_BUCKET_MASK));
+  const __m128i escape_value = _mm_set1_epi8(char(PACKED_COUNT_ESCAPE));
+  bool any_escapes = false;
+
+  size_t i = first;
+  for (; i + 16 <= last; i += 16) {
+    __m128i k = _mm_loadu_si128((const __m128i *)(keys + i));
+    __m128i c = _mm_loadu_si128((const __m128i *)(counts + i));
+    any_escapes |= (_mm_movemask_epi8(_mm_cmpeq_epi8(c, escape_value)) != 0);
+
+    alignas(16) uint8_t buckets[16];
+    alignas(16) uint8_t values[16];
+    _mm_store_si128((__m128i *)buckets, _mm_and_si128(k, bucket_mask));
+    _mm_store_si128((__m128i *)values, c);
+    for (int j = 0; j < 16; ++j) {
+      hist32[buckets[j]] += values[j];
+    }
+  }
+
+  if (any_escapes) {
+    const packed_escape *escape = std::lower_bound(
+      escapes, escapes + num_escapes, first,
+      [](const packed_escape &lhs, size_t rhs) { return lhs.entry < rhs; });
+    for (size_t e = first; e < i; ++e) {
+      if (counts[e] != PACKED_COUNT_ESCAPE) {
+        continue;
+      }
+      if (escape == escapes + num_escapes || escape->entry != e) {
+        throw std::runtime_error("Packed count escape is missing.");
+      }
+      hist32[keys[e] & PACKED_BUCKET_MASK] += escape->count - PACKED_COUNT_ESCAPE;
+      ++escape;
+    }
+  }
+
+  accumulate_packed_scalar(keys, counts, escapes, num_escapes, i, last, hist32);
+#else
+  accumulate_packed_scalar(keys, counts, escapes, num_escapes, first, last, hist32);
+#endif
+}
+
+// folds a 32-bucket histogram into the usual MAX_N_SPEEDS buckets.
+inline void fold_packed_hist(const uint32_t *hist32, uint32_t *hist) {
+  for (int i = 0; i < MAX_N_SPEEDS; ++i) {
+    hist[i] += hist32[i];
+  }
+}
+
+#endif /* PACKED_ENTRIES_HPP */
@@ -0,0 +1,149 @@
+#ifndef PACKED_HISTOGRAM_READER_HPP
+#define PACKED_HISTOGRAM_READER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <stdexcept>
+
+#include "histogram_tile_generated.h"
+#include "checked_histogram.hpp"
+#include "packed_entries.hpp"
+#include "fb_histogram_reader.hpp"
+#include "query_trace.hpp"
+
+// histogram_reader.hpp reader for the tiles convert_fb_to_packed writes, with
+// exact counts, reading the packed entries one at a time. segments which
+// couldn't be packed have plain entries, and are read as those.
+class packed_histogram_reader {
+public:
+  // the packed entries of one segment at one day_hour.
+  struct packed_range {
+    const uint8_t *keys;
+    const uint8_t *counts;
+    const packed_escape *escapes;
+    size_t num_escapes;
+    size_t first;
+    size_t last;
+  };
+
+  explicit packed_histogram_reader(checked_histogram &tile)
+    : tile_(&tile), plain_(tile) {}
+
+  uint32_t num_segments() const {
+    return tile_->num_segments();
+  }
+
+  template <typename F>
+  void for_each_entry(uint32_t segment_id, uint32_t day_hour, F &&f) const {
+    packed_range range;
+    if (!find_range(segment_id, day_hour, range)) {
+      plain_.for_each_entry(segment_id, day_hour, f);
+      return;
+    }
+
+    const packed_escape *escapes_end = range.escapes + range.num_escapes;
+    const packed_escape *escape = std::lower_bound(
+      range.escapes, escapes_end, range.first,
+      [](const packed_escape &lhs, size_t rhs) { return lhs.entry < rhs; });
+    QUERY_TRACE_PHASE(scan);
+    QUERY_TRACE_ENTRIES(range.last - range.first);
+    for (size_t i = range.first; i < range.last; ++i) {
+      uint32_t count = range.counts[i];
+      if (count == PACKED_COUNT_ESCAPE) {
+        if (escape == escapes_end || escape->entry != i) {
+          throw std::runtime_error("Packed count escape is missing.");
+        }
+        count = escape->count;
+        ++escape;
+      }
+      f(uint32_t(range.keys[i] & PACKED_BUCKET_MASK), count);
+    }
+  }
+
+  // finds segment_id's packed entries at day_hour. returns false if the
+  // segment has plain entries instead.
+  bool find_range(uint32_t segment_id, uint32_t day_hour, packed_range &range) const {
+    auto segment = tile_->segment(segment_id);
+    auto day_hours = segment->packed_day_hours();
+    auto keys = segment->packed_keys();
+    auto counts = segment->packed_counts();
+    if (day_hours == nullptr || keys == nullptr || counts == nullptr) {
+      return false;
+    }
+    if (keys->size() != day_hours->size() || counts->size() != day_hours->size()) {
+      throw std::runtime_error("Packed entry arrays differ in length.");
+    }
+
+    range.keys = keys->data();
+    range.counts = counts->data();
+    range.escapes = nullptr;
+    range.num_escapes = 0;
+    if (segment->count_escapes() != nullptr) {
+      range.escapes = reinterpret_cast<const packed_escape *>(segment->count_escapes()->Data());
+      range.num_escapes = segment->count_escapes()->size();
+    }
+    QUERY_TRACE_PHASE(entry_search);
+    find_packed_day_hour(day_hours->data(), day_hours->size(), day_hour, range.first, range.last);
+    return true;
+  }
+
+  const fb_histogram_reader &plain() const { return plain_; }
+
+private:
+  checked_histogram *tile_;
+  fb_histogram_reader plain_;
+};
+
+// as packed_histogram_reader, but a query's packed entries are summed with
+// accumulate_packed, 16 at a time, into all 32 buckets the encoding allows,
+// and only those sums are handed on. so it overloads visit_entries() rather
+// than reading entry by entry.
+class simd_packed_histogram_reader {
+public:
+  explicit simd_packed_histogram_reader(checked_histogram &tile)
+    : packed_(tile) {}
+
+  const packed_histogram_reader &packed() const { return packed_; }
+
+private:
+  packed_histogram_reader packed_;
+};
+
+template <typename F>
+void visit_entries(
+  const simd_packed_histogram_reader &reader,
+  const std::set<uint32_t> &segment_ids,
+  uint32_t day_hour,
+  F &&f) {
+
+  const packed_histogram_reader &packed = reader.packed();
+  uint32_t hist32[PACKED_BUCKET_MASK + 1];
+  memset(hist32, 0, sizeof hist32);
+
+  const uint32_t num_segments = packed.num_segments();
+  for (auto segment_id : segment_ids) {
+    if (segment_id >= num_segments) {
+      continue;
+    }
+    QUERY_TRACE_PHASE(segment_lookup);
+    packed_histogram_reader::packed_range range;
+    if (!packed.find_range(segment_id, day_hour, range)) {
+      packed.plain().for_each_entry(segment_id, day_hour, f);
+      continue;
+    }
+    QUERY_TRACE_PHASE(scan);
+    QUERY_TRACE_ENTRIES(range.last - range.first);
+    accumulate_packed(range.keys, range.counts, range.escapes, range.num_escapes,
+                      range.first, range.last, hist32);
+  }
+
+  for (uint32_t bucket = 0; bucket <= PACKED_BUCKET_MASK; ++bucket) {
+    if (hist32[bucket] != 0) {
+      f(bucket, hist32[bucket]);
+    }
+  }
+}
+
+#endif /* PACKED_HISTOGRAM_READER_HPP */
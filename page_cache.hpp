@@ -0,0 +1,92 @@
+#ifndef PAGE_CACHE_HPP
+#define PAGE_CACHE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// a range of bytes in a file or mapping, by offset from its start.
+struct byte_range {
+  uint64_t offset;
+  uint64_t size;
+};
+
+inline uint64_t page_size() {
+  static const uint64_t size = uint64_t(sysconf(_SC_PAGESIZE));
+  return size;
+}
+
+// rounds each range out to whole pages, clips it to limit bytes, then sorts
+// and merges ranges which touch, so that each page is asked for once and
+// neighbouring requests become one larger one.
+inline std::vector<byte_range> coalesce_pages(std::vector<byte_range> ranges, uint64_t limit) {
+  const uint64_t page = page_size();
+  std::vector<byte_range> pages;
+  for (const auto &range : ranges) {
+    if (range.size == 0 || range.offset >= limit) {
+      continue;
+    }
+    const uint64_t begin = range.offset & ~(page - 1);
+    const uint64_t end = std::min(limit, range.offset + range.size);
+    const uint64_t rounded_end = std::min(limit, (end + page - 1) & ~(page - 1));
+    pages.push_back({begin, rounded_end - begin});
+  }
+  std::sort(pages.begin(), pages.end(),
+            [](const byte_range &a, const byte_range &b) { return a.offset < b.offset; });
+
+  std::vector<byte_range> merged;
+  for (const auto &range : pages) {
+    if (!merged.empty() && range.offset <= merged.back().offset + merged.back().size) {
+      const uint64_t end = std::max(merged.back().offset + merged.back().size, range.offset + range.size);
+      merged.back().size = end - merged.back().offset;
+    } else {
+      merged.push_back(range);
+    }
+  }
+  return merged;
+}
+
+// asks the kernel to start reading in the pages of a mapping covering ranges,
+// without waiting for them. for a file mapping this queues readahead for
+// every range at once, so the reads can all be in flight together rather
+// than each faulting in turn. base must be the start of the mapping. returns
+// the number of bytes advised.
+inline uint64_t willneed_mapped(const void *base, size_t size, const std::vector<byte_range> &ranges) {
+  uint64_t advised = 0;
+  for (const auto &range : coalesce_pages(ranges, size)) {
+    if (madvise((char *)base + range.offset, range.size, MADV_WILLNEED) == 0) {
+      advised += range.size;
+    }
+  }
+  return advised;
+}
+
+// as willneed_mapped, for files read with read() rather than mapped. this is
+// the same asynchronous readahead as readahead(2).
+inline uint64_t willneed_file(int fd, uint64_t file_size, const std::vector<byte_range> &ranges) {
+  uint64_t advised = 0;
+  for (const auto &range : coalesce_pages(ranges, file_size)) {
+    if (posix_fadvise(fd, off_t(range.offset), off_t(range.size), POSIX_FADV_WILLNEED) == 0) {
+      advised += range.size;
+    }
+  }
+  return advised;
+}
+
+// drop the file's pages from the page cache, so that the next mapping starts
+// cold. this only works for pages which aren't mapped anywhere else.
+inline void drop_page_cache(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd != -1) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+#endif /* PAGE_CACHE_HPP */
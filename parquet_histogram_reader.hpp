@@ -0,0 +1,159 @@
+#ifndef PARQUET_HISTOGRAM_READER_HPP
+#define PARQUET_HISTOGRAM_READER_HPP
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include <parquet/api/reader.h>
+
+#include "query_trace.hpp"
+#include "speed_buckets.hpp"
+
+// histogram_reader.hpp reader for the Parquet tile written by
+// convert_fb_to_parquet, with columns vtype, segment_id, day_hour,
+// next_segment_id, speed_bucket and count. being columnar, it's read a whole
+// query at a time, so this overloads visit_entries() rather than reading
+// segment by segment.
+class parquet_histogram_reader {
+public:
+  static constexpr int batch_size = 500;
+
+  explicit parquet_histogram_reader(std::shared_ptr<parquet::ParquetFileReader> file_reader)
+    : file_reader_(file_reader) {}
+
+  const std::shared_ptr<parquet::ParquetFileReader> &file_reader() const {
+    return file_reader_;
+  }
+
+private:
+  std::shared_ptr<parquet::ParquetFileReader> file_reader_;
+};
+
+// the key convert_fb_to_parquet records the tile's speed bucket scheme under
+// in the file's key-value metadata, as format_speed_buckets writes it.
+const char *const parquet_speed_buckets_key = "speed_buckets";
+
+// the speed bucket scheme of a Parquet tile, or the default for files which
+// don't record one.
+inline speed_bucket_scheme parquet_speed_buckets(const std::shared_ptr<parquet::ParquetFileReader> &file_reader) {
+  auto key_value_metadata = file_reader->metadata()->key_value_metadata();
+  if (key_value_metadata == nullptr) {
+    return default_speed_buckets;
+  }
+  const int i = key_value_metadata->FindKey(parquet_speed_buckets_key);
+  if (i < 0) {
+    return default_speed_buckets;
+  }
+  speed_bucket_scheme scheme;
+  if (!parse_speed_buckets(key_value_metadata->value(i), scheme)) {
+    throw std::runtime_error("Unusable speed bucket scheme in Parquet tile.");
+  }
+  return scheme;
+}
+
+// for each row group, scans the segment_id column for rows in segment_ids,
+// then the day_hour column at just those rows, then the speed_bucket and
+// count columns at the rows which matched both. those are its segment_lookup,
+// entry_search and scan phases. entries scanned are the column values
+// decoded, and the cache lines touched are only those of the decoded
+// segment IDs, since the rest happens inside the Parquet library.
+template <typename F>
+void visit_entries(
+  const parquet_histogram_reader &reader,
+  const std::set<uint32_t> &segment_ids,
+  uint32_t day_hour,
+  F &&f) {
+
+  const auto &file_reader = reader.file_reader();
+  const int num_row_groups = file_reader->metadata()->num_row_groups();
+
+  for (int row_group = 0; row_group < num_row_groups; ++row_group) {
+    QUERY_TRACE_PHASE(segment_lookup);
+    auto rg_reader = file_reader->RowGroup(row_group);
+
+    size_t row_idx = 0;
+    std::vector<size_t> rows;
+
+    // first scan the segment_id column to find matching segment indices
+    auto segment_id_reader =
+      std::static_pointer_cast<parquet::Int32Reader>(rg_reader->Column(1));
+
+    while(true) {
+      int32_t ids[parquet_histogram_reader::batch_size];
+      int64_t num_values = 0;
+      segment_id_reader->ReadBatch(parquet_histogram_reader::batch_size, nullptr, nullptr, ids, &num_values);
+
+      if (num_values <= 0) {
+        break;
+      }
+      QUERY_TRACE_ENTRIES(num_values);
+      QUERY_TRACE_TOUCH(ids, num_values * sizeof ids[0]);
+
+      for (int64_t i = 0; i < num_values; ++i) {
+        if (segment_ids.count(ids[i]) > 0) {
+          rows.push_back(row_idx + i);
+        }
+      }
+      row_idx += num_values;
+    }
+
+    // next, scan the day_hour column to find matching values
+    auto day_hour_reader =
+      std::static_pointer_cast<parquet::Int32Reader>(rg_reader->Column(2));
+
+    QUERY_TRACE_PHASE(entry_search);
+    size_t current_row_pos = 0;
+    std::vector<size_t> new_rows;
+    for (auto row_idx : rows) {
+      if (current_row_pos < row_idx) {
+        day_hour_reader->Skip(row_idx - current_row_pos);
+        current_row_pos = row_idx;
+      }
+
+      int32_t value = 0;
+      int64_t count = 0;
+      day_hour_reader->ReadBatch(1, nullptr, nullptr, &value, &count);
+      current_row_pos += 1;
+
+      assert(count == 1);
+      QUERY_TRACE_ENTRIES(1);
+
+      if (uint32_t(value) == day_hour) {
+        new_rows.push_back(row_idx);
+      }
+    }
+
+    auto speed_bucket_reader =
+      std::static_pointer_cast<parquet::Int32Reader>(rg_reader->Column(4));
+    auto count_reader =
+      std::static_pointer_cast<parquet::Int32Reader>(rg_reader->Column(5));
+
+    QUERY_TRACE_PHASE(scan);
+    current_row_pos = 0;
+    for (auto row_idx : new_rows) {
+      if (current_row_pos < row_idx) {
+        speed_bucket_reader->Skip(row_idx - current_row_pos);
+        count_reader->Skip(row_idx - current_row_pos);
+        current_row_pos = row_idx;
+      }
+
+      int32_t speed_value = 0, count_value = 0;
+      int64_t count = 0;
+      speed_bucket_reader->ReadBatch(1, nullptr, nullptr, &speed_value, &count);
+      assert(count == 1);
+      count_reader->ReadBatch(1, nullptr, nullptr, &count_value, &count);
+      assert(count == 1);
+
+      current_row_pos += 1;
+      QUERY_TRACE_ENTRIES(1);
+
+      f(uint32_t(speed_value), uint32_t(count_value));
+    }
+  }
+}
+
+#endif /* PARQUET_HISTOGRAM_READER_HPP */
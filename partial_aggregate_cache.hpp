@@ -0,0 +1,171 @@
+#ifndef PARTIAL_AGGREGATE_CACHE_HPP
+#define PARTIAL_AGGREGATE_CACHE_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "prefix_sums.hpp"
+
+// a bounded cache of per-(segment, day_hour) partial histograms, shared by all
+// the query threads in a process. it doesn't know about any tile format: on a
+// miss, a caller-supplied function computes the partial histogram from
+// whatever reader the caller has.
+//
+// the cache is split into shards by key, each with its own lock and LRU list,
+// so that threads working on different segments rarely contend. each entry
+// records the tile version it was computed from, and a lookup for any other
+// version is a miss, so swapping in a new tile invalidates everything cached
+// from the old one without having to stop and clear the cache.
+class partial_aggregate_cache {
+public:
+  typedef std::array<uint32_t, MAX_N_SPEEDS> partial_hist;
+
+  // approximate size of each cached entry, including the list and hash table
+  // nodes, which is what budget_bytes is divided by.
+  static constexpr size_t entry_bytes = sizeof(partial_hist) + 96;
+
+  partial_aggregate_cache(size_t budget_bytes, size_t num_shards = 16)
+    : shards_(num_shards == 0 ? 1 : num_shards) {
+    const size_t capacity = budget_bytes / entry_bytes / shards_.size();
+    for (auto &shard : shards_) {
+      shard.reset(new cache_shard());
+      shard->capacity = (capacity == 0) ? 1 : capacity;
+    }
+  }
+
+  // adds the partial histogram for (segment_id, day_hour) from tile version
+  // into hist. on a miss, compute(partial) is called to fill in a zeroed
+  // partial_hist. compute runs without any lock held, so two threads missing
+  // on the same key at once may both compute it.
+  template <typename Compute>
+  void add(uint64_t version, uint32_t segment_id, uint32_t day_hour, uint32_t *hist, Compute compute) {
+    const uint64_t key = (uint64_t(segment_id) << 8) | day_hour;
+    cache_shard &shard = *shards_[shard_for(key)];
+
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto itr = shard.index.find(key);
+      if (itr != shard.index.end()) {
+        if (itr->second->version == version) {
+          shard.lru.splice(shard.lru.begin(), shard.lru, itr->second);
+          add_hist(itr->second->hist, hist);
+          ++shard.hits;
+          return;
+        }
+        // computed from an older tile, so drop it.
+        shard.lru.erase(itr->second);
+        shard.index.erase(itr);
+        ++shard.invalidations;
+      }
+      ++shard.misses;
+    }
+
+    cache_entry entry;
+    entry.key = key;
+    entry.version = version;
+    entry.hist.fill(0);
+    compute(entry.hist);
+    add_hist(entry.hist, hist);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.index.find(key) != shard.index.end()) {
+      // another thread got there first.
+      return;
+    }
+    while (shard.lru.size() >= shard.capacity) {
+      shard.index.erase(shard.lru.back().key);
+      shard.lru.pop_back();
+      ++shard.evictions;
+    }
+    shard.lru.push_front(entry);
+    shard.index[key] = shard.lru.begin();
+  }
+
+  void clear() {
+    for (auto &shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      shard->lru.clear();
+      shard->index.clear();
+    }
+  }
+
+  void reset_counters() {
+    for (auto &shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      shard->hits = shard->misses = shard->evictions = shard->invalidations = 0;
+    }
+  }
+
+  size_t num_shards() const { return shards_.size(); }
+  size_t capacity() const { return shards_.size() * shards_[0]->capacity; }
+
+  size_t size() const {
+    size_t total = 0;
+    for (const auto &shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      total += shard->lru.size();
+    }
+    return total;
+  }
+
+  uint64_t hits() const { return sum(&cache_shard::hits); }
+  uint64_t misses() const { return sum(&cache_shard::misses); }
+  uint64_t evictions() const { return sum(&cache_shard::evictions); }
+  // entries found computed from an older tile version, which are also
+  // counted as misses.
+  uint64_t invalidations() const { return sum(&cache_shard::invalidations); }
+
+  double hit_rate() const {
+    const uint64_t h = hits(), lookups = h + misses();
+    return (lookups > 0) ? double(h) / double(lookups) : 0.0;
+  }
+
+private:
+  struct cache_entry {
+    uint64_t key;
+    uint64_t version;
+    partial_hist hist;
+  };
+
+  struct cache_shard {
+    std::mutex mutex;
+    std::list<cache_entry> lru;
+    std::unordered_map<uint64_t, std::list<cache_entry>::iterator> index;
+    size_t capacity = 0;
+    uint64_t hits = 0, misses = 0, evictions = 0, invalidations = 0;
+  };
+
+  static void add_hist(const partial_hist &partial, uint32_t *hist) {
+    for (int i = 0; i < MAX_N_SPEEDS; ++i) {
+      hist[i] += partial[i];
+    }
+  }
+
+  size_t shard_for(uint64_t key) const {
+    // mix the bits so that neighbouring segments land on different shards.
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return size_t(key % shards_.size());
+  }
+
+  uint64_t sum(uint64_t cache_shard::*counter) const {
+    uint64_t total = 0;
+    for (const auto &shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      total += (*shard).*counter;
+    }
+    return total;
+  }
+
+  // shards are heap allocated, as they hold a mutex and can't be moved.
+  std::vector<std::unique_ptr<cache_shard> > shards_;
+};
+
+#endif /* PARTIAL_AGGREGATE_CACHE_HPP */
@@ -0,0 +1,69 @@
+#ifndef PBF_HISTOGRAM_READER_HPP
+#define PBF_HISTOGRAM_READER_HPP
+
+#include <algorithm>
+#include <cstdint>
+
+#include "histogram_tile.pb.h"
+#include "speed_buckets.hpp"
+#include "query_trace.hpp"
+
+class pbf_segment_index;
+
+// histogram_reader.hpp reader for a parsed Protocol Buffers tile, either a
+// whole Histogram or a pbf_segment_index. entries are sorted by day_hour, as
+// in the FlatBuffers tile, so it searches for the day_hour rather than
+// scanning.
+class pbf_histogram_reader {
+public:
+  explicit pbf_histogram_reader(const OpenTraffic::pbf::Histogram &histogram)
+    : segments_(histogram.segments().data()), num_segments_(uint32_t(histogram.segments_size())) {}
+
+  // defined in pbf_segment_index.hpp, so that only its users pull in the
+  // arena and thread headers.
+  explicit pbf_histogram_reader(const pbf_segment_index &index);
+
+  uint32_t num_segments() const {
+    return num_segments_;
+  }
+
+  template <typename F>
+  void for_each_entry(uint32_t segment_id, uint32_t day_hour, F &&f) const {
+    const auto &segment = *segments_[segment_id];
+    QUERY_TRACE_TOUCH(&segment, sizeof segment);
+    const auto &entries = segment.entries();
+    QUERY_TRACE_PHASE(entry_search);
+    auto itr = std::lower_bound(
+      entries.begin(), entries.end(),
+      day_hour,
+      [](const OpenTraffic::pbf::Entry &lhs, uint32_t rhs) {
+        QUERY_TRACE_TOUCH(&lhs, sizeof lhs);
+        return lhs.day_hour() < rhs;
+      });
+    QUERY_TRACE_PHASE(scan);
+    while ((itr != entries.end()) && (itr->day_hour() == day_hour)) {
+      QUERY_TRACE_ENTRIES(1);
+      QUERY_TRACE_TOUCH(&*itr, sizeof *itr);
+      f(itr->speed_bucket(), itr->count());
+      ++itr;
+    }
+  }
+
+private:
+  const OpenTraffic::pbf::Segment *const *segments_;
+  uint32_t num_segments_;
+};
+
+// as the FlatBuffers tile_speed_buckets in fb_histogram_reader.hpp.
+inline speed_bucket_scheme tile_speed_buckets(const OpenTraffic::pbf::Histogram &histogram) {
+  if (!histogram.has_speed_buckets()) {
+    return default_speed_buckets;
+  }
+  const auto &buckets = histogram.speed_buckets();
+  speed_bucket_scheme scheme = {
+    buckets.width(), buckets.count(), speed_units(buckets.units())};
+  check_speed_buckets(scheme);
+  return scheme;
+}
+
+#endif /* PBF_HISTOGRAM_READER_HPP */
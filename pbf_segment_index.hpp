@@ -0,0 +1,155 @@
+#ifndef PBF_SEGMENT_INDEX_HPP
+#define PBF_SEGMENT_INDEX_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/arena.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include "histogram_tile.pb.h"
+#include "pbf_histogram_reader.hpp"
+#include "run_on_threads.hpp"
+
+// a Protocol Buffers tile parsed on several threads. ParseFromIstream parses
+// a Histogram from start to finish on one thread, so startup grows with the
+// size of the tile however many cores there are. here it's done in two
+// passes instead:
+//
+//   scan: one pass over the top level of the wire format finds the byte
+//     range of each of the Histogram's segments (field 2), skipping over
+//     their contents, and gathers up every other field.
+//   parse: threads take runs of segments in turn and parse each from its
+//     range into an arena of their own.
+//
+// the other fields are parsed into histogram(), which has no segments. the
+// segments are read-only, through segment() and segments(), in the order
+// they were in the tile. the tile's buffer needn't outlive the index.
+class pbf_segment_index {
+public:
+  struct load_stats {
+    double scan_seconds;
+    double parse_seconds;
+    unsigned int num_threads;
+  };
+
+  pbf_segment_index(const void *buffer, size_t size, unsigned int num_threads) {
+    using std::chrono::steady_clock;
+    using std::chrono::duration;
+    using std::chrono::duration_cast;
+
+    if (size > size_t(INT_MAX)) {
+      throw std::runtime_error("Protocol Buffers tile is too big to parse.");
+    }
+    if (num_threads == 0) {
+      num_threads = 1;
+    }
+    const uint8_t *data = static_cast<const uint8_t *>(buffer);
+
+    steady_clock::time_point t0 = steady_clock::now();
+    std::vector<range> ranges;
+    std::string rest;
+    scan(data, size, ranges, rest);
+    if (!histogram_.ParseFromString(rest)) {
+      throw std::runtime_error("Unable to parse Protocol Buffers tile.");
+    }
+
+    steady_clock::time_point t1 = steady_clock::now();
+    segments_.resize(ranges.size(), nullptr);
+    for (unsigned int t = 0; t < num_threads; ++t) {
+      arenas_.emplace_back(new google::protobuf::Arena());
+    }
+    const size_t segments_per_chunk = 64;
+    const size_t num_chunks = (ranges.size() + segments_per_chunk - 1) / segments_per_chunk;
+    std::atomic<size_t> next_chunk(0);
+    detail::run_on_threads(num_threads, [&](unsigned int t) {
+        google::protobuf::Arena *arena = arenas_[t].get();
+        for (size_t c = next_chunk++; c < num_chunks; c = next_chunk++) {
+          const size_t end = std::min(ranges.size(), (c + 1) * segments_per_chunk);
+          for (size_t i = c * segments_per_chunk; i < end; ++i) {
+            auto segment = google::protobuf::Arena::CreateMessage<OpenTraffic::pbf::Segment>(arena);
+            if (!segment->ParseFromArray(data + ranges[i].offset, int(ranges[i].size))) {
+              throw std::runtime_error("Unable to parse segment " + std::to_string(i) + ".");
+            }
+            segments_[i] = segment;
+          }
+        }
+      });
+    steady_clock::time_point t2 = steady_clock::now();
+
+    stats_.scan_seconds = duration_cast<duration<double>>(t1 - t0).count();
+    stats_.parse_seconds = duration_cast<duration<double>>(t2 - t1).count();
+    stats_.num_threads = num_threads;
+  }
+
+  pbf_segment_index(const pbf_segment_index &) = delete;
+  pbf_segment_index &operator=(const pbf_segment_index &) = delete;
+
+  // the tile's fields other than its segments.
+  const OpenTraffic::pbf::Histogram &histogram() const { return histogram_; }
+
+  uint32_t num_segments() const { return uint32_t(segments_.size()); }
+  const OpenTraffic::pbf::Segment &segment(uint32_t i) const { return *segments_[i]; }
+  const OpenTraffic::pbf::Segment *const *segments() const { return segments_.data(); }
+
+  const load_stats &stats() const { return stats_; }
+
+private:
+  struct range {
+    size_t offset;
+    uint32_t size;
+  };
+
+  // finds the range of each segment, and appends every other field, tag and
+  // all, to rest, which then parses as a Histogram with no segments.
+  static void scan(const uint8_t *data, size_t size, std::vector<range> &ranges, std::string &rest) {
+    using google::protobuf::internal::WireFormatLite;
+    google::protobuf::io::CodedInputStream input(data, int(size));
+    while (true) {
+      const int start = input.CurrentPosition();
+      const uint32_t tag = input.ReadTag();
+      if (tag == 0) {
+        if (input.CurrentPosition() != int(size)) {
+          throw std::runtime_error("Malformed Protocol Buffers tile.");
+        }
+        return;
+      }
+      if (WireFormatLite::GetTagFieldNumber(tag) == OpenTraffic::pbf::Histogram::kSegmentsFieldNumber) {
+        uint32_t length = 0;
+        if (WireFormatLite::GetTagWireType(tag) != WireFormatLite::WIRETYPE_LENGTH_DELIMITED ||
+            !input.ReadVarint32(&length)) {
+          throw std::runtime_error("Malformed segment in Protocol Buffers tile.");
+        }
+        const range r = {size_t(input.CurrentPosition()), length};
+        if (!input.Skip(int(length))) {
+          throw std::runtime_error("Segment runs past the end of the Protocol Buffers tile.");
+        }
+        ranges.push_back(r);
+      } else {
+        if (!WireFormatLite::SkipField(&input, tag)) {
+          throw std::runtime_error("Malformed Protocol Buffers tile.");
+        }
+        rest.append(reinterpret_cast<const char *>(data + start), size_t(input.CurrentPosition() - start));
+      }
+    }
+  }
+
+  OpenTraffic::pbf::Histogram histogram_;
+  // declared before segments_, which point into them.
+  std::vector<std::unique_ptr<google::protobuf::Arena> > arenas_;
+  std::vector<const OpenTraffic::pbf::Segment *> segments_;
+  load_stats stats_;
+};
+
+inline pbf_histogram_reader::pbf_histogram_reader(const pbf_segment_index &index)
+  : segments_(index.segments()), num_segments_(index.num_segments()) {}
+
+#endif /* PBF_SEGMENT_INDEX_HPP */
@@ -0,0 +1,80 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// a single hardware or software event counter for the calling thread, read
+// through perf_event_open. if the kernel doesn't allow it, e.g: because of
+// perf_event_paranoid or running in a VM without a PMU, then ok() is false
+// and stop() always returns zero.
+class perf_counter {
+public:
+  perf_counter(uint32_t type, uint64_t config) : fd_(-1) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+
+  ~perf_counter() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  perf_counter(const perf_counter &) = delete;
+  perf_counter &operator=(const perf_counter &) = delete;
+
+  bool ok() const { return fd_ >= 0; }
+
+  void start() {
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+
+  uint64_t stop() {
+    uint64_t value = 0;
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(fd_, &value, sizeof value) != sizeof value) {
+        value = 0;
+      }
+    }
+    return value;
+  }
+
+  static uint64_t cache_event(uint64_t cache, uint64_t op, uint64_t result) {
+    return cache | (op << 8) | (result << 16);
+  }
+
+private:
+  int fd_;
+};
+
+// config for counting data TLB misses on loads, with type PERF_TYPE_HW_CACHE.
+inline uint64_t dtlb_load_miss_config() {
+  return perf_counter::cache_event(
+    PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+}
+
+// config for counting L1 data cache misses on loads, with type
+// PERF_TYPE_HW_CACHE.
+inline uint64_t l1d_load_miss_config() {
+  return perf_counter::cache_event(
+    PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+}
+
+#endif /* PERF_COUNTERS_HPP */
@@ -0,0 +1,22 @@
+#ifndef PLAIN_ENTRIES_HPP
+#define PLAIN_ENTRIES_HPP
+
+#include <stdexcept>
+
+#include "histogram_tile_generated.h"
+
+// tools which walk a segment's entries() directly only see plain entries. a
+// segment stored as bucket runs or packed entries has none, so it would look
+// empty to them and they'd give wrong answers or write tiles missing its
+// data. they call this wherever entries() is null, which costs nothing for
+// segments which have entries. fb_histogram_reader.hpp and tile_merge.hpp
+// read the other encodings.
+inline void require_plain_entries(const OpenTraffic::Segment *segment) {
+  if (segment->bucket_runs() != nullptr || segment->packed_day_hours() != nullptr) {
+    throw std::runtime_error(
+      "Tile has bucket run or packed segments, which this tool can't read. "
+      "Use a tile written without --bucket-runs or packing.");
+  }
+}
+
+#endif /* PLAIN_ENTRIES_HPP */
@@ -0,0 +1,96 @@
+#ifndef PREFIX_SUMS_HPP
+#define PREFIX_SUMS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "speed_buckets.hpp"
+
+constexpr uint32_t NUM_DAY_HOURS = 7 * 24;
+
+// a half-open [start, end) range of day_hours. ranges which wrap around the
+// end of the week should be split in two.
+typedef std::pair<uint32_t, uint32_t> day_hour_range;
+
+// cumulative per-speed-bucket counts along day_hour for a single segment.
+//
+// rather than storing a row for every one of the 168 day_hours, which would be
+// mostly empty for quiet segments, there's one row per distinct day_hour with
+// data, plus a leading row of zeros. day_hour_index maps each day_hour
+// boundary in [0, 168] to the row which holds the sums of all entries with a
+// smaller day_hour, so any range is two lookups and a subtraction.
+struct prefix_sums {
+  std::vector<uint8_t> day_hour_index;
+  std::vector<uint32_t> counts;
+};
+
+// build the prefix sums for a segment's entries, which must be sorted by
+// day_hour. works for anything with day_hour(), speed_bucket() and count()
+// accessors, e.g: the FlatBuffers and Protocol Buffers Entry types.
+template <typename Entries>
+prefix_sums build_prefix_sums(const Entries &entries) {
+  prefix_sums p;
+  p.day_hour_index.resize(NUM_DAY_HOURS + 1);
+  p.counts.assign(MAX_N_SPEEDS, 0);
+
+  uint32_t row = 0;
+  uint32_t current_day_hour = 0;
+  for (const auto &entry : entries) {
+    const uint32_t day_hour = entry.day_hour();
+    if (row == 0 || day_hour != current_day_hour) {
+      // fill in the boundaries up to and including this day_hour, all of
+      // which see the sums of everything before it.
+      for (uint32_t i = (row == 0) ? 0 : current_day_hour + 1; i <= day_hour; ++i) {
+        p.day_hour_index[i] = uint8_t(row);
+      }
+      // start a new row as a copy of the previous one. resize first, as
+      // inserting a range of the vector into itself isn't allowed.
+      const size_t previous = p.counts.size() - MAX_N_SPEEDS;
+      p.counts.resize(p.counts.size() + MAX_N_SPEEDS);
+      std::copy(p.counts.begin() + previous,
+                p.counts.begin() + previous + MAX_N_SPEEDS,
+                p.counts.begin() + previous + MAX_N_SPEEDS);
+      current_day_hour = day_hour;
+      ++row;
+    }
+    const uint32_t bucket = entry.speed_bucket();
+    if (bucket < MAX_N_SPEEDS) {
+      p.counts[row * MAX_N_SPEEDS + bucket] += entry.count();
+    }
+  }
+
+  // every boundary after the last day_hour sees all of the entries.
+  for (uint32_t i = (row == 0) ? 0 : current_day_hour + 1; i <= NUM_DAY_HOURS; ++i) {
+    p.day_hour_index[i] = uint8_t(row);
+  }
+
+  return p;
+}
+
+// add the counts for all entries in [start, end) to hist. both the index and
+// counts must come from the same segment.
+inline void add_prefix_range(
+  const uint8_t *day_hour_index,
+  const uint32_t *counts,
+  uint32_t start, uint32_t end,
+  uint32_t *hist) {
+
+  const uint32_t *lo = counts + day_hour_index[start] * MAX_N_SPEEDS;
+  const uint32_t *hi = counts + day_hour_index[end] * MAX_N_SPEEDS;
+  for (int i = 0; i < MAX_N_SPEEDS; ++i) {
+    hist[i] += hi[i] - lo[i];
+  }
+}
+
+// the same [start_hour, end_hour) window on each of monday to friday.
+inline std::vector<day_hour_range> weekday_ranges(uint32_t start_hour, uint32_t end_hour) {
+  std::vector<day_hour_range> ranges;
+  for (uint32_t day = 1; day <= 5; ++day) {
+    ranges.emplace_back(day * 24 + start_hour, day * 24 + end_hour);
+  }
+  return ranges;
+}
+
+#endif /* PREFIX_SUMS_HPP */
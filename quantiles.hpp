@@ -0,0 +1,101 @@
+#ifndef QUANTILES_HPP
+#define QUANTILES_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "prefix_sums.hpp"
+
+// speed quantiles used for congestion detection.
+const std::vector<double> congestion_quantiles = {0.15, 0.5, 0.85};
+
+// speed at quantile q (in [0, 1]) of a cumulative histogram, where cdf[i] is
+// the total count in buckets 0..i. the speed is interpolated linearly within
+// the 5mph bucket in which the quantile falls, taking bucket i's speeds to be
+// spread evenly over [5i, 5i + 5). mean_speed in histogram_reader.hpp instead
+// counts every speed in bucket i as 5i, its lower edge, as the tools always
+// have, so a mean comes out up to half a bucket (2.5mph) below the quantiles
+// of the same histogram. compare like with like. returns 0 for an empty cdf.
+inline double quantile_from_cdf(const uint32_t *cdf, double q) {
+  const uint32_t total = cdf[MAX_N_SPEEDS - 1];
+  if (total == 0) {
+    return 0.0;
+  }
+
+  const double target = q * double(total);
+  const uint32_t *itr = (target > 0.0)
+    ? std::lower_bound(cdf, cdf + MAX_N_SPEEDS, target,
+                       [](uint32_t lhs, double rhs) { return double(lhs) < rhs; })
+    : std::upper_bound(cdf, cdf + MAX_N_SPEEDS, 0u);
+  if (itr == cdf + MAX_N_SPEEDS) {
+    --itr;
+  }
+
+  const int bucket = int(itr - cdf);
+  const uint32_t below = (bucket > 0) ? cdf[bucket - 1] : 0;
+  const double frac = (target - double(below)) / double(*itr - below);
+  return 5.0 * (double(bucket) + std::min(std::max(frac, 0.0), 1.0));
+}
+
+inline std::vector<double> quantiles_from_cdf(const uint32_t *cdf, const std::vector<double> &qs) {
+  std::vector<double> speeds;
+  speeds.reserve(qs.size());
+  for (double q : qs) {
+    speeds.push_back(quantile_from_cdf(cdf, q));
+  }
+  return speeds;
+}
+
+// adds the running total of hist into cdf, so that several histograms (or a
+// mix of histograms and precomputed cdfs) can be combined before searching.
+inline void accumulate_cdf(const uint32_t *hist, uint32_t *cdf) {
+  uint32_t running = 0;
+  for (int i = 0; i < MAX_N_SPEEDS; ++i) {
+    running += hist[i];
+    cdf[i] += running;
+  }
+}
+
+inline std::vector<double> quantiles_from_hist(const uint32_t *hist, const std::vector<double> &qs) {
+  uint32_t cdf[MAX_N_SPEEDS] = {0};
+  accumulate_cdf(hist, cdf);
+  return quantiles_from_cdf(cdf, qs);
+}
+
+// precomputed per-day_hour cdfs for a segment, one row of MAX_N_SPEEDS for
+// each distinct day_hour with data. the rows line up with the prefix sums'
+// day_hour_index: day_hour d has data when index[d + 1] > index[d], and its
+// cdf is row index[d].
+inline std::vector<uint32_t> build_cdf_counts(const prefix_sums &p) {
+  const size_t num_rows = p.counts.size() / MAX_N_SPEEDS - 1;
+  std::vector<uint32_t> cdfs(num_rows * MAX_N_SPEEDS, 0);
+  for (size_t row = 0; row < num_rows; ++row) {
+    const uint32_t *lo = &p.counts[row * MAX_N_SPEEDS];
+    const uint32_t *hi = &p.counts[(row + 1) * MAX_N_SPEEDS];
+    uint32_t running = 0;
+    for (int i = 0; i < MAX_N_SPEEDS; ++i) {
+      running += hi[i] - lo[i];
+      cdfs[row * MAX_N_SPEEDS + i] = running;
+    }
+  }
+  return cdfs;
+}
+
+// add the precomputed cdf for day_hour into cdf, if the segment has data then.
+inline void add_day_hour_cdf(
+  const uint8_t *day_hour_index,
+  const uint32_t *cdf_counts,
+  uint32_t day_hour,
+  uint32_t *cdf) {
+
+  const uint32_t row = day_hour_index[day_hour];
+  if (day_hour_index[day_hour + 1] > row) {
+    const uint32_t *src = cdf_counts + row * MAX_N_SPEEDS;
+    for (int i = 0; i < MAX_N_SPEEDS; ++i) {
+      cdf[i] += src[i];
+    }
+  }
+}
+
+#endif /* QUANTILES_HPP */
@@ -0,0 +1,170 @@
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <unordered_map>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "query_protocol.hpp"
+#include "framed_socket.hpp"
+#include "zipf_workload.hpp"
+
+using std::chrono::steady_clock;
+using std::chrono::duration;
+using std::chrono::duration_cast;
+
+// load generator for query_server. each connection keeps depth requests in
+// flight, pipelined, for the given time, mixing queries for sets of Zipf
+// distributed segments with queries along short routes.
+
+struct connection_stats {
+  std::vector<double> latencies;
+  uint64_t num_bad;
+  uint64_t total_count;
+};
+
+void run_connection(
+  const std::string &path, uint32_t num_segments, unsigned int depth,
+  double route_fraction, steady_clock::time_point end, uint64_t seed,
+  connection_stats &stats) {
+
+  // the server may have only just been started, so give it a while.
+  const int fd = connect_unix(path, false, 10.0);
+  zipf_workload workload(num_segments, 1.1, seed);
+  std::uniform_int_distribution<uint32_t> dist_day(1, 5);
+  std::uniform_int_distribution<uint32_t> dist_hour(7, 19);
+  std::uniform_real_distribution<double> dist_unit(0.0, 1.0);
+
+  std::unordered_map<uint32_t, steady_clock::time_point> in_flight;
+  uint32_t next_request_id = 0;
+  std::vector<uint8_t> out, in;
+  uint8_t buffer[64 * 1024];
+  stats.num_bad = 0;
+  stats.total_count = 0;
+
+  while (true) {
+    // top the window back up, in a single write.
+    const bool running = steady_clock::now() < end;
+    out.clear();
+    while (running && in_flight.size() < depth) {
+      query_request request;
+      request.request_id = next_request_id++;
+      request.day_hour = uint8_t(dist_day(workload.eng) * 24 + dist_hour(workload.eng));
+      if (dist_unit(workload.eng) < route_fraction) {
+        // each sample tile segment's first next segment is the following ID.
+        request.kind = query_kind::route;
+        const uint32_t start = workload() % (num_segments - 4);
+        for (uint32_t i = 0; i < 5; ++i) {
+          request.segment_ids.push_back(start + i);
+        }
+      } else {
+        request.kind = query_kind::segments;
+        while (request.segment_ids.size() < 50) {
+          request.segment_ids.push_back(workload());
+        }
+      }
+      encode_request(request, out);
+      in_flight[request.request_id] = steady_clock::now();
+    }
+    if (!out.empty()) {
+      write_all(fd, out);
+    }
+    if (in_flight.empty()) {
+      break;
+    }
+
+    ssize_t n = read(fd, buffer, sizeof buffer);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      throw std::runtime_error("Server closed the connection.");
+    }
+    in.insert(in.end(), buffer, buffer + n);
+
+    const steady_clock::time_point now = steady_clock::now();
+    size_t offset = 0;
+    const uint8_t *body;
+    uint32_t length;
+    bool too_big;
+    query_response response;
+    while (next_frame(in, offset, body, length, too_big)) {
+      if (!decode_response(body, length, response)) {
+        throw std::runtime_error("Malformed response.");
+      }
+      auto itr = in_flight.find(response.request_id);
+      if (itr == in_flight.end()) {
+        throw std::runtime_error("Response to an unknown request.");
+      }
+      stats.latencies.push_back(duration_cast<duration<double>>(now - itr->second).count());
+      in_flight.erase(itr);
+      if (response.status != query_status::ok) {
+        ++stats.num_bad;
+      }
+      for (auto c : response.hist) {
+        stats.total_count += c;
+      }
+    }
+    if (too_big) {
+      throw std::runtime_error("Response frame too big.");
+    }
+    in.erase(in.begin(), in.begin() + offset);
+  }
+  close(fd);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 7) {
+    std::cerr << "Usage: " << argv[0] << " SOCKET [connections, default 4] [requests in flight per connection, default 16]\n"
+              << "       [seconds, default 5] [fraction of route queries, default 0.1] [segments, default 10000]\n";
+    return 1;
+  }
+  const std::string path = argv[1];
+  const unsigned int num_connections = (argc > 2) ? unsigned(atoi(argv[2])) : 4;
+  const unsigned int depth = (argc > 3) ? unsigned(atoi(argv[3])) : 16;
+  const double seconds = (argc > 4) ? atof(argv[4]) : 5.0;
+  const double route_fraction = (argc > 5) ? atof(argv[5]) : 0.1;
+  const uint32_t num_segments = (argc > 6) ? uint32_t(atoi(argv[6])) : 10000;
+  if (num_connections == 0 || depth == 0 || num_segments < 5) {
+    std::cerr << "Need at least one connection, one request in flight and 5 segments.\n";
+    return 1;
+  }
+
+  std::vector<connection_stats> stats(num_connections);
+  std::vector<std::thread> threads;
+  const steady_clock::time_point t0 = steady_clock::now();
+  const steady_clock::time_point end = t0 + std::chrono::microseconds(int64_t(seconds * 1e6));
+  for (unsigned int i = 0; i < num_connections; ++i) {
+    threads.emplace_back(run_connection, path, num_segments, depth, route_fraction, end,
+                         12345 + i, std::ref(stats[i]));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  const double elapsed = duration_cast<duration<double>>(steady_clock::now() - t0).count();
+
+  std::vector<double> latencies;
+  uint64_t num_bad = 0, total_count = 0;
+  for (auto &s : stats) {
+    latencies.insert(latencies.end(), s.latencies.begin(), s.latencies.end());
+    num_bad += s.num_bad;
+    total_count += s.total_count;
+  }
+  if (latencies.empty()) {
+    std::cout << "No responses.\n";
+    return 1;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto at = [&](double q) { return latencies[size_t(q * double(latencies.size() - 1))]; };
+
+  std::cout << latencies.size() << " requests on " << num_connections << " connections, "
+            << depth << " in flight each: " << (double(latencies.size()) / elapsed)
+            << " requests/s\n";
+  std::cout << "latency p50 = " << at(0.5) << "s, p99 = " << at(0.99) << "s, p99.9 = "
+            << at(0.999) << "s, max = " << latencies.back() << "s\n";
+  std::cout << num_bad << " refused, " << total_count << " observations in all answers\n";
+  return 0;
+}
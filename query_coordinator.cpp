@@ -0,0 +1,452 @@
+#include <iostream>
+#include <unordered_map>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+
+#include <sys/signalfd.h>
+
+#include "query_protocol.hpp"
+#include "framed_socket.hpp"
+#include "segment_shards.hpp"
+
+// scatter-gather front end for a set of query_servers, each serving one shard
+// written by convert_fb_to_shards. it speaks the same protocol as
+// query_server, so query_client can drive either.
+//
+// a segments query is split by shard, and each part sent to the shard which
+// owns those segments. a route goes whole to every shard owning any segment
+// along it, since a shard has the entries for its own segments only and so
+// answers for exactly its part of the route. responses carry summed
+// histograms, so the parts are added up and the total sent back once every
+// shard has answered.
+//
+// there's one persistent connection to each shard, with every sub-request
+// pipelined on it under a request ID unique to the coordinator. it's all on
+// one thread: the work here is just copying and adding, and the shards do
+// the rest. as in query_server, a client with too many answers outstanding
+// isn't read from until it catches up. SIGINT or SIGTERM stops it.
+
+// a client request waiting on its parts.
+struct scattered_query {
+  uint64_t connection_id;
+  uint32_t request_id;
+  uint32_t remaining;
+  bool bad;
+  uint32_t hist[MAX_N_SPEEDS];
+};
+
+constexpr uint64_t listen_id = 0;
+constexpr uint64_t signal_id = 1;
+constexpr uint64_t first_shard_id = 2;
+
+// bytes of answers, written or still to come, past which a client isn't read
+// from until it catches up.
+constexpr size_t max_pending_output = 1 << 20;
+
+class coordinator {
+public:
+  coordinator(int listen_fd, int signal_fd, uint32_t num_segments,
+              const std::vector<std::string> &shard_paths)
+    : listen_fd_(listen_fd), num_segments_(num_segments),
+      num_shards_(uint32_t(shard_paths.size())),
+      next_id_(first_shard_id + shard_paths.size()), next_key_(0),
+      num_requests_(0), num_parts_(0), num_bad_(0) {
+
+    epoll_fd_ = epoll_create1(0);
+    if (epoll_fd_ == -1) {
+      throw std::runtime_error("Unable to create epoll instance.");
+    }
+    add(listen_fd, listen_id, EPOLLIN);
+    add(signal_fd, signal_id, EPOLLIN);
+
+    // the shards may still be loading their tiles, so give them a while.
+    // segments are assigned to shards by their share of num_segments, so
+    // each shard is checked to be from a tile of that many before the
+    // connection goes non-blocking.
+    shards_.resize(num_shards_);
+    for (uint32_t i = 0; i < num_shards_; ++i) {
+      framed_connection &c = shards_[i];
+      c.fd = connect_unix(shard_paths[i], false, 10.0);
+      const uint32_t shard_segments = ask_num_segments(c.fd);
+      if (shard_segments != num_segments_) {
+        throw std::runtime_error("Shard " + std::to_string(i) + " has " + std::to_string(shard_segments) +
+                                 " segments, not " + std::to_string(num_segments_) + ".");
+      }
+      fcntl(c.fd, F_SETFL, fcntl(c.fd, F_GETFL) | O_NONBLOCK);
+      c.out_offset = 0;
+      c.want_read = true;
+      c.want_write = false;
+      c.in_flight = 0;
+      add(c.fd, first_shard_id + i, EPOLLIN | EPOLLRDHUP);
+    }
+    parts_.resize(num_shards_);
+  }
+
+  ~coordinator() {
+    for (auto &c : shards_) {
+      close(c.fd);
+    }
+    for (auto &c : clients_) {
+      close(c.second.fd);
+    }
+    close(epoll_fd_);
+  }
+
+  // runs until a signal arrives.
+  void run() {
+    epoll_event events[64];
+    while (true) {
+      const int n = epoll_wait(epoll_fd_, events, 64, -1);
+      if (n == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::runtime_error("epoll_wait failed.");
+      }
+      for (int i = 0; i < n; ++i) {
+        const uint64_t id = events[i].data.u64;
+        if (id == listen_id) {
+          accept_connections();
+        } else if (id == signal_id) {
+          return;
+        } else if (id < first_shard_id + num_shards_) {
+          framed_connection &c = shards_[id - first_shard_id];
+          if ((events[i].events & EPOLLOUT) != 0) {
+            dirty_.push_back(id);
+          }
+          if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP)) != 0 &&
+              !read_responses(c)) {
+            throw std::runtime_error("Lost the connection to shard " +
+                                     std::to_string(id - first_shard_id) + ".");
+          }
+        } else {
+          auto itr = clients_.find(id);
+          if (itr == clients_.end()) {
+            continue;
+          }
+          if ((events[i].events & EPOLLOUT) != 0) {
+            dirty_.push_back(id);
+          }
+          if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP)) != 0 &&
+              !read_requests(id, itr->second)) {
+            close_connection(id);
+          }
+        }
+      }
+
+      for (auto id : dirty_) {
+        framed_connection *c = connection(id);
+        if (c == nullptr) {
+          continue;
+        }
+        const bool is_shard = id < first_shard_id + num_shards_;
+        if (!flush_connection(epoll_fd_, id, *c)) {
+          if (is_shard) {
+            throw std::runtime_error("Unable to write to shard " +
+                                     std::to_string(id - first_shard_id) + ".");
+          }
+          close_connection(id);
+          continue;
+        }
+        if (!is_shard) {
+          const bool want_read = pending_output(*c, 4 + RESPONSE_SIZE) < max_pending_output;
+          watch_connection(epoll_fd_, id, *c, want_read, c->want_write);
+        }
+      }
+      dirty_.clear();
+    }
+  }
+
+  uint64_t num_requests() const { return num_requests_; }
+  uint64_t num_parts() const { return num_parts_; }
+  uint64_t num_bad() const { return num_bad_; }
+
+private:
+  void add(int fd, uint64_t id, uint32_t events) {
+    epoll_event ev;
+    ev.events = events;
+    ev.data.u64 = id;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == -1) {
+      throw std::runtime_error("Unable to add fd to epoll.");
+    }
+  }
+
+  // sends an info request on a blocking connection and waits for the answer.
+  static uint32_t ask_num_segments(int fd) {
+    query_request request;
+    request.request_id = 0;
+    request.kind = query_kind::info;
+    request.day_hour = 0;
+    std::vector<uint8_t> out;
+    encode_request(request, out);
+    write_all(fd, out);
+
+    std::vector<uint8_t> in;
+    uint8_t buffer[4096];
+    size_t offset = 0;
+    const uint8_t *body;
+    uint32_t length;
+    bool too_big;
+    while (!next_frame(in, offset, body, length, too_big)) {
+      if (too_big) {
+        throw std::runtime_error("Shard sent an oversized frame.");
+      }
+      ssize_t n = read(fd, buffer, sizeof buffer);
+      if (n == -1 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        throw std::runtime_error("Shard closed the connection.");
+      }
+      in.insert(in.end(), buffer, buffer + n);
+    }
+    query_response response;
+    if (!decode_response(body, length, response) || response.status != query_status::ok) {
+      throw std::runtime_error("Shard didn't answer an info request.");
+    }
+    return response.hist[0];
+  }
+
+  framed_connection *connection(uint64_t id) {
+    if (id >= first_shard_id && id < first_shard_id + num_shards_) {
+      return &shards_[id - first_shard_id];
+    }
+    auto itr = clients_.find(id);
+    return itr == clients_.end() ? nullptr : &itr->second;
+  }
+
+  void accept_connections() {
+    while (true) {
+      int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd == -1) {
+        return;
+      }
+      const uint64_t id = next_id_++;
+      framed_connection &c = clients_[id];
+      c.fd = fd;
+      c.out_offset = 0;
+      c.want_read = true;
+      c.want_write = false;
+      c.in_flight = 0;
+      add(fd, id, EPOLLIN | EPOLLRDHUP);
+    }
+  }
+
+  void refuse(uint64_t id, framed_connection &c, uint32_t request_id) {
+    query_response response;
+    memset(&response, 0, sizeof response);
+    response.request_id = request_id;
+    response.status = query_status::bad_request;
+    encode_response(response, c.out);
+    dirty_.push_back(id);
+    ++num_bad_;
+  }
+
+  // splits a request into one part per shard which has anything to say
+  // about it, leaving the rest of parts_ empty. segment IDs outside the tile
+  // are skipped, as query_server would.
+  void split(const query_request &request) {
+    for (auto &part : parts_) {
+      part.clear();
+    }
+    for (auto segment_id : request.segment_ids) {
+      if (segment_id >= num_segments_) {
+        continue;
+      }
+      parts_[shard_of_segment(segment_id, num_segments_, num_shards_)].push_back(segment_id);
+    }
+    if (request.kind == query_kind::route) {
+      for (auto &part : parts_) {
+        if (!part.empty()) {
+          part = request.segment_ids;
+        }
+      }
+    }
+  }
+
+  // reads client requests and sends their parts on to the shards. returns
+  // false if the connection should be closed.
+  bool read_requests(uint64_t id, framed_connection &c) {
+    const bool open = read_available(c);
+
+    size_t offset = 0;
+    const uint8_t *body;
+    uint32_t length;
+    bool too_big;
+    query_request request;
+    while (next_frame(c.in, offset, body, length, too_big)) {
+      ++num_requests_;
+      if (!decode_request(body, length, request)) {
+        uint32_t request_id = 0;
+        if (length >= 4) {
+          memcpy(&request_id, body, 4);
+        }
+        refuse(id, c, request_id);
+        continue;
+      }
+      if (request.kind == query_kind::info) {
+        query_response response;
+        memset(&response, 0, sizeof response);
+        response.request_id = request.request_id;
+        response.status = query_status::ok;
+        response.hist[0] = num_segments_;
+        encode_response(response, c.out);
+        dirty_.push_back(id);
+        continue;
+      }
+
+      split(request);
+      ++c.in_flight;
+      dirty_.push_back(id);
+      const uint32_t key = next_key_++;
+      scattered_query &q = pending_[key];
+      q.connection_id = id;
+      q.request_id = request.request_id;
+      q.remaining = 0;
+      q.bad = false;
+      memset(q.hist, 0, sizeof q.hist);
+
+      query_request part;
+      part.request_id = key;
+      part.kind = request.kind;
+      part.day_hour = request.day_hour;
+      for (uint32_t shard = 0; shard < num_shards_; ++shard) {
+        if (parts_[shard].empty()) {
+          continue;
+        }
+        part.segment_ids.swap(parts_[shard]);
+        encode_request(part, shards_[shard].out);
+        dirty_.push_back(first_shard_id + shard);
+        ++q.remaining;
+        ++num_parts_;
+      }
+      if (q.remaining == 0) {
+        // no segments in the tile at all, so nothing to ask.
+        finish(key);
+      }
+    }
+    c.in.erase(c.in.begin(), c.in.begin() + offset);
+    return open && !too_big;
+  }
+
+  // reads responses from a shard, adding each into its query. returns false
+  // if the shard has gone away or sent something unreadable.
+  bool read_responses(framed_connection &c) {
+    const bool open = read_available(c);
+
+    size_t offset = 0;
+    const uint8_t *body;
+    uint32_t length;
+    bool too_big;
+    query_response response;
+    while (next_frame(c.in, offset, body, length, too_big)) {
+      if (!decode_response(body, length, response)) {
+        return false;
+      }
+      auto itr = pending_.find(response.request_id);
+      if (itr == pending_.end()) {
+        return false;
+      }
+      scattered_query &q = itr->second;
+      for (uint32_t i = 0; i < MAX_N_SPEEDS; ++i) {
+        q.hist[i] += response.hist[i];
+      }
+      q.bad = q.bad || response.status != query_status::ok;
+      if (--q.remaining == 0) {
+        finish(response.request_id);
+      }
+    }
+    c.in.erase(c.in.begin(), c.in.begin() + offset);
+    return open && !too_big;
+  }
+
+  // answers the client, if it's still there, and forgets the query.
+  void finish(uint32_t key) {
+    auto itr = pending_.find(key);
+    const scattered_query &q = itr->second;
+    auto client = clients_.find(q.connection_id);
+    if (client != clients_.end()) {
+      query_response response;
+      response.request_id = q.request_id;
+      response.status = q.bad ? query_status::bad_request : query_status::ok;
+      memcpy(response.hist, q.hist, sizeof response.hist);
+      encode_response(response, client->second.out);
+      --client->second.in_flight;
+      dirty_.push_back(q.connection_id);
+    }
+    pending_.erase(itr);
+  }
+
+  // any of its queries still waiting on shards are answered into the void.
+  void close_connection(uint64_t id) {
+    auto itr = clients_.find(id);
+    if (itr == clients_.end()) {
+      return;
+    }
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, itr->second.fd, nullptr);
+    close(itr->second.fd);
+    clients_.erase(itr);
+  }
+
+  int epoll_fd_;
+  int listen_fd_;
+  const uint32_t num_segments_;
+  const uint32_t num_shards_;
+  uint64_t next_id_;
+  uint32_t next_key_;
+  std::vector<framed_connection> shards_;
+  std::unordered_map<uint64_t, framed_connection> clients_;
+  std::unordered_map<uint32_t, scattered_query> pending_;
+  // scratch space for splitting requests, one per shard.
+  std::vector<std::vector<uint32_t> > parts_;
+  // connections with output to write.
+  std::vector<uint64_t> dirty_;
+  uint64_t num_requests_;
+  uint64_t num_parts_;
+  uint64_t num_bad_;
+};
+
+int main(int argc, char *argv[]) {
+  if (argc < 4) {
+    std::cerr << "Usage: " << argv[0] << " SOCKET NUM_SEGMENTS SHARD_SOCKET...\n";
+    return 1;
+  }
+  const std::string socket_path = argv[1];
+  const uint32_t num_segments = uint32_t(atoi(argv[2]));
+  const std::vector<std::string> shard_paths(argv + 3, argv + argc);
+  if (num_segments < shard_paths.size()) {
+    std::cerr << "Need at least one segment per shard.\n";
+    return 1;
+  }
+
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigprocmask(SIG_BLOCK, &signals, nullptr);
+  const int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+  if (signal_fd == -1) {
+    throw std::runtime_error("Unable to create signalfd.");
+  }
+  const int listen_fd = listen_unix(socket_path);
+
+  uint64_t num_requests = 0, num_parts = 0, num_bad = 0;
+  {
+    coordinator c(listen_fd, signal_fd, num_segments, shard_paths);
+    std::cout << "Coordinating " << shard_paths.size() << " shards of " << num_segments
+              << " segments on " << socket_path << ".\n";
+    c.run();
+    num_requests = c.num_requests();
+    num_parts = c.num_parts();
+    num_bad = c.num_bad();
+  }
+  close(listen_fd);
+  close(signal_fd);
+  unlink(socket_path.c_str());
+
+  std::cout << "Split " << num_requests << " requests into " << num_parts << " parts ("
+            << (num_requests > 0 ? double(num_parts) / double(num_requests) : 0.0)
+            << " per request), and refused " << num_bad << ".\n";
+  return 0;
+}
@@ -0,0 +1,141 @@
+#ifndef QUERY_PROTOCOL_HPP
+#define QUERY_PROTOCOL_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "prefix_sums.hpp"
+
+// the binary framing spoken by query_server and its clients over a local
+// socket. both ends are on the same machine, so everything is in host byte
+// order. every frame is a uint32_t length, of what follows it, then:
+//
+//   request:  uint32_t request_id, uint8_t kind, uint8_t day_hour,
+//             uint16_t num_segments, uint32_t segment_ids[num_segments]
+//   response: uint32_t request_id, uint32_t status,
+//             uint32_t hist[MAX_N_SPEEDS]
+//
+// responses carry the summed histogram rather than a mean, so that partial
+// answers for parts of a query can be merged exactly. requests on one
+// connection can be pipelined, and responses may come back in any order.
+//
+// an info request has no segments, and its response has the number of
+// segments in the tile in hist[0], so that a coordinator can check that its
+// shards were all split from a tile of the size it expects.
+
+enum class query_kind : uint8_t {
+  // aggregate over a set of segments.
+  segments = 0,
+  // aggregate along a route, a list of segments each leading to the next.
+  route = 1,
+  // the number of segments in the tile.
+  info = 2
+};
+
+enum class query_status : uint32_t {
+  ok = 0,
+  bad_request = 1
+};
+
+// frames bigger than this are refused, and the connection dropped.
+constexpr uint32_t MAX_FRAME_SIZE = 1 << 20;
+
+constexpr uint32_t REQUEST_HEADER_SIZE = 4 + 1 + 1 + 2;
+constexpr uint32_t RESPONSE_SIZE = 4 + 4 + 4 * MAX_N_SPEEDS;
+
+struct query_request {
+  uint32_t request_id;
+  query_kind kind;
+  uint8_t day_hour;
+  std::vector<uint32_t> segment_ids;
+};
+
+struct query_response {
+  uint32_t request_id;
+  query_status status;
+  uint32_t hist[MAX_N_SPEEDS];
+};
+
+inline void append_bytes(std::vector<uint8_t> &out, const void *data, size_t size) {
+  const uint8_t *p = (const uint8_t *)data;
+  out.insert(out.end(), p, p + size);
+}
+
+// appends the request, framed, to out.
+inline void encode_request(const query_request &request, std::vector<uint8_t> &out) {
+  const uint32_t length = REQUEST_HEADER_SIZE + 4 * uint32_t(request.segment_ids.size());
+  const uint16_t num_segments = uint16_t(request.segment_ids.size());
+  append_bytes(out, &length, 4);
+  append_bytes(out, &request.request_id, 4);
+  append_bytes(out, &request.kind, 1);
+  append_bytes(out, &request.day_hour, 1);
+  append_bytes(out, &num_segments, 2);
+  append_bytes(out, request.segment_ids.data(), 4 * request.segment_ids.size());
+}
+
+// decodes the body of a request frame, returning false if it's malformed.
+inline bool decode_request(const uint8_t *body, uint32_t length, query_request &request) {
+  if (length < REQUEST_HEADER_SIZE) {
+    return false;
+  }
+  uint16_t num_segments = 0;
+  memcpy(&request.request_id, body, 4);
+  memcpy(&request.kind, body + 4, 1);
+  memcpy(&request.day_hour, body + 5, 1);
+  memcpy(&num_segments, body + 6, 2);
+  if (length != REQUEST_HEADER_SIZE + 4 * uint32_t(num_segments) ||
+      (request.kind != query_kind::segments && request.kind != query_kind::route &&
+       request.kind != query_kind::info) ||
+      (request.kind == query_kind::info && num_segments != 0) ||
+      request.day_hour >= NUM_DAY_HOURS) {
+    return false;
+  }
+  request.segment_ids.resize(num_segments);
+  memcpy(request.segment_ids.data(), body + REQUEST_HEADER_SIZE, 4 * size_t(num_segments));
+  return true;
+}
+
+inline void encode_response(const query_response &response, std::vector<uint8_t> &out) {
+  const uint32_t length = RESPONSE_SIZE;
+  append_bytes(out, &length, 4);
+  append_bytes(out, &response.request_id, 4);
+  append_bytes(out, &response.status, 4);
+  append_bytes(out, response.hist, sizeof response.hist);
+}
+
+inline bool decode_response(const uint8_t *body, uint32_t length, query_response &response) {
+  if (length != RESPONSE_SIZE) {
+    return false;
+  }
+  memcpy(&response.request_id, body, 4);
+  memcpy(&response.status, body + 4, 4);
+  memcpy(response.hist, body + 8, sizeof response.hist);
+  return true;
+}
+
+// finds the next complete frame in buffer from offset. returns false if
+// there isn't one yet, otherwise sets body and length and moves offset past
+// it. a frame claiming to be bigger than MAX_FRAME_SIZE sets too_big.
+inline bool next_frame(
+  const std::vector<uint8_t> &buffer, size_t &offset,
+  const uint8_t *&body, uint32_t &length, bool &too_big) {
+
+  too_big = false;
+  if (buffer.size() - offset < 4) {
+    return false;
+  }
+  memcpy(&length, buffer.data() + offset, 4);
+  if (length > MAX_FRAME_SIZE) {
+    too_big = true;
+    return false;
+  }
+  if (buffer.size() - offset - 4 < length) {
+    return false;
+  }
+  body = buffer.data() + offset + 4;
+  offset += 4 + length;
+  return true;
+}
+
+#endif /* QUERY_PROTOCOL_HPP */
@@ -3,93 +3,174 @@
 #include <iostream>
 #include <random>
 #include <chrono>
+#include "prefix_sums.hpp"
+#include "quantiles.hpp"
+#include "checked_histogram.hpp"
+#include "bucket_runs.hpp"
+#include "vehicle_types.hpp"
+#include "histogram_reader.hpp"
+#include "fb_histogram_reader.hpp"
 
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <sys/mman.h>
-#include <fcntl.h>
-#include <unistd.h>
+#include "mmapped_file.hpp"
 
 namespace ot = OpenTraffic;
 namespace fb = flatbuffers;
 
-struct mmapped_file {
-  mmapped_file(const std::string &path) {
-    int fd = open(path.c_str(), O_RDONLY);
-    if (fd == -1) {
-      throw std::runtime_error("Unable to open input file.");
+// adds the segment's bucket runs with day_hour in [begin, end) into hist.
+// returns false if the segment stores plain entries instead.
+bool add_segment_runs(
+  const ot::Segment *segment, uint32_t begin, uint32_t end, uint32_t *hist) {
+
+  auto runs = segment->bucket_runs();
+  auto run_counts = segment->run_counts();
+  if (runs == nullptr || run_counts == nullptr) {
+    return false;
+  }
+  add_bucket_runs(
+    reinterpret_cast<const bucket_run *>(runs->Data()), runs->size(),
+    run_counts->data(), run_counts->size(),
+    begin, end, hist, MAX_N_SPEEDS);
+  return true;
+}
+
+// mean speed, in the tile's units, at a single day_hour over the vehicle
+// types in types, which are all aggregated in the one pass over each
+// segment's entries. kernel is the one picked for the tile's speed bucket
+// scheme when it was opened.
+double query_file(
+  checked_histogram &tile,
+  const speed_bucket_scheme &scheme,
+  mean_speed_kernel<fb_histogram_reader> kernel,
+  const std::set<uint32_t> &query_ids,
+  uint32_t day_hour,
+  vehicle_type_mask types = all_vehicle_types) {
+
+  return kernel(scheme, fb_histogram_reader(tile, types), query_ids, day_hour);
+}
+
+// mean speed over a set of disjoint day_hour ranges. uses the segment's prefix
+// sums when the tile has them, which makes each range constant time per
+// segment, otherwise scans the entries for each range.
+double query_file_ranges(
+  checked_histogram &tile,
+  const std::set<uint32_t> &query_ids,
+  const std::vector<day_hour_range> &ranges,
+  bool use_prefix_sums = true) {
+
+  uint32_t hist[MAX_N_SPEEDS];
+  memset(hist, 0, sizeof hist);
+
+  for (auto segment_id : query_ids) {
+    if (segment_id >= tile.num_segments()) {
+      continue;
     }
-    struct stat st;
-    int status = fstat(fd, &st);
-    if (status != 0) {
-      throw std::runtime_error("Unable to stat input file.");
+    auto segment = tile.segment(segment_id);
+    auto day_hour_index = segment->day_hour_index();
+    auto prefix_counts = segment->prefix_counts();
+    if (use_prefix_sums && day_hour_index != nullptr && prefix_counts != nullptr) {
+      for (const auto &range : ranges) {
+        assert(range.first <= range.second && range.second <= NUM_DAY_HOURS);
+        add_prefix_range(
+          day_hour_index->data(), prefix_counts->data(),
+          range.first, range.second, hist);
+      }
+      continue;
     }
-    size = st.st_size;
-    buffer = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
-    if (buffer == MAP_FAILED) {
-      throw std::runtime_error("Unable to mmap input file.");
+
+    if (segment->bucket_runs() != nullptr) {
+      for (const auto &range : ranges) {
+        add_segment_runs(segment, range.first, range.second, hist);
+      }
+      continue;
+    }
+    auto entries = segment->entries();
+    if (entries == nullptr) {
+      continue;
     }
-    close(fd);
-  }
 
-  ~mmapped_file() {
-    munmap(buffer, size);
+    for (const auto &range : ranges) {
+      auto itr = std::lower_bound(
+        entries->begin(), entries->end(),
+        range.first,
+        [](const ot::Entry *lhs, uint32_t rhs) {
+          return uint32_t(lhs->day_hour()) < rhs;
+        });
+      while ((itr != entries->end()) && ((*itr)->day_hour() < range.second)) {
+        int bucket = (*itr)->speed_bucket();
+        if (bucket < MAX_N_SPEEDS) {
+          hist[bucket] += (*itr)->count();
+        }
+        ++itr;
+      }
+    }
   }
 
-  size_t size;
-  void *buffer;
-};
-
-#define MAX_N_SPEEDS (120 / 5)
+  return mean_speed(hist);
+}
 
-double query_file(
-  const ot::Histogram *histogram,
+// speed quantiles at a single day_hour. uses the segment's precomputed cdfs
+// when the tile has them, otherwise scans the entries and builds the cdf from
+// the aggregated histogram.
+std::vector<double> query_file_quantiles(
+  checked_histogram &tile,
   const std::set<uint32_t> &query_ids,
-  uint32_t day_hour) {
+  uint32_t day_hour,
+  const std::vector<double> &qs,
+  bool use_cdf = true) {
 
   uint32_t hist[MAX_N_SPEEDS];
   memset(hist, 0, sizeof hist);
+  uint32_t cdf[MAX_N_SPEEDS];
+  memset(cdf, 0, sizeof cdf);
 
   for (auto segment_id : query_ids) {
-    auto segs = histogram->segments();
-    assert(segs != nullptr);
-    auto segment = (*segs)[segment_id];
+    if (segment_id >= tile.num_segments()) {
+      continue;
+    }
+    auto segment = tile.segment(segment_id);
+    auto day_hour_index = segment->day_hour_index();
+    auto cdf_counts = segment->cdf_counts();
+    if (use_cdf && day_hour_index != nullptr && cdf_counts != nullptr) {
+      add_day_hour_cdf(day_hour_index->data(), cdf_counts->data(), day_hour, cdf);
+      continue;
+    }
+
+    if (add_segment_runs(segment, day_hour, day_hour + 1, hist)) {
+      continue;
+    }
     auto entries = segment->entries();
     if (entries == nullptr) {
-      //std::cout << "No entries for segment_id " << segment_id << "\n";
       continue;
     }
+
     auto itr = std::lower_bound(
       entries->begin(), entries->end(),
       day_hour,
       [](const ot::Entry *lhs, uint32_t rhs) {
         return uint32_t(lhs->day_hour()) < rhs;
       });
-    if (itr != entries->end()) {
-      while ((itr != entries->end()) && ((*itr)->day_hour() == day_hour)) {
-        int bucket = (*itr)->speed_bucket();
-        if (bucket < MAX_N_SPEEDS) {
-          hist[bucket] += (*itr)->count();
-        }
-        ++itr;
+    while ((itr != entries->end()) && ((*itr)->day_hour() == day_hour)) {
+      int bucket = (*itr)->speed_bucket();
+      if (bucket < MAX_N_SPEEDS) {
+        hist[bucket] += (*itr)->count();
       }
-    } else {
-      std::cout << "Didn't find segment " << segment_id << " day/hour " << day_hour << "\n";
+      ++itr;
     }
   }
 
-  int sum = 0, num = 0;
-  for (int i = 0; i < MAX_N_SPEEDS; ++i) {
-    sum += (i * 5) * hist[i];
-    num += hist[i];
-  }
+  accumulate_cdf(hist, cdf);
+  return quantiles_from_cdf(cdf, qs);
+}
 
-  if (num > 0) {
-    return double(sum) / double(num);
-  } else {
-    std::cout << "No data for query\n";
-    return 0.0;
-  }
+void usage(const char *prog) {
+  std::cerr << "Usage: " << prog << " [--open full|footer|checksum|lazy] [--vehicle-types LIST]\n"
+            << "  --open  how to check the tile on open, default full. anything other\n"
+            << "          than full relies on the footer written by make_sample_tile.\n"
+            << "          footer:   trust the footer's verified flag.\n"
+            << "          checksum: trust the flag, but check the payload's CRC32C.\n"
+            << "          lazy:     trust the flag, and verify segments on first use.\n"
+            << "  --vehicle-types  comma separated types to aggregate, from auto, truck\n"
+            << "          and bus. default all of them.\n";
 }
 
 int main(int argc, char *argv[]) {
@@ -97,6 +178,36 @@ int main(int argc, char *argv[]) {
   using std::chrono::duration;
   using std::chrono::duration_cast;
 
+  tile_open_mode open_mode = tile_open_mode::verify_full;
+  vehicle_type_mask types = all_vehicle_types;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--open") == 0 && i + 1 < argc) {
+      const std::string mode = argv[++i];
+      if (mode == "full") {
+        open_mode = tile_open_mode::verify_full;
+      } else if (mode == "footer") {
+        open_mode = tile_open_mode::trust_footer;
+      } else if (mode == "checksum") {
+        open_mode = tile_open_mode::checksum;
+      } else if (mode == "lazy") {
+        open_mode = tile_open_mode::lazy;
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--vehicle-types") == 0 && i + 1 < argc) {
+      std::vector<ot::VehicleType> type_list;
+      if (!parse_vehicle_types(argv[++i], type_list)) {
+        usage(argv[0]);
+        return 1;
+      }
+      types = vehicle_types_to_mask(type_list);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
   std::mt19937_64 eng(12345);
   std::uniform_int_distribution<uint32_t> dist_segment_id(0, 10000);
 
@@ -115,27 +226,149 @@ int main(int argc, char *argv[]) {
   double val = 0;
   steady_clock::time_point t0 = steady_clock::now();
   steady_clock::time_point t1;
+  speed_bucket_scheme scheme;
   {
     mmapped_file f("sample.tile");
-
-    auto verifier = fb::Verifier((const uint8_t *)f.buffer, f.size);
-    bool ok = ot::VerifyHistogramBuffer(verifier);
-    if (!ok) {
-      throw std::runtime_error("Buffer verification failed.");
+    checked_histogram tile(f.buffer, f.size, open_mode);
+    if (tile.mode() != open_mode) {
+      std::cout << "Tile has no verified footer, fell back to full verification.\n";
     }
-
-    auto histogram = ot::GetHistogram(f.buffer);
+    scheme = tile_speed_buckets(tile.histogram());
+    auto kernel = select_mean_speed_kernel<fb_histogram_reader>(scheme);
 
     t1 = steady_clock::now();
     for (int n = 0; n < num_iterations; ++n) {
-      val = query_file(histogram, query_segment_ids, 4 * 24 + 12);
+      val = query_file(tile, scheme, kernel, query_segment_ids, 4 * 24 + 12, types);
     }
   }
   steady_clock::time_point t2 = steady_clock::now();
   duration<double> setup_t = duration_cast<duration<double>>(t1 - t0);
   duration<double> iter_t = duration_cast<duration<double>>(t2 - t1);
 
-  std::cout << "val = " << val << " in " << (iter_t.count() / double(num_iterations)) << "s per iteration, plus " << setup_t.count() << "s to setup\n";
+  std::cout << "val = " << val << " " << scheme.units_name() << " in " << (iter_t.count() / double(num_iterations)) << "s per iteration, plus " << setup_t.count() << "s to setup\n";
+
+  // the mean speed through the kernel picked for the tile's speed bucket
+  // scheme, against the generic kernel which any scheme could use.
+  {
+    mmapped_file f("sample.tile");
+    checked_histogram tile(f.buffer, f.size, open_mode);
+    fb_histogram_reader reader(tile, types);
+    auto kernel = select_mean_speed_kernel<fb_histogram_reader>(scheme);
+    std::cout << "Tile has " << scheme.count << " speed buckets of " << scheme.width
+              << " " << scheme.units_name() << (kernel == &generic_mean_speed<fb_histogram_reader> ?
+                                                ", which has no specialised kernel.\n" : ".\n");
+
+    for (auto k : {kernel, &generic_mean_speed<fb_histogram_reader>}) {
+      steady_clock::time_point s0 = steady_clock::now();
+      for (int n = 0; n < num_iterations; ++n) {
+        val = k(scheme, reader, query_segment_ids, 4 * 24 + 12);
+      }
+      steady_clock::time_point s1 = steady_clock::now();
+      duration<double> scheme_t = duration_cast<duration<double>>(s1 - s0);
+
+      std::cout << "val = " << val << " " << scheme.units_name() << " in "
+                << (scheme_t.count() / double(num_iterations)) << "s per iteration"
+                << (k == kernel ? " with the tile's kernel\n" : " with the generic kernel\n");
+    }
+  }
+
+  // a tile with several vehicle types can answer for all of them in one pass,
+  // where separate tiles would need a lookup each.
+  {
+    mmapped_file f("sample.tile");
+    checked_histogram tile(f.buffer, f.size, open_mode);
+    auto tile_types = tile.histogram()->vehicle_types();
+    auto kernel = select_mean_speed_kernel<fb_histogram_reader>(scheme);
+    if (tile_types == nullptr) {
+      std::cout << "Tile has one vehicle type, run make_sample_tile --vehicle-types auto,truck,bus to compare.\n";
+    } else {
+      steady_clock::time_point v0 = steady_clock::now();
+      for (int n = 0; n < num_iterations; ++n) {
+        val = query_file(tile, scheme, kernel, query_segment_ids, 4 * 24 + 12, all_vehicle_types);
+      }
+      steady_clock::time_point v1 = steady_clock::now();
+      std::vector<double> vals(tile_types->size());
+      for (int n = 0; n < num_iterations; ++n) {
+        for (size_t i = 0; i < tile_types->size(); ++i) {
+          vals[i] = query_file(tile, scheme, kernel, query_segment_ids, 4 * 24 + 12,
+                               vehicle_type_bit(ot::VehicleType((*tile_types)[i])));
+        }
+      }
+      steady_clock::time_point v2 = steady_clock::now();
+      duration<double> all_t = duration_cast<duration<double>>(v1 - v0);
+      duration<double> each_t = duration_cast<duration<double>>(v2 - v1);
+
+      std::cout << "all " << tile_types->size() << " vehicle types val = " << val << " in "
+                << (all_t.count() / double(num_iterations)) << "s per iteration\n";
+      std::cout << "each vehicle type val =";
+      for (auto v : vals) {
+        std::cout << " " << v;
+      }
+      std::cout << " in " << (each_t.count() / double(num_iterations)) << "s per iteration\n";
+    }
+  }
+
+  // the prefix sums, cdfs and quantiles below are all in 5mph buckets.
+  if (scheme != default_speed_buckets) {
+    std::cout << "Skipping ranges and quantiles, which need the default speed buckets.\n";
+    return 0;
+  }
+
+  // weekday morning peak, which is 10 separate day_hours.
+  const auto ranges = weekday_ranges(7, 9);
+  {
+    mmapped_file f("sample.tile");
+    checked_histogram tile(f.buffer, f.size, open_mode);
+    bool has_prefix_sums = false;
+    for (auto segment_id : query_segment_ids) {
+      if (segment_id >= tile.num_segments()) {
+        continue;
+      }
+      auto segment = tile.segment(segment_id);
+      has_prefix_sums |= (segment->day_hour_index() != nullptr);
+    }
+    if (!has_prefix_sums) {
+      std::cout << "Tile has no prefix sums, run make_sample_tile --prefix-sums to compare.\n";
+    }
+
+    for (bool use_prefix_sums : {false, true}) {
+      steady_clock::time_point r0 = steady_clock::now();
+      for (int n = 0; n < num_iterations; ++n) {
+        val = query_file_ranges(tile, query_segment_ids, ranges, use_prefix_sums);
+      }
+      steady_clock::time_point r1 = steady_clock::now();
+      duration<double> range_t = duration_cast<duration<double>>(r1 - r0);
+
+      std::cout << "weekdays 07:00-09:00 val = " << val << " in " << (range_t.count() / double(num_iterations)) << "s per iteration"
+                << (use_prefix_sums ? " with prefix sums\n" : " scanning entries\n");
+    }
+
+    bool has_cdf = false;
+    for (auto segment_id : query_segment_ids) {
+      if (segment_id >= tile.num_segments()) {
+        continue;
+      }
+      auto segment = tile.segment(segment_id);
+      has_cdf |= (segment->cdf_counts() != nullptr);
+    }
+    if (!has_cdf) {
+      std::cout << "Tile has no cdfs, run make_sample_tile --cdf to compare.\n";
+    }
+
+    for (bool use_cdf : {false, true}) {
+      std::vector<double> speeds;
+      steady_clock::time_point q0 = steady_clock::now();
+      for (int n = 0; n < num_iterations; ++n) {
+        speeds = query_file_quantiles(tile, query_segment_ids, 4 * 24 + 12, congestion_quantiles, use_cdf);
+      }
+      steady_clock::time_point q1 = steady_clock::now();
+      duration<double> quantile_t = duration_cast<duration<double>>(q1 - q0);
+
+      std::cout << "p15/p50/p85 = " << speeds[0] << "/" << speeds[1] << "/" << speeds[2]
+                << " in " << (quantile_t.count() / double(num_iterations)) << "s per iteration"
+                << (use_cdf ? " with cdfs\n" : " on the fly\n");
+    }
+  }
 
   return 0;
 }
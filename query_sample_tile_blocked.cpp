@@ -0,0 +1,126 @@
+#include "histogram_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+
+#include "blocked_tile.hpp"
+#include "plain_entries.hpp"
+#include "histogram_reader.hpp"
+#include "fb_histogram_reader.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+// a blocked tile whose blocks are FlatBuffers Histograms. each block is
+// verified the first time it's decompressed into the cache.
+class blocked_histogram {
+public:
+  blocked_histogram(const std::string &path, size_t cache_budget)
+    : reader(path, cache_budget) {}
+
+  // the segment, which is valid until the next call to segment().
+  const ot::Segment *segment(uint32_t segment_id) {
+    const uint32_t block = reader.block_for_segment(segment_id);
+    size_t size = 0;
+    bool is_new = false;
+    const uint8_t *buffer = reader.block(block, size, is_new);
+    if (is_new) {
+      auto verifier = fb::Verifier(buffer, size);
+      if (!ot::VerifyHistogramBuffer(verifier)) {
+        throw std::runtime_error("Block verification failed.");
+      }
+      require_default_speed_buckets(tile_speed_buckets(ot::GetHistogram(buffer)));
+    }
+    auto segments = ot::GetHistogram(buffer)->segments();
+    return (*segments)[segment_id - reader.first_segment(block)];
+  }
+
+  blocked_tile_reader reader;
+};
+
+// histogram_reader.hpp reader for a blocked_histogram.
+class blocked_histogram_reader {
+public:
+  explicit blocked_histogram_reader(blocked_histogram &histogram)
+    : histogram_(&histogram) {}
+
+  uint32_t num_segments() const {
+    return histogram_->reader.num_segments();
+  }
+
+  template <typename F>
+  void for_each_entry(uint32_t segment_id, uint32_t day_hour, F &&f) const {
+    auto segment = histogram_->segment(segment_id);
+    auto entries = segment->entries();
+    if (entries == nullptr) {
+      require_plain_entries(segment);
+      return;
+    }
+    auto itr = std::lower_bound(
+      entries->begin(), entries->end(),
+      day_hour,
+      [](const ot::Entry *lhs, uint32_t rhs) {
+        return uint32_t(lhs->day_hour()) < rhs;
+      });
+    while ((itr != entries->end()) && ((*itr)->day_hour() == day_hour)) {
+      f(uint32_t((*itr)->speed_bucket()), uint32_t((*itr)->count()));
+      ++itr;
+    }
+  }
+
+private:
+  // decompressing blocks into the cache changes it, so isn't const.
+  blocked_histogram *histogram_;
+};
+
+int main(int argc, char *argv[]) {
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+
+  if (argc > 2) {
+    std::cerr << "Usage: " << argv[0] << " [cache budget in MiB, default 64]\n";
+    return 1;
+  }
+  const size_t budget_bytes = size_t(((argc > 1) ? atof(argv[1]) : 64.0) * 1024 * 1024);
+
+  std::mt19937_64 eng(12345);
+  std::uniform_int_distribution<uint32_t> dist_segment_id(0, 10000);
+
+  std::set<uint32_t> query_segment_ids;
+  for (int i = 0; i < 50; ++i) {
+    query_segment_ids.insert(dist_segment_id(eng));
+  }
+  std::cout << "Querying for " << query_segment_ids.size() << " segments.\n";
+
+  const int num_iterations = 100000;
+  double val = 0;
+  steady_clock::time_point t0 = steady_clock::now();
+  blocked_histogram histogram("sample.tile.blocked", budget_bytes);
+  blocked_histogram_reader reader(histogram);
+  steady_clock::time_point t1 = steady_clock::now();
+
+  // the first query has to decompress every block it touches.
+  val = query_mean_speed(reader, query_segment_ids, 4 * 24 + 12);
+  steady_clock::time_point t2 = steady_clock::now();
+
+  for (int n = 0; n < num_iterations; ++n) {
+    val = query_mean_speed(reader, query_segment_ids, 4 * 24 + 12);
+  }
+  steady_clock::time_point t3 = steady_clock::now();
+
+  duration<double> setup_t = duration_cast<duration<double>>(t1 - t0);
+  duration<double> first_t = duration_cast<duration<double>>(t2 - t1);
+  duration<double> iter_t = duration_cast<duration<double>>(t3 - t2);
+
+  std::cout << "val = " << val << " in " << (iter_t.count() / double(num_iterations)) << "s per iteration, plus "
+            << setup_t.count() << "s to setup and " << first_t.count() << "s for the first, cold, query\n";
+  std::cout << "cache: " << histogram.reader.cached_bytes() << " bytes in use of " << budget_bytes
+            << ", " << histogram.reader.hits() << " hits, " << histogram.reader.misses() << " misses, "
+            << histogram.reader.evictions() << " evictions, " << histogram.reader.decompressed_bytes()
+            << " bytes decompressed\n";
+
+  return 0;
+}
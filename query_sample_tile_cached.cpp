@@ -0,0 +1,165 @@
+#include "histogram_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#include "mmapped_file.hpp"
+#include "checked_histogram.hpp"
+#include "histogram_reader.hpp"
+#include "fb_histogram_reader.hpp"
+#include "partial_aggregate_cache.hpp"
+#include "zipf_workload.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+// histogram_reader.hpp reader which goes through the cache for each segment,
+// if there is one. version identifies the tile the cached partials come from.
+class cached_histogram_reader {
+public:
+  cached_histogram_reader(checked_histogram &tile, partial_aggregate_cache *cache, uint64_t version)
+    : plain_(tile), cache_(cache), version_(version) {}
+
+  uint32_t num_segments() const {
+    return plain_.num_segments();
+  }
+
+  template <typename F>
+  void for_each_entry(uint32_t segment_id, uint32_t day_hour, F &&f) const {
+    if (cache_ == nullptr) {
+      plain_.for_each_entry(segment_id, day_hour, f);
+      return;
+    }
+    uint32_t hist[MAX_N_SPEEDS];
+    memset(hist, 0, sizeof hist);
+    cache_->add(version_, segment_id, day_hour, hist,
+                [&](partial_aggregate_cache::partial_hist &partial) {
+                  plain_.for_each_entry(segment_id, day_hour, [&partial](uint32_t bucket, uint32_t count) {
+                      if (bucket < MAX_N_SPEEDS) {
+                        partial[bucket] += count;
+                      }
+                    });
+                });
+    for (uint32_t i = 0; i < MAX_N_SPEEDS; ++i) {
+      f(i, hist[i]);
+    }
+  }
+
+private:
+  fb_histogram_reader plain_;
+  partial_aggregate_cache *cache_;
+  uint64_t version_;
+};
+
+struct query {
+  std::set<uint32_t> segment_ids;
+  uint32_t day_hour;
+};
+
+// runs the queries num_iterations times on each of num_threads threads, each
+// starting at a different place, and returns the time per query. checksum is
+// the sum of all the answers, which should be the same with or without a cache.
+double run_queries(
+  const cached_histogram_reader &reader,
+  const std::vector<query> &queries,
+  int num_iterations,
+  unsigned int num_threads,
+  double &checksum) {
+
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+
+  std::vector<double> checksums(num_threads, 0.0);
+  steady_clock::time_point t0 = steady_clock::now();
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t]() {
+        const size_t start = t * queries.size() / num_threads;
+        for (int n = 0; n < num_iterations; ++n) {
+          for (size_t i = 0; i < queries.size(); ++i) {
+            const auto &q = queries[(start + i) % queries.size()];
+            checksums[t] += query_mean_speed(reader, q.segment_ids, q.day_hour);
+          }
+        }
+      });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  steady_clock::time_point t1 = steady_clock::now();
+  duration<double> query_t = duration_cast<duration<double>>(t1 - t0);
+
+  checksum = 0;
+  for (auto c : checksums) {
+    checksum += c;
+  }
+
+  return query_t.count() / double(size_t(num_iterations) * queries.size() * num_threads);
+}
+
+void print_stats(const partial_aggregate_cache &cache) {
+  std::cout << "  " << cache.size() << " of " << cache.capacity() << " entries, hit rate = "
+            << cache.hit_rate() << ", " << cache.hits() << " hits, " << cache.misses()
+            << " misses, " << cache.evictions() << " evictions, " << cache.invalidations()
+            << " invalidated\n";
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 3) {
+    std::cerr << "Usage: " << argv[0] << " [cache budget in MiB, default 4] [threads, default 4]\n";
+    return 1;
+  }
+  const size_t budget_bytes = size_t(((argc > 1) ? atof(argv[1]) : 4.0) * 1024 * 1024);
+  const unsigned int num_threads = (argc > 2) ? unsigned(atoi(argv[2])) : 4;
+  if (num_threads == 0) {
+    std::cerr << "Need at least one thread.\n";
+    return 1;
+  }
+
+  mmapped_file f("sample.tile");
+  checked_histogram tile(f.buffer, f.size, tile_open_mode::verify_full);
+  require_default_speed_buckets(tile_speed_buckets(tile.histogram()));
+  const uint32_t num_segments = tile.num_segments();
+
+  // skewed segments, each query at a weekday daytime hour.
+  zipf_workload workload(num_segments, 1.1, 12345);
+  std::uniform_int_distribution<uint32_t> dist_day(1, 5);
+  std::uniform_int_distribution<uint32_t> dist_hour(7, 19);
+  std::vector<query> queries(1000);
+  for (auto &q : queries) {
+    while (q.segment_ids.size() < 50) {
+      q.segment_ids.insert(workload());
+    }
+    q.day_hour = dist_day(workload.eng) * 24 + dist_hour(workload.eng);
+  }
+
+  const int num_iterations = 20;
+  std::cout << "Running " << queries.size() << " queries " << num_iterations
+            << " times on " << num_threads << " threads.\n";
+
+  double checksum = 0;
+  double per_query = run_queries(cached_histogram_reader(tile, nullptr, 0), queries, num_iterations, num_threads, checksum);
+  std::cout << "without cache: " << per_query << "s per query (checksum " << checksum << ")\n";
+
+  partial_aggregate_cache cache(budget_bytes);
+  per_query = run_queries(cached_histogram_reader(tile, &cache, 1), queries, 1, num_threads, checksum);
+  std::cout << "with cache, cold: " << per_query << "s per query (checksum " << checksum << ")\n";
+  print_stats(cache);
+
+  cache.reset_counters();
+  per_query = run_queries(cached_histogram_reader(tile, &cache, 1), queries, num_iterations, num_threads, checksum);
+  std::cout << "with cache, warm: " << per_query << "s per query (checksum " << checksum << ")\n";
+  print_stats(cache);
+
+  // a new tile version invalidates everything cached from the old one.
+  cache.reset_counters();
+  per_query = run_queries(cached_histogram_reader(tile, &cache, 2), queries, 1, num_threads, checksum);
+  std::cout << "with cache, after a tile swap: " << per_query << "s per query (checksum " << checksum << ")\n";
+  print_stats(cache);
+
+  return 0;
+}
@@ -0,0 +1,253 @@
+#include "histogram_tile_generated.h"
+#include "histogram_delta_generated.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <algorithm>
+
+#include "tile_handle.hpp"
+#include "delta_tile.hpp"
+#include "delta_compactor.hpp"
+#include "sample_delta.hpp"
+#include "histogram_reader.hpp"
+#include "fb_histogram_reader.hpp"
+#include "zipf_workload.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+using std::chrono::steady_clock;
+using std::chrono::duration;
+using std::chrono::duration_cast;
+
+struct query {
+  std::set<uint32_t> segment_ids;
+  std::vector<uint32_t> route;
+  uint32_t day_hour;
+};
+
+struct latency_summary {
+  double mean, p50, p99;
+};
+
+latency_summary summarise(std::vector<double> &latencies) {
+  latency_summary s = {0, 0, 0};
+  if (latencies.empty()) {
+    return s;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  for (auto l : latencies) {
+    s.mean += l;
+  }
+  s.mean /= double(latencies.size());
+  s.p50 = latencies[size_t(0.5 * double(latencies.size() - 1))];
+  s.p99 = latencies[size_t(0.99 * double(latencies.size() - 1))];
+  return s;
+}
+
+void write_sample_delta(const std::string &path, const ot::Histogram *histogram, uint32_t day, double fraction, uint64_t seed) {
+  std::vector<ot::DeltaEntry> entries = sample_delta_entries(histogram, day, fraction, seed);
+  fb::FlatBufferBuilder builder(1024);
+  build_delta_tile(entries, tile_speed_buckets(histogram), builder);
+  uint8_t *buf = builder.GetBufferPointer();
+  size_t size = builder.GetSize();
+  const tile_footer footer = make_tile_footer(buf, size, true);
+  std::ofstream out(path);
+  out.write((const char *)buf, (std::streamsize)size);
+  out.write((const char *)&footer, sizeof footer);
+}
+
+// runs one query, returning the mean speed for a set of segments or, for a
+// route, the total count along it in the scheme's buckets.
+template <typename Reader>
+double run_query(const Reader &reader, mean_speed_kernel<Reader> kernel, const speed_bucket_scheme &scheme, const query &q) {
+  if (!q.route.empty()) {
+    double total = 0;
+    visit_route(reader, q.route, q.day_hour, [&total, &scheme](uint32_t bucket, uint32_t count) {
+        if (bucket < scheme.count) {
+          total += count;
+        }
+      });
+    return total;
+  }
+  return kernel(scheme, reader, q.segment_ids, q.day_hour);
+}
+
+// the histogram for a query, in full, to compare readers exactly. speed
+// buckets are bytes, so every bucket of any scheme fits.
+template <typename Reader>
+std::vector<uint32_t> query_hist(const Reader &reader, const query &q) {
+  std::vector<uint32_t> hist(256, 0);
+  auto add = [&hist](uint32_t bucket, uint32_t count) {
+    hist[bucket] += count;
+  };
+  if (!q.route.empty()) {
+    visit_route(reader, q.route, q.day_hour, add);
+  } else {
+    visit_entries(reader, q.segment_ids, q.day_hour, add);
+  }
+  return hist;
+}
+
+// measures how much each outstanding delta adds to query latency, checks that
+// the tile with its deltas overlaid answers the same as the tile they compact
+// into, then queries while deltas keep arriving and a delta_compactor folds
+// them in in the background.
+int main(int argc, char *argv[]) {
+  if (argc > 4) {
+    std::cerr << "Usage: " << argv[0] << " [most deltas, default 8] [fraction of segments in each delta, default 0.05]\n"
+              << "       [seconds to run the compactor, default 5]\n";
+    return 1;
+  }
+  const uint32_t max_deltas = (argc > 1) ? uint32_t(atoi(argv[1])) : 8;
+  const double fraction = (argc > 2) ? atof(argv[2]) : 0.05;
+  const double run_seconds = (argc > 3) ? atof(argv[3]) : 5.0;
+  if (max_deltas == 0) {
+    std::cerr << "Need at least one delta.\n";
+    return 1;
+  }
+
+  mmap_policy policy;
+  policy.populate = true;
+  tile_handle handle("sample.tile", tile_open_mode::verify_full, policy);
+  const size_t slot = handle.register_reader();
+
+  std::vector<std::string> delta_paths;
+  std::vector<query> queries(2000);
+  speed_bucket_scheme scheme;
+  {
+    tile_handle::read_guard tile(handle, slot);
+    const ot::Histogram *histogram = tile->tile.histogram();
+    scheme = tile_speed_buckets(histogram);
+    for (uint32_t i = 0; i < max_deltas; ++i) {
+      delta_paths.push_back("sample.delta." + std::to_string(i));
+      write_sample_delta(delta_paths.back(), histogram, i % 7, fraction, 1000 + i);
+    }
+
+    // one query in ten is along a route. each sample tile segment's first
+    // next segment is the following ID.
+    zipf_workload workload(tile->tile.num_segments(), 1.1, 12345);
+    std::uniform_int_distribution<uint32_t> dist_day(0, 6);
+    std::uniform_int_distribution<uint32_t> dist_hour(7, 19);
+    for (size_t i = 0; i < queries.size(); ++i) {
+      query &q = queries[i];
+      if (i % 10 == 0) {
+        const uint32_t start = workload() % (tile->tile.num_segments() - 4);
+        for (uint32_t j = 0; j < 5; ++j) {
+          q.route.push_back(start + j);
+        }
+      } else {
+        while (q.segment_ids.size() < 50) {
+          q.segment_ids.insert(workload());
+        }
+      }
+      q.day_hour = dist_day(workload.eng) * 24 + dist_hour(workload.eng);
+    }
+  }
+  const auto kernel = select_mean_speed_kernel<delta_histogram_reader>(scheme);
+
+  // latency against the number of outstanding deltas.
+  double base_mean = 0;
+  for (uint32_t num_deltas = 0; num_deltas <= max_deltas; ++num_deltas) {
+    if (num_deltas > 0) {
+      handle.add_delta(delta_paths[num_deltas - 1]);
+    }
+    std::vector<double> latencies;
+    double checksum = 0;
+    for (int rep = 0; rep < 5; ++rep) {
+      for (const auto &q : queries) {
+        steady_clock::time_point q0 = steady_clock::now();
+        {
+          tile_handle::read_guard tile(handle, slot);
+          delta_histogram_reader reader(tile->tile, tile->deltas);
+          checksum += run_query(reader, kernel, scheme, q);
+        }
+        steady_clock::time_point q1 = steady_clock::now();
+        latencies.push_back(duration_cast<duration<double>>(q1 - q0).count());
+      }
+    }
+    const latency_summary s = summarise(latencies);
+    if (num_deltas == 0) {
+      base_mean = s.mean;
+    }
+    std::cout << num_deltas << " deltas: mean = " << s.mean << "s, p50 = " << s.p50 << "s, p99 = "
+              << s.p99 << "s, overhead " << (100.0 * (s.mean - base_mean) / base_mean)
+              << "% (checksum " << checksum << ")\n";
+  }
+
+  // the overlay has to answer exactly as the compacted tile does.
+  {
+    tile_handle::read_guard tile(handle, slot);
+    fb::FlatBufferBuilder builder(1024 * 1024);
+    steady_clock::time_point c0 = steady_clock::now();
+    const tile_merge_stats stats = compact_deltas(tile->tile.histogram(), tile->deltas, builder);
+    steady_clock::time_point c1 = steady_clock::now();
+    checked_histogram compacted(builder.GetBufferPointer(), builder.GetSize(), tile_open_mode::verify_full);
+
+    delta_histogram_reader overlay(tile->tile, tile->deltas);
+    fb_histogram_reader plain(compacted);
+    size_t mismatches = 0;
+    for (const auto &q : queries) {
+      if (query_hist(overlay, q) != query_hist(plain, q)) {
+        ++mismatches;
+      }
+    }
+    std::cout << "Compacted " << tile->deltas.size() << " deltas into " << stats.entries_out
+              << " entries from " << stats.entries_in << " in "
+              << duration_cast<duration<double>>(c1 - c0).count() << "s, " << mismatches
+              << " of " << queries.size() << " queries answered differently.\n";
+  }
+
+  // deltas keep arriving while a thread queries, and the compactor folds them
+  // in whenever there are more than 2.
+  handle.swap("sample.tile");
+  std::vector<double> latencies;
+  {
+    delta_compactor compactor(handle, "sample.tile.compacted", 2, 64 * 1024 * 1024);
+    std::atomic<bool> stop(false);
+    std::thread querier([&]() {
+        const size_t query_slot = handle.register_reader();
+        size_t i = 0;
+        double checksum = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+          const auto &q = queries[i++ % queries.size()];
+          steady_clock::time_point q0 = steady_clock::now();
+          {
+            tile_handle::read_guard tile(handle, query_slot);
+            delta_histogram_reader reader(tile->tile, tile->deltas);
+            checksum += run_query(reader, kernel, scheme, q);
+          }
+          steady_clock::time_point q1 = steady_clock::now();
+          latencies.push_back(duration_cast<duration<double>>(q1 - q0).count());
+        }
+        handle.unregister_reader(query_slot);
+      });
+
+    const steady_clock::time_point end = steady_clock::now() +
+      std::chrono::microseconds(int64_t(run_seconds * 1e6));
+    size_t added = 0;
+    while (steady_clock::now() < end) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      handle.add_delta(delta_paths[added++ % delta_paths.size()]);
+      compactor.notify();
+    }
+    stop.store(true);
+    querier.join();
+
+    std::shared_ptr<mapped_tile> base;
+    delta_list deltas;
+    handle.layers(base, deltas);
+    std::cout << added << " deltas added, " << compactor.num_compactions() << " compactions, "
+              << deltas.size() << " deltas outstanding at the end.\n";
+  }
+  const latency_summary s = summarise(latencies);
+  std::cout << "with background compaction: mean = " << s.mean << "s, p50 = " << s.p50
+            << "s, p99 = " << s.p99 << "s over " << latencies.size() << " queries\n";
+
+  handle.unregister_reader(slot);
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include "histogram_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+
+#include "mmapped_file.hpp"
+#include "checked_histogram.hpp"
+#include "plain_entries.hpp"
+#include "histogram_reader.hpp"
+#include "fb_histogram_reader.hpp"
+
+#include "hot_segment_cubes.hpp"
+#include "zipf_workload.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+// histogram_reader.hpp reader which reads segments which are in the cubes
+// from there, and the rest from the tile. pass a null cubes pointer to always
+// read the tile.
+class hot_histogram_reader {
+public:
+  hot_histogram_reader(checked_histogram &tile, hot_segment_cubes *cubes)
+    : plain_(tile), cubes_(cubes) {}
+
+  uint32_t num_segments() const {
+    return plain_.num_segments();
+  }
+
+  template <typename F>
+  void for_each_entry(uint32_t segment_id, uint32_t day_hour, F &&f) const {
+    if (cubes_ != nullptr) {
+      const uint32_t *row = cubes_->lookup(segment_id, day_hour);
+      if (row != nullptr) {
+        for (uint32_t i = 0; i < MAX_N_SPEEDS; ++i) {
+          f(i, row[i]);
+        }
+        return;
+      }
+    }
+    plain_.for_each_entry(segment_id, day_hour, f);
+  }
+
+private:
+  fb_histogram_reader plain_;
+  // lookups count hits and misses, so aren't const.
+  hot_segment_cubes *cubes_;
+};
+
+int main(int argc, char *argv[]) {
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+
+  if (argc > 2) {
+    std::cerr << "Usage: " << argv[0] << " [budget in MiB, default 8]\n";
+    return 1;
+  }
+  const size_t budget_bytes = size_t(((argc > 1) ? atof(argv[1]) : 8.0) * 1024 * 1024);
+
+  mmapped_file f("sample.tile");
+  checked_histogram tile(f.buffer, f.size, tile_open_mode::verify_full);
+  auto histogram = tile.histogram();
+  require_default_speed_buckets(tile_speed_buckets(histogram));
+  auto segs = histogram->segments();
+  const uint32_t num_segments = segs->size();
+
+  // the first half of the workload is the trace used to pick hot segments,
+  // the second half is what's benchmarked.
+  zipf_workload workload(num_segments, 1.1, 12345);
+  std::vector<uint32_t> trace;
+  for (int i = 0; i < 100000; ++i) {
+    trace.push_back(workload());
+  }
+  std::vector<std::set<uint32_t> > queries(1000);
+  for (auto &query : queries) {
+    while (query.size() < 50) {
+      query.insert(workload());
+    }
+  }
+
+  steady_clock::time_point t0 = steady_clock::now();
+  hot_segment_cubes cubes(num_segments, trace, budget_bytes);
+  for (auto segment_id : cubes.hot_segments()) {
+    auto entries = (*segs)[segment_id]->entries();
+    if (entries == nullptr) {
+      require_plain_entries((*segs)[segment_id]);
+      continue;
+    }
+    for (auto entry : *entries) {
+      cubes.add(segment_id, entry->day_hour(), entry->speed_bucket(), entry->count());
+    }
+  }
+  steady_clock::time_point t1 = steady_clock::now();
+  std::cout << "Built " << cubes.num_cubes() << " cubes (" << cubes.size_bytes()
+            << " bytes of a " << budget_bytes << " byte budget) in "
+            << duration_cast<duration<double>>(t1 - t0).count() << "s\n";
+
+  const uint32_t day_hour = 4 * 24 + 12;
+  const int num_iterations = 100;
+  for (hot_segment_cubes *c : {(hot_segment_cubes *)nullptr, &cubes}) {
+    hot_histogram_reader reader(tile, c);
+    double val = 0;
+    steady_clock::time_point q0 = steady_clock::now();
+    for (int n = 0; n < num_iterations; ++n) {
+      for (const auto &query : queries) {
+        val += query_mean_speed(reader, query, day_hour);
+      }
+    }
+    steady_clock::time_point q1 = steady_clock::now();
+    duration<double> query_t = duration_cast<duration<double>>(q1 - q0);
+
+    const double per_query = query_t.count() / double(num_iterations * queries.size());
+    std::cout << (c == nullptr ? "without" : "with") << " cubes: "
+              << per_query << "s per query (checksum " << val << ")\n";
+  }
+
+  const uint64_t lookups = cubes.hits() + cubes.misses();
+  std::cout << "cube hits = " << cubes.hits() << ", misses = " << cubes.misses()
+            << ", hit rate = " << (lookups > 0 ? double(cubes.hits()) / double(lookups) : 0.0) << "\n";
+
+  return 0;
+}
@@ -0,0 +1,227 @@
+#include "histogram_tile_generated.h"
+#include "histogram_hour_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <limits>
+
+#include "mmapped_file.hpp"
+#include "checked_histogram.hpp"
+#include "histogram_reader.hpp"
+#include "fb_histogram_reader.hpp"
+#include "run_on_threads.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+// histogram_reader.hpp reader for the hour-major tile. a query only needs
+// the one day_hour block, so this overloads visit_entries() to find it once
+// and, as the query IDs are sorted, to start each lookup in the block's
+// segment IDs from where the last one left off.
+class hour_major_histogram_reader {
+public:
+  explicit hour_major_histogram_reader(const ot::HourMajorHistogram *histogram)
+    : histogram_(histogram) {}
+
+  const ot::HourMajorHistogram *histogram() const { return histogram_; }
+
+private:
+  const ot::HourMajorHistogram *histogram_;
+};
+
+template <typename F>
+void visit_entries(
+  const hour_major_histogram_reader &reader,
+  const std::set<uint32_t> &query_ids,
+  uint32_t day_hour,
+  F &&f) {
+
+  auto block = (*reader.histogram()->day_hours())[day_hour];
+  const uint32_t num_runs = block->segment_ids()->size();
+  const uint32_t *segment_ids = block->segment_ids()->data();
+  const uint32_t *offsets = block->offsets()->data();
+  const uint8_t *speed_buckets = block->speed_buckets()->data();
+  const uint32_t *counts = block->counts()->data();
+
+  const uint32_t *itr = segment_ids;
+  const uint32_t *end = segment_ids + num_runs;
+  for (auto segment_id : query_ids) {
+    itr = std::lower_bound(itr, end, segment_id);
+    if (itr == end) {
+      break;
+    }
+    if (*itr != segment_id) {
+      continue;
+    }
+    const size_t run = itr - segment_ids;
+    for (uint32_t i = offsets[run]; i < offsets[run + 1]; ++i) {
+      f(uint32_t(speed_buckets[i]), counts[i]);
+    }
+  }
+}
+
+// mean speed of every segment at day_hour from the segment-major tile, written
+// to a dense array indexed by segment ID. segments without data are NaN.
+std::vector<float> snapshot_file(const fb_histogram_reader &reader, uint32_t day_hour) {
+  const uint32_t num_segments = reader.num_segments();
+  std::vector<float> speeds(num_segments, std::numeric_limits<float>::quiet_NaN());
+
+  for (uint32_t segment_id = 0; segment_id < num_segments; ++segment_id) {
+    uint32_t sum = 0, num = 0;
+    reader.for_each_entry(segment_id, day_hour, [&sum, &num](uint32_t bucket, uint32_t count) {
+        if (bucket < MAX_N_SPEEDS) {
+          sum += bucket * count;
+          num += count;
+        }
+      });
+    if (num > 0) {
+      speeds[segment_id] = 5.0f * float(sum) / float(num);
+    }
+  }
+
+  return speeds;
+}
+
+// the inner loop of the hour-major snapshot, over runs [begin, end) of the
+// block. the bucket check is folded into the count as a mask so that the
+// loop over each run has no branches, and vectorises.
+void snapshot_runs(
+  const ot::DayHourBlock *block,
+  size_t begin, size_t end,
+  float *speeds) {
+
+  const uint32_t *segment_ids = block->segment_ids()->data();
+  const uint32_t *offsets = block->offsets()->data();
+  const uint8_t *speed_buckets = block->speed_buckets()->data();
+  const uint32_t *counts = block->counts()->data();
+
+  for (size_t run = begin; run < end; ++run) {
+    uint32_t sum = 0, num = 0;
+    for (uint32_t i = offsets[run]; i < offsets[run + 1]; ++i) {
+      const uint32_t bucket = speed_buckets[i];
+      const uint32_t count = counts[i] & -uint32_t(bucket < MAX_N_SPEEDS);
+      sum += bucket * count;
+      num += count;
+    }
+    if (num > 0) {
+      speeds[segment_ids[run]] = 5.0f * float(sum) / float(num);
+    }
+  }
+}
+
+// mean speed of every segment at day_hour from the hour-major tile, with the
+// block's runs split between the team's threads, or all on this one if
+// there's no team.
+std::vector<float> snapshot_hour_major(
+  const ot::HourMajorHistogram *histogram,
+  uint32_t day_hour,
+  thread_team *team) {
+
+  std::vector<float> speeds(histogram->num_segments(), std::numeric_limits<float>::quiet_NaN());
+
+  auto block = (*histogram->day_hours())[day_hour];
+  const size_t num_runs = block->segment_ids()->size();
+  if (team == nullptr) {
+    snapshot_runs(block, 0, num_runs, speeds.data());
+    return speeds;
+  }
+
+  // each thread writes to a disjoint set of segment IDs, so no
+  // synchronisation is needed beyond waiting for the team.
+  const size_t chunk = (num_runs + team->size() - 1) / team->size();
+  float *out = speeds.data();
+  team->run([&](unsigned int t) {
+      const size_t begin = std::min(num_runs, t * chunk);
+      const size_t end = std::min(num_runs, begin + chunk);
+      snapshot_runs(block, begin, end, out);
+    });
+
+  return speeds;
+}
+
+template <typename F>
+double time_per_iteration(int num_iterations, F f) {
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+
+  steady_clock::time_point t0 = steady_clock::now();
+  for (int n = 0; n < num_iterations; ++n) {
+    f();
+  }
+  steady_clock::time_point t1 = steady_clock::now();
+  return duration_cast<duration<double>>(t1 - t0).count() / double(num_iterations);
+}
+
+int main(int argc, char *argv[]) {
+  std::mt19937_64 eng(12345);
+  std::uniform_int_distribution<uint32_t> dist_segment_id(0, 10000);
+
+  std::set<uint32_t> query_segment_ids;
+  for (int i = 0; i < 50; ++i) {
+    query_segment_ids.insert(dist_segment_id(eng));
+  }
+  std::cout << "Querying for " << query_segment_ids.size() << " segments.\n";
+
+  mmapped_file f("sample.tile");
+  checked_histogram tile(f.buffer, f.size, tile_open_mode::verify_full);
+  require_default_speed_buckets(tile_speed_buckets(tile.histogram()));
+  fb_histogram_reader reader(tile);
+
+  mmapped_file hf("sample.tile.hour");
+  auto hour_verifier = fb::Verifier((const uint8_t *)hf.buffer, hf.size);
+  if (!ot::VerifyHourMajorHistogramBuffer(hour_verifier)) {
+    throw std::runtime_error("Hour-major buffer verification failed.");
+  }
+  auto hour_histogram = ot::GetHourMajorHistogram(hf.buffer);
+  require_default_speed_buckets(speed_buckets_scheme(hour_histogram->speed_buckets()));
+  hour_major_histogram_reader hour_reader(hour_histogram);
+
+  const uint32_t day_hour = 4 * 24 + 12;
+  const unsigned int num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  const int num_iterations = 100000;
+  double val = 0;
+  double t = time_per_iteration(num_iterations, [&]() {
+      val = query_mean_speed(reader, query_segment_ids, day_hour);
+    });
+  std::cout << "segment set, segment-major: val = " << val << " in " << t << "s per iteration\n";
+
+  t = time_per_iteration(num_iterations, [&]() {
+      val = query_mean_speed(hour_reader, query_segment_ids, day_hour);
+    });
+  std::cout << "segment set, hour-major: val = " << val << " in " << t << "s per iteration\n";
+
+  const int num_snapshot_iterations = 1000;
+  std::vector<float> speeds;
+  t = time_per_iteration(num_snapshot_iterations, [&]() {
+      speeds = snapshot_file(reader, day_hour);
+    });
+  std::cout << "snapshot, segment-major: " << t << "s per iteration\n";
+
+  // the team is started once, so the timings don't include starting threads.
+  thread_team team(num_threads);
+  std::vector<float> hour_speeds;
+  for (thread_team *threads : {(thread_team *)nullptr, &team}) {
+    t = time_per_iteration(num_snapshot_iterations, [&]() {
+        hour_speeds = snapshot_hour_major(hour_histogram, day_hour, threads);
+      });
+    std::cout << "snapshot, hour-major with " << (threads == nullptr ? 1 : threads->size())
+              << " threads: " << t << "s per iteration\n";
+  }
+
+  size_t num_mismatches = 0;
+  for (size_t i = 0; i < speeds.size(); ++i) {
+    const bool both_nan = std::isnan(speeds[i]) && std::isnan(hour_speeds[i]);
+    if (!both_nan && speeds[i] != hour_speeds[i]) {
+      ++num_mismatches;
+    }
+  }
+  if (num_mismatches > 0 || speeds.size() != hour_speeds.size()) {
+    std::cout << "Snapshots differ for " << num_mismatches << " segments!\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,159 @@
+#include "histogram_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include "mmapped_file.hpp"
+#include "checked_histogram.hpp"
+#include "histogram_reader.hpp"
+#include "fb_histogram_reader.hpp"
+#include "log_counts.hpp"
+#include "error_stats.hpp"
+#include "zipf_workload.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+// reader for the tiles convert_fb_to_packed --log-counts writes, with the
+// code width fixed at compile time so the hot loop is a table load per entry.
+template <uint32_t Bits>
+class log_count_histogram_reader {
+public:
+  explicit log_count_histogram_reader(checked_histogram &tile)
+    : tile_(&tile), plain_(tile) {}
+
+  uint32_t num_segments() const {
+    return tile_->num_segments();
+  }
+
+  template <typename F>
+  void for_each_entry(uint32_t segment_id, uint32_t day_hour, F &&f) const {
+    auto segment = tile_->segment(segment_id);
+    auto day_hours = segment->packed_day_hours();
+    auto keys = segment->packed_keys();
+    auto codes = segment->log_counts();
+    if (day_hours == nullptr || keys == nullptr || codes == nullptr) {
+      // segments which couldn't be packed have plain entries.
+      plain_.for_each_entry(segment_id, day_hour, f);
+      return;
+    }
+    if (keys->size() != day_hours->size() || codes->size() != log_counts_size(Bits, day_hours->size())) {
+      throw std::runtime_error("Packed entry arrays differ in length.");
+    }
+
+    QUERY_TRACE_PHASE(entry_search);
+    size_t first = 0, last = 0;
+    find_packed_day_hour(day_hours->data(), day_hours->size(), day_hour, first, last);
+    QUERY_TRACE_PHASE(scan);
+    QUERY_TRACE_ENTRIES(last - first);
+    for_each_log_count<Bits>(keys->data(), codes->data(), first, last, f);
+  }
+
+private:
+  checked_histogram *tile_;
+  fb_histogram_reader plain_;
+};
+
+template <uint32_t Bits>
+int compare(checked_histogram &exact_tile, checked_histogram &log_tile) {
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+
+  const speed_bucket_scheme scheme = tile_speed_buckets(exact_tile.histogram());
+  fb_histogram_reader exact_reader(exact_tile);
+  log_count_histogram_reader<Bits> log_reader(log_tile);
+  auto exact_kernel = select_mean_speed_kernel<fb_histogram_reader>(scheme);
+  auto log_kernel = select_mean_speed_kernel<log_count_histogram_reader<Bits> >(scheme);
+
+  // data is clustered around midday, so the queries are too.
+  zipf_workload workload(exact_tile.num_segments(), 1.1, 12345);
+  std::mt19937_64 eng(12345);
+  std::uniform_int_distribution<uint32_t> dist_day(0, 6);
+  std::uniform_int_distribution<uint32_t> dist_hour(8, 15);
+  std::vector<std::set<uint32_t> > queries(1000);
+  std::vector<uint32_t> day_hours;
+  for (auto &query : queries) {
+    while (query.size() < 50) {
+      query.insert(workload());
+    }
+    day_hours.push_back(dist_day(eng) * 24 + dist_hour(eng));
+  }
+
+  const int num_iterations = 100;
+  std::vector<double> exact(queries.size()), approx(queries.size());
+  steady_clock::time_point t0 = steady_clock::now();
+  for (int n = 0; n < num_iterations; ++n) {
+    for (size_t i = 0; i < queries.size(); ++i) {
+      exact[i] = exact_kernel(scheme, exact_reader, queries[i], day_hours[i]);
+    }
+  }
+  steady_clock::time_point t1 = steady_clock::now();
+  for (int n = 0; n < num_iterations; ++n) {
+    for (size_t i = 0; i < queries.size(); ++i) {
+      approx[i] = log_kernel(scheme, log_reader, queries[i], day_hours[i]);
+    }
+  }
+  steady_clock::time_point t2 = steady_clock::now();
+
+  const double num_queries = double(num_iterations * queries.size());
+  std::cout << "exact counts: " << (duration_cast<duration<double>>(t1 - t0).count() / num_queries)
+            << "s per query\n";
+  std::cout << Bits << " bit log counts: " << (duration_cast<duration<double>>(t2 - t1).count() / num_queries)
+            << "s per query\n";
+
+  // queries with no data at all are left out, as both answers are 0.
+  error_stats mean_errors;
+  for (size_t i = 0; i < queries.size(); ++i) {
+    if (exact[i] > 0.0) {
+      mean_errors.add(exact[i], approx[i]);
+    }
+  }
+  mean_errors.print("mean speed", scheme.units_name());
+
+  // the quantiles are interpolated in 5mph buckets.
+  if (scheme == default_speed_buckets) {
+    error_stats quantile_errors[3];
+    for (size_t i = 0; i < queries.size(); ++i) {
+      if (exact[i] == 0.0) {
+        continue;
+      }
+      auto e = query_quantiles(exact_reader, queries[i], day_hours[i], congestion_quantiles);
+      auto a = query_quantiles(log_reader, queries[i], day_hours[i], congestion_quantiles);
+      for (int q = 0; q < 3; ++q) {
+        quantile_errors[q].add(e[q], a[q]);
+      }
+    }
+    quantile_errors[0].print("p15", scheme.units_name());
+    quantile_errors[1].print("p50", scheme.units_name());
+    quantile_errors[2].print("p85", scheme.units_name());
+  }
+  return 0;
+}
+
+// compares answers from a tile with log coded counts, written by
+// convert_fb_to_packed --log-counts, with exact answers from sample.tile,
+// over a Zipf workload of queries at busy day_hours.
+int main(int argc, char *argv[]) {
+  const uint32_t bits = (argc > 1) ? uint32_t(atoi(argv[1])) : 8;
+  if (argc > 2 || (bits != 8 && bits != 4)) {
+    std::cerr << "Usage: " << argv[0] << " [8|4, default 8]\n";
+    return 1;
+  }
+
+  mmapped_file exact_file("sample.tile");
+  checked_histogram exact_tile(exact_file.buffer, exact_file.size, tile_open_mode::verify_full);
+  mmapped_file log_file("sample.tile.log" + std::to_string(bits));
+  checked_histogram log_tile(log_file.buffer, log_file.size, tile_open_mode::verify_full);
+  if (log_tile.histogram()->log_count_bits() != bits) {
+    throw std::runtime_error("Tile doesn't have " + std::to_string(bits) + " bit log counts.");
+  }
+  std::cout << "Tile is " << log_file.size << " bytes with " << bits << " bit log counts, "
+            << exact_file.size << " bytes exact.\n";
+
+  return (bits == 8) ? compare<8>(exact_tile, log_tile) : compare<4>(exact_tile, log_tile);
+}
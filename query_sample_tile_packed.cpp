@@ -0,0 +1,83 @@
+#include "histogram_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <chrono>
+
+#include "mmapped_file.hpp"
+#include "checked_histogram.hpp"
+#include "histogram_reader.hpp"
+#include "fb_histogram_reader.hpp"
+#include "packed_histogram_reader.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+// times num_iterations of the query, leaving the answer in val.
+template <typename Reader>
+double time_query(
+  const Reader &reader, const std::set<uint32_t> &query_ids, uint32_t day_hour,
+  int num_iterations, double &val) {
+
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+
+  steady_clock::time_point t0 = steady_clock::now();
+  for (int n = 0; n < num_iterations; ++n) {
+    val = query_mean_speed(reader, query_ids, day_hour);
+  }
+  steady_clock::time_point t1 = steady_clock::now();
+  return duration_cast<duration<double>>(t1 - t0).count() / double(num_iterations);
+}
+
+int main() {
+  std::mt19937_64 eng(12345);
+  std::uniform_int_distribution<uint32_t> dist_segment_id(0, 10000);
+
+  std::set<uint32_t> query_segment_ids;
+  for (int i = 0; i < 50; ++i) {
+    query_segment_ids.insert(dist_segment_id(eng));
+  }
+  std::cout << "Querying for " << query_segment_ids.size() << " segments.\n";
+
+  mmapped_file plain_file("sample.tile");
+  checked_histogram plain(plain_file.buffer, plain_file.size, tile_open_mode::verify_full);
+  mmapped_file packed_file("sample.tile.packed");
+  checked_histogram packed(packed_file.buffer, packed_file.size, tile_open_mode::verify_full);
+  require_default_speed_buckets(tile_speed_buckets(plain.histogram()));
+  require_default_speed_buckets(tile_speed_buckets(packed.histogram()));
+  // log coded tiles have no count bytes, see query_sample_tile_log.
+  if (packed.histogram()->log_count_bits() != 0) {
+    throw std::runtime_error("Tile has log coded counts, which this tool can't read.");
+  }
+  std::cout << "Tile is " << packed_file.size << " bytes packed, " << plain_file.size << " bytes plain.\n";
+  fb_histogram_reader plain_reader(plain);
+  packed_histogram_reader packed_reader(packed);
+  simd_packed_histogram_reader simd_reader(packed);
+
+  // every day_hour should give the same answer from both tiles.
+  for (uint32_t day_hour = 0; day_hour < NUM_DAY_HOURS; ++day_hour) {
+    const double expected = query_mean_speed(plain_reader, query_segment_ids, day_hour);
+    const double actual = query_mean_speed(packed_reader, query_segment_ids, day_hour);
+    const double simd_actual = query_mean_speed(simd_reader, query_segment_ids, day_hour);
+    if (actual != expected || simd_actual != expected) {
+      std::cerr << "Mismatch at day_hour " << day_hour << ": " << actual << " packed, "
+                << simd_actual << " packed with SSE2, " << expected << " plain\n";
+      return 1;
+    }
+  }
+
+  const int num_iterations = 100000;
+  const uint32_t day_hour = 4 * 24 + 12;
+  double val = 0;
+
+  double t = time_query(plain_reader, query_segment_ids, day_hour, num_iterations, val);
+  std::cout << "val = " << val << " in " << t << "s per iteration from plain entries\n";
+  t = time_query(packed_reader, query_segment_ids, day_hour, num_iterations, val);
+  std::cout << "val = " << val << " in " << t << "s per iteration from packed entries one at a time\n";
+  t = time_query(simd_reader, query_segment_ids, day_hour, num_iterations, val);
+  std::cout << "val = " << val << " in " << t << "s per iteration from packed entries with SSE2\n";
+
+  return 0;
+}
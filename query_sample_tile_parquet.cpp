@@ -15,104 +15,86 @@
 #include <parquet/api/reader.h>
 #include <parquet/api/writer.h>
 
-#define MAX_N_SPEEDS (120 / 5)
-constexpr int BATCH_SIZE = 500;
-
-double query_file(
+#include "quantiles.hpp"
+#include "page_cache.hpp"
+#include "histogram_reader.hpp"
+#include "parquet_histogram_reader.hpp"
+
+// the byte ranges of the column chunks which accumulate_hist will read for a
+// query: the segment_id column of every row group, plus the day_hour,
+// speed_bucket and count columns of row groups which might hold one of the
+// query's segments. that's judged from the segment_id column statistics, and
+// is every row group if there aren't any.
+std::vector<byte_range> query_column_chunks(
   const std::shared_ptr<parquet::ParquetFileReader> file_reader,
-  const std::set<uint32_t> &query_ids,
-  uint32_t day_hour) {
-
-  uint32_t hist[MAX_N_SPEEDS];
-  memset(hist, 0, sizeof hist);
-
-  const int num_row_groups = file_reader->metadata()->num_row_groups();
-  uint32_t sum = 0, num = 0;
-
-  for (int row_group = 0; row_group < num_row_groups; ++row_group) {
-    auto rg_reader = file_reader->RowGroup(row_group);
-
-    size_t row_idx = 0;
-    std::vector<size_t> rows;
-
-    // first scan the segment_id column to find matching segment indices
-    auto segment_id_reader =
-      std::static_pointer_cast<parquet::Int32Reader>(rg_reader->Column(1));
-
-    while(true) {
-      int32_t segment_ids[BATCH_SIZE];
-      int64_t num_values = 0;
-      segment_id_reader->ReadBatch(BATCH_SIZE, nullptr, nullptr, segment_ids, &num_values);
-
-      if (num_values <= 0) {
-        break;
-      }
-
-      for (int64_t i = 0; i < num_values; ++i) {
-        if (query_ids.count(segment_ids[i]) > 0) {
-          rows.push_back(row_idx + i);
-        }
-      }
-      row_idx += num_values;
+  const std::set<uint32_t> &query_ids) {
+
+  auto chunk_range = [](const parquet::ColumnChunkMetaData &chunk) {
+    const int64_t start = chunk.has_dictionary_page() ?
+      chunk.dictionary_page_offset() : chunk.data_page_offset();
+    return byte_range{uint64_t(start), uint64_t(chunk.total_compressed_size())};
+  };
+
+  std::vector<byte_range> ranges;
+  auto metadata = file_reader->metadata();
+  for (int row_group = 0; row_group < metadata->num_row_groups(); ++row_group) {
+    auto rg_metadata = metadata->RowGroup(row_group);
+    auto segment_id_chunk = rg_metadata->ColumnChunk(1);
+    ranges.push_back(chunk_range(*segment_id_chunk));
+
+    bool may_match = true;
+    if (segment_id_chunk->is_stats_set()) {
+      auto stats = std::static_pointer_cast<parquet::Int32Statistics>(segment_id_chunk->statistics());
+      auto itr = query_ids.lower_bound(uint32_t(stats->min()));
+      may_match = (itr != query_ids.end()) && (*itr <= uint32_t(stats->max()));
     }
-
-    // next, scan the day_hour column to find matching values
-    auto day_hour_reader =
-      std::static_pointer_cast<parquet::Int32Reader>(rg_reader->Column(2));
-
-    size_t current_row_pos = 0;
-    std::vector<size_t> new_rows;
-    for (auto row_idx : rows) {
-      if (current_row_pos < row_idx) {
-        day_hour_reader->Skip(row_idx - current_row_pos);
-        current_row_pos = row_idx;
-      }
-
-      int32_t value = 0;
-      int64_t count = 0;
-      day_hour_reader->ReadBatch(1, nullptr, nullptr, &value, &count);
-      current_row_pos += 1;
-
-      assert(count == 1);
-
-      if (value == day_hour) {
-        new_rows.push_back(row_idx);
+    if (may_match) {
+      for (int column : {2, 4, 5}) {
+        ranges.push_back(chunk_range(*rg_metadata->ColumnChunk(column)));
       }
     }
+  }
+  return ranges;
+}
 
-    auto speed_bucket_reader =
-      std::static_pointer_cast<parquet::Int32Reader>(rg_reader->Column(4));
-    auto count_reader =
-      std::static_pointer_cast<parquet::Int32Reader>(rg_reader->Column(5));
-
-    current_row_pos = 0;
-    for (auto row_idx : new_rows) {
-      if (current_row_pos < row_idx) {
-        speed_bucket_reader->Skip(row_idx - current_row_pos);
-        count_reader->Skip(row_idx - current_row_pos);
-        current_row_pos = row_idx;
-      }
+// starts reading in the query's column chunks, all at once, so that the reads
+// accumulate_hist makes one after another find them already in the page
+// cache. returns the number of bytes advised.
+uint64_t prefetch_column_chunks(
+  const std::string &path,
+  const std::shared_ptr<parquet::ParquetFileReader> file_reader,
+  const std::set<uint32_t> &query_ids) {
 
-      int32_t speed_value = 0, count_value = 0;
-      int64_t count = 0;
-      speed_bucket_reader->ReadBatch(1, nullptr, nullptr, &speed_value, &count);
-      assert(count == 1);
-      count_reader->ReadBatch(1, nullptr, nullptr, &count_value, &count);
-      assert(count == 1);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return 0;
+  }
+  struct stat st;
+  uint64_t advised = 0;
+  if (fstat(fd, &st) == 0) {
+    advised = willneed_file(fd, uint64_t(st.st_size), query_column_chunks(file_reader, query_ids));
+  }
+  close(fd);
+  return advised;
+}
 
-      current_row_pos += 1;
+double query_file(
+  const std::shared_ptr<parquet::ParquetFileReader> file_reader,
+  const std::set<uint32_t> &query_ids,
+  uint32_t day_hour) {
 
-      sum += speed_value * count_value;
-      num += count_value;
-    }
-  }
+  return query_mean_speed(parquet_histogram_reader(file_reader), query_ids, day_hour);
+}
 
-  if (num > 0) {
-    return 5.0 * double(sum) / double(num);
-  } else {
-    std::cout << "No data for query\n";
-    return 0.0;
-  }
+// speed quantiles at a single day_hour. there's no precomputed cdf in the
+// Parquet file, so this always aggregates on the fly.
+std::vector<double> query_file_quantiles(
+  const std::shared_ptr<parquet::ParquetFileReader> file_reader,
+  const std::set<uint32_t> &query_ids,
+  uint32_t day_hour,
+  const std::vector<double> &qs) {
+
+  return query_quantiles(parquet_histogram_reader(file_reader), query_ids, day_hour, qs);
 }
 
 int main(int argc, char *argv[]) {
@@ -147,6 +129,7 @@ int main(int argc, char *argv[]) {
 
     std::shared_ptr<parquet::ParquetFileReader> file_reader =
       parquet::ParquetFileReader::Open(input, props);
+    require_default_speed_buckets(parquet_speed_buckets(file_reader));
 
     auto sch = file_reader->metadata()->schema();
     for (int i = 0; i < sch->num_columns(); ++i) {
@@ -165,5 +148,60 @@ int main(int argc, char *argv[]) {
 
   std::cout << "val = " << val << " in " << (iter_t.count() / double(num_iterations)) << "s per iteration, plus " << setup_t.count() << "s to setup\n";
 
+  {
+    using FileClass = ::arrow::io::ReadableFile;
+    std::shared_ptr<FileClass> input;
+    PARQUET_THROW_NOT_OK(FileClass::Open("sample.tile.parquet", &input));
+
+    parquet::ReaderProperties props;
+
+    std::shared_ptr<parquet::ParquetFileReader> file_reader =
+      parquet::ParquetFileReader::Open(input, props);
+    require_default_speed_buckets(parquet_speed_buckets(file_reader));
+
+    std::vector<double> speeds;
+    steady_clock::time_point q0 = steady_clock::now();
+    for (int n = 0; n < num_iterations; ++n) {
+      speeds = query_file_quantiles(file_reader, query_segment_ids, 4 * 24 + 12, congestion_quantiles);
+    }
+    steady_clock::time_point q1 = steady_clock::now();
+    duration<double> quantile_t = duration_cast<duration<double>>(q1 - q0);
+
+    std::cout << "p15/p50/p85 = " << speeds[0] << "/" << speeds[1] << "/" << speeds[2]
+              << " in " << (quantile_t.count() / double(num_iterations)) << "s per iteration on the fly\n";
+  }
+
+  // a cold first query, with and without prefetching the column chunks it
+  // needs. opening the file reads the footer, so that isn't counted.
+  for (bool prefetch : {false, true}) {
+    drop_page_cache("sample.tile.parquet");
+
+    using FileClass = ::arrow::io::ReadableFile;
+    std::shared_ptr<FileClass> input;
+    PARQUET_THROW_NOT_OK(FileClass::Open("sample.tile.parquet", &input));
+
+    parquet::ReaderProperties props;
+
+    std::shared_ptr<parquet::ParquetFileReader> file_reader =
+      parquet::ParquetFileReader::Open(input, props);
+    require_default_speed_buckets(parquet_speed_buckets(file_reader));
+
+    uint64_t advised = 0;
+    steady_clock::time_point c0 = steady_clock::now();
+    if (prefetch) {
+      advised = prefetch_column_chunks("sample.tile.parquet", file_reader, query_segment_ids);
+    }
+    val = query_file(file_reader, query_segment_ids, 4 * 24 + 12);
+    steady_clock::time_point c1 = steady_clock::now();
+    duration<double> cold_t = duration_cast<duration<double>>(c1 - c0);
+
+    std::cout << "cold val = " << val << " in " << cold_t.count() << "s";
+    if (prefetch) {
+      std::cout << " prefetching " << advised << " bytes of column chunks\n";
+    } else {
+      std::cout << " without prefetch\n";
+    }
+  }
+
   return 0;
 }
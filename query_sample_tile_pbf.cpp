@@ -4,63 +4,106 @@
 #include <random>
 #include <chrono>
 #include <algorithm>
-
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <sys/mman.h>
-#include <fcntl.h>
-#include <unistd.h>
+#include <thread>
+#include <cstdlib>
+#include "mmapped_file.hpp"
+#include "quantiles.hpp"
+#include "histogram_reader.hpp"
+#include "pbf_histogram_reader.hpp"
+#include "pbf_segment_index.hpp"
 
 namespace otpbf = OpenTraffic::pbf;
 
-#define MAX_N_SPEEDS (120 / 5)
-
+// mean speed, in the tile's units, through the kernel picked for its speed
+// bucket scheme when it was opened.
 double query_file(
   const otpbf::Histogram &histogram,
+  const speed_bucket_scheme &scheme,
+  mean_speed_kernel<pbf_histogram_reader> kernel,
   const std::set<uint32_t> &query_ids,
   uint32_t day_hour) {
 
+  return kernel(scheme, pbf_histogram_reader(histogram), query_ids, day_hour);
+}
+
+// speed quantiles at a single day_hour, using the segment's precomputed cdfs
+// when present, otherwise building the cdf from the scanned entries.
+std::vector<double> query_file_quantiles(
+  const otpbf::Histogram &histogram,
+  const std::set<uint32_t> &query_ids,
+  uint32_t day_hour,
+  const std::vector<double> &qs,
+  bool use_cdf = true) {
+
   uint32_t hist[MAX_N_SPEEDS];
   memset(hist, 0, sizeof hist);
+  uint32_t cdf[MAX_N_SPEEDS];
+  memset(cdf, 0, sizeof cdf);
 
   for (auto segment_id : query_ids) {
-    auto segs = histogram.segments();
-    auto segment = segs.Get(segment_id);
+    const auto &segment = histogram.segments(segment_id);
     if (segment.entries_size() == 0) {
-      //std::cout << "No entries for segment_id " << segment_id << "\n";
       continue;
     }
-    auto entries = segment.entries();
-    auto itr = std::find_if(
-      entries.begin(), entries.end(),
-      [&](const otpbf::Entry &e) {
-        return uint32_t(e.day_hour()) == day_hour;
-      });
-    if (itr != entries.end()) {
-      while ((itr != entries.end()) && ((*itr).day_hour() == day_hour)) {
-        int bucket = (*itr).speed_bucket();
+
+    if (use_cdf && segment.day_hour_index_size() == NUM_DAY_HOURS + 1 && segment.cdf_counts_size() > 0) {
+      const auto &index = segment.day_hour_index();
+      const uint32_t row = index.Get(day_hour);
+      if (index.Get(day_hour + 1) > row) {
+        for (int i = 0; i < MAX_N_SPEEDS; ++i) {
+          cdf[i] += segment.cdf_counts(row * MAX_N_SPEEDS + i);
+        }
+      }
+      continue;
+    }
+
+    for (const auto &e : segment.entries()) {
+      if (e.day_hour() == day_hour) {
+        int bucket = e.speed_bucket();
         if (bucket < MAX_N_SPEEDS) {
-          hist[bucket] += (*itr).count();
+          hist[bucket] += e.count();
         }
-        ++itr;
       }
-    } else {
-      std::cout << "Didn't find segment " << segment_id << " day/hour " << day_hour << "\n";
     }
   }
 
-  int sum = 0, num = 0;
-  for (int i = 0; i < MAX_N_SPEEDS; ++i) {
-    sum += (i * 5) * hist[i];
-    num += hist[i];
-  }
+  accumulate_cdf(hist, cdf);
+  return quantiles_from_cdf(cdf, qs);
+}
 
-  if (num > 0) {
-    return double(sum) / double(num);
-  } else {
-    std::cout << "No data for query\n";
-    return 0.0;
+// parses the tile a segment at a time on num_threads threads, and checks it
+// answers every day_hour the same as the tile parsed whole. returns false if
+// it doesn't.
+bool check_segment_index(const otpbf::Histogram &histogram, const std::set<uint32_t> &query_ids,
+                         const mmapped_file &f, unsigned int num_threads) {
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+
+  steady_clock::time_point t0 = steady_clock::now();
+  pbf_segment_index index(f.buffer, f.size, num_threads);
+  steady_clock::time_point t1 = steady_clock::now();
+  std::cout << "Parsed " << index.num_segments() << " segments on " << index.stats().num_threads
+            << " threads in " << duration_cast<duration<double>>(t1 - t0).count() << "s: scan "
+            << index.stats().scan_seconds << "s, parse " << index.stats().parse_seconds << "s\n";
+
+  if (index.num_segments() != uint32_t(histogram.segments_size()) ||
+      tile_speed_buckets(index.histogram()) != tile_speed_buckets(histogram)) {
+    std::cerr << "Segment index differs from the parsed tile.\n";
+    return false;
+  }
+  for (uint32_t day_hour = 0; day_hour < NUM_DAY_HOURS; ++day_hour) {
+    uint32_t expected[MAX_N_SPEEDS], actual[MAX_N_SPEEDS];
+    memset(expected, 0, sizeof expected);
+    memset(actual, 0, sizeof actual);
+    accumulate_hist(pbf_histogram_reader(histogram), query_ids, day_hour, expected);
+    accumulate_hist(pbf_histogram_reader(index), query_ids, day_hour, actual);
+    if (memcmp(expected, actual, sizeof expected) != 0) {
+      std::cerr << "Mismatch at day_hour " << day_hour << " between the segment index and the parsed tile.\n";
+      return false;
+    }
   }
+  return true;
 }
 
 int main(int argc, char *argv[]) {
@@ -68,6 +111,15 @@ int main(int argc, char *argv[]) {
   using std::chrono::duration;
   using std::chrono::duration_cast;
 
+  if (argc > 2) {
+    std::cerr << "Usage: " << argv[0] << " [threads to parse on, default all cores]\n";
+    return 1;
+  }
+  unsigned int num_threads = (argc > 1) ? unsigned(atoi(argv[1])) : std::thread::hardware_concurrency();
+  if (num_threads == 0) {
+    num_threads = 1;
+  }
+
   std::mt19937_64 eng(12345);
   std::uniform_int_distribution<uint32_t> dist_segment_id(0, 10000);
 
@@ -81,23 +133,73 @@ int main(int argc, char *argv[]) {
   double val = 0;
   steady_clock::time_point t0 = steady_clock::now();
   steady_clock::time_point t1;
+  speed_bucket_scheme scheme;
   {
     otpbf::Histogram histogram;
     std::fstream in("sample.tile.pbf");
     if (!histogram.ParseFromIstream(&in)) {
       throw std::runtime_error("Unable to open input");
     }
+    scheme = tile_speed_buckets(histogram);
+    auto kernel = select_mean_speed_kernel<pbf_histogram_reader>(scheme);
 
     t1 = steady_clock::now();
     for (int n = 0; n < num_iterations; ++n) {
-      val = query_file(histogram, query_segment_ids, 4 * 24 + 12);
+      val = query_file(histogram, scheme, kernel, query_segment_ids, 4 * 24 + 12);
     }
   }
   steady_clock::time_point t2 = steady_clock::now();
   duration<double> setup_t = duration_cast<duration<double>>(t1 - t0);
   duration<double> iter_t = duration_cast<duration<double>>(t2 - t1);
 
-  std::cout << "val = " << val << " in " << (iter_t.count() / double(num_iterations)) << "s per iteration, plus " << setup_t.count() << "s to setup\n";
+  std::cout << "val = " << val << " " << scheme.units_name() << " in " << (iter_t.count() / double(num_iterations)) << "s per iteration, plus " << setup_t.count() << "s to setup\n";
+
+  // the same tile split at its segments and parsed on one thread, then on
+  // all of them.
+  {
+    otpbf::Histogram histogram;
+    std::fstream in("sample.tile.pbf");
+    if (!histogram.ParseFromIstream(&in)) {
+      throw std::runtime_error("Unable to open input");
+    }
+    mmapped_file f("sample.tile.pbf");
+    for (unsigned int threads : {1u, num_threads}) {
+      if (!check_segment_index(histogram, query_segment_ids, f, threads)) {
+        return 1;
+      }
+      if (num_threads == 1) {
+        break;
+      }
+    }
+  }
+
+  // the cdfs and quantiles are in 5mph buckets.
+  if (scheme != default_speed_buckets) {
+    std::cout << "Skipping quantiles, which need the default speed buckets.\n";
+    return 0;
+  }
+
+  {
+    otpbf::Histogram histogram;
+    std::fstream in("sample.tile.pbf");
+    if (!histogram.ParseFromIstream(&in)) {
+      throw std::runtime_error("Unable to open input");
+    }
+
+    for (bool use_cdf : {false, true}) {
+      std::vector<double> speeds;
+      steady_clock::time_point q0 = steady_clock::now();
+      for (int n = 0; n < num_iterations; ++n) {
+        speeds = query_file_quantiles(histogram, query_segment_ids, 4 * 24 + 12, congestion_quantiles, use_cdf);
+      }
+      steady_clock::time_point q1 = steady_clock::now();
+      duration<double> quantile_t = duration_cast<duration<double>>(q1 - q0);
+
+      std::cout << "p15/p50/p85 = " << speeds[0] << "/" << speeds[1] << "/" << speeds[2]
+                << " in " << (quantile_t.count() / double(num_iterations)) << "s per iteration"
+                << (use_cdf ? " with cdfs\n" : " on the fly\n");
+    }
+  }
 
   return 0;
 }
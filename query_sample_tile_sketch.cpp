@@ -0,0 +1,108 @@
+#include "histogram_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+#include "mmapped_file.hpp"
+#include "checked_histogram.hpp"
+#include "histogram_reader.hpp"
+#include "fb_histogram_reader.hpp"
+#include "speed_sketch.hpp"
+#include "error_stats.hpp"
+#include "zipf_workload.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+// compares approximate answers from the tile's sketches with exact answers
+// from its entries, over a Zipf workload of queries at busy day_hours.
+int main(int argc, char *argv[]) {
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+
+  mmapped_file f("sample.tile");
+  checked_histogram tile(f.buffer, f.size, tile_open_mode::verify_full);
+  auto sketches = tile.histogram()->sketches();
+  const uint32_t num_segments = tile.num_segments();
+  if (sketches == nullptr || sketches->size() != num_segments * SKETCH_NUM_PARTS) {
+    std::cout << "Tile has no sketches, run make_sample_tile --sketches to compare.\n";
+    return 0;
+  }
+  const speed_sketch *sketch_data = reinterpret_cast<const speed_sketch *>(sketches->Data());
+  const size_t sketches_size = sketches->size() * sizeof(speed_sketch);
+  std::cout << "Sketches are " << sketches_size << " bytes of the " << f.size << " byte tile ("
+            << (100.0 * sketches_size / double(f.size)) << "%).\n";
+
+  const speed_bucket_scheme scheme = tile_speed_buckets(tile.histogram());
+  fb_histogram_reader reader(tile);
+  auto kernel = select_mean_speed_kernel<fb_histogram_reader>(scheme);
+
+  // data is clustered around midday, so the queries are too.
+  zipf_workload workload(num_segments, 1.1, 12345);
+  std::mt19937_64 eng(12345);
+  std::uniform_int_distribution<uint32_t> dist_day(0, 6);
+  std::uniform_int_distribution<uint32_t> dist_hour(8, 15);
+  std::vector<std::set<uint32_t> > queries(1000);
+  std::vector<uint32_t> day_hours;
+  for (auto &query : queries) {
+    while (query.size() < 50) {
+      query.insert(workload());
+    }
+    day_hours.push_back(dist_day(eng) * 24 + dist_hour(eng));
+  }
+
+  const int num_iterations = 100;
+  std::vector<double> exact(queries.size()), approx(queries.size());
+  steady_clock::time_point t0 = steady_clock::now();
+  for (int n = 0; n < num_iterations; ++n) {
+    for (size_t i = 0; i < queries.size(); ++i) {
+      exact[i] = kernel(scheme, reader, queries[i], day_hours[i]);
+    }
+  }
+  steady_clock::time_point t1 = steady_clock::now();
+  for (int n = 0; n < num_iterations; ++n) {
+    for (size_t i = 0; i < queries.size(); ++i) {
+      approx[i] = approx_mean_speed(sketch_data, num_segments, scheme, queries[i], day_hours[i]);
+    }
+  }
+  steady_clock::time_point t2 = steady_clock::now();
+
+  const double num_queries = double(num_iterations * queries.size());
+  std::cout << "exact: " << (duration_cast<duration<double>>(t1 - t0).count() / num_queries)
+            << "s per query\n";
+  std::cout << "sketch: " << (duration_cast<duration<double>>(t2 - t1).count() / num_queries)
+            << "s per query\n";
+
+  // queries with no data at all are left out, as both answers are 0.
+  error_stats mean_errors;
+  for (size_t i = 0; i < queries.size(); ++i) {
+    if (exact[i] > 0.0) {
+      mean_errors.add(exact[i], approx[i]);
+    }
+  }
+  mean_errors.print("mean speed", scheme.units_name());
+
+  // the exact quantiles are in 5mph buckets.
+  if (scheme == default_speed_buckets) {
+    error_stats quantile_errors[3];
+    for (size_t i = 0; i < queries.size(); ++i) {
+      if (exact[i] == 0.0) {
+        continue;
+      }
+      auto e = query_quantiles(reader, queries[i], day_hours[i], congestion_quantiles);
+      auto a = approx_congestion_quantiles(sketch_data, num_segments, scheme, queries[i], day_hours[i]);
+      for (int q = 0; q < 3; ++q) {
+        quantile_errors[q].add(e[q], a[q]);
+      }
+    }
+    quantile_errors[0].print("p15", scheme.units_name());
+    quantile_errors[1].print("p50", scheme.units_name());
+    quantile_errors[2].print("p85", scheme.units_name());
+  }
+
+  return 0;
+}
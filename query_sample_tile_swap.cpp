@@ -0,0 +1,159 @@
+#include "histogram_tile_generated.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
+
+#include "tile_handle.hpp"
+#include "histogram_reader.hpp"
+#include "fb_histogram_reader.hpp"
+#include "zipf_workload.hpp"
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+
+using std::chrono::steady_clock;
+using std::chrono::duration;
+using std::chrono::duration_cast;
+
+struct query {
+  std::set<uint32_t> segment_ids;
+  uint32_t day_hour;
+};
+
+// when a query started, and how long it took in seconds.
+struct timed_query {
+  steady_clock::time_point start;
+  double latency;
+};
+
+void print_latencies(const char *name, std::vector<double> &latencies) {
+  if (latencies.empty()) {
+    std::cout << name << ": no queries\n";
+    return;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto at = [&](double q) { return latencies[size_t(q * double(latencies.size() - 1))]; };
+  std::cout << name << ": " << latencies.size() << " queries, p50 = " << at(0.5)
+            << "s, p99 = " << at(0.99) << "s, p99.9 = " << at(0.999)
+            << "s, max = " << latencies.back() << "s\n";
+}
+
+// queries the tile on several threads while another thread keeps swapping it
+// for a freshly mapped copy, then compares the latency of queries which ran
+// during or just after a swap with the rest.
+int main(int argc, char *argv[]) {
+  if (argc > 4) {
+    std::cerr << "Usage: " << argv[0] << " [threads, default 4] [seconds, default 5] [ms between swaps, default 200]\n";
+    return 1;
+  }
+  const unsigned int num_threads = (argc > 1) ? unsigned(atoi(argv[1])) : 4;
+  const double run_seconds = (argc > 2) ? atof(argv[2]) : 5.0;
+  const int swap_interval_ms = (argc > 3) ? atoi(argv[3]) : 200;
+  if (num_threads == 0 || num_threads > tile_handle::max_readers) {
+    std::cerr << "Need between 1 and " << tile_handle::max_readers << " threads.\n";
+    return 1;
+  }
+
+  // populate the mapping, so that the first queries on a new tile don't take
+  // page faults which a swap in production would have warmed up first. the
+  // queries assume the default speed buckets, so every tile swapped in is
+  // checked for them.
+  mmap_policy policy;
+  policy.populate = true;
+  tile_handle handle("sample.tile", tile_open_mode::verify_full, policy,
+                     [](const checked_histogram &tile) {
+                       require_default_speed_buckets(tile_speed_buckets(tile.histogram()));
+                     });
+
+  std::vector<query> queries(1000);
+  const size_t setup_slot = handle.register_reader();
+  {
+    tile_handle::read_guard tile(handle, setup_slot);
+    zipf_workload workload(tile->tile.num_segments(), 1.1, 12345);
+    std::uniform_int_distribution<uint32_t> dist_day(1, 5);
+    std::uniform_int_distribution<uint32_t> dist_hour(7, 19);
+    for (auto &q : queries) {
+      while (q.segment_ids.size() < 50) {
+        q.segment_ids.insert(workload());
+      }
+      q.day_hour = dist_day(workload.eng) * 24 + dist_hour(workload.eng);
+    }
+  }
+  handle.unregister_reader(setup_slot);
+
+  std::atomic<bool> stop(false);
+  std::vector<std::vector<timed_query> > timings(num_threads);
+  std::vector<double> checksums(num_threads, 0.0);
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t]() {
+        const size_t slot = handle.register_reader();
+        size_t i = t * queries.size() / num_threads;
+        while (!stop.load(std::memory_order_relaxed)) {
+          const auto &q = queries[i++ % queries.size()];
+          steady_clock::time_point q0 = steady_clock::now();
+          {
+            tile_handle::read_guard tile(handle, slot);
+            checksums[t] += query_mean_speed(fb_histogram_reader(tile->tile), q.segment_ids, q.day_hour);
+          }
+          steady_clock::time_point q1 = steady_clock::now();
+          timings[t].push_back(timed_query{q0, duration_cast<duration<double>>(q1 - q0).count()});
+        }
+        handle.unregister_reader(slot);
+      });
+  }
+
+  // swaps until the time's up, recording when each swap started and when it
+  // finished, which includes unmapping whatever tiles it could.
+  std::vector<std::pair<steady_clock::time_point, steady_clock::time_point> > swaps;
+  const steady_clock::time_point end = steady_clock::now() +
+    std::chrono::microseconds(int64_t(run_seconds * 1e6));
+  while (steady_clock::now() < end) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(swap_interval_ms));
+    steady_clock::time_point s0 = steady_clock::now();
+    handle.swap("sample.tile");
+    steady_clock::time_point s1 = steady_clock::now();
+    swaps.emplace_back(s0, s1);
+  }
+  stop.store(true);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  const size_t waiting = handle.reclaim();
+
+  // a query counts as during a swap if it started between the start of one
+  // and 10ms after its end.
+  const auto settle = std::chrono::milliseconds(10);
+  std::vector<double> steady, during;
+  double checksum = 0;
+  for (unsigned int t = 0; t < num_threads; ++t) {
+    checksum += checksums[t];
+    auto swap = swaps.begin();
+    for (const auto &timing : timings[t]) {
+      while (swap != swaps.end() && swap->second + settle < timing.start) {
+        ++swap;
+      }
+      if (swap != swaps.end() && swap->first <= timing.start) {
+        during.push_back(timing.latency);
+      } else {
+        steady.push_back(timing.latency);
+      }
+    }
+  }
+
+  double swap_seconds = 0;
+  for (const auto &swap : swaps) {
+    swap_seconds += duration_cast<duration<double>>(swap.second - swap.first).count();
+  }
+  std::cout << swaps.size() << " swaps, " << (swaps.empty() ? 0.0 : swap_seconds / double(swaps.size()))
+            << "s each to map, verify and publish, ending at version " << handle.version()
+            << " with " << waiting << " tiles waiting to be unmapped (checksum " << checksum << ")\n";
+  print_latencies("steady", steady);
+  print_latencies("during swaps", during);
+
+  return 0;
+}
@@ -0,0 +1,419 @@
+#include "histogram_tile_generated.h"
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <unordered_map>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+
+#include "tile_handle.hpp"
+#include "histogram_reader.hpp"
+#include "fb_histogram_reader.hpp"
+#include "query_protocol.hpp"
+#include "framed_socket.hpp"
+
+// serves queries on a tile over a UNIX domain socket, see query_protocol.hpp.
+//
+// one thread runs an epoll loop which owns all the connections. it reads
+// whatever requests have arrived on every ready connection, then hands them
+// to the worker threads in batches of up to max_batch, so that under load a
+// worker pins the tile and wakes up once per batch rather than per request.
+// workers post their answers back through an eventfd, and the loop writes
+// them out. SIGINT or SIGTERM stops the server.
+
+struct pending_query {
+  uint64_t connection_id;
+  query_request request;
+};
+
+struct answered_query {
+  uint64_t connection_id;
+  query_response response;
+};
+
+// a queue of batches for the workers. close() wakes them all to exit.
+class batch_queue {
+public:
+  batch_queue() : closed_(false) {}
+
+  void push(std::vector<pending_query> &&batch) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      batches_.push_back(std::move(batch));
+    }
+    ready_.notify_one();
+  }
+
+  // false once the queue is closed and empty.
+  bool pop(std::vector<pending_query> &batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_.wait(lock, [this]() { return closed_ || !batches_.empty(); });
+    if (batches_.empty()) {
+      return false;
+    }
+    batch = std::move(batches_.front());
+    batches_.pop_front();
+    return true;
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    ready_.notify_all();
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<std::vector<pending_query> > batches_;
+  bool closed_;
+};
+
+// answers from the workers, waiting for the event loop to pick them up.
+class answer_queue {
+public:
+  explicit answer_queue(int event_fd) : event_fd_(event_fd) {}
+
+  void push(std::vector<answered_query> &answers) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      answers_.insert(answers_.end(), answers.begin(), answers.end());
+    }
+    const uint64_t one = 1;
+    ssize_t n = write(event_fd_, &one, sizeof one);
+    (void)n;
+  }
+
+  void take(std::vector<answered_query> &answers) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    answers.swap(answers_);
+    answers_.clear();
+  }
+
+private:
+  int event_fd_;
+  std::mutex mutex_;
+  std::vector<answered_query> answers_;
+};
+
+void answer(const fb_histogram_reader &reader, const query_request &request, query_response &response) {
+  response.request_id = request.request_id;
+  response.status = query_status::ok;
+  memset(response.hist, 0, sizeof response.hist);
+  if (request.kind == query_kind::info) {
+    response.hist[0] = reader.num_segments();
+  } else if (request.kind == query_kind::route) {
+    accumulate_route(reader, request.segment_ids, request.day_hour, response.hist);
+  } else {
+    const std::set<uint32_t> ids(request.segment_ids.begin(), request.segment_ids.end());
+    accumulate_hist(reader, ids, request.day_hour, response.hist);
+  }
+}
+
+void run_worker(tile_handle &handle, batch_queue &batches, answer_queue &answers) {
+  const size_t slot = handle.register_reader();
+  std::vector<pending_query> batch;
+  std::vector<answered_query> answered;
+  while (batches.pop(batch)) {
+    answered.resize(batch.size());
+    {
+      tile_handle::read_guard tile(handle, slot);
+      fb_histogram_reader reader(tile->tile);
+      for (size_t i = 0; i < batch.size(); ++i) {
+        answered[i].connection_id = batch[i].connection_id;
+        answer(reader, batch[i].request, answered[i].response);
+      }
+    }
+    answers.push(answered);
+  }
+  handle.unregister_reader(slot);
+}
+
+// epoll data for the fds which aren't connections. connections are
+// numbered from first_connection_id.
+constexpr uint64_t listen_id = 0;
+constexpr uint64_t answers_id = 1;
+constexpr uint64_t signal_id = 2;
+constexpr uint64_t first_connection_id = 3;
+
+// bytes of answers, written or still to come, past which a connection isn't
+// read from until its client catches up.
+constexpr size_t max_pending_output = 1 << 20;
+
+class event_loop {
+public:
+  event_loop(int listen_fd, int event_fd, int signal_fd, batch_queue &batches,
+             answer_queue &answers, size_t max_batch)
+    : listen_fd_(listen_fd), event_fd_(event_fd), batches_(batches), answers_(answers),
+      max_batch_(max_batch), next_id_(first_connection_id),
+      num_requests_(0), num_batches_(0), num_bad_(0) {
+
+    epoll_fd_ = epoll_create1(0);
+    if (epoll_fd_ == -1) {
+      throw std::runtime_error("Unable to create epoll instance.");
+    }
+    add(listen_fd, listen_id, EPOLLIN);
+    add(event_fd, answers_id, EPOLLIN);
+    add(signal_fd, signal_id, EPOLLIN);
+  }
+
+  ~event_loop() {
+    for (auto &c : connections_) {
+      close(c.second.fd);
+    }
+    close(epoll_fd_);
+  }
+
+  // runs until a signal arrives.
+  void run() {
+    epoll_event events[64];
+    std::vector<pending_query> ready;
+    std::vector<answered_query> answered;
+    while (true) {
+      const int n = epoll_wait(epoll_fd_, events, 64, -1);
+      if (n == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::runtime_error("epoll_wait failed.");
+      }
+      for (int i = 0; i < n; ++i) {
+        const uint64_t id = events[i].data.u64;
+        if (id == listen_id) {
+          accept_connections();
+        } else if (id == answers_id) {
+          uint64_t count;
+          ssize_t r = read(event_fd_, &count, sizeof count);
+          (void)r;
+          answers_.take(answered);
+          for (const auto &a : answered) {
+            auto itr = connections_.find(a.connection_id);
+            if (itr != connections_.end()) {
+              encode_response(a.response, itr->second.out);
+              --itr->second.in_flight;
+              dirty_.push_back(a.connection_id);
+            }
+          }
+        } else if (id == signal_id) {
+          return;
+        } else {
+          auto itr = connections_.find(id);
+          if (itr == connections_.end()) {
+            continue;
+          }
+          if ((events[i].events & EPOLLOUT) != 0) {
+            dirty_.push_back(id);
+          }
+          if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP)) != 0) {
+            if (read_requests(id, itr->second, ready)) {
+              dirty_.push_back(id);
+            } else {
+              close_connection(id);
+            }
+          }
+        }
+      }
+
+      // everything which arrived this time round goes out in batches.
+      for (size_t start = 0; start < ready.size(); start += max_batch_) {
+        const size_t end = std::min(ready.size(), start + max_batch_);
+        batches_.push(std::vector<pending_query>(
+          std::make_move_iterator(ready.begin() + start), std::make_move_iterator(ready.begin() + end)));
+        ++num_batches_;
+      }
+      num_requests_ += ready.size();
+      ready.clear();
+
+      // a client which sends requests faster than it reads the answers
+      // isn't read from again until it's caught up, so what's buffered for
+      // it stays bounded.
+      for (auto id : dirty_) {
+        auto itr = connections_.find(id);
+        if (itr == connections_.end()) {
+          continue;
+        }
+        framed_connection &c = itr->second;
+        if (!flush_connection(epoll_fd_, id, c)) {
+          close_connection(id);
+          continue;
+        }
+        const bool want_read = pending_output(c, 4 + RESPONSE_SIZE) < max_pending_output;
+        watch_connection(epoll_fd_, id, c, want_read, c.want_write);
+      }
+      dirty_.clear();
+    }
+  }
+
+  uint64_t num_requests() const { return num_requests_; }
+  uint64_t num_batches() const { return num_batches_; }
+  uint64_t num_bad() const { return num_bad_; }
+
+private:
+  void add(int fd, uint64_t id, uint32_t events) {
+    epoll_event ev;
+    ev.events = events;
+    ev.data.u64 = id;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == -1) {
+      throw std::runtime_error("Unable to add fd to epoll.");
+    }
+  }
+
+  void accept_connections() {
+    while (true) {
+      int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd == -1) {
+        return;
+      }
+      const uint64_t id = next_id_++;
+      framed_connection &c = connections_[id];
+      c.fd = fd;
+      c.out_offset = 0;
+      c.want_read = true;
+      c.want_write = false;
+      c.in_flight = 0;
+      add(fd, id, EPOLLIN | EPOLLRDHUP);
+    }
+  }
+
+  // reads and parses whatever is available. returns false if the connection
+  // should be closed.
+  bool read_requests(uint64_t id, framed_connection &c, std::vector<pending_query> &ready) {
+    const bool open = read_available(c);
+
+    size_t offset = 0;
+    const uint8_t *body;
+    uint32_t length;
+    bool too_big;
+    while (next_frame(c.in, offset, body, length, too_big)) {
+      pending_query q;
+      q.connection_id = id;
+      if (decode_request(body, length, q.request)) {
+        ready.push_back(std::move(q));
+        ++c.in_flight;
+      } else {
+        // answer what can be answered, so the client isn't left waiting.
+        query_response response;
+        memset(&response, 0, sizeof response);
+        if (length >= 4) {
+          memcpy(&response.request_id, body, 4);
+        }
+        response.status = query_status::bad_request;
+        encode_response(response, c.out);
+        dirty_.push_back(id);
+        ++num_bad_;
+      }
+    }
+    c.in.erase(c.in.begin(), c.in.begin() + offset);
+    return open && !too_big;
+  }
+
+  void close_connection(uint64_t id) {
+    auto itr = connections_.find(id);
+    if (itr == connections_.end()) {
+      return;
+    }
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, itr->second.fd, nullptr);
+    close(itr->second.fd);
+    connections_.erase(itr);
+  }
+
+  int epoll_fd_;
+  int listen_fd_;
+  int event_fd_;
+  batch_queue &batches_;
+  answer_queue &answers_;
+  const size_t max_batch_;
+  uint64_t next_id_;
+  std::unordered_map<uint64_t, framed_connection> connections_;
+  // connections with output to write.
+  std::vector<uint64_t> dirty_;
+  uint64_t num_requests_;
+  uint64_t num_batches_;
+  uint64_t num_bad_;
+};
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 5) {
+    std::cerr << "Usage: " << argv[0] << " SOCKET [tile, default sample.tile] [workers, default 4] [max batch, default 32]\n";
+    return 1;
+  }
+  const std::string socket_path = argv[1];
+  const std::string tile_path = (argc > 2) ? argv[2] : "sample.tile";
+  const unsigned int num_workers = (argc > 3) ? unsigned(atoi(argv[3])) : 4;
+  const size_t max_batch = (argc > 4) ? size_t(atoi(argv[4])) : 32;
+  if (num_workers == 0 || num_workers > tile_handle::max_readers || max_batch == 0) {
+    std::cerr << "Need between 1 and " << tile_handle::max_readers << " workers, and a batch of at least 1.\n";
+    return 1;
+  }
+
+  mmap_policy policy;
+  policy.populate = true;
+  tile_handle handle(tile_path, tile_open_mode::verify_full, policy);
+
+  // replies have MAX_N_SPEEDS buckets, so only the default scheme fits them.
+  {
+    const size_t slot = handle.register_reader();
+    {
+      tile_handle::read_guard tile(handle, slot);
+      require_default_speed_buckets(tile_speed_buckets(tile->tile.histogram()));
+    }
+    handle.unregister_reader(slot);
+  }
+
+  // signals are taken through a signalfd, so that the event loop sees them.
+  // they have to be blocked before any threads start, so all threads inherit
+  // the mask.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+  const int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+  const int event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (signal_fd == -1 || event_fd == -1) {
+    throw std::runtime_error("Unable to create server fds.");
+  }
+  const int listen_fd = listen_unix(socket_path);
+
+  batch_queue batches;
+  answer_queue answers(event_fd);
+  std::vector<std::thread> workers;
+  for (unsigned int i = 0; i < num_workers; ++i) {
+    workers.emplace_back(run_worker, std::ref(handle), std::ref(batches), std::ref(answers));
+  }
+
+  std::cout << "Serving " << tile_path << " on " << socket_path << " with " << num_workers
+            << " workers.\n";
+  uint64_t num_requests = 0, num_batches = 0, num_bad = 0;
+  {
+    event_loop loop(listen_fd, event_fd, signal_fd, batches, answers, max_batch);
+    loop.run();
+    num_requests = loop.num_requests();
+    num_batches = loop.num_batches();
+    num_bad = loop.num_bad();
+  }
+
+  batches.close();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  close(listen_fd);
+  close(event_fd);
+  close(signal_fd);
+  unlink(socket_path.c_str());
+
+  std::cout << "Answered " << num_requests << " requests in " << num_batches << " batches ("
+            << (num_batches > 0 ? double(num_requests) / double(num_batches) : 0.0)
+            << " per batch), and refused " << num_bad << ".\n";
+  return 0;
+}
@@ -0,0 +1,292 @@
+#ifndef QUERY_TRACE_HPP
+#define QUERY_TRACE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// instrumentation for the phases of a query through histogram_reader.hpp:
+//
+//   segment_lookup: finding a segment in the tile.
+//   entry_search:   finding its entries for the day_hour.
+//   scan:           walking those entries and adding them up.
+//   finalise:       turning the histogram into an answer.
+//
+// the readers mark each change of phase with QUERY_TRACE_PHASE, which
+// charges the time since the last mark to the phase being left, so there's
+// one clock read per change rather than a pair per phase. they also count
+// the entries they scan and the cache lines they touch.
+//
+// it's all compiled out unless QUERY_TRACE is defined, so the hooks cost
+// nothing in the other tools. when it is defined, the hooks record into the
+// query_tracer which has a query open on the calling thread, if any.
+
+enum class query_phase : uint32_t {
+  segment_lookup = 0,
+  entry_search = 1,
+  scan = 2,
+  finalise = 3
+};
+
+constexpr uint32_t NUM_QUERY_PHASES = 4;
+
+inline const char *query_phase_name(query_phase phase) {
+  static const char *names[NUM_QUERY_PHASES] = {
+    "segment_lookup", "entry_search", "scan", "finalise"};
+  return names[uint32_t(phase)];
+}
+
+// the cheapest clock there is: the time stamp counter on x86-64, where the
+// ticks are reference cycles, and nanoseconds elsewhere.
+inline uint64_t trace_clock() {
+#if defined(__x86_64__)
+  return __rdtsc();
+#else
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+inline const char *trace_clock_units() {
+#if defined(__x86_64__)
+  return "tsc_cycles";
+#else
+  return "ns";
+#endif
+}
+
+// a histogram of non-negative values in the style of HdrHistogram: exact
+// below 16, then 16 linear buckets per power of two, so any value is known
+// to within 1/16th at a fixed 8KB whatever the range.
+class log_histogram {
+public:
+  static constexpr uint32_t sub_bits = 4;
+  static constexpr uint32_t sub_buckets = 1 << sub_bits;
+  static constexpr uint32_t num_buckets = (64 - sub_bits + 1) << sub_bits;
+
+  log_histogram() { clear(); }
+
+  void clear() {
+    memset(counts_, 0, sizeof counts_);
+    count_ = 0;
+    sum_ = 0;
+    max_ = 0;
+  }
+
+  void record(uint64_t value) {
+    ++counts_[bucket_of(value)];
+    ++count_;
+    sum_ += double(value);
+    if (value > max_) {
+      max_ = value;
+    }
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t max() const { return max_; }
+  double mean() const { return (count_ > 0) ? sum_ / double(count_) : 0.0; }
+
+  // the q'th quantile, as the highest value in its bucket.
+  uint64_t quantile(double q) const {
+    if (count_ == 0) {
+      return 0;
+    }
+    uint64_t rank = uint64_t(q * double(count_));
+    rank = (rank < 1) ? 1 : (rank > count_ ? count_ : rank);
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < num_buckets; ++i) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        const uint64_t top = (i + 1 < num_buckets) ? bucket_floor(i + 1) - 1 : max_;
+        return (top < max_) ? top : max_;
+      }
+    }
+    return max_;
+  }
+
+  static uint32_t bucket_of(uint64_t value) {
+    if (value < sub_buckets) {
+      return uint32_t(value);
+    }
+    const uint32_t msb = 63 - uint32_t(__builtin_clzll(value));
+    const uint32_t shift = msb - sub_bits;
+    return ((shift + 1) << sub_bits) + uint32_t((value >> shift) & (sub_buckets - 1));
+  }
+
+  static uint64_t bucket_floor(uint32_t bucket) {
+    if (bucket < sub_buckets) {
+      return bucket;
+    }
+    const uint32_t shift = (bucket >> sub_bits) - 1;
+    return uint64_t(sub_buckets + (bucket & (sub_buckets - 1))) << shift;
+  }
+
+  void write_json(std::ostream &out) const {
+    out << "{\"count\": " << count_ << ", \"mean\": " << mean()
+        << ", \"p50\": " << quantile(0.5) << ", \"p90\": " << quantile(0.9)
+        << ", \"p99\": " << quantile(0.99) << ", \"p99.9\": " << quantile(0.999)
+        << ", \"max\": " << max_ << "}";
+  }
+
+private:
+  uint64_t counts_[num_buckets];
+  uint64_t count_;
+  double sum_;
+  uint64_t max_;
+};
+
+// per query distributions of the time in each phase, the total, the entries
+// scanned and the cache lines touched. one per thread: begin_query() makes
+// it the one the calling thread's hooks record into, until end_query().
+class query_tracer {
+public:
+  query_tracer() : open_(false) {}
+
+  void begin_query();
+  void end_query();
+
+  void mark(query_phase phase) {
+    const uint64_t now = trace_clock();
+    ticks_[uint32_t(phase_)] += now - last_;
+    last_ = now;
+    phase_ = phase;
+  }
+
+  void add_entries(uint64_t n) {
+    entries_ += n;
+  }
+
+  // counts the cache lines of [p, p + size), less one if the first is the
+  // line last touched, so that walking a contiguous array counts each line
+  // once.
+  void touch(const void *p, size_t size) {
+    uint64_t first = uint64_t(uintptr_t(p)) >> 6;
+    const uint64_t last = uint64_t(uintptr_t(p) + (size > 0 ? size - 1 : 0)) >> 6;
+    if (first == last_line_) {
+      ++first;
+    }
+    if (last >= first) {
+      lines_ += last - first + 1;
+    }
+    last_line_ = last;
+  }
+
+  const log_histogram &phase(query_phase p) const { return phases_[uint32_t(p)]; }
+  const log_histogram &total() const { return total_; }
+  const log_histogram &entries() const { return entries_hist_; }
+  const log_histogram &cache_lines() const { return lines_hist_; }
+
+  void clear() {
+    for (auto &h : phases_) {
+      h.clear();
+    }
+    total_.clear();
+    entries_hist_.clear();
+    lines_hist_.clear();
+  }
+
+  // the distributions as a JSON object's members, without the braces, so
+  // that callers can add their own.
+  void write_json_members(std::ostream &out) const {
+    out << "\"clock\": \"" << trace_clock_units() << "\", \"queries\": " << total_.count()
+        << ", \"phases\": {";
+    for (uint32_t i = 0; i < NUM_QUERY_PHASES; ++i) {
+      out << (i > 0 ? ", " : "") << "\"" << query_phase_name(query_phase(i)) << "\": ";
+      phases_[i].write_json(out);
+    }
+    out << "}, \"total\": ";
+    total_.write_json(out);
+    out << ", \"entries_scanned\": ";
+    entries_hist_.write_json(out);
+    out << ", \"cache_lines\": ";
+    lines_hist_.write_json(out);
+  }
+
+private:
+  bool open_;
+  query_phase phase_;
+  uint64_t start_;
+  uint64_t last_;
+  uint64_t ticks_[NUM_QUERY_PHASES];
+  uint64_t entries_;
+  uint64_t lines_;
+  uint64_t last_line_;
+
+  log_histogram phases_[NUM_QUERY_PHASES];
+  log_histogram total_;
+  log_histogram entries_hist_;
+  log_histogram lines_hist_;
+};
+
+// the tracer with a query open on this thread, or null.
+inline query_tracer *&active_query_tracer() {
+  static thread_local query_tracer *tracer = nullptr;
+  return tracer;
+}
+
+inline void query_tracer::begin_query() {
+  open_ = true;
+  memset(ticks_, 0, sizeof ticks_);
+  entries_ = 0;
+  lines_ = 0;
+  last_line_ = ~uint64_t(0);
+  // anything before the first mark is the query finding its first segment.
+  phase_ = query_phase::segment_lookup;
+  active_query_tracer() = this;
+  start_ = last_ = trace_clock();
+}
+
+inline void query_tracer::end_query() {
+  if (!open_) {
+    return;
+  }
+  const uint64_t now = trace_clock();
+  ticks_[uint32_t(phase_)] += now - last_;
+  for (uint32_t i = 0; i < NUM_QUERY_PHASES; ++i) {
+    phases_[i].record(ticks_[i]);
+  }
+  total_.record(now - start_);
+  entries_hist_.record(entries_);
+  lines_hist_.record(lines_);
+  active_query_tracer() = nullptr;
+  open_ = false;
+}
+
+#if defined(QUERY_TRACE)
+
+#define QUERY_TRACE_PHASE(phase) \
+  do { \
+    if (query_tracer *query_trace_t = active_query_tracer()) { \
+      query_trace_t->mark(query_phase::phase); \
+    } \
+  } while (0)
+
+#define QUERY_TRACE_ENTRIES(n) \
+  do { \
+    if (query_tracer *query_trace_t = active_query_tracer()) { \
+      query_trace_t->add_entries(n); \
+    } \
+  } while (0)
+
+#define QUERY_TRACE_TOUCH(p, size) \
+  do { \
+    if (query_tracer *query_trace_t = active_query_tracer()) { \
+      query_trace_t->touch(p, size); \
+    } \
+  } while (0)
+
+#else
+
+#define QUERY_TRACE_PHASE(phase) do {} while (0)
+#define QUERY_TRACE_ENTRIES(n) do {} while (0)
+#define QUERY_TRACE_TOUCH(p, size) do {} while (0)
+
+#endif
+
+#endif /* QUERY_TRACE_HPP */
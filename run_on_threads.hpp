@@ -0,0 +1,130 @@
+#ifndef RUN_ON_THREADS_HPP
+#define RUN_ON_THREADS_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace detail {
+
+// runs f(i) for i in [0, n) on a thread each, rethrowing the first exception
+// any of them threw.
+template <typename F>
+void run_on_threads(unsigned int n, F &&f) {
+  std::mutex mutex;
+  std::exception_ptr error;
+  std::vector<std::thread> threads;
+  for (unsigned int i = 0; i < n; ++i) {
+    threads.emplace_back([&, i]() {
+        try {
+          f(i);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (!error) {
+            error = std::current_exception();
+          }
+        }
+      });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+} // namespace detail
+
+// a fixed set of threads, each of which runs f(i), for its own i in
+// [0, size()), on every call to run(). for callers which split many short
+// steps between threads, and would otherwise spend as long starting threads
+// as working. run() is for one caller at a time.
+class thread_team {
+public:
+  explicit thread_team(unsigned int n)
+    : task_(nullptr), generation_(0), remaining_(0), stopping_(false) {
+    for (unsigned int i = 0; i < n; ++i) {
+      threads_.emplace_back([this, i]() { work(i); });
+    }
+  }
+
+  ~thread_team() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    start_.notify_all();
+    for (auto &thread : threads_) {
+      thread.join();
+    }
+  }
+
+  unsigned int size() const { return unsigned(threads_.size()); }
+
+  // runs f on every thread and waits for them all, rethrowing the first
+  // exception any of them threw.
+  template <typename F>
+  void run(F &&f) {
+    const std::function<void(unsigned int)> task(std::ref(f));
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_ = &task;
+    error_ = nullptr;
+    remaining_ = threads_.size();
+    ++generation_;
+    start_.notify_all();
+    done_.wait(lock, [this]() { return remaining_ == 0; });
+    task_ = nullptr;
+    if (error_) {
+      std::exception_ptr error = error_;
+      error_ = nullptr;
+      std::rethrow_exception(error);
+    }
+  }
+
+private:
+  void work(unsigned int i) {
+    uint64_t seen = 0;
+    while (true) {
+      const std::function<void(unsigned int)> *task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_.wait(lock, [&]() { return stopping_ || generation_ != seen; });
+        if (stopping_) {
+          return;
+        }
+        seen = generation_;
+        task = task_;
+      }
+      std::exception_ptr error;
+      try {
+        (*task)(i);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (error && !error_) {
+        error_ = error;
+      }
+      if (--remaining_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  const std::function<void(unsigned int)> *task_;
+  uint64_t generation_;
+  size_t remaining_;
+  bool stopping_;
+  std::exception_ptr error_;
+  std::vector<std::thread> threads_;
+};
+
+#endif /* RUN_ON_THREADS_HPP */
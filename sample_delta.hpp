@@ -0,0 +1,68 @@
+#ifndef SAMPLE_DELTA_HPP
+#define SAMPLE_DELTA_HPP
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "histogram_tile_generated.h"
+#include "histogram_delta_generated.h"
+#include "fb_histogram_reader.hpp"
+
+// fake new observations for a day of the week on a sample tile: for a
+// fraction of its segments, a few hours of the day, mostly along turns the
+// tile already has but now and then along a new one. like make_sample_tile,
+// there's no empirical evidence for any of it.
+inline std::vector<OpenTraffic::DeltaEntry> sample_delta_entries(
+  const OpenTraffic::Histogram *histogram, uint32_t day, double fraction, uint64_t seed) {
+
+  namespace ot = OpenTraffic;
+  const uint32_t num_segments = (histogram->segments() != nullptr) ? histogram->segments()->size() : 0;
+  const speed_bucket_scheme scheme = tile_speed_buckets(histogram);
+  std::vector<ot::VehicleType> types;
+  if (histogram->vehicle_types() != nullptr) {
+    for (auto type : *(histogram->vehicle_types())) {
+      types.push_back(ot::VehicleType(type));
+    }
+  } else {
+    types.push_back(histogram->vehicle_type());
+  }
+
+  std::mt19937_64 eng(seed);
+  std::uniform_real_distribution<double> dist_unit(0.0, 1.0);
+  std::uniform_int_distribution<uint32_t> dist_hour(6, 21);
+  std::uniform_int_distribution<uint32_t> dist_num_hours(1, 4);
+  std::uniform_int_distribution<uint32_t> dist_bucket(scheme.count / 4, scheme.count * 3 / 4);
+  std::uniform_int_distribution<uint32_t> dist_count(1, 20);
+  std::uniform_int_distribution<uint32_t> dist_segment(0, num_segments > 0 ? num_segments - 1 : 0);
+  std::uniform_int_distribution<size_t> dist_type(0, types.size() - 1);
+
+  std::vector<ot::DeltaEntry> entries;
+  for (uint32_t segment_id = 0; segment_id < num_segments; ++segment_id) {
+    if (dist_unit(eng) >= fraction) {
+      continue;
+    }
+    auto next_segment_ids = histogram->segments()->Get(segment_id)->next_segment_ids();
+    const uint32_t num_hours = dist_num_hours(eng);
+    for (uint32_t h = 0; h < num_hours; ++h) {
+      const uint32_t day_hour = day * 24 + dist_hour(eng);
+      uint32_t next_id;
+      if (next_segment_ids != nullptr && next_segment_ids->size() > 0 && dist_unit(eng) < 0.95) {
+        next_id = next_segment_ids->Get(uint32_t(dist_unit(eng) * next_segment_ids->size()));
+      } else {
+        next_id = dist_segment(eng);
+      }
+      const uint32_t bucket = dist_bucket(eng);
+      for (int i = -1; i < 2; ++i) {
+        if (int(bucket) + i < 0 || bucket + i >= scheme.count) {
+          continue;
+        }
+        entries.emplace_back(segment_id, next_id, uint8_t(day_hour), uint8_t(bucket + i),
+                             types[dist_type(eng)], dist_count(eng));
+      }
+    }
+  }
+  return entries;
+}
+
+#endif /* SAMPLE_DELTA_HPP */
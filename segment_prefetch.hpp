@@ -0,0 +1,89 @@
+#ifndef SEGMENT_PREFETCH_HPP
+#define SEGMENT_PREFETCH_HPP
+
+#include <set>
+#include <vector>
+
+#include "histogram_tile_generated.h"
+#include "page_cache.hpp"
+
+struct prefetch_stats {
+  uint32_t waves;
+  uint64_t bytes;
+};
+
+// starts reading in all the pages of a mapped FlatBuffers tile which a query
+// for segment_ids will touch, before the query runs.
+//
+// finding a segment's data means following offsets, each of which may be on
+// a page which isn't resident yet, so this goes in three waves: the slots in
+// the segments vector, then the Segment tables and their vtables, then the
+// entry vectors. each wave advises all of its pages at once and the next one
+// waits only for the slowest, so a cold query costs about three disk round
+// trips rather than a few per segment, one after another.
+//
+// whole entry vectors are prefetched, rather than just the run for the
+// query's day_hour, as finding the run means searching the entries. they're
+// usually only a page or two.
+inline prefetch_stats prefetch_segments(
+  const void *buffer, size_t size,
+  const OpenTraffic::Histogram *histogram,
+  const std::set<uint32_t> &segment_ids) {
+
+  namespace fb = flatbuffers;
+  const uint8_t *base = static_cast<const uint8_t *>(buffer);
+  auto range_of = [base](const void *p, size_t n) {
+    return byte_range{uint64_t(static_cast<const uint8_t *>(p) - base), n};
+  };
+
+  prefetch_stats stats = {0, 0};
+  auto segs = histogram->segments();
+  if (segs == nullptr) {
+    return stats;
+  }
+
+  std::vector<uint32_t> ids;
+  std::vector<byte_range> ranges;
+  for (auto segment_id : segment_ids) {
+    if (segment_id < segs->size()) {
+      ids.push_back(segment_id);
+      ranges.push_back(range_of(segs->Data() + segment_id * sizeof(fb::uoffset_t), sizeof(fb::uoffset_t)));
+    }
+  }
+  stats.bytes += willneed_mapped(buffer, size, ranges);
+  stats.waves += 1;
+
+  ranges.clear();
+  for (auto segment_id : ids) {
+    const uint8_t *table = reinterpret_cast<const uint8_t *>((*segs)[segment_id]);
+    const uint8_t *vtable = table - fb::ReadScalar<fb::soffset_t>(table);
+    ranges.push_back(range_of(table, 64));
+    ranges.push_back(range_of(vtable, 32));
+  }
+  stats.bytes += willneed_mapped(buffer, size, ranges);
+  stats.waves += 1;
+
+  ranges.clear();
+  for (auto segment_id : ids) {
+    auto segment = (*segs)[segment_id];
+    if (segment->entries() != nullptr) {
+      ranges.push_back(range_of(
+        segment->entries()->Data() - sizeof(fb::uoffset_t),
+        sizeof(fb::uoffset_t) + segment->entries()->size() * sizeof(OpenTraffic::Entry)));
+    }
+    if (segment->bucket_runs() != nullptr && segment->run_counts() != nullptr) {
+      ranges.push_back(range_of(
+        segment->bucket_runs()->Data() - sizeof(fb::uoffset_t),
+        sizeof(fb::uoffset_t) + segment->bucket_runs()->size() * sizeof(OpenTraffic::BucketRun)));
+      ranges.push_back(range_of(
+        segment->run_counts()->Data() - sizeof(fb::uoffset_t),
+        sizeof(fb::uoffset_t) + segment->run_counts()->size() * sizeof(uint32_t)));
+    }
+  }
+  stats.bytes += willneed_mapped(buffer, size, ranges);
+  stats.waves += 1;
+
+  return stats;
+}
+
+#endif /* SEGMENT_PREFETCH_HPP */
@@ -0,0 +1,26 @@
+#ifndef SEGMENT_SHARDS_HPP
+#define SEGMENT_SHARDS_HPP
+
+#include <cstdint>
+
+// segment IDs [0, num_segments) split into num_shards contiguous ranges of
+// as near equal size as possible. convert_fb_to_shards writes a tile for each
+// range, and query_coordinator routes segments to them by the same split.
+
+inline uint32_t shard_first_segment(uint32_t shard, uint32_t num_segments, uint32_t num_shards) {
+  return uint32_t(uint64_t(shard) * num_segments / num_shards);
+}
+
+inline uint32_t shard_of_segment(uint32_t segment_id, uint32_t num_segments, uint32_t num_shards) {
+  // the inverse of shard_first_segment, corrected for rounding.
+  uint32_t shard = uint32_t((uint64_t(segment_id) * num_shards + num_shards - 1) / num_segments);
+  while (shard > 0 && shard_first_segment(shard, num_segments, num_shards) > segment_id) {
+    --shard;
+  }
+  while (shard + 1 < num_shards && shard_first_segment(shard + 1, num_segments, num_shards) <= segment_id) {
+    ++shard;
+  }
+  return shard;
+}
+
+#endif /* SEGMENT_SHARDS_HPP */
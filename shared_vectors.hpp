@@ -0,0 +1,106 @@
+#ifndef SHARED_VECTORS_HPP
+#define SHARED_VECTORS_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "histogram_tile_generated.h"
+
+// content addressed vectors for a FlatBufferBuilder: each distinct vector is
+// written once, and every table which would have had a copy of it points to
+// that one instead. FlatBuffers offsets are just offsets, so a shared vector
+// reads exactly as an unshared one would, and readers needn't know.
+//
+// vectors are looked up by a hash of their bytes and element type, and then
+// compared with the candidate already in the builder, so a hash collision
+// costs a comparison rather than a wrong answer. vectors are only shared
+// between the same element type, which keeps them aligned for it.
+class shared_vectors {
+public:
+  struct stats {
+    uint64_t vectors;
+    uint64_t shared;
+    // bytes of vector data which didn't have to be written again.
+    uint64_t bytes_saved;
+  };
+
+  shared_vectors() : stats_{0, 0, 0} {}
+
+  template <typename T>
+  flatbuffers::Offset<flatbuffers::Vector<T>> create(
+    flatbuffers::FlatBufferBuilder &builder, const T *data, size_t size) {
+    return flatbuffers::Offset<flatbuffers::Vector<T>>(
+      find_or_add(builder, data, size, sizeof(T), type_tag<T>(), [&]() {
+          return builder.CreateVector(data, size).o;
+        }));
+  }
+
+  template <typename T>
+  flatbuffers::Offset<flatbuffers::Vector<const T *>> create_structs(
+    flatbuffers::FlatBufferBuilder &builder, const T *data, size_t size) {
+    return flatbuffers::Offset<flatbuffers::Vector<const T *>>(
+      find_or_add(builder, data, size, sizeof(T), type_tag<T>(), [&]() {
+          return builder.CreateVectorOfStructs(data, size).o;
+        }));
+  }
+
+  const stats &totals() const { return stats_; }
+
+private:
+  struct stored {
+    const void *tag;
+    flatbuffers::uoffset_t offset;
+  };
+
+  // a distinct address for each element type.
+  template <typename T>
+  static const void *type_tag() {
+    static const char tag = 0;
+    return &tag;
+  }
+
+  static uint64_t hash(const void *data, size_t bytes, const void *tag) {
+    // FNV-1a.
+    uint64_t h = 14695981039346656037ull ^ uint64_t(uintptr_t(tag));
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < bytes; ++i) {
+      h = (h ^ p[i]) * 1099511628211ull;
+    }
+    return h;
+  }
+
+  template <typename Create>
+  flatbuffers::uoffset_t find_or_add(
+    flatbuffers::FlatBufferBuilder &builder, const void *data, size_t size, size_t elem_size,
+    const void *tag, Create create) {
+
+    const size_t bytes = size * elem_size;
+    const uint64_t h = hash(data, bytes, tag);
+    ++stats_.vectors;
+    auto &candidates = by_hash_[h];
+    for (const auto &c : candidates) {
+      if (c.tag != tag) {
+        continue;
+      }
+      // the builder fills downwards from the end of its buffer, so an offset
+      // is a distance back from the end of what's been written.
+      const uint8_t *vec = builder.GetCurrentBufferPointer() + builder.GetSize() - c.offset;
+      if (flatbuffers::ReadScalar<flatbuffers::uoffset_t>(vec) == size &&
+          memcmp(vec + sizeof(flatbuffers::uoffset_t), data, bytes) == 0) {
+        ++stats_.shared;
+        stats_.bytes_saved += bytes;
+        return c.offset;
+      }
+    }
+    const flatbuffers::uoffset_t offset = create();
+    candidates.push_back(stored{tag, offset});
+    return offset;
+  }
+
+  std::unordered_map<uint64_t, std::vector<stored> > by_hash_;
+  stats stats_;
+};
+
+#endif /* SHARED_VECTORS_HPP */
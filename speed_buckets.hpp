@@ -0,0 +1,88 @@
+#ifndef SPEED_BUCKETS_HPP
+#define SPEED_BUCKETS_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// how a tile's speed_bucket values map to speeds: bucket i holds speeds from
+// i * width up to (i + 1) * width, in units, and there are count buckets. the
+// tile stores the width in a byte, and speed_bucket is a byte, so there can
+// be at most 256 buckets.
+enum class speed_units : uint32_t {
+  mph = 0,
+  kph = 1
+};
+
+struct speed_bucket_scheme {
+  uint32_t width;
+  uint32_t count;
+  speed_units units;
+
+  const char *units_name() const {
+    return (units == speed_units::kph) ? "km/h" : "mph";
+  }
+
+  bool operator==(const speed_bucket_scheme &other) const {
+    return width == other.width && count == other.count && units == other.units;
+  }
+  bool operator!=(const speed_bucket_scheme &other) const {
+    return !(*this == other);
+  }
+};
+
+// what tiles without a recorded scheme use: 5 mph buckets up to 120 mph.
+const speed_bucket_scheme default_speed_buckets = {5, 24, speed_units::mph};
+
+// the number of buckets in the default scheme, which the fixed size
+// histograms, prefix sums and cubes are laid out for. tools built on them
+// should check the tile's scheme is the default before using them.
+#define MAX_N_SPEEDS (120 / 5)
+
+static_assert(MAX_N_SPEEDS == 24, "MAX_N_SPEEDS should match default_speed_buckets");
+
+// throws if the scheme can't be used.
+inline void check_speed_buckets(const speed_bucket_scheme &scheme) {
+  if (scheme.width == 0 || scheme.width > 255 || scheme.count == 0 || scheme.count > 256) {
+    throw std::runtime_error("Unusable speed bucket scheme.");
+  }
+}
+
+// throws unless scheme is the default, for tools whose histograms are fixed
+// at MAX_N_SPEEDS buckets of 5 mph.
+inline void require_default_speed_buckets(const speed_bucket_scheme &scheme) {
+  if (scheme != default_speed_buckets) {
+    throw std::runtime_error(
+      "Tile's speed buckets aren't the default 5 mph up to 120 mph, which this tool needs.");
+  }
+}
+
+// parses "width,count,units", e.g: "1,160,kph". returns false if it's not in
+// that form or isn't usable.
+inline bool parse_speed_buckets(const std::string &str, speed_bucket_scheme &scheme) {
+  std::istringstream in(str);
+  std::string width, count, units;
+  if (!std::getline(in, width, ',') || !std::getline(in, count, ',') || !std::getline(in, units)) {
+    return false;
+  }
+  scheme.width = uint32_t(atoi(width.c_str()));
+  scheme.count = uint32_t(atoi(count.c_str()));
+  if (units == "mph") {
+    scheme.units = speed_units::mph;
+  } else if (units == "kph") {
+    scheme.units = speed_units::kph;
+  } else {
+    return false;
+  }
+  return scheme.width > 0 && scheme.width <= 255 && scheme.count > 0 && scheme.count <= 256;
+}
+
+// the scheme as parse_speed_buckets reads it.
+inline std::string format_speed_buckets(const speed_bucket_scheme &scheme) {
+  return std::to_string(scheme.width) + "," + std::to_string(scheme.count) + "," +
+    ((scheme.units == speed_units::kph) ? "kph" : "mph");
+}
+
+#endif /* SPEED_BUCKETS_HPP */
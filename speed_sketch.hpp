@@ -0,0 +1,160 @@
+#ifndef SPEED_SKETCH_HPP
+#define SPEED_SKETCH_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <set>
+#include <vector>
+
+#include "prefix_sums.hpp"
+#include "speed_buckets.hpp"
+
+// a few bytes summarising one segment over one part of the week, for
+// approximate answers which don't need to read the entries at all. the
+// speeds are positions along the scheme's whole range, width * count, in
+// 255ths, and the count is on a log scale with 8 steps per doubling.
+// matches the SpeedSketch struct in histogram_tile.fbs.
+struct speed_sketch {
+  uint8_t count;
+  uint8_t mean;
+  uint8_t p15;
+  uint8_t p50;
+  uint8_t p85;
+};
+
+// each day is cut into parts of this many hours, so a segment has
+// SKETCH_NUM_PARTS sketches and the tile has that many per segment.
+constexpr uint32_t SKETCH_HOURS_PER_PART = 4;
+constexpr uint32_t SKETCH_NUM_PARTS = NUM_DAY_HOURS / SKETCH_HOURS_PER_PART;
+
+inline uint8_t encode_sketch_count(uint64_t count) {
+  if (count == 0) {
+    return 0;
+  }
+  const double q = 1.0 + std::round(8.0 * std::log2(double(count)));
+  return uint8_t(std::min(q, 255.0));
+}
+
+inline double decode_sketch_count(uint8_t q) {
+  return (q == 0) ? 0.0 : std::exp2(double(q - 1) / 8.0);
+}
+
+inline uint8_t encode_sketch_speed(double speed, const speed_bucket_scheme &scheme) {
+  const double range = double(scheme.width) * double(scheme.count);
+  return uint8_t(std::min(std::max(std::round(255.0 * speed / range), 0.0), 255.0));
+}
+
+inline double decode_sketch_speed(uint8_t q, const speed_bucket_scheme &scheme) {
+  return double(q) * double(scheme.width) * double(scheme.count) / 255.0;
+}
+
+// speed at quantile q of a histogram in the scheme's buckets, interpolated
+// within the bucket as quantile_from_cdf does for 5mph buckets.
+inline double sketch_quantile(
+  const std::vector<uint64_t> &hist, uint64_t total, double q,
+  const speed_bucket_scheme &scheme) {
+
+  const double target = q * double(total);
+  uint64_t below = 0;
+  for (uint32_t i = 0; i < hist.size(); ++i) {
+    if (hist[i] > 0 && double(below + hist[i]) >= target) {
+      const double frac = (target - double(below)) / double(hist[i]);
+      return double(scheme.width) * (double(i) + std::min(std::max(frac, 0.0), 1.0));
+    }
+    below += hist[i];
+  }
+  return double(scheme.width) * double(hist.size());
+}
+
+// the SKETCH_NUM_PARTS sketches for a segment's entries, which must be
+// sorted by day_hour. works for anything with day_hour(), speed_bucket() and
+// count() accessors, like build_prefix_sums.
+template <typename Entries>
+std::vector<speed_sketch> build_speed_sketches(
+  const Entries &entries, const speed_bucket_scheme &scheme) {
+
+  std::vector<speed_sketch> sketches(SKETCH_NUM_PARTS, speed_sketch{0, 0, 0, 0, 0});
+  std::vector<uint64_t> hist(scheme.count, 0);
+  auto itr = entries.begin();
+  for (uint32_t part = 0; part < SKETCH_NUM_PARTS; ++part) {
+    const uint32_t end = (part + 1) * SKETCH_HOURS_PER_PART;
+    std::fill(hist.begin(), hist.end(), 0);
+    uint64_t total = 0, sum = 0;
+    for (; itr != entries.end() && uint32_t(itr->day_hour()) < end; ++itr) {
+      const uint32_t bucket = itr->speed_bucket();
+      if (bucket < scheme.count) {
+        hist[bucket] += itr->count();
+        total += itr->count();
+        sum += uint64_t(bucket) * itr->count();
+      }
+    }
+    if (total == 0) {
+      continue;
+    }
+
+    speed_sketch &s = sketches[part];
+    s.count = encode_sketch_count(total);
+    s.mean = encode_sketch_speed(double(scheme.width) * double(sum) / double(total), scheme);
+    s.p15 = encode_sketch_speed(sketch_quantile(hist, total, 0.15, scheme), scheme);
+    s.p50 = encode_sketch_speed(sketch_quantile(hist, total, 0.5, scheme), scheme);
+    s.p85 = encode_sketch_speed(sketch_quantile(hist, total, 0.85, scheme), scheme);
+  }
+  return sketches;
+}
+
+// approximate mean speed, in the scheme's units, at a day_hour from a tile's
+// sketches, which are SKETCH_NUM_PARTS per segment in segment order. this is
+// the count-weighted mean of the segments' means over the whole day part,
+// so it differs from the exact answer both by the quantisation and by the
+// other hours in the part. returns 0 if none of the segments have data.
+inline double approx_mean_speed(
+  const speed_sketch *sketches, uint32_t num_segments,
+  const speed_bucket_scheme &scheme,
+  const std::set<uint32_t> &segment_ids, uint32_t day_hour) {
+
+  const uint32_t part = day_hour / SKETCH_HOURS_PER_PART;
+  double weight = 0.0, sum = 0.0;
+  for (auto segment_id : segment_ids) {
+    if (segment_id >= num_segments) {
+      continue;
+    }
+    const speed_sketch &s = sketches[segment_id * SKETCH_NUM_PARTS + part];
+    const double w = decode_sketch_count(s.count);
+    weight += w;
+    sum += w * decode_sketch_speed(s.mean, scheme);
+  }
+  return (weight > 0.0) ? sum / weight : 0.0;
+}
+
+// approximate p15, p50 and p85 speeds, as the count-weighted means of the
+// segments' quantiles. quantiles don't combine like that exactly, so this is
+// rougher than the mean.
+inline std::vector<double> approx_congestion_quantiles(
+  const speed_sketch *sketches, uint32_t num_segments,
+  const speed_bucket_scheme &scheme,
+  const std::set<uint32_t> &segment_ids, uint32_t day_hour) {
+
+  const uint32_t part = day_hour / SKETCH_HOURS_PER_PART;
+  double weight = 0.0;
+  std::vector<double> speeds(3, 0.0);
+  for (auto segment_id : segment_ids) {
+    if (segment_id >= num_segments) {
+      continue;
+    }
+    const speed_sketch &s = sketches[segment_id * SKETCH_NUM_PARTS + part];
+    const double w = decode_sketch_count(s.count);
+    weight += w;
+    speeds[0] += w * decode_sketch_speed(s.p15, scheme);
+    speeds[1] += w * decode_sketch_speed(s.p50, scheme);
+    speeds[2] += w * decode_sketch_speed(s.p85, scheme);
+  }
+  if (weight > 0.0) {
+    for (auto &speed : speeds) {
+      speed /= weight;
+    }
+  }
+  return speeds;
+}
+
+#endif /* SPEED_SKETCH_HPP */
@@ -0,0 +1,132 @@
+#ifndef TILE_FOOTER_HPP
+#define TILE_FOOTER_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+// a fixed-size footer appended to a tile when it's generated. it records the
+// size of the tile proper, a CRC32C of it, and whether it passed the full
+// FlatBuffers Verifier when it was written. opening a trusted tile then only
+// needs to read the last few bytes, rather than walking the whole buffer.
+//
+// readers which don't know about the footer are unaffected, since the
+// FlatBuffer is at the start of the file and ignores trailing bytes.
+struct tile_footer {
+  // number of bytes of tile data before the footer.
+  uint64_t payload_size;
+  // CRC32C (Castagnoli) of the payload.
+  uint32_t checksum;
+  // bitwise or of tile_footer_flags.
+  uint32_t flags;
+  uint32_t version;
+  uint32_t reserved;
+  char magic[8];
+};
+
+static_assert(sizeof(tile_footer) == 32, "unexpected footer padding");
+
+enum tile_footer_flags : uint32_t {
+  // the payload passed the full Verifier when the tile was generated.
+  tile_footer_verified = 1
+};
+
+constexpr char tile_footer_magic[8] = {'O', 'T', 'F', 'O', 'O', 'T', 'E', 'R'};
+constexpr uint32_t tile_footer_version = 1;
+
+namespace detail {
+
+inline uint32_t crc32c_software(uint32_t crc, const uint8_t *data, size_t size) {
+  // built by the first caller. function-local statics are initialised once
+  // even when threads race to it, e.g. a swap and a compaction.
+  static const std::array<uint32_t, 256> table = []() {
+    std::array<uint32_t, 256> t;
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? (c >> 1) ^ 0x82f63b78u : (c >> 1);
+      }
+      t[i] = c;
+    }
+    return t;
+  }();
+
+  for (size_t i = 0; i < size; ++i) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+inline uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t size) {
+  uint64_t c = crc;
+  for (; size >= 8; size -= 8, data += 8) {
+    uint64_t word;
+    memcpy(&word, data, sizeof word);
+    c = _mm_crc32_u64(c, word);
+  }
+  uint32_t c32 = uint32_t(c);
+  for (; size > 0; --size, ++data) {
+    c32 = _mm_crc32_u8(c32, *data);
+  }
+  return c32;
+}
+#endif
+
+} // namespace detail
+
+// CRC32C of data, using the SSE4.2 crc32 instruction when the CPU has it.
+inline uint32_t crc32c(const uint8_t *data, size_t size) {
+  uint32_t crc = 0xffffffffu;
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2")) {
+    return ~detail::crc32c_sse42(crc, data, size);
+  }
+#endif
+  return ~detail::crc32c_software(crc, data, size);
+}
+
+inline tile_footer make_tile_footer(const uint8_t *payload, size_t size, bool verified) {
+  tile_footer footer;
+  memset(&footer, 0, sizeof footer);
+  footer.payload_size = size;
+  footer.checksum = crc32c(payload, size);
+  footer.flags = verified ? uint32_t(tile_footer_verified) : 0;
+  footer.version = tile_footer_version;
+  memcpy(footer.magic, tile_footer_magic, sizeof footer.magic);
+  return footer;
+}
+
+// how much checking to do when opening a tile.
+enum class tile_open_mode {
+  // run the full FlatBuffers Verifier over the whole buffer.
+  verify_full,
+  // trust the footer's verified flag. O(1) in the size of the tile.
+  trust_footer,
+  // trust the footer's verified flag, but check the payload checksum.
+  // catches corruption since generation, at memory bandwidth.
+  checksum,
+  // trust the footer for the top-level structure, and verify each segment
+  // the first time a query touches it.
+  lazy
+};
+
+// reads the footer at the end of a tile. returns false if there isn't one,
+// or it's inconsistent with the size of the file.
+inline bool read_tile_footer(const void *buffer, size_t size, tile_footer &footer) {
+  if (size < sizeof(tile_footer)) {
+    return false;
+  }
+  memcpy(&footer, (const uint8_t *)buffer + size - sizeof(tile_footer), sizeof footer);
+  return (memcmp(footer.magic, tile_footer_magic, sizeof footer.magic) == 0) &&
+    (footer.version == tile_footer_version) &&
+    (footer.payload_size + sizeof(tile_footer) == size);
+}
+
+#endif /* TILE_FOOTER_HPP */
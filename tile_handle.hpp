@@ -0,0 +1,268 @@
+#ifndef TILE_HANDLE_HPP
+#define TILE_HANDLE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mmapped_file.hpp"
+#include "checked_histogram.hpp"
+#include "delta_tile.hpp"
+
+// a mapped and checked tile.
+struct mapped_tile {
+  mapped_tile(const std::string &path, tile_open_mode mode, const mmap_policy &policy)
+    : file(path, policy), tile(file.buffer, file.size, mode) {}
+
+  mmapped_file file;
+  checked_histogram tile;
+};
+
+// a tile and the deltas overlaid on it, as published by a tile_handle. a tile
+// is shared by everything published on it, and unmapped with the last.
+// version goes up by one with each swap or delta, so it can key caches such
+// as partial_aggregate_cache.
+struct published_tile {
+  published_tile(std::shared_ptr<mapped_tile> base, delta_list deltas, uint64_t version)
+    : base(std::move(base)), tile(this->base->tile), deltas(std::move(deltas)), version(version) {}
+
+  std::shared_ptr<mapped_tile> base;
+  checked_histogram &tile;
+  delta_list deltas;
+  uint64_t version;
+};
+
+// the current tile, which can be swapped for a new one while queries are
+// running on the old one, without readers ever taking a lock.
+//
+// reclamation is epoch based. each reading thread claims a slot, once, and
+// while it's reading the slot holds the global epoch from when it started.
+// a swap publishes the new tile, then retires the old one under the epoch
+// before bumping it. a retired tile is unmapped once no slot holds an epoch
+// at or before the one it was retired under, since any reader which started
+// later can only have seen a newer tile.
+//
+// readers share the tile, so lazy verification, which records what it's
+// verified as it goes, isn't allowed. a thread can nest read_guards on its
+// slot, e.g. in a callback; the slot keeps the outermost one's epoch.
+//
+// check, if given, is called on every tile as it's opened, before it's
+// published, and refuses it by throwing: e.g. a tile in a speed bucket scheme
+// the readers can't query.
+class tile_handle {
+public:
+  static constexpr size_t max_readers = 64;
+
+  typedef std::function<void(const checked_histogram &)> tile_check;
+
+  explicit tile_handle(
+    const std::string &path,
+    tile_open_mode mode = tile_open_mode::verify_full,
+    const mmap_policy &policy = mmap_policy(),
+    tile_check check = tile_check())
+    : mode_(mode), policy_(policy), check_(std::move(check)), epoch_(1), version_(1),
+      next_version_(1) {
+
+    if (mode == tile_open_mode::lazy) {
+      throw std::runtime_error("Shared tiles can't be verified lazily.");
+    }
+    for (auto &slot : slots_) {
+      slot.epoch.store(0);
+      slot.in_use.store(false);
+      slot.depth = 0;
+    }
+    current_.store(new published_tile(open_tile(path), delta_list(), next_version_++));
+  }
+
+  // there mustn't be any readers left.
+  ~tile_handle() {
+    delete current_.load();
+    for (auto &retired : retired_) {
+      delete retired.second;
+    }
+  }
+
+  tile_handle(const tile_handle &) = delete;
+  tile_handle &operator=(const tile_handle &) = delete;
+
+private:
+  struct alignas(64) reader_slot {
+    // the epoch the reader started in, or 0 when it isn't reading.
+    std::atomic<uint64_t> epoch;
+    std::atomic<bool> in_use;
+    // read_guards open on the slot. only its own thread touches this.
+    uint32_t depth;
+  };
+
+public:
+  // claims a reader slot for a thread, which it should keep for as long as it
+  // queries the tile. throws if they're all in use.
+  size_t register_reader() {
+    for (size_t i = 0; i < max_readers; ++i) {
+      bool expected = false;
+      if (slots_[i].in_use.compare_exchange_strong(expected, true)) {
+        return i;
+      }
+    }
+    throw std::runtime_error("Too many tile readers.");
+  }
+
+  void unregister_reader(size_t slot) {
+    slots_[slot].in_use.store(false);
+  }
+
+  // the current tile, which stays mapped for the guard's lifetime. both ends
+  // are a handful of atomic operations on the reader's own cache line.
+  class read_guard {
+  public:
+    read_guard(tile_handle &handle, size_t slot)
+      : slot_(&handle.slots_[slot]) {
+      // the slot has to be seen to hold the epoch before the tile is loaded,
+      // hence sequential consistency rather than acquire/release. a nested
+      // guard keeps the outer one's epoch, which is older still, so whatever
+      // it loads is held too.
+      if (slot_->depth++ == 0) {
+        slot_->epoch.store(handle.epoch_.load());
+      }
+      tile_ = handle.current_.load();
+    }
+
+    ~read_guard() {
+      if (--slot_->depth == 0) {
+        slot_->epoch.store(0, std::memory_order_release);
+      }
+    }
+
+    read_guard(const read_guard &) = delete;
+    read_guard &operator=(const read_guard &) = delete;
+
+    published_tile &operator*() const { return *tile_; }
+    published_tile *operator->() const { return tile_; }
+
+  private:
+    reader_slot *slot_;
+    published_tile *tile_;
+  };
+
+  // maps and checks the tile at path, then publishes it in place of the
+  // current one, which is unmapped when its last reader leaves. the new tile
+  // is opened before anything is published, so a tile which fails its checks
+  // throws and leaves the current one in place. any deltas on the current
+  // tile are dropped with it. returns the new version.
+  uint64_t swap(const std::string &path) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    auto base = open_tile(path);
+    return publish_locked(new published_tile(std::move(base), delta_list(), next_version_));
+  }
+
+  // maps and checks the delta at path, then publishes the current tile with
+  // it overlaid after any others. returns the new version.
+  uint64_t add_delta(const std::string &path) {
+    auto delta = std::make_shared<const delta_tile>(path, policy_);
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    const published_tile *current = current_.load();
+    check_delta_applies(current->tile.histogram(), *delta);
+    delta_list deltas = current->deltas;
+    deltas.push_back(std::move(delta));
+    return publish_locked(new published_tile(current->base, std::move(deltas), next_version_));
+  }
+
+  // the current tile and its deltas, for writers such as delta_compactor
+  // which need them for longer than a read_guard.
+  void layers(std::shared_ptr<mapped_tile> &base, delta_list &deltas) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    base = current_.load()->base;
+    deltas = current_.load()->deltas;
+  }
+
+  // publishes the tile at path, which is from_base with the first
+  // num_folded of its deltas folded in, with the rest of the deltas overlaid.
+  // deltas added since are kept, but if the tile was swapped meanwhile this
+  // throws and leaves it in place. returns the new version.
+  uint64_t swap_compacted(const std::string &path, const std::shared_ptr<mapped_tile> &from_base,
+                          size_t num_folded) {
+    auto base = open_tile(path);
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    const published_tile *current = current_.load();
+    if (current->base != from_base || current->deltas.size() < num_folded) {
+      throw std::runtime_error("Tile was swapped while its deltas were compacted.");
+    }
+    delta_list deltas(current->deltas.begin() + num_folded, current->deltas.end());
+    return publish_locked(new published_tile(std::move(base), std::move(deltas), next_version_));
+  }
+
+  // unmaps whatever retired tiles no reader can still be using, and returns
+  // the number left waiting.
+  size_t reclaim() {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    return reclaim_locked();
+  }
+
+  // the current tile's version. it's kept apart from the tile, which could
+  // be unmapped while it was read outside a read_guard.
+  uint64_t version() const {
+    return version_.load();
+  }
+
+private:
+  std::shared_ptr<mapped_tile> open_tile(const std::string &path) const {
+    auto tile = std::make_shared<mapped_tile>(path, mode_, policy_);
+    if (check_) {
+      check_(tile->tile);
+    }
+    return tile;
+  }
+
+  uint64_t publish_locked(published_tile *next) {
+    ++next_version_;
+    published_tile *old = current_.exchange(next);
+    version_.store(next->version);
+    retired_.emplace_back(epoch_.fetch_add(1), old);
+    reclaim_locked();
+    return next->version;
+  }
+
+  size_t reclaim_locked() {
+    // the oldest epoch any reader is in, or one past the current epoch if
+    // nobody is reading.
+    uint64_t oldest = epoch_.load() + 1;
+    for (const auto &slot : slots_) {
+      const uint64_t e = slot.epoch.load();
+      if (e != 0 && e < oldest) {
+        oldest = e;
+      }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < retired_.size(); ++i) {
+      if (retired_[i].first < oldest) {
+        delete retired_[i].second;
+      } else {
+        retired_[kept++] = retired_[i];
+      }
+    }
+    retired_.resize(kept);
+    return kept;
+  }
+
+  const tile_open_mode mode_;
+  const mmap_policy policy_;
+  const tile_check check_;
+  std::atomic<published_tile *> current_;
+  std::atomic<uint64_t> epoch_;
+  std::atomic<uint64_t> version_;
+  reader_slot slots_[max_readers];
+
+  // only writers take this, to serialise swaps and the retired list.
+  std::mutex writer_mutex_;
+  std::vector<std::pair<uint64_t, published_tile *> > retired_;
+  uint64_t next_version_;
+};
+
+#endif /* TILE_HANDLE_HPP */
@@ -0,0 +1,425 @@
+#ifndef TILE_MERGE_HPP
+#define TILE_MERGE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "histogram_tile_generated.h"
+#include "fb_histogram_reader.hpp"
+#include "packed_entries.hpp"
+#include "log_counts.hpp"
+#include "bucket_runs.hpp"
+#include "speed_buckets.hpp"
+
+// merges tiles covering different windows of time, e.g: weekly tiles into a
+// monthly one, by summing the counts of entries with the same key.
+//
+// each segment's next_segment_ids are the union of the inputs', in the order
+// they're first seen, so the first input's indexes stay the same and the
+// others' are remapped. entries are sorted by (day_hour, next_segment_idx,
+// vehicle_type, speed_bucket), so once remapped each input's entries for a
+// segment are merged in a single pass over all of them, k ways, summing
+// entries with equal keys. an input whose remapping isn't in order has its
+// entries for the segment sorted again first.
+//
+// inputs can hold plain, packed, log count or bucket run entries, though
+// log counts are merged as the counts they decode to. the merged tile has
+// plain entries and none of the optional sections, which can be added again
+// by the converters.
+
+// one segment of the merged tile.
+struct merged_segment {
+  std::vector<uint32_t> next_segment_ids;
+  std::vector<OpenTraffic::Entry> entries;
+};
+
+struct tile_merge_stats {
+  uint64_t num_segments;
+  uint64_t entries_in;
+  uint64_t entries_out;
+};
+
+namespace detail {
+
+inline uint32_t merge_key(const OpenTraffic::Entry &e) {
+  return (uint32_t(e.day_hour()) << 24) | (uint32_t(e.next_segment_idx()) << 16) |
+    (uint32_t(uint8_t(e.vehicle_type())) << 8) | uint32_t(e.speed_bucket());
+}
+
+// appends every entry of segment, whatever its encoding, to out. single-type
+// tiles' entries get the tile's type, so they can be merged with others.
+inline void read_segment_entries(
+  const OpenTraffic::Histogram *histogram, const OpenTraffic::Segment *segment,
+  std::vector<OpenTraffic::Entry> &out) {
+
+  namespace ot = OpenTraffic;
+  const bool multi_type = histogram->vehicle_types() != nullptr;
+  const ot::VehicleType tile_type = histogram->vehicle_type();
+  auto type_of = [&](ot::VehicleType entry_type) {
+    return multi_type ? entry_type : tile_type;
+  };
+
+  if (segment->bucket_runs() != nullptr && segment->run_counts() != nullptr) {
+    // runs are only written for tiles of Autos.
+    auto runs = segment->bucket_runs();
+    auto counts = segment->run_counts();
+    for (auto run : *runs) {
+      if (size_t(run->counts_offset()) + run->length() > counts->size()) {
+        throw std::runtime_error("Bucket run is outside the run counts.");
+      }
+      for (uint32_t i = 0; i < run->length(); ++i) {
+        const uint32_t count = counts->Get(run->counts_offset() + i);
+        if (count > 0) {
+          out.emplace_back(run->day_hour(), run->next_segment_idx(), run->first_bucket() + i,
+                           type_of(ot::VehicleType_Auto), count);
+        }
+      }
+    }
+  } else if (segment->packed_day_hours() != nullptr && segment->packed_keys() != nullptr &&
+             segment->log_counts() != nullptr) {
+    auto day_hours = segment->packed_day_hours();
+    auto keys = segment->packed_keys();
+    auto codes = segment->log_counts();
+    const uint32_t bits = histogram->log_count_bits();
+    if (keys->size() != day_hours->size() || codes->size() != log_counts_size(bits, day_hours->size())) {
+      throw std::runtime_error("Packed entries differ in length.");
+    }
+    for (uint32_t i = 0; i < day_hours->size(); ++i) {
+      const uint8_t key = keys->Get(i);
+      out.emplace_back(day_hours->Get(i), key >> PACKED_BUCKET_BITS, key & PACKED_BUCKET_MASK,
+                       type_of(ot::VehicleType_Auto), log_count_at(bits, codes->data(), i));
+    }
+  } else if (segment->packed_day_hours() != nullptr && segment->packed_keys() != nullptr &&
+             segment->packed_counts() != nullptr) {
+    auto day_hours = segment->packed_day_hours();
+    auto keys = segment->packed_keys();
+    auto counts = segment->packed_counts();
+    if (keys->size() != day_hours->size() || counts->size() != day_hours->size()) {
+      throw std::runtime_error("Packed entries differ in length.");
+    }
+    const packed_escape *escape = nullptr, *escapes_end = nullptr;
+    if (segment->count_escapes() != nullptr) {
+      escape = reinterpret_cast<const packed_escape *>(segment->count_escapes()->Data());
+      escapes_end = escape + segment->count_escapes()->size();
+    }
+    for (uint32_t i = 0; i < day_hours->size(); ++i) {
+      uint32_t count = counts->Get(i);
+      if (count == PACKED_COUNT_ESCAPE) {
+        if (escape == escapes_end || escape->entry != i) {
+          throw std::runtime_error("Packed count escape is missing.");
+        }
+        count = escape->count;
+        ++escape;
+      }
+      const uint8_t key = keys->Get(i);
+      out.emplace_back(day_hours->Get(i), key >> PACKED_BUCKET_BITS, key & PACKED_BUCKET_MASK,
+                       type_of(ot::VehicleType_Auto), count);
+    }
+  } else if (segment->entries() != nullptr) {
+    for (auto e : *(segment->entries())) {
+      out.emplace_back(e->day_hour(), e->next_segment_idx(), e->speed_bucket(),
+                       type_of(e->vehicle_type()), e->count());
+    }
+  }
+}
+
+// the index of next_id in next_segment_ids, adding it to the end if it isn't
+// there.
+inline uint8_t next_segment_index(std::vector<uint32_t> &next_segment_ids, uint32_t next_id) {
+  auto itr = std::find(next_segment_ids.begin(), next_segment_ids.end(), next_id);
+  if (itr == next_segment_ids.end()) {
+    if (next_segment_ids.size() == 256) {
+      throw std::runtime_error("Merged segment has more than 256 next segments.");
+    }
+    itr = next_segment_ids.insert(itr, next_id);
+  }
+  return uint8_t(itr - next_segment_ids.begin());
+}
+
+inline flatbuffers::Offset<OpenTraffic::Segment> write_merged_segment(
+  flatbuffers::FlatBufferBuilder &builder, uint32_t segment_id, const merged_segment &segment) {
+
+  namespace ot = OpenTraffic;
+  namespace fb = flatbuffers;
+  fb::Offset<fb::Vector<uint32_t>> next_segment_ids;
+  fb::Offset<fb::Vector<const ot::Entry *>> entries;
+  if (!segment.next_segment_ids.empty()) {
+    next_segment_ids = builder.CreateVector(segment.next_segment_ids);
+  }
+  if (!segment.entries.empty()) {
+    entries = builder.CreateVectorOfStructs(segment.entries);
+  }
+  ot::SegmentBuilder sbuilder(builder);
+  sbuilder.add_segment_id(segment_id);
+  if (!next_segment_ids.IsNull()) { sbuilder.add_next_segment_ids(next_segment_ids); }
+  if (!entries.IsNull()) { sbuilder.add_entries(entries); }
+  return sbuilder.Finish();
+}
+
+// finishes builder with a tile of segments. types are sorted and unique.
+inline void finish_merged_tile(
+  flatbuffers::FlatBufferBuilder &builder,
+  const std::vector<flatbuffers::Offset<OpenTraffic::Segment> > &segments_vector,
+  const std::vector<int8_t> &types, bool multi_type, const speed_bucket_scheme &scheme) {
+
+  namespace ot = OpenTraffic;
+  namespace fb = flatbuffers;
+  auto segments = builder.CreateVector(segments_vector);
+  fb::Offset<fb::Vector<int8_t>> vehicle_types;
+  if (multi_type) {
+    vehicle_types = builder.CreateVector(types);
+  }
+  auto speed_buckets = ot::CreateSpeedBuckets(
+    builder, uint8_t(scheme.width), uint16_t(scheme.count), ot::SpeedUnits(scheme.units));
+
+  ot::HistogramBuilder hbuilder(builder);
+  hbuilder.add_vehicle_type(ot::VehicleType(types.front()));
+  hbuilder.add_segments(segments);
+  if (multi_type) { hbuilder.add_vehicle_types(vehicle_types); }
+  hbuilder.add_speed_buckets(speed_buckets);
+  builder.Finish(hbuilder.Finish());
+}
+
+} // namespace detail
+
+// reusable buffers for merging one segment at a time.
+struct segment_merge_scratch {
+  std::vector<std::vector<OpenTraffic::Entry> > inputs;
+  std::vector<size_t> positions;
+};
+
+// merges segment_id of each of the inputs into out. inputs with fewer
+// segments count as having nothing for it. returns the number of entries
+// read.
+inline uint64_t merge_segment(
+  const std::vector<const OpenTraffic::Histogram *> &inputs, uint32_t segment_id,
+  segment_merge_scratch &scratch, merged_segment &out) {
+
+  namespace ot = OpenTraffic;
+  out.next_segment_ids.clear();
+  out.entries.clear();
+  scratch.inputs.resize(inputs.size());
+  scratch.positions.assign(inputs.size(), 0);
+
+  uint64_t entries_in = 0;
+  for (size_t k = 0; k < inputs.size(); ++k) {
+    auto &entries = scratch.inputs[k];
+    entries.clear();
+    auto segments = inputs[k]->segments();
+    if (segments == nullptr || segment_id >= segments->size()) {
+      continue;
+    }
+    auto segment = segments->Get(segment_id);
+
+    // the union of next segments, and where this input's indexes go in it.
+    uint8_t remap[256];
+    uint32_t num_next = 0;
+    if (segment->next_segment_ids() != nullptr) {
+      num_next = segment->next_segment_ids()->size();
+      if (num_next > 256) {
+        throw std::runtime_error("Segment has more than 256 next segments.");
+      }
+      for (uint32_t i = 0; i < num_next; ++i) {
+        remap[i] = detail::next_segment_index(out.next_segment_ids, segment->next_segment_ids()->Get(i));
+      }
+    }
+
+    detail::read_segment_entries(inputs[k], segment, entries);
+    entries_in += entries.size();
+    for (auto &e : entries) {
+      if (e.next_segment_idx() >= num_next) {
+        throw std::runtime_error("Entry's next segment index is out of range.");
+      }
+      e = ot::Entry(e.day_hour(), remap[e.next_segment_idx()], e.speed_bucket(),
+                    e.vehicle_type(), e.count());
+    }
+    // remapped indexes can be out of order, and so can the vehicle types of
+    // a tile written with them in command-line order, so the entries are
+    // only taken as sorted once they've been checked.
+    auto by_key = [](const ot::Entry &a, const ot::Entry &b) {
+      return detail::merge_key(a) < detail::merge_key(b);
+    };
+    if (!std::is_sorted(entries.begin(), entries.end(), by_key)) {
+      std::stable_sort(entries.begin(), entries.end(), by_key);
+    }
+  }
+
+  // a k-way merge. there are only a handful of inputs, so the smallest key
+  // is found by looking at each rather than keeping a heap.
+  while (true) {
+    uint32_t min_key = UINT32_MAX;
+    bool any = false;
+    for (size_t k = 0; k < inputs.size(); ++k) {
+      if (scratch.positions[k] < scratch.inputs[k].size()) {
+        const uint32_t key = detail::merge_key(scratch.inputs[k][scratch.positions[k]]);
+        if (!any || key < min_key) {
+          min_key = key;
+          any = true;
+        }
+      }
+    }
+    if (!any) {
+      break;
+    }
+
+    // inputs can repeat a key, so everything with it is summed.
+    uint64_t count = 0;
+    const ot::Entry *first = nullptr;
+    for (size_t k = 0; k < inputs.size(); ++k) {
+      const auto &entries = scratch.inputs[k];
+      size_t &pos = scratch.positions[k];
+      while (pos < entries.size() && detail::merge_key(entries[pos]) == min_key) {
+        first = &entries[pos];
+        count += entries[pos].count();
+        ++pos;
+      }
+    }
+    if (count > UINT32_MAX) {
+      throw std::runtime_error("Merged count is too big for an entry.");
+    }
+    out.entries.emplace_back(first->day_hour(), first->next_segment_idx(), first->speed_bucket(),
+                             first->vehicle_type(), uint32_t(count));
+  }
+  return entries_in;
+}
+
+// merges the inputs into builder, finishing it. segments are merged in
+// chunks of chunk_size on num_threads threads, and written to the builder in
+// order as they're done. at most window chunks are merged ahead of the
+// writer, so the memory used beyond the builder's own is bounded whatever the
+// size of the tiles. the inputs must all have the same speed bucket scheme.
+inline tile_merge_stats merge_tiles(
+  const std::vector<const OpenTraffic::Histogram *> &inputs,
+  flatbuffers::FlatBufferBuilder &builder,
+  unsigned int num_threads, uint32_t chunk_size = 1024) {
+
+  namespace ot = OpenTraffic;
+  namespace fb = flatbuffers;
+  if (inputs.empty() || num_threads == 0 || chunk_size == 0) {
+    throw std::runtime_error("Nothing to merge.");
+  }
+
+  const speed_bucket_scheme scheme = tile_speed_buckets(inputs.front());
+  uint32_t num_segments = 0;
+  bool multi_type = false;
+  std::vector<int8_t> types;
+  for (auto input : inputs) {
+    if (tile_speed_buckets(input) != scheme) {
+      throw std::runtime_error("Tiles have different speed bucket schemes.");
+    }
+    if (input->segments() != nullptr) {
+      num_segments = std::max(num_segments, uint32_t(input->segments()->size()));
+    }
+    if (input->vehicle_types() != nullptr) {
+      multi_type = true;
+      types.insert(types.end(), input->vehicle_types()->begin(), input->vehicle_types()->end());
+    } else {
+      types.push_back(int8_t(input->vehicle_type()));
+    }
+  }
+  std::sort(types.begin(), types.end());
+  types.erase(std::unique(types.begin(), types.end()), types.end());
+  multi_type = multi_type || types.size() > 1;
+
+  // merged chunks waiting for the writer, by chunk number.
+  const uint32_t num_chunks = (num_segments + chunk_size - 1) / chunk_size;
+  const uint32_t window = 2 * num_threads;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::map<uint32_t, std::vector<merged_segment> > done;
+  uint32_t next_chunk = 0, written = 0;
+  bool failed = false;
+  std::exception_ptr error;
+  std::atomic<uint64_t> entries_in(0);
+
+  auto worker = [&]() {
+    segment_merge_scratch scratch;
+    while (true) {
+      uint32_t chunk;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() { return failed || next_chunk >= num_chunks || next_chunk < written + window; });
+        if (failed || next_chunk >= num_chunks) {
+          return;
+        }
+        chunk = next_chunk++;
+      }
+      const uint32_t first = chunk * chunk_size;
+      const uint32_t last = std::min(num_segments, first + chunk_size);
+      std::vector<merged_segment> segments(last - first);
+      try {
+        uint64_t n = 0;
+        for (uint32_t id = first; id < last; ++id) {
+          n += merge_segment(inputs, id, scratch, segments[id - first]);
+        }
+        entries_in += n;
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!failed) {
+          error = std::current_exception();
+        }
+        failed = true;
+        changed.notify_all();
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        done[chunk].swap(segments);
+      }
+      changed.notify_all();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned int i = 0; i < num_threads; ++i) {
+    threads.emplace_back(worker);
+  }
+
+  tile_merge_stats stats = {num_segments, 0, 0};
+  std::vector<fb::Offset<ot::Segment> > segments_vector;
+  segments_vector.reserve(num_segments);
+  while (written < num_chunks) {
+    std::vector<merged_segment> segments;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [&]() { return failed || done.count(written) > 0; });
+      if (failed) {
+        break;
+      }
+      segments.swap(done[written]);
+      done.erase(written);
+    }
+
+    // segment_id is the index, even for the shared empty segments some
+    // tiles have.
+    uint32_t segment_id = written * chunk_size;
+    for (const auto &segment : segments) {
+      segments_vector.push_back(detail::write_merged_segment(builder, segment_id++, segment));
+      stats.entries_out += segment.entries.size();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++written;
+    }
+    changed.notify_all();
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  stats.entries_in = entries_in;
+
+  detail::finish_merged_tile(builder, segments_vector, types, multi_type, scheme);
+  return stats;
+}
+
+#endif /* TILE_MERGE_HPP */
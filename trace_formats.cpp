@@ -0,0 +1,265 @@
+#include "histogram_tile_generated.h"
+#include "histogram_tile.pb.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <memory>
+#include <cstring>
+
+#include <arrow/io/file.h>
+#include <parquet/api/reader.h>
+
+#include "mmapped_file.hpp"
+#include "checked_histogram.hpp"
+#include "histogram_reader.hpp"
+#include "fb_histogram_reader.hpp"
+#include "pbf_histogram_reader.hpp"
+#include "parquet_histogram_reader.hpp"
+#include "query_trace.hpp"
+#include "perf_counters.hpp"
+
+#if !defined(QUERY_TRACE)
+#error "trace_formats needs the query_trace.hpp hooks, build it with -DQUERY_TRACE"
+#endif
+
+namespace ot = OpenTraffic;
+namespace fb = flatbuffers;
+namespace otpbf = OpenTraffic::pbf;
+
+// runs bench_formats' queries through each format's reader with the
+// query_trace.hpp hooks compiled in, and breaks the time per query down by
+// phase, along with the entries each query scans and the cache lines it
+// touches. --json writes the distributions to a file. --perf also runs the
+// queries again untraced under hardware counters, where the kernel allows.
+
+struct query {
+  std::set<uint32_t> segment_ids;
+  uint32_t day_hour;
+};
+
+// hardware counts per query, or negative if they weren't available.
+struct perf_result {
+  double cycles;
+  double instructions;
+  double l1d_load_misses;
+  double cache_misses;
+};
+
+struct format_trace {
+  std::string name;
+  query_tracer tracer;
+  bool has_perf;
+  perf_result perf;
+  // the sum of the answers of one pass, which should be the same for every
+  // format, as in bench_formats.
+  double checksum;
+};
+
+// the answers of the timed passes are written here, so that they can't be
+// optimised away.
+volatile double answer_sink;
+
+template <typename Reader>
+void trace_queries(const Reader &reader, const std::vector<query> &queries, double min_seconds,
+                   bool perf, format_trace &trace) {
+  using std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+
+  // a query which throws leaves the tracer open, and it mustn't outlive the
+  // trace.
+  struct close_tracer {
+    ~close_tracer() { active_query_tracer() = nullptr; }
+  } closer;
+
+  // one untraced pass to warm up.
+  trace.checksum = 0;
+  for (const auto &q : queries) {
+    trace.checksum += query_mean_speed(reader, q.segment_ids, q.day_hour);
+  }
+
+  steady_clock::time_point t0 = steady_clock::now();
+  while (duration_cast<duration<double>>(steady_clock::now() - t0).count() < min_seconds) {
+    for (const auto &q : queries) {
+      trace.tracer.begin_query();
+      answer_sink = query_mean_speed(reader, q.segment_ids, q.day_hour);
+      trace.tracer.end_query();
+    }
+  }
+
+  trace.has_perf = perf;
+  if (perf) {
+    perf_counter cycles(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    perf_counter instructions(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    perf_counter l1d(PERF_TYPE_HW_CACHE, l1d_load_miss_config());
+    perf_counter misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    const uint64_t num_queries = trace.tracer.total().count();
+    cycles.start();
+    instructions.start();
+    l1d.start();
+    misses.start();
+    for (uint64_t n = 0; n < num_queries; n += queries.size()) {
+      for (const auto &q : queries) {
+        answer_sink = query_mean_speed(reader, q.segment_ids, q.day_hour);
+      }
+    }
+    const uint64_t num_misses = misses.stop();
+    const uint64_t num_l1d = l1d.stop();
+    const uint64_t num_instructions = instructions.stop();
+    const uint64_t num_cycles = cycles.stop();
+    auto per_query = [&](const perf_counter &c, uint64_t value) {
+      return c.ok() ? double(value) / double(num_queries) : -1.0;
+    };
+    trace.perf.cycles = per_query(cycles, num_cycles);
+    trace.perf.instructions = per_query(instructions, num_instructions);
+    trace.perf.l1d_load_misses = per_query(l1d, num_l1d);
+    trace.perf.cache_misses = per_query(misses, num_misses);
+  }
+}
+
+void print_trace(const format_trace &trace) {
+  const query_tracer &t = trace.tracer;
+  std::cout << trace.name << ": " << t.total().count() << " queries, " << trace_clock_units()
+            << " per query p50 = " << t.total().quantile(0.5) << ", p99 = " << t.total().quantile(0.99)
+            << " (checksum " << trace.checksum << ")\n";
+  for (uint32_t i = 0; i < NUM_QUERY_PHASES; ++i) {
+    const log_histogram &h = t.phase(query_phase(i));
+    std::cout << "  " << query_phase_name(query_phase(i)) << ": mean = " << h.mean()
+              << ", p50 = " << h.quantile(0.5) << ", p99 = " << h.quantile(0.99) << "\n";
+  }
+  std::cout << "  " << t.entries().mean() << " entries scanned and " << t.cache_lines().mean()
+            << " cache lines touched per query\n";
+  if (trace.has_perf) {
+    auto print = [](const char *name, double value) {
+      std::cout << ", " << name << " ";
+      if (value >= 0) {
+        std::cout << value;
+      } else {
+        std::cout << "n/a";
+      }
+    };
+    std::cout << "  untraced, per query";
+    print("cycles", trace.perf.cycles);
+    print("instructions", trace.perf.instructions);
+    print("L1d load misses", trace.perf.l1d_load_misses);
+    print("cache misses", trace.perf.cache_misses);
+    std::cout << "\n";
+  }
+}
+
+void write_json(std::ostream &out, const std::vector<std::unique_ptr<format_trace> > &traces) {
+  auto value = [&](double v) {
+    if (v >= 0) {
+      out << v;
+    } else {
+      out << "null";
+    }
+  };
+  out << "[\n";
+  for (size_t i = 0; i < traces.size(); ++i) {
+    const format_trace &trace = *traces[i];
+    out << "  {\"format\": \"" << trace.name << "\", ";
+    trace.tracer.write_json_members(out);
+    if (trace.has_perf) {
+      out << ", \"perf\": {\"cycles\": ";
+      value(trace.perf.cycles);
+      out << ", \"instructions\": ";
+      value(trace.perf.instructions);
+      out << ", \"l1d_load_misses\": ";
+      value(trace.perf.l1d_load_misses);
+      out << ", \"cache_misses\": ";
+      value(trace.perf.cache_misses);
+      out << "}";
+    }
+    out << "}" << (i + 1 < traces.size() ? "," : "") << "\n";
+  }
+  out << "]\n";
+}
+
+int main(int argc, char *argv[]) {
+  std::string json_path;
+  bool perf = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else if (strcmp(argv[i], "--perf") == 0) {
+      perf = true;
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--json FILE] [--perf]\n";
+      return 1;
+    }
+  }
+
+  // the same queries as bench_formats.
+  std::mt19937_64 eng(12345);
+  std::uniform_int_distribution<uint32_t> dist_segment_id(0, 9999);
+  std::uniform_int_distribution<uint32_t> dist_day(1, 5);
+  std::uniform_int_distribution<uint32_t> dist_hour(7, 19);
+  std::vector<query> queries(20);
+  for (auto &q : queries) {
+    while (q.segment_ids.size() < 50) {
+      q.segment_ids.insert(dist_segment_id(eng));
+    }
+    q.day_hour = dist_day(eng) * 24 + dist_hour(eng);
+  }
+  const double min_seconds = 1.0;
+
+  // tracers are big, so they live on the heap. formats which fail are left
+  // out.
+  std::vector<std::unique_ptr<format_trace> > traces;
+  std::unique_ptr<format_trace> trace;
+
+  try {
+    mmapped_file f("sample.tile");
+    checked_histogram tile(f.buffer, f.size, tile_open_mode::verify_full);
+    require_default_speed_buckets(tile_speed_buckets(tile.histogram()));
+    trace.reset(new format_trace());
+    trace->name = "FlatBuffers";
+    trace_queries(fb_histogram_reader(tile), queries, min_seconds, perf, *trace);
+    traces.push_back(std::move(trace));
+  } catch (const std::exception &e) {
+    std::cout << "FlatBuffers: skipped, " << e.what() << "\n";
+  }
+
+  try {
+    otpbf::Histogram histogram;
+    std::fstream in("sample.tile.pbf");
+    if (!histogram.ParseFromIstream(&in)) {
+      throw std::runtime_error("Unable to open input");
+    }
+    require_default_speed_buckets(tile_speed_buckets(histogram));
+    trace.reset(new format_trace());
+    trace->name = "Protocol Buffers";
+    trace_queries(pbf_histogram_reader(histogram), queries, min_seconds, perf, *trace);
+    traces.push_back(std::move(trace));
+  } catch (const std::exception &e) {
+    std::cout << "Protocol Buffers: skipped, " << e.what() << "\n";
+  }
+
+  try {
+    using FileClass = ::arrow::io::ReadableFile;
+    std::shared_ptr<FileClass> input;
+    PARQUET_THROW_NOT_OK(FileClass::Open("sample.tile.parquet", &input));
+    parquet::ReaderProperties props;
+    std::shared_ptr<parquet::ParquetFileReader> file_reader =
+      parquet::ParquetFileReader::Open(input, props);
+    require_default_speed_buckets(parquet_speed_buckets(file_reader));
+    trace.reset(new format_trace());
+    trace->name = "Parquet";
+    trace_queries(parquet_histogram_reader(file_reader), queries, min_seconds, perf, *trace);
+    traces.push_back(std::move(trace));
+  } catch (const std::exception &e) {
+    std::cout << "Parquet: skipped, " << e.what() << "\n";
+  }
+
+  for (const auto &t : traces) {
+    print_trace(*t);
+  }
+  if (!json_path.empty()) {
+    std::ofstream out(json_path);
+    write_json(out, traces);
+    std::cout << "Wrote " << json_path << "\n";
+  }
+  return 0;
+}
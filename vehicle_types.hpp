@@ -0,0 +1,75 @@
+#ifndef VEHICLE_TYPES_HPP
+#define VEHICLE_TYPES_HPP
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "histogram_tile_generated.h"
+
+// a set of vehicle types, one bit per OpenTraffic::VehicleType, so that a
+// query can aggregate any combination of types in a single pass.
+typedef uint32_t vehicle_type_mask;
+
+constexpr vehicle_type_mask all_vehicle_types = ~vehicle_type_mask(0);
+
+inline bool vehicle_type_matches(vehicle_type_mask mask, uint32_t vehicle_type) {
+  return vehicle_type < 32 && ((mask >> vehicle_type) & 1);
+}
+
+inline vehicle_type_mask vehicle_type_bit(OpenTraffic::VehicleType vehicle_type) {
+  return vehicle_type_mask(1) << uint32_t(vehicle_type);
+}
+
+struct vehicle_type_name {
+  const char *name;
+  OpenTraffic::VehicleType type;
+};
+
+const std::vector<vehicle_type_name> vehicle_type_names = {
+  {"auto", OpenTraffic::VehicleType_Auto},
+  {"truck", OpenTraffic::VehicleType_Truck},
+  {"bus", OpenTraffic::VehicleType_Bus},
+};
+
+// parses a comma separated list of types, e.g: "auto,truck". returns false if
+// any of them isn't known.
+inline bool parse_vehicle_types(const std::string &list, std::vector<OpenTraffic::VehicleType> &types) {
+  types.clear();
+  std::istringstream in(list);
+  std::string name;
+  while (std::getline(in, name, ',')) {
+    bool found = false;
+    for (const auto &known : vehicle_type_names) {
+      if (name == known.name) {
+        types.push_back(known.type);
+        found = true;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+  }
+  return !types.empty();
+}
+
+inline vehicle_type_mask vehicle_types_to_mask(const std::vector<OpenTraffic::VehicleType> &types) {
+  vehicle_type_mask mask = 0;
+  for (auto type : types) {
+    mask |= vehicle_type_bit(type);
+  }
+  return mask;
+}
+
+// the mask to test each entry's vehicle_type against for a query on mask. in
+// a tile with only one vehicle type the entries' own types are meaningless,
+// so that's either all of them or none.
+inline vehicle_type_mask entry_mask(const OpenTraffic::Histogram *histogram, vehicle_type_mask mask) {
+  if (histogram->vehicle_types() != nullptr) {
+    return mask;
+  }
+  return (mask & vehicle_type_bit(histogram->vehicle_type())) ? all_vehicle_types : 0;
+}
+
+#endif /* VEHICLE_TYPES_HPP */
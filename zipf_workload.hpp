@@ -0,0 +1,33 @@
+#ifndef ZIPF_WORKLOAD_HPP
+#define ZIPF_WORKLOAD_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// a skewed workload: segment popularity follows a Zipf distribution, with the
+// popular segments scattered randomly through the ID space.
+struct zipf_workload {
+  zipf_workload(uint32_t num_segments, double exponent, uint64_t seed)
+    : eng(seed), ids(num_segments) {
+    std::vector<double> weights(num_segments);
+    for (uint32_t i = 0; i < num_segments; ++i) {
+      ids[i] = i;
+      weights[i] = 1.0 / std::pow(double(i + 1), exponent);
+    }
+    std::shuffle(ids.begin(), ids.end(), eng);
+    dist = std::discrete_distribution<uint32_t>(weights.begin(), weights.end());
+  }
+
+  uint32_t operator()() {
+    return ids[dist(eng)];
+  }
+
+  std::mt19937_64 eng;
+  std::vector<uint32_t> ids;
+  std::discrete_distribution<uint32_t> dist;
+};
+
+#endif /* ZIPF_WORKLOAD_HPP */